@@ -9,6 +9,7 @@
 #include <cstring>
 #include <regex>
 #include <tuple>
+#include <algorithm>
 
 #include "Utils/ints.hpp"
 #include "Utils/str_util.hpp"
@@ -16,6 +17,7 @@
 #include "EMU_FS_types.hpp"
 #include "fs_common.hpp"
 #include "EMU_FS_drv.hpp"
+#include "bank.hpp"
 #include "Utils/FAT_utils.hpp"
 #include "min_vfs/min_vfs_base.hpp"
 
@@ -233,43 +235,6 @@ namespace EMU::FS
 		return 0;
 	}
 
-	static void map_dir_blocks(filesystem_t &fs, std::vector<bool> &map)
-	{
-		const u16 END_OF_FILE_BLKS = fs.header.file_list_blk_addr + map.size();
-
-		u8 d_type;
-		u16 blks[MAX_BLOCKS_PER_DIR];
-
-		for(u32 i = 0; i < fs.header.dir_list_blk_cnt; i++)
-		{
-			fs.stream.seekg(fs.header.dir_list_blk_addr * BLK_SIZE + i * BLK_SIZE + 0x11);
-
-			for(u8 j = 0; j < DIRS_PER_BLOCK; j++)
-			{
-				d_type = fs.stream.get();
-
-				if(!is_valid_dir((Dir_type_e)d_type))
-				{
-					fs.stream.seekg(14 + 0x11, std::ios_base::cur);
-					continue;
-				}
-
-				fs.stream.read((char*)blks, 14);
-				
-				for(u8 k = 0; k < MAX_BLOCKS_PER_DIR; k++)
-				{
-					if constexpr(ENDIANNESS != std::endian::native)
-						blks[k] = std::byteswap(blks[k]);
-
-					if(blks[k] >= fs.header.file_list_blk_addr && blks[k] < END_OF_FILE_BLKS)
-						map[blks[k] - fs.header.file_list_blk_addr] = true;
-				}
-
-				fs.stream.seekg(0x11, std::ios_base::cur);
-			}
-		}
-	}
-
 	u16 load_file(std::fstream &disk, File_t &file)
 	{
 		file.addr = disk.tellg();
@@ -323,116 +288,307 @@ namespace EMU::FS
 		else return 0;
 	}
 
-	template<bool check_name>
-	u16 load_dir_from_name(filesystem_t &mount, const char *dirname, std::vector<Dir_t> &dst)
+	/*-----------------------------In-memory index-----------------------------*/
+	constexpr u16 NO_OWNER = 0xFFFF;
+
+	//On-disk names are 16 chars, not necessarily null-terminated
+	static std::string name_key(const char *name)
 	{
-		u8 temp[BLK_SIZE];
-		u16 offset;
-		uintmax_t block_abs_addr;
+		return std::string(name, std::find(name, name + 16, 0));
+	}
 
-		Dir_t dir;
+	static u16 dir_slot(const filesystem_t &mount, const Dir_t &dir)
+	{
+		return (dir.addr - mount.header.dir_list_blk_addr * BLK_SIZE)
+			/ On_disk_sizes::DIR_ENTRY;
+	}
+
+	static bool in_file_list(const filesystem_t &mount, const u16 block)
+	{
+		return block >= mount.header.file_list_blk_addr && block
+			< mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt;
+	}
 
-		block_abs_addr = mount.header.dir_list_blk_addr * BLK_SIZE;
-		for(u32 block = 0; block < mount.header.dir_list_blk_cnt; block++, block_abs_addr += BLK_SIZE)
+	//First file with a given bank number wins, same as scanning the blocks
+	static void index_banks(dir_idx_t &idx)
+	{
+		idx.banks.clear();
+
+		for(u8 i = 0; i < idx.files.size(); i++)
+			if(is_valid_file(idx.files[i].type))
+				idx.banks.try_emplace(idx.files[i].bank_num, i);
+	}
+
+	//Parses one of a dir's file list blocks into its slots. No data means
+	//the block isn't in the file list, so all of its slots are empty.
+	static void index_dir_block(filesystem_t &mount, const u16 slot,
+								const u8 blk_idx, const u8 *data)
+	{
+		dir_idx_t &idx = mount.dirs[slot];
+		const u16 block = idx.dir.blocks[blk_idx];
+
+		for(u8 i = 0; i < FILES_PER_BLOCK; i++)
 		{
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+			File_t &file = idx.files[blk_idx * FILES_PER_BLOCK + i];
 
-			offset = 0;
-			for(u8 i = 0; i < DIRS_PER_BLOCK; i++, offset += On_disk_sizes::DIR_ENTRY)
+			if(!data)
 			{
-				if(!is_valid_dir((Dir_type_e)temp[offset + 0x11])) continue;
+				file.type = File_type_e::DEL;
+				continue;
+			}
 
-				if constexpr(check_name)
-				{
-					std::replace(temp + offset, temp + offset + 16, '/', '\\');
+			file.addr = block * BLK_SIZE + i * On_disk_sizes::FILE_ENTRY;
+			load_file<true>(data + i * On_disk_sizes::FILE_ENTRY, file);
+		}
 
-					if(std::strncmp((char*)(temp + offset), dirname, 16))
-						continue;
+		if(data && mount.file_list_blk_owner[block
+			- mount.header.file_list_blk_addr] == NO_OWNER)
+			mount.file_list_blk_owner[block - mount.header.file_list_blk_addr]
+				= slot;
+	}
+
+	/*Mirrors a dir entry write into the index. Doesn't touch the dir's file
+	 *slots, that's up to the callers.*/
+	static void index_dir(filesystem_t &mount, const Dir_t &dir)
+	{
+		const u16 slot = dir_slot(mount, dir);
+
+		Dir_t &old = mount.dirs[slot].dir;
+
+		if(is_valid_dir(old.type))
+		{
+			const auto it = mount.dir_names.find(name_key(old.name));
+
+			//a later dir with the same name (fsck material) takes over
+			if(it != mount.dir_names.end() && it->second == slot)
+			{
+				mount.dir_names.erase(it);
+
+				for(u16 i = slot + 1; i < mount.dirs.size(); i++)
+				{
+					if(is_valid_dir(mount.dirs[i].dir.type) && name_key(
+						mount.dirs[i].dir.name) == name_key(old.name))
+					{
+						mount.dir_names.emplace(name_key(old.name), i);
+						break;
+					}
 				}
+			}
+		}
+
+		old = dir;
+
+		if(is_valid_dir(dir.type))
+		{
+			const auto res = mount.dir_names.try_emplace(name_key(dir.name),
+														 slot);
+
+			if(!res.second && res.first->second > slot)
+				res.first->second = slot;
+		}
+	}
+
+	//Mirrors a file entry write into the index
+	static void index_file(filesystem_t &mount, const File_t &file)
+	{
+		const u16 block = file.addr / BLK_SIZE;
+
+		mount.banks.erase(file.addr);
+
+		if(!in_file_list(mount, block)) return;
+
+		const u16 owner = mount.file_list_blk_owner[block
+			- mount.header.file_list_blk_addr];
+
+		if(owner == NO_OWNER) return;
+
+		dir_idx_t &idx = mount.dirs[owner];
+
+		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
+		{
+			if(idx.dir.blocks[i] != block) continue;
+
+			File_t &entry = idx.files[i * FILES_PER_BLOCK + file.addr
+				% BLK_SIZE / On_disk_sizes::FILE_ENTRY];
+			const bool banks_changed = is_valid_file(entry.type)
+				!= is_valid_file(file.type) || entry.bank_num != file.bank_num;
+
+			entry = file;
+			if(banks_changed) index_banks(idx);
+
+			return;
+		}
+	}
+
+	static u16 write_file(filesystem_t &mount, const File_t &file)
+	{
+		const u16 err = write_file(mount.stream, file);
+
+		index_file(mount, file);
+
+		return err;
+	}
+
+	static void delete_file_entry(filesystem_t &mount, File_t file)
+	{
+		mount.stream.seekp(file.addr + 0x1A);
+		mount.stream.put((u8)File_type_e::DEL);
+
+		file.type = File_type_e::DEL;
+		index_file(mount, file);
+	}
+
+	/*Reads the dir list and the file list in one go each and parses both
+	 *into the index*/
+	static u16 build_index(filesystem_t &fs)
+	{
+		const u32 DIR_CNT = fs.header.dir_list_blk_cnt * DIRS_PER_BLOCK;
+
+		std::unique_ptr<u8[]> dir_list, file_list;
+
+		//Both lists have to be on the disk, and slots must fit in a u16
+		if((uintmax_t)fs.header.dir_list_blk_addr + fs.header.dir_list_blk_cnt
+			> fs.header.block_cnt || (uintmax_t)fs.header.file_list_blk_addr
+			+ fs.header.file_list_blk_cnt > fs.header.block_cnt
+			|| DIR_CNT >= NO_OWNER)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::INVALID_STATE);
+
+		dir_list = std::make_unique<u8[]>(fs.header.dir_list_blk_cnt
+			* BLK_SIZE);
+		fs.stream.seekg(fs.header.dir_list_blk_addr * BLK_SIZE);
+		fs.stream.read((char*)dir_list.get(), fs.header.dir_list_blk_cnt
+			* BLK_SIZE);
+
+		file_list = std::make_unique<u8[]>(fs.header.file_list_blk_cnt
+			* BLK_SIZE);
+		fs.stream.seekg(fs.header.file_list_blk_addr * BLK_SIZE);
+		fs.stream.read((char*)file_list.get(), fs.header.file_list_blk_cnt
+			* BLK_SIZE);
+
+		if(fs.stream.fail())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		fs.dirs.assign(DIR_CNT, dir_idx_t());
+		fs.dir_names.clear();
+		fs.banks.clear();
+		fs.file_list_blk_owner.assign(fs.header.file_list_blk_cnt, NO_OWNER);
+
+		for(u16 i = 0; i < DIR_CNT; i++)
+		{
+			dir_idx_t &idx = fs.dirs[i];
+
+			idx.dir.addr = fs.header.dir_list_blk_addr * BLK_SIZE + i
+				* On_disk_sizes::DIR_ENTRY;
+			load_dir<true>(dir_list.get() + i * On_disk_sizes::DIR_ENTRY,
+						   idx.dir);
+
+			if(!is_valid_dir(idx.dir.type)) continue;
+
+			fs.dir_names.try_emplace(name_key(idx.dir.name), i);
+			idx.files.resize(MAX_FILES_PER_DIR);
+
+			for(u8 j = 0; j < MAX_BLOCKS_PER_DIR; j++)
+			{
+				const u16 block = idx.dir.blocks[j];
+
+				index_dir_block(fs, i, j, in_file_list(fs, block) ?
+					file_list.get() + (block - fs.header.file_list_blk_addr)
+						* BLK_SIZE : nullptr);
+			}
+
+			index_banks(idx);
+		}
 
-				dir.addr = block_abs_addr + offset;
-				load_dir<true>(temp + offset, dir);
+		return 0;
+	}
 
-				dst.push_back(dir);
-				if constexpr(check_name) return 0;
+	static void map_dir_blocks(filesystem_t &fs, bit_util::bitset_t &map)
+	{
+		for(const dir_idx_t &idx: fs.dirs)
+		{
+			if(!is_valid_dir(idx.dir.type)) continue;
+
+			for(const u16 block: idx.dir.blocks)
+			{
+				if(block >= fs.header.file_list_blk_addr && block
+					< fs.header.file_list_blk_addr + map.size())
+					map.set(block - fs.header.file_list_blk_addr);
 			}
 		}
+	}
 
+	template<bool check_name>
+	u16 load_dir_from_name(filesystem_t &mount, const char *dirname, std::vector<Dir_t> &dst)
+	{
 		if constexpr(check_name)
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
-		else return 0;
+		{
+			const auto it = mount.dir_names.find(name_key(dirname));
+
+			if(it == mount.dir_names.end())
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
+
+			dst.push_back(mount.dirs[it->second].dir);
+		}
+		else
+		{
+			for(const dir_idx_t &idx: mount.dirs)
+				if(is_valid_dir(idx.dir.type)) dst.push_back(idx.dir);
+		}
+
+		return 0;
 	}
 
 	template<const comp_e COMP>
 	u16 load_file_in_dir(filesystem_t &mount, const Dir_t &dir,
 						 const comp_to_t comp_to, std::vector<File_t> &dst)
 	{
-		u8 temp[BLK_SIZE];
-		u16 offset;
-		uintmax_t block_abs_addr;
-		
-		File_t file;
+		const dir_idx_t &idx = mount.dirs[dir_slot(mount, dir)];
 
-		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
+		if constexpr(COMP == comp_e::BANK)
 		{
-			if(dir.blocks[i] < mount.header.file_list_blk_addr ||
-				dir.blocks[i] >= mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt)
-				continue;
+			const auto it = idx.banks.find(comp_to.bank_num);
 
-			block_abs_addr = dir.blocks[i] * BLK_SIZE;
+			if(it == idx.banks.end())
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
 
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
-
-			offset = 0;
-			for(u8 i = 0; i < FILES_PER_BLOCK; i++, offset += On_disk_sizes::FILE_ENTRY)
+			dst.push_back(idx.files[it->second]);
+			return 0;
+		}
+		else
+		{
+			for(const File_t &file: idx.files)
 			{
-				if(!is_valid_file((File_type_e)temp[offset + 0x1A])) continue;
+				if(!is_valid_file(file.type)) continue;
 
 				if constexpr(COMP == comp_e::NAME)
 				{
-					std::replace(temp + offset, temp + offset + 16, '/', '\\');
-
-					if(std::strncmp((char*)(temp + offset), comp_to.name, 16))
+					if(std::strncmp(file.name, comp_to.name, 16))
 						continue;
 				}
-				else if constexpr(COMP == comp_e::BANK)
-				{
-					if(temp[offset + 0x11] != comp_to.bank_num) continue;
-				}
-
-				file.addr = block_abs_addr + offset;
-				load_file<true>(temp + offset, file);
 
 				dst.push_back(file);
 				if constexpr(COMP != comp_e::NONE) return 0;
 			}
-		}
 
-		if constexpr(COMP == comp_e::NONE) return 0;
-		else
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
+			if constexpr(COMP == comp_e::NONE) return 0;
+			else
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
+		}
 	}
 
 	static u16 update_next_file_list_block(filesystem_t &mount, const u16 used)
 	{
 		if(used >= mount.next_file_list_blk)
 		{
-			u16 i, final_block_addr;
+			u16 final_block_addr;
 
-			for(i = used - mount.header.file_list_blk_addr; i < mount.header.file_list_blk_cnt; i++)
-			{
-				if(!mount.dir_content_block_map[i])
-				{
-					mount.next_file_list_blk = i + mount.header.file_list_blk_addr;
-					break;
-				}
-			}
+			const uintmax_t i = mount.dir_content_block_map.find_first_unset(used - mount.header.file_list_blk_addr);
 
-			if(i >= mount.header.file_list_blk_cnt && mount.next_file_list_blk != i + mount.header.file_list_blk_addr)
+			if(i < mount.dir_content_block_map.size())
+				mount.next_file_list_blk = i + mount.header.file_list_blk_addr;
+			else
 				mount.next_file_list_blk = mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt;
 
 			final_block_addr = mount.next_file_list_blk;
@@ -453,26 +609,40 @@ namespace EMU::FS
 	{
 		const u16 END_OF_FILE_LIST = mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt;
 
+		u8 data[BLK_SIZE];
 		u16 err;
 
 		for(u16 &block_addr: dir.blocks)
 		{
 			if(block_addr < mount.header.file_list_blk_addr || block_addr >= END_OF_FILE_LIST)
 			{
-				for(u16 i = 0; i < mount.header.file_list_blk_cnt; i++)
+				const uintmax_t i = mount.dir_content_block_map.find_first_unset();
+
+				if(i < mount.dir_content_block_map.size())
 				{
-					if(!mount.dir_content_block_map[i])
-					{
-						//Consider 0ing out the new sector
-						block_addr = i + mount.header.file_list_blk_addr;
-						err = write_dir(mount.stream, dir);
-						if(err) return err;
+					//Consider 0ing out the new sector
+					block_addr = i + mount.header.file_list_blk_addr;
+					err = write_dir(mount.stream, dir);
+					if(err) return err;
 
-						mount.dir_content_block_map[i] = true;
-						new_block = block_addr;
+					mount.dir_content_block_map.set(i);
+					new_block = block_addr;
 
-						return update_next_file_list_block(mount, block_addr);
-					}
+					/*Whatever's left in the block shows up as part of
+					 *the dir, so the index needs to see it too*/
+					mount.stream.seekg(block_addr * BLK_SIZE);
+					mount.stream.read((char*)data, BLK_SIZE);
+					if(mount.stream.fail())
+						return ret_val_setup(min_vfs::LIBRARY_ID,
+											 (u8)min_vfs::ERR::IO_ERROR);
+
+					mount.file_list_blk_owner[i] = NO_OWNER;
+					index_dir(mount, dir);
+					index_dir_block(mount, dir_slot(mount, dir),
+									&block_addr - dir.blocks, data);
+					index_banks(mount.dirs[dir_slot(mount, dir)]);
+
+					return update_next_file_list_block(mount, block_addr);
 				}
 
 				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NO_SPACE_LEFT);
@@ -487,43 +657,27 @@ namespace EMU::FS
 	static u16 find_file_or_free(filesystem_t &mount, const Dir_t &dir, const u8 bank_num, File_t &dst)
 	{
 		bool found_free;
-		u8 temp[BLK_SIZE];
-		u16 offset;
-		uintmax_t block_abs_addr, free_abs_addr;
+		uintmax_t free_abs_addr;
+
+		const dir_idx_t &idx = mount.dirs[dir_slot(mount, dir)];
+		const auto it = idx.banks.find(bank_num);
+
+		if(it != idx.banks.end())
+		{
+			dst = idx.files[it->second];
+			return 0;
+		}
 
 		found_free = false;
-		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
+		for(u8 i = 0; i < idx.files.size(); i++)
 		{
-			if(dir.blocks[i] < mount.header.file_list_blk_addr ||
-				dir.blocks[i] >= mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt)
+			if(!in_file_list(mount, dir.blocks[i / FILES_PER_BLOCK])
+				|| is_valid_file(idx.files[i].type))
 				continue;
 
-			block_abs_addr = dir.blocks[i] * BLK_SIZE;
-
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
-
-			offset = 0;
-			for(u8 i = 0; i < FILES_PER_BLOCK; i++, offset += On_disk_sizes::FILE_ENTRY)
-			{
-				if(!is_valid_file((EMU::FS::File_type_e)temp[offset + 0x1A]))
-				{
-					if(!found_free)
-					{
-						free_abs_addr = block_abs_addr + offset;
-						found_free = true;
-					}
-
-					continue;
-				}
-
-				if(temp[offset + 0x11] != bank_num) continue;
-
-				dst.addr = block_abs_addr + offset;
-				load_file<true>(temp + offset, dst);
-				return 0;
-			}
+			free_abs_addr = idx.files[i].addr;
+			found_free = true;
+			break;
 		}
 
 		dst.start_cluster = FAT_ATTRS.END_OF_CHAIN;
@@ -544,51 +698,37 @@ namespace EMU::FS
 								 const char *fname, File_t &dst)
 	{
 		bool found_free, bank_nums[255];
-		u8 temp[BLK_SIZE], i;
-		u16 offset;
-		uintmax_t block_abs_addr, free_abs_addr;
+		u8 i;
+		uintmax_t free_abs_addr;
+
+		const dir_idx_t &idx = mount.dirs[dir_slot(mount, dir)];
 
 		std::memset(bank_nums, 0, sizeof(bank_nums));
 		found_free = false;
-		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
+		for(u8 i = 0; i < idx.files.size(); i++)
 		{
-			if(dir.blocks[i] < mount.header.file_list_blk_addr ||
-				dir.blocks[i] >= mount.header.file_list_blk_addr
-					+ mount.header.file_list_blk_cnt)
-				continue;
-
-			block_abs_addr = dir.blocks[i] * BLK_SIZE;
+			const File_t &file = idx.files[i];
 
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID,
-				(u8)min_vfs::ERR::IO_ERROR);
+			if(!in_file_list(mount, dir.blocks[i / FILES_PER_BLOCK]))
+				continue;
 
-			offset = 0;
-			for(u8 i = 0; i < FILES_PER_BLOCK; i++, offset += On_disk_sizes::FILE_ENTRY)
+			if(!is_valid_file(file.type))
 			{
-				if(!is_valid_file((EMU::FS::File_type_e)temp[offset + 0x1A]))
+				if(!found_free)
 				{
-					if(!found_free)
-					{
-						free_abs_addr = block_abs_addr + offset;
-						found_free = true;
-					}
-
-					continue;
+					free_abs_addr = file.addr;
+					found_free = true;
 				}
 
-				bank_nums[temp[offset + 0x11]] = true;
+				continue;
+			}
 
-				std::replace(temp + offset, temp + offset + 16, '/', '\\');
+			bank_nums[file.bank_num] = true;
 
-				if(std::strncmp((char*)(temp + offset), fname, 16))
-					continue;
+			if(std::strncmp(file.name, fname, 16)) continue;
 
-				dst.addr = block_abs_addr + offset;
-				load_file<true>(temp + offset, dst);
-				return 0;
-			}
+			dst = file;
+			return 0;
 		}
 
 		for(i = 0; i < 0x80; i++)
@@ -634,6 +774,12 @@ namespace EMU::FS
 		return {cls_cnt, block_cnt, byte_cnt};
 	}
 
+	/*contig: keep the new clusters in one run if at all possible
+	 *deferred: for the data path. Only the FAT cache and the index get
+	 *touched; filesystem_t::write commits the FAT and takes the new clusters
+	 *off the free count, the entry gets written by sync_file_entry.
+	 *Either way, the FAT always hits the disk before the entry does.*/
+	template <const bool contig = false, const bool deferred = false>
 	static u16 resize_file(filesystem_t &mount, File_t &file, const uintmax_t new_size)
 	{
 		const std::tuple<u16, u16, u16> counts = file_size_to_counts(calc_cluster_size(mount.header.cluster_shift), new_size);
@@ -646,13 +792,16 @@ namespace EMU::FS
 
 		if(grow)
 		{
-			err = FAT_utils::follow_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, file.start_cluster, chain);
+			err = FAT_t::follow_chain(mount.FAT.get(), mount.FAT_attrs.LENGTH, file.start_cluster, chain);
 			if(err && err != ret_val_setup(FAT_utils::LIBRARY_ID, (u8)FAT_utils::ERR::BAD_START))
 				return err;
 
 			old_cls_cnt = chain.size();
 
-			err = FAT_utils::find_free_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, std::get<0>(counts), chain);
+			if constexpr(contig)
+				err = FAT_t::find_contig_free_chain(mount.FAT.get(), mount.FAT_attrs.LENGTH, std::get<0>(counts), chain);
+			else
+				err = FAT_t::find_free_chain(mount.FAT.get(), mount.FAT_attrs.LENGTH, std::get<0>(counts), chain);
 			if(err)
 			{
 				if(err == ret_val_setup(FAT_utils::LIBRARY_ID, (u8)FAT_utils::ERR::NO_FREE_CLUSTERS))
@@ -665,15 +814,15 @@ namespace EMU::FS
 		}
 		else if(shrink)
 		{
-			err = FAT_utils::follow_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, file.start_cluster, chain);
+			err = FAT_t::follow_chain(mount.FAT.get(), mount.FAT_attrs.LENGTH, file.start_cluster, chain);
 			if(err) return err;
 
 			old_cls_cnt = chain.size();
 
-			err = FAT_utils::shrink_chain(mount.stream, FAT_ATTRS, mount.FAT_attrs, chain, std::get<0>(counts));
+			err = FAT_utils::shrink_chain(mount.FAT, FAT_ATTRS, chain, std::get<0>(counts));
 			if(err) return err;
 
-			err = FAT_utils::shrink_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, chain, std::get<0>(counts));
+			err = mount.FAT.commit(mount.stream, FAT_ATTRS);
 			if(err) return err;
 
 			file.start_cluster = chain.size() ? chain[0] : FAT_ATTRS.END_OF_CHAIN;
@@ -684,20 +833,45 @@ namespace EMU::FS
 		file.block_cnt = std::get<1>(counts);
 		file.byte_cnt = std::get<2>(counts);
 
-		err = write_file(mount.stream, file);
-		if(err) return err;
-
 		if(grow)
 		{
-			err = FAT_utils::write_chain(mount.stream, FAT_ATTRS, mount.FAT_attrs, chain);
+			err = FAT_utils::write_chain(mount.FAT, FAT_ATTRS, chain);
 			if(err) return err;
 
-			err = FAT_utils::write_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, chain);
+			if constexpr(deferred) return 0;
+
+			err = mount.FAT.commit(mount.stream, FAT_ATTRS);
 			if(err) return err;
 
 			mount.free_clusters -= std::get<0>(counts) - old_cls_cnt;
 		}
 
+		return write_file(mount, file);
+	}
+
+	/*Writes an open file's entry out if the data path left it dirty. The
+	 *FAT goes first: if we crash in between, the chain on disk is just
+	 *longer than the entry says and fsck fixes the entry up to match. The
+	 *other way around, the entry could claim clusters that are still free.
+	 *The index is already up to date.*/
+	static u16 sync_file_entry(filesystem_t &mount, internal_file_t &file)
+	{
+		u16 err;
+
+		if(!file.entry_dirty) return 0;
+
+		err = mount.FAT.commit(mount.stream, FAT_ATTRS);
+		if(err) return err;
+
+		err = write_file(mount.stream, file.file_entry);
+		if(err) return err;
+
+		if(!mount.stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		file.entry_dirty = false;
+
 		return 0;
 	}
 
@@ -708,20 +882,19 @@ namespace EMU::FS
 
 		if(file.cluster_cnt)
 		{
-			err = FAT_utils::follow_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, file.start_cluster, chain);
+			err = FAT_t::follow_chain(mount.FAT.get(), mount.FAT_attrs.LENGTH, file.start_cluster, chain);
 			if(err) return err;
 
-			err = FAT_utils::free_chain(mount.stream, FAT_ATTRS, mount.FAT_attrs, chain);
+			err = FAT_utils::free_chain(mount.FAT, FAT_ATTRS, chain);
 			if(err) return err;
 
-			err = FAT_utils::free_chain(mount.FAT.get(), FAT_ATTRS, mount.FAT_attrs.LENGTH, chain);
+			err = mount.FAT.commit(mount.stream, FAT_ATTRS);
 			if(err) return err;
 		}
 
 		mount.free_clusters += chain.size();
 
-		mount.stream.seekp(file.addr + 0x1A);
-		mount.stream.put(0);
+		delete_file_entry(mount, file);
 		return 0;
 	}
 
@@ -729,14 +902,13 @@ namespace EMU::FS
 	static u16 remove_dir(filesystem_t &mount, const Dir_t &dir)
 	{
 		const u16 END_OF_FILE_LIST = mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt;
+		const u16 slot = dir_slot(mount, dir);
 
 		bool del_failed;
-		u8 temp[BLK_SIZE];
-		u16 offset, err;
-		uintmax_t block_abs_addr;
+		u16 err;
 
 		filesystem_t::file_map_iterator_t fmap_it;
-		File_t file;
+		Dir_t deleted;
 
 		if constexpr(recurse)
 		{
@@ -744,41 +916,26 @@ namespace EMU::FS
 			err = 0;
 		}
 
-		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
+		for(u8 i = 0; i < mount.dirs[slot].files.size(); i++)
 		{
-			if(dir.blocks[i] < mount.header.file_list_blk_addr ||
-				dir.blocks[i] >= mount.header.file_list_blk_addr + mount.header.file_list_blk_cnt)
-				continue;
-
-			block_abs_addr = dir.blocks[i] * BLK_SIZE;
+			//copy, remove_file updates the slot
+			File_t file = mount.dirs[slot].files[i];
 
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+			if(!is_valid_file(file.type)) continue;
 
-			offset = 0;
-			for(u8 i = 0; i < FILES_PER_BLOCK; i++, offset += On_disk_sizes::FILE_ENTRY)
+			if constexpr(recurse)
 			{
-				if(!is_valid_file((File_type_e)temp[offset + 0x1A]))
-					continue;
+				fmap_it = mount.open_files.find(std::string(dir.name) + "/" + std::to_string(file.bank_num));
 
-				if constexpr(recurse)
+				if(fmap_it != mount.open_files.end())
 				{
-					fmap_it = mount.open_files.find(std::string(dir.name) + "/" + std::to_string(temp[offset + 0x11]));
-
-					if(fmap_it != mount.open_files.end())
-					{
-						del_failed = true;
-						continue;
-					}
-
-					file.addr = block_abs_addr + offset;
-					load_file<true>(temp + offset, file);
-
-					err |= remove_file(mount, file);
+					del_failed = true;
+					continue;
 				}
-				else return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_EMPTY);
+
+				err |= remove_file(mount, file);
 			}
+			else return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_EMPTY);
 		}
 
 		if constexpr(recurse)
@@ -792,12 +949,24 @@ namespace EMU::FS
 		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
 		{
 			if(dir.blocks[i] >= mount.header.file_list_blk_addr && dir.blocks[i] < END_OF_FILE_LIST)
-				mount.dir_content_block_map[dir.blocks[i] - mount.header.file_list_blk_addr] = false;
+			{
+				const u16 blk = dir.blocks[i] - mount.header.file_list_blk_addr;
+
+				mount.dir_content_block_map.reset(blk);
+				if(mount.file_list_blk_owner[blk] == slot)
+					mount.file_list_blk_owner[blk] = NO_OWNER;
+			}
 		}
 
 		mount.stream.seekp(dir.addr + 0x11);
 		mount.stream.put((char)Dir_type_e::DEL);
 
+		deleted = mount.dirs[slot].dir;
+		deleted.type = Dir_type_e::DEL;
+		index_dir(mount, deleted);
+		mount.dirs[slot].files.clear();
+		mount.dirs[slot].banks.clear();
+
 		if(!mount.stream.is_open() || !mount.stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
@@ -806,56 +975,30 @@ namespace EMU::FS
 
 	static u16 rename_dir(filesystem_t &mount, const char *src_name, const char *dst_name)
 	{
-		/*Run a single pass trying to find and load old dir by name and trying
-		to find if dir with dst_name exists. If nonexistant, load cur dir and
-		rename.*/
+		u8 temp[On_disk_sizes::DIR_ENTRY];
 
-		bool found_src, found_dst;
-		u8 temp[BLK_SIZE];
-		u16 offset;
-		uintmax_t block_abs_addr;
+		Dir_t dir;
 
-		Dir_t dir, dst_dir;
+		const auto src_it = mount.dir_names.find(name_key(src_name));
 
-		found_src = false;
-		found_dst = false;
-		block_abs_addr = mount.header.dir_list_blk_addr * BLK_SIZE;
-		for(u32 block = 0; block < mount.header.dir_list_blk_cnt; block++, block_abs_addr += BLK_SIZE)
-		{
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
-
-			offset = 0;
-			for(u8 i = 0; i < DIRS_PER_BLOCK; i++, offset += On_disk_sizes::DIR_ENTRY)
-			{
-				if(!is_valid_dir((Dir_type_e)temp[offset + 0x11]))
-					continue;
+		if(src_it == mount.dir_names.end())
+			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
 
-				if(!found_src && !std::strncmp((char*)(temp + offset), src_name, 16))
-				{
-					dir.addr = block_abs_addr + offset;
-					load_dir<true>(temp + offset, dir);
-					found_src = true;
-				}
-				else if(!std::strncmp((char*)(temp + offset), dst_name, 16))
-				{
-					dst_dir.addr = block_abs_addr + offset;
-					load_dir<true>(temp + offset, dst_dir);
-					
-					if(remove_dir<false>(mount, dst_dir))
-						return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::ALREADY_EXISTS);
+		const u16 src_slot = src_it->second;
+		const std::string dst_key = name_key(dst_name);
 
-					found_dst = true;
-				}
-			}
+		//Anything already using the new name has to go, as long as it's empty
+		for(u16 i = 0; i < mount.dirs.size(); i++)
+		{
+			if(i == src_slot || !is_valid_dir(mount.dirs[i].dir.type)
+				|| name_key(mount.dirs[i].dir.name) != dst_key)
+				continue;
 
-			if(found_src && found_dst) break;
+			if(remove_dir<false>(mount, mount.dirs[i].dir))
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::ALREADY_EXISTS);
 		}
 
-		if(!found_src)
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
-
+		dir = mount.dirs[src_slot].dir;
 		prepare_dir_name(dst_name, dir.name);
 		write_dir(temp, dir);
 		mount.stream.seekp(dir.addr);
@@ -864,6 +1007,8 @@ namespace EMU::FS
 		if(!mount.stream.is_open() || !mount.stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
+		index_dir(mount, dir);
+
 		return 0;
 	}
 
@@ -912,83 +1057,55 @@ namespace EMU::FS
 		dst_file.type = src_file.type;
 		std::memcpy(dst_file.props, src_file.props, sizeof(File_t::props));
 
-		err = write_file(mount.stream, dst_file);
+		err = write_file(mount, dst_file);
 		if(err) return err;
 
-		mount.stream.seekp(src_file.addr + 0x1A);
-		mount.stream.put((u8)File_type_e::DEL);
+		delete_file_entry(mount, src_file);
 
 		return 0;
 	}
 
-	//Controls only src comp. Dst always by block num.
+	//Controls only src comp. Dst always by bank num.
 	template <const comp_e COMP>
 	static u16 load_src_and_dst(filesystem_t &mount, const Dir_t &dir,
 								File_t &src_file, File_t &dst_file)
 	{
 		bool found_src, found_dst;
-		u8 temp[BLK_SIZE];
-		u16 offset, err;
-		uintmax_t block_abs_addr;
+		u16 err;
 
-		filesystem_t::file_map_iterator_t fmap_it;
+		const dir_idx_t &idx = mount.dirs[dir_slot(mount, dir)];
 
 		found_src = false;
-		found_dst = false;
-		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++)
-		{
-			if(dir.blocks[i] < mount.header.file_list_blk_addr ||
-				dir.blocks[i] >= mount.header.file_list_blk_addr
-					+ mount.header.file_list_blk_cnt)
-				continue;
-
-			block_abs_addr = dir.blocks[i] * BLK_SIZE;
 
-			mount.stream.seekg(block_abs_addr);
-			mount.stream.read((char*)temp, BLK_SIZE);
-			if(mount.stream.fail()) return ret_val_setup(min_vfs::LIBRARY_ID,
-				(u8)min_vfs::ERR::IO_ERROR);
-
-			offset = 0;
-			for(u8 i = 0; i < FILES_PER_BLOCK; i++, offset
-				+= On_disk_sizes::FILE_ENTRY)
+		if constexpr(COMP == comp_e::NAME)
+		{
+			for(const File_t &file: idx.files)
 			{
-				if(!is_valid_file((File_type_e)temp[offset + 0x1A]))
-					continue;
-
-				if constexpr(COMP == comp_e::NAME)
-				{
-					std::replace(temp + offset, temp + offset + 16, '/', '\\');
-
-					if(!found_src && !std::strncmp((char*)(temp + offset),
-						src_file.name, 16))
-					{
-						src_file.addr = block_abs_addr + offset;
-						load_file<true>(temp + offset, src_file);
-						found_src = true;
-					}
-				}
-				else if constexpr(COMP == comp_e::BANK)
-				{
-					if(!found_dst && temp[offset + 0x11] == src_file.bank_num)
-					{
-						src_file.addr = block_abs_addr + offset;
-						load_file<true>(temp + offset, src_file);
-						found_src = true;
-					}
-				}
-
-				if(!found_dst && temp[offset + 0x11] == dst_file.bank_num)
+				if(is_valid_file(file.type)
+					&& !std::strncmp(file.name, src_file.name, 16))
 				{
-					dst_file.addr = block_abs_addr + offset;
-					load_file<true>(temp + offset, dst_file);
-					found_dst = true;
+					src_file = file;
+					found_src = true;
+					break;
 				}
 			}
+		}
+		else if constexpr(COMP == comp_e::BANK)
+		{
+			const auto it = idx.banks.find(src_file.bank_num);
 
-			if(found_src && found_dst) break;
+			if(it != idx.banks.end())
+			{
+				src_file = idx.files[it->second];
+				found_src = true;
+			}
 		}
 
+		const auto dst_it = idx.banks.find(dst_file.bank_num);
+
+		found_dst = dst_it != idx.banks.end();
+		if(found_dst) dst_file = idx.files[dst_it->second];
+
 		err = 0;
 
 		if(!found_src)
@@ -1119,7 +1236,7 @@ namespace EMU::FS
 		if(dst_fname_cln.size() && dst_fname_cln[0])
 			std::memcpy(files[0].name, dst_fname_cln.data(), 16);
 
-		write_file(mount.stream, files[0]);
+		write_file(mount, files[0]);
 
 		return 0;
 	}
@@ -1169,13 +1286,16 @@ namespace EMU::FS
 	}
 
 	static uint16_t get_or_alloc_next_cls(filesystem_t &mount,
-										  const u16 cur_cls, File_t &file)
+										  const u16 cur_cls,
+										  internal_file_t &internal_file)
 	{
 		u16 next_cls, err;
 
-		err = FAT_utils::get_next_or_free_cluster(mount.FAT.get(), FAT_ATTRS,
-												  mount.FAT_attrs.LENGTH,
-											cur_cls, next_cls);
+		File_t &file = internal_file.file_entry;
+
+		err = FAT_t::get_next_or_free_cluster(mount.FAT.get(),
+											  mount.FAT_attrs.LENGTH, cur_cls,
+											  next_cls);
 		if(err)
 		{
 			if(err == ret_val_setup(FAT_utils::LIBRARY_ID, (u8)FAT_utils::ERR::ALLOC))
@@ -1188,20 +1308,16 @@ namespace EMU::FS
 					file.cluster_cnt++;
 					file.block_cnt = 0;
 					file.byte_cnt = 0;
+					internal_file.entry_dirty = true;
 
-					write_file(mount.stream, file);
-					if(!mount.stream.good())
-						throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::IO_ERROR));
-
-					err = FAT_utils::extend_chain(mount.FAT.get(), mount.stream,
-												  FAT_ATTRS, mount.FAT_attrs,
+					//Committed by filesystem_t::write once the whole write
+					//is done, so we don't hit the FAT for every cluster. Same
+					//goes for the free count.
+					err = FAT_utils::extend_chain(mount.FAT, FAT_ATTRS,
 												  cur_cls, next_cls);
 					if(err)
 						return ret_val_setup(min_vfs::LIBRARY_ID,
 											 (u8)min_vfs::ERR::IO_ERROR);
-
-					mount.free_clusters--;
 				}
 			}
 			else throw min_vfs::FS_err(err);
@@ -1218,9 +1334,8 @@ namespace EMU::FS
 	{
 		u16 err;
 
-		err = FAT_utils::get_nth_cluster(fs.FAT.get(), FAT_ATTRS,
-										 fs.FAT_attrs.LENGTH, cls,
-										 start_cls_idx);
+		err = FAT_t::get_nth_cluster(fs.FAT.get(), fs.FAT_attrs.LENGTH, cls,
+									 start_cls_idx);
 
 		if(err)
 		{
@@ -1237,13 +1352,16 @@ namespace EMU::FS
 				return err;
 			else
 			{
-				err = resize_file(fs, internal_file.file_entry, pos + 1);
+				err = resize_file<false, true>(fs, internal_file.file_entry,
+											   pos + 1);
 				if(err) return err;
 
+				internal_file.entry_dirty = true;
+
 				cls = internal_file.file_entry.start_cluster;
-				err = FAT_utils::get_nth_cluster(fs.FAT.get(), FAT_ATTRS,
-												 fs.FAT_attrs.LENGTH, cls,
-												 start_cls_idx);
+				err = FAT_t::get_nth_cluster(fs.FAT.get(),
+											 fs.FAT_attrs.LENGTH, cls,
+											 start_cls_idx);
 				if(err) return err;
 			}
 		}
@@ -1251,7 +1369,29 @@ namespace EMU::FS
 		return 0;
 	}
 
-	template <const bool write>
+	/*One seek and one read or write for a run of contiguous clusters. lock
+	 *is false for callers that already hold mtx.*/
+	template <const bool write, const bool lock = true>
+	static uint16_t transfer_run(filesystem_t &mount, const uintmax_t addr,
+								 const uintmax_t len, char *buf)
+	{
+		if(!len) return 0;
+
+		if constexpr(lock) mount.mtx.lock();
+		mount.stream.seekg(addr);
+
+		if constexpr(write) mount.stream.write(buf, len);
+		else mount.stream.read(buf, len);
+		if constexpr(lock) mount.mtx.unlock();
+
+		if(!mount.stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	template <const bool write, const bool lock = true>
 	static uint16_t read_write_file(filesystem_t &mount,
 									internal_file_t &internal_file,
 									uintmax_t &pos, uintmax_t len, void *dst)
@@ -1272,7 +1412,6 @@ namespace EMU::FS
 			const u32 pos_in_first_cls = pos - start_cls_idx * cluster_size;
 			const u32 first_cls_len = std::min((u32)(cluster_size
 				- pos_in_first_cls), local_len);
-			const u16 whole_cls = (local_len - first_cls_len) / cluster_size;
 
 			u16 err, cls = internal_file.file_entry.start_cluster;
 
@@ -1287,131 +1426,92 @@ namespace EMU::FS
 			}
 			else
 			{
-				err = FAT_utils::get_nth_cluster(mount.FAT.get(), FAT_ATTRS,
-												 mount.FAT_attrs.LENGTH, cls,
-												 start_cls_idx);
+				err = FAT_t::get_nth_cluster(mount.FAT.get(),
+											 mount.FAT_attrs.LENGTH, cls,
+											 start_cls_idx);
 
 				if(err)
 					return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
 			}
 
 			const uintmax_t DATA_ADDR = mount.header.data_sctn_blk_addr * BLK_SIZE;
+			const uintmax_t MAX_RUN = std::max(mount.max_io_size / cluster_size,
+											   (uintmax_t)1);
 
-			dst_off = 0;
-
-			mount.mtx.lock();
-			mount.stream.seekg(DATA_ADDR + cluster_size * (cls
-				- FAT_ATTRS.DATA_MIN) + pos_in_first_cls);
+			/*Clusters get queued up for as long as they're physically contiguous
+			 *and then moved with a single seek and transfer, up to max_io_size.
+			 *The first one may start partway through.*/
+			uintmax_t run_cnt = 1, run_len = first_cls_len;
+			uintmax_t run_addr = DATA_ADDR + cluster_size * (cls
+				- FAT_ATTRS.DATA_MIN) + pos_in_first_cls;
+			uintmax_t left = local_len - first_cls_len;
 
-			if constexpr(write) mount.stream.write((char*)dst + dst_off,
-				first_cls_len);
-			else mount.stream.read((char*)dst + dst_off, first_cls_len);
-			mount.mtx.unlock();
-
-			if(!mount.stream.good())
-				return ret_val_setup(min_vfs::LIBRARY_ID,
-									 (u8)min_vfs::ERR::IO_ERROR);
-
-			len -= first_cls_len;
-			pos += first_cls_len;
-			dst_off += first_cls_len;
+			dst_off = 0;
 
-			for(u16 i = 0; i < whole_cls; i++)
+			while(left)
 			{
 				if constexpr(write)
 				{
 					try
 					{
 						mount.mtx.lock();
-						cls = get_or_alloc_next_cls(mount, cls,
-													internal_file.file_entry);
+						cls = get_or_alloc_next_cls(mount, cls, internal_file);
 						mount.mtx.unlock();
 					}
 					catch(min_vfs::FS_err e)
 					{
 						mount.mtx.unlock();
-						return e.err_code;
+						err = e.err_code;
 					}
 				}
 				else cls = mount.FAT[cls];
 
-				if(cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX)
+				if(!err && (cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX))
 				{
 					if constexpr(write)
-						return ret_val_setup(min_vfs::LIBRARY_ID,
-											 (u8)min_vfs::ERR::NO_SPACE_LEFT);
+						err = ret_val_setup(min_vfs::LIBRARY_ID,
+											(u8)min_vfs::ERR::NO_SPACE_LEFT);
 					else
-						return ret_val_setup(min_vfs::LIBRARY_ID,
-											 (u8)min_vfs::ERR::END_OF_FILE);
+						err = ret_val_setup(min_vfs::LIBRARY_ID,
+											(u8)min_vfs::ERR::END_OF_FILE);
 				}
 
-				mount.mtx.lock();
-				mount.stream.seekg(DATA_ADDR + cluster_size * (cls
-					- FAT_ATTRS.DATA_MIN));
+				const uintmax_t cls_addr = DATA_ADDR + cluster_size * (cls
+					- FAT_ATTRS.DATA_MIN);
 
-				if constexpr(write) mount.stream.write((char*)dst + dst_off,
-					cluster_size);
-				else mount.stream.read((char*)dst + dst_off, cluster_size);
-				mount.mtx.unlock();
-
-				if(!mount.stream.good())
-					return ret_val_setup(min_vfs::LIBRARY_ID,
-										 (u8)min_vfs::ERR::IO_ERROR);
+				//Flush what's queued so pos reflects everything that got through
+				if(err || run_addr + run_len != cls_addr || run_cnt == MAX_RUN)
+				{
+					const u16 io_err = transfer_run<write, lock>(mount, run_addr, run_len,
+						(char*)dst + dst_off);
+					if(io_err) return io_err;
 
-				len -= cluster_size;
-				pos += cluster_size;
-				dst_off += cluster_size;
-			}
+					len -= run_len;
+					pos += run_len;
+					dst_off += run_len;
 
-			if(len)
-			{
-				if constexpr(write)
-				{
-					try
-					{
-						mount.mtx.lock();
-						cls = get_or_alloc_next_cls(mount, cls,
-													internal_file.file_entry);
-						mount.mtx.unlock();
-					}
-					catch(min_vfs::FS_err e)
-					{
-						mount.mtx.unlock();
-						return e.err_code;
-					}
-				}
-				else cls = mount.FAT[cls];
+					if(err) return err;
 
-				if(cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX)
-				{
-					if constexpr(write)
-						return ret_val_setup(min_vfs::LIBRARY_ID,
-											 (u8)min_vfs::ERR::NO_SPACE_LEFT);
-					else
-						return ret_val_setup(min_vfs::LIBRARY_ID,
-											 (u8)min_vfs::ERR::END_OF_FILE);
+					run_cnt = 0;
+					run_len = 0;
+					run_addr = cls_addr;
 				}
 
-				mount.mtx.lock();
-				mount.stream.seekg(DATA_ADDR + cluster_size * (cls
-					- FAT_ATTRS.DATA_MIN));
+				const u32 chunk = std::min((uintmax_t)cluster_size, left);
 
-				if constexpr(write) mount.stream.write((char*)dst + dst_off,
-					len);
-				else mount.stream.read((char*)dst + dst_off, len);
-				mount.mtx.unlock();
+				run_cnt++;
+				run_len += chunk;
+				left -= chunk;
+			}
 
-				if(!mount.stream.good())
-					return ret_val_setup(min_vfs::LIBRARY_ID,
-										 (u8)min_vfs::ERR::IO_ERROR);
+			err = transfer_run<write, lock>(mount, run_addr, run_len,
+									  (char*)dst + dst_off);
+			if(err) return err;
 
-				pos += len;
-				len = 0;
-			}
+			len -= run_len;
+			pos += run_len;
 
-			/*Might wanna move this to the outer write function (filesystem_t's
-			write function) so that we always update the file size, regardless
-			of how we return from this one.*/
+			//Only in memory, see sync_file_entry
 			if constexpr(write)
 			{
 				const uintmax_t current_file_size =
@@ -1425,14 +1525,7 @@ namespace EMU::FS
 					internal_file.file_entry.cluster_cnt = std::get<0>(counts);
 					internal_file.file_entry.block_cnt = std::get<1>(counts);
 					internal_file.file_entry.byte_cnt = std::get<2>(counts);
-
-					mount.mtx.lock();
-					write_file(mount.stream, internal_file.file_entry);
-					mount.mtx.unlock();
-
-					if(!mount.stream.good())
-						return ret_val_setup(min_vfs::LIBRARY_ID,
-											 (u8)min_vfs::ERR::IO_ERROR);
+					internal_file.entry_dirty = true;
 				}
 			}
 			
@@ -1511,27 +1604,22 @@ namespace EMU::FS
 		if constexpr(ENDIANNESS != std::endian::native)
 			next_file_list_blk = std::byteswap(next_file_list_blk);
 
+		err = build_index(*this);
+		if(err) throw min_vfs::FS_err(err);
+
 		dir_cnt_dir_blcks = header.dir_list_blk_cnt * DIRS_PER_BLOCK
 			* MAX_BLOCKS_PER_DIR;
-		dir_content_block_map.resize(std::min((size_t)header.file_list_blk_cnt,
-											  dir_cnt_dir_blcks));
+		dir_content_block_map.assign(std::min((size_t)header.file_list_blk_cnt,
+											  dir_cnt_dir_blcks), false);
 		map_dir_blocks(*this, dir_content_block_map);
 
 		FAT_attrs.BASE_ADDR = header.FAT_blk_addr * BLK_SIZE;
 		FAT_attrs.LENGTH = header.cluster_cnt + 1;
 
-		stream.seekg(FAT_attrs.BASE_ADDR);
-		FAT = std::make_unique<u16[]>(FAT_attrs.LENGTH);
-		stream.read((char*)FAT.get(), FAT_attrs.LENGTH * 2);
-
-		if constexpr(ENDIANNESS != std::endian::native)
-		{
-			for(u32 i = 0; i < header.cluster_cnt + 1; i++)
-				FAT[i] = std::byteswap(FAT[i]);
-		}
+		FAT = FAT_utils::FAT_cache_t<u16>(FAT_ATTRS, FAT_attrs);
+		FAT.load(stream, FAT_ATTRS);
 
-		free_clusters = FAT_utils::count_free_clusters(FAT.get(), FAT_ATTRS,
-													   FAT_attrs.LENGTH);
+		free_clusters = FAT_t::count_free_clusters(FAT.get(), FAT_attrs.LENGTH);
 
 		if(!stream.good())
 			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
@@ -1548,9 +1636,15 @@ namespace EMU::FS
 		header = other.header;
 		next_file_list_blk = other.next_file_list_blk;
 		dir_content_block_map = other.dir_content_block_map;
+		dirs = std::move(other.dirs);
+		dir_names = std::move(other.dir_names);
+		file_list_blk_owner = std::move(other.file_list_blk_owner);
 		FAT_attrs = other.FAT_attrs;
 		FAT = std::move(other.FAT);
 		free_clusters = other.free_clusters;
+		max_io_size = other.max_io_size;
+		//Their readers point at other
+		banks.clear();
 
 		/*See comment in S7XX driver's implementation of this.*/
 		open_files = other.open_files;
@@ -1589,6 +1683,143 @@ namespace EMU::FS
 		return open_files.empty();
 	}
 
+	/*Banks can be looked into as if they were dirs: dir/bank/Presets and
+	 *dir/bank/Samples list what's in them, see bank.hpp. Listing dir/bank
+	 *gets those two; with get_dir, or if it isn't a bank, the file itself.*/
+	constexpr char BANK_PRESETS_DIR[] = "Presets";
+	constexpr char BANK_SAMPLES_DIR[] = "Samples";
+
+	//dir/file, file being "bank_num-name" or just the name
+	static u16 load_file_from_path(filesystem_t &mount,
+								   const std::vector<std::string> &split_path,
+								   std::vector<File_t> &files)
+	{
+		u16 err;
+		std::vector<Dir_t> dirs;
+
+		err = load_dir_from_name<true>(mount, split_path[0].c_str(), dirs);
+		if(err) return err;
+
+		std::string fname;
+		const u16 bank_num = bank_num_and_name_from_name(split_path[1], fname);
+
+		if(bank_num < 0x100)
+			return load_file_in_dir<comp_e::BANK>(mount, dirs[0],
+							{.bank_num = (u8)bank_num}, files);
+
+		return load_file_in_dir<comp_e::NAME>(mount, dirs[0],
+							{.name = fname.c_str()}, files);
+	}
+
+	/*Opens a bank's contents straight off its clusters, without opening the
+	 *file. lock is false for callers that already hold mtx.*/
+	template <const bool lock>
+	static u16 open_bank_file(filesystem_t &mount, const File_t &file,
+							  bank::bank_t &bank)
+	{
+		//Not an open file, just enough for read_write_file to go on. Reads
+		//never look past file_entry.
+		const std::shared_ptr<internal_file_t> internal_file =
+			std::make_shared<internal_file_t>();
+
+		internal_file->map_entry = nullptr;
+		internal_file->dir_map_entry = nullptr;
+		internal_file->ftype = min_vfs::ftype_t::file;
+		internal_file->file_entry = file;
+
+		const u32 cluster_size = calc_cluster_size(mount.header.cluster_shift);
+
+		bank.io_size = cluster_size;
+
+		return bank.open
+		(
+			[&mount, internal_file](uintmax_t pos, uintmax_t len,
+									void *dst) -> u16
+			{
+				return read_write_file<false, lock>(mount, *internal_file,
+													pos, len, dst);
+			},
+			calc_file_size(file, cluster_size)
+		);
+	}
+
+	//Only parsed the first time around, names get read as they're listed
+	static u16 cached_bank(filesystem_t &mount, const File_t &file,
+						   bank::bank_t *&bank)
+	{
+		const auto res = mount.banks.try_emplace(file.addr);
+
+		if(res.second)
+		{
+			//list's caller already holds mtx
+			const u16 err = open_bank_file<false>(mount, file,
+												  res.first->second);
+			if(err)
+			{
+				mount.banks.erase(res.first);
+				return err;
+			}
+		}
+
+		bank = &res.first->second;
+
+		return 0;
+	}
+
+	static u16 list_bank(filesystem_t &mount, const File_t &file,
+						 const std::vector<std::string> &split_path,
+						 std::vector<min_vfs::dentry_t> &dentries,
+						 const bool get_dir)
+	{
+		u16 err;
+		bank::obj_type_e type;
+		bank::bank_t *bank_ptr;
+		std::vector<min_vfs::dentry_t> objs;
+
+		if(split_path[2] == BANK_PRESETS_DIR)
+			type = bank::obj_type_e::PRESET;
+		else if(split_path[2] == BANK_SAMPLES_DIR)
+			type = bank::obj_type_e::SAMPLE;
+		else
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+
+		err = cached_bank(mount, file, bank_ptr);
+		if(err) return err;
+
+		bank::bank_t &bank = *bank_ptr;
+
+		if(split_path.size() == 3)
+		{
+			if(!get_dir) return bank.list(type, dentries);
+
+			dentries.emplace_back
+			(
+				split_path[2],
+				0,
+				0, //ctime
+				0, //mtime
+				0, //atime
+				min_vfs::ftype_t::dir
+			);
+			return 0;
+		}
+
+		err = bank.list(type, objs);
+		if(err) return err;
+
+		for(const min_vfs::dentry_t &dentry: objs)
+		{
+			if(dentry.fname == split_path[3])
+			{
+				dentries.push_back(dentry);
+				return 0;
+			}
+		}
+
+		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
+	}
+
 	u16 filesystem_t::list(const char *file_path,
 						   std::vector<min_vfs::dentry_t> &dentries,
 						   const bool get_dir)
@@ -1661,25 +1892,42 @@ namespace EMU::FS
 				return 0;
 
 			case 2:
-				err = load_dir_from_name<true>(*this, split_path[0].c_str(),
-											   dirs);
+			case 3:
+			case 4:
+				err = load_file_from_path(*this, split_path, files);
 				if(err) return err;
 
+				if(split_path.size() > 2)
+					return list_bank(*this, files[0], split_path, dentries,
+									 get_dir);
+
+				if(!get_dir)
 				{
-					std::string fname;
-					u16 bank_num;
+					bank::bank_t *bank;
 
-					bank_num = bank_num_and_name_from_name(split_path[1],
-														   fname);
+					err = cached_bank(*this, files[0], bank);
 
-					if(bank_num < 0x100)
-						err = load_file_in_dir<comp_e::BANK>(*this, dirs[0],
-											{.bank_num = (u8)bank_num}, files);
-					else
-						err = load_file_in_dir<comp_e::NAME>(*this, dirs[0],
-												{.name = fname.c_str()}, files);
+					if(!err)
+					{
+						for(const char *const dir: {BANK_PRESETS_DIR,
+													BANK_SAMPLES_DIR})
+							dentries.emplace_back
+							(
+								dir,
+								0,
+								0, //ctime
+								0, //mtime
+								0, //atime
+								min_vfs::ftype_t::dir
+							);
+
+						return 0;
+					}
+
+					if(err != ret_val_setup(bank::LIBRARY_ID,
+											(u8)bank::ERR::NOT_A_BANK))
+						return err;
 				}
-				if(err) return err;
 
 				dentries.resize(1);
 				
@@ -1696,13 +1944,31 @@ namespace EMU::FS
 		return 0;
 	}
 
+	uint16_t filesystem_t::open_bank(const char *path, bank::bank_t &bank)
+	{
+		u16 err;
+		std::vector<File_t> files;
+
+		const std::vector<std::string> split_path =
+			str_util::split(std::string(path), std::string("/"));
+
+		if(split_path.size() != 2)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::INVALID_PATH);
+
+		mtx.lock();
+		err = load_file_from_path(*this, split_path, files);
+		mtx.unlock();
+		if(err) return err;
+
+		return open_bank_file<true>(*this, files[0], bank);
+	}
+
 	uint16_t filesystem_t::mkdir(const char *dir_path)
 	{
-		bool found_free, found_dir;
-		u16 offset;
-		uintmax_t block_abs_addr, free_dir_slot_addr;
+		u8 buffer[On_disk_sizes::DIR_ENTRY];
+		u16 slot;
 
-		std::unique_ptr<u8[]> buffer;
 		std::vector<std::string> split_path;
 
 		Dir_t dir;
@@ -1712,65 +1978,32 @@ namespace EMU::FS
 		if(split_path.size() != 1)
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::INVALID_PATH);
 
-		const char *search_name = split_path[0].c_str();
-
-		found_dir = false;
-		found_free = false;
-		buffer = std::make_unique<u8[]>(BLK_SIZE);
-		for(block_abs_addr = header.dir_list_blk_addr * BLK_SIZE;
-			block_abs_addr < header.dir_list_blk_addr * BLK_SIZE
-				+ header.dir_list_blk_cnt * BLK_SIZE;
-			block_abs_addr += BLK_SIZE)
-		{
-			stream.seekg(block_abs_addr);
-			stream.read((char*)buffer.get(), BLK_SIZE);
-
-			offset = 0;
-			for(u8 i = 0; i < DIRS_PER_BLOCK; i++, offset
-				+= On_disk_sizes::DIR_ENTRY)
-			{
-				if(!is_valid_dir((Dir_type_e)buffer[offset + 0x11]))
-				{
-					if(!found_free)
-					{
-						free_dir_slot_addr = block_abs_addr + offset;
-						found_free = true;
-					}
-
-					continue;
-				}
-
-				std::replace(buffer.get() + offset, buffer.get() + offset + 16,
-							 '/', '\\');
-
-				if(!std::strncmp((char*)(buffer.get() + offset), search_name,
-					16))
-				{
-					dir.addr = block_abs_addr + offset;
-					load_dir<true>(buffer.get() + offset, dir);
-					found_dir = true;
-					break;
-				}
-			}
-		}
-
-		if(found_dir)
+		if(dir_names.contains(name_key(split_path[0].c_str())))
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::ALREADY_EXISTS);
 
-		if(!found_free)
+		for(slot = 0; slot < dirs.size(); slot++)
+			if(!is_valid_dir(dirs[slot].dir.type)) break;
+
+		if(slot >= dirs.size())
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NO_SPACE_LEFT);
 
 		prepare_dir_name(split_path[0], dir.name);
+		dir.name[16] = 0;
 		dir.type = Dir_type_e::NORMAL;
+		dir.addr = dirs[slot].dir.addr;
 		for(u8 i = 0; i < MAX_BLOCKS_PER_DIR; i++) dir.blocks[i] = 0xFFFF;
 
-		write_dir(buffer.get(), dir);
-		stream.seekp(free_dir_slot_addr);
-		stream.write((char*)buffer.get(), On_disk_sizes::DIR_ENTRY);
+		write_dir(buffer, dir);
+		stream.seekp(dir.addr);
+		stream.write((char*)buffer, On_disk_sizes::DIR_ENTRY);
 		stream.flush();
 		if(!stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
+		index_dir(*this, dir);
+		dirs[slot].files.assign(MAX_FILES_PER_DIR, File_t());
+		dirs[slot].banks.clear();
+
 		return 0;
 	}
 
@@ -2074,7 +2307,7 @@ namespace EMU::FS
 		}
 
 		file.type = File_type_e::STD;
-		write_file(stream, file);
+		write_file(*this, file);
 		stream.flush();
 
 		if(!stream.is_open() || !stream.good())
@@ -2115,10 +2348,18 @@ namespace EMU::FS
 		return 0;
 	}
 
+	/*Unlike flush, this one doesn't take mtx itself: stream_t::close already
+	 *holds it around the call, and it's not recursive.
+	 *The handle gets released even if syncing the entry fails, otherwise the
+	 *file would stay open forever.*/
 	uint16_t filesystem_t::fclose(void *internal_file)
 	{
+		u16 err = 0;
 		internal_file_t *const cast_ptr = (internal_file_t*)internal_file;
 
+		if(cast_ptr->ftype == min_vfs::ftype_t::file)
+			err = sync_file_entry(*this, *cast_ptr);
+
 		if(cast_ptr->map_entry->second.first == 1)
 		{
 			if(cast_ptr->ftype == min_vfs::ftype_t::file)
@@ -2132,7 +2373,7 @@ namespace EMU::FS
 		}
 		else cast_ptr->map_entry->second.first--;
 
-		return 0;
+		return err;
 	}
 
 	uint16_t filesystem_t::read(void *internal_file, uintmax_t &pos, uintmax_t len, void *dst)
@@ -2140,20 +2381,74 @@ namespace EMU::FS
 		return read_write_file<false>(*this, *((internal_file_t*)internal_file), pos, len, dst);
 	}
 
+	/*However many clusters a write allocates, the metadata costs the same:
+	 *one FAT commit and one free count update here, one entry write at
+	 *flush or fclose.*/
 	uint16_t filesystem_t::write(void *internal_file, uintmax_t &pos, uintmax_t len, void *src)
 	{
-		return read_write_file<true>(*this, *((internal_file_t*)internal_file), pos, len, src);
+		internal_file_t &file = *((internal_file_t*)internal_file);
+		const u16 old_cls_cnt = file.file_entry.cluster_cnt;
+		const u16 err = read_write_file<true>(*this, file, pos, len, src);
+
+		//Whatever got allocated, even if we failed halfway through
+		mtx.lock();
+		const u16 commit_err = FAT.commit(stream, FAT_ATTRS);
+		free_clusters -= file.file_entry.cluster_cnt - old_cls_cnt;
+		if(file.entry_dirty) index_file(*this, file.file_entry);
+		else banks.erase(file.file_entry.addr);
+		mtx.unlock();
+
+		return err ? err : commit_err;
 	}
 
 	uint16_t filesystem_t::flush(void *internal_file)
 	{
 		mtx.lock();
+		u16 err = FAT.commit(stream, FAT_ATTRS);
+		if(!err) err = sync_file_entry(*this, *((internal_file_t*)internal_file));
 		stream.flush();
 		const bool str_status = stream.good();
 		mtx.unlock();
 
+		if(err) return err;
+
 		if(str_status) return 0;
 		else return ret_val_setup(min_vfs::LIBRARY_ID,
 			(u8)min_vfs::ERR::IO_ERROR);
 	}
+
+	/*The whole chain gets reserved in one go, contiguous if there's a big
+	 *enough run, and the file entry and FAT only get written once. Writes
+	 *within the new size then never have to allocate.*/
+	uint16_t filesystem_t::fallocate(void *internal_file, const uintmax_t len)
+	{
+		u16 err;
+
+		internal_file_t &file = *((internal_file_t*)internal_file);
+		const u32 cluster_size = calc_cluster_size(header.cluster_shift);
+
+		if(file.ftype != min_vfs::ftype_t::file)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_A_FILE);
+
+		if(len > header.cluster_cnt * cluster_size)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::FILE_TOO_LARGE);
+
+		if(len <= calc_file_size(file.file_entry, cluster_size)) return 0;
+
+		err = resize_file<true>(*this, file.file_entry, len);
+		if(err) return err;
+
+		//resize_file wrote the entry, pending changes and all
+		file.entry_dirty = false;
+
+		stream.flush();
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
 }
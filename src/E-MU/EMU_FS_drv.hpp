@@ -5,13 +5,18 @@
 
 #include "library_IDs.hpp"
 #include "Utils/ints.hpp"
+#include "Utils/bit_util.hpp"
 #include "min_vfs/min_vfs_base.hpp"
 #include "EMU_FS_types.hpp"
+#include "bank.hpp"
 
 namespace EMU::FS
 {
 	constexpr u8 LIBRARY_ID = (u8)Library_IDs::EMU_FS;
 
+	//Default cap for a single data read or write, see filesystem_t::max_io_size
+	constexpr uintmax_t DEFAULT_MAX_IO_SIZE = 4 * 1024 * 1024;
+
 	enum class ERR: u8
 	{
 		BAD_CLUSTER_CNT = 1,
@@ -39,22 +44,53 @@ namespace EMU::FS
 		BAD_DIR = 1 << 11,
 		BAD_NEXT_DIR_CONTENT_BLK = 1 << 12,
 		UNMARKED_RESERVED_CLUSTERS = 1 << 13,
-		BAD_FILE = 1 << 14
+		BAD_FILE = 1 << 14,
+		LOST_CLUSTERS = 1 << 15
 	};
 
 	uint16_t mkfs(const std::filesystem::path &fs_path,
 				  const std::string &label);
 	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status);
+	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status,
+				  min_vfs::fsck_timings_t &timings);
+	uint16_t defrag(const std::filesystem::path &fs_path,
+					min_vfs::defrag_stats_t &stats);
 
 	struct internal_file_t;
 
+	//One dir from the dir list along with its parsed file list
+	struct dir_idx_t
+	{
+		Dir_t dir;
+		//MAX_FILES_PER_DIR slots, FILES_PER_BLOCK per entry in dir.blocks;
+		//empty if the dir itself isn't valid
+		std::vector<File_t> files;
+		std::unordered_map<u8, u8> banks; //bank_num -> slot in files
+	};
+
 	struct filesystem_t: min_vfs::filesystem_t
 	{
 		Header_t header;
 		u16 next_file_list_blk, free_clusters;
-		std::vector<bool> dir_content_block_map;
+		bit_util::bitset_t dir_content_block_map; //file list blocks in use
+
+		/*Parsed dir list and file lists, built at mount. Everything that
+		 *writes a dir or file entry keeps these in sync, so lookups never
+		 *have to touch the disk.*/
+		std::vector<dir_idx_t> dirs; //by slot in the dir list
+		std::unordered_map<std::string, u16> dir_names; //name -> slot
+		std::vector<u16> file_list_blk_owner; //file list block -> dir slot
 		FAT_utils::FAT_dyna_attrs_t<u16> FAT_attrs;
-		std::unique_ptr<u16[]> FAT;
+		FAT_utils::FAT_cache_t<u16> FAT;
+
+		/*Runs of contiguous clusters get read or written in one go, split
+		 *into transfers of at most this many bytes (never less than one
+		 *cluster). Can be changed at any time.*/
+		uintmax_t max_io_size = DEFAULT_MAX_IO_SIZE;
+
+		/*Banks that have been looked into with list, names and all, by file
+		 *entry addr. Anything that writes the file or its entry drops it.*/
+		std::unordered_map<uintmax_t, bank::bank_t> banks;
 
 		typedef std::unordered_map<std::string, std::pair<uintmax_t, internal_file_t>> file_map_t;
 		file_map_t open_files;
@@ -86,6 +122,13 @@ namespace EMU::FS
 		uint16_t read(void *internal_file, uintmax_t &pos, uintmax_t len, void *dst);
 		uint16_t write(void *internal_file, uintmax_t &pos, uintmax_t len, void *src);
 		uint16_t flush(void *internal_file);
+		uint16_t fallocate(void *internal_file, const uintmax_t len);
+
+		/*Gets a bank's contents ready to be read (listed, exported), see
+		 *bank.hpp. Sample data gets streamed a cluster at a time, straight
+		 *off the file's clusters, so the bank is only good for as long as
+		 *nobody writes to the file. Its reader takes mtx, so don't hold it.*/
+		uint16_t open_bank(const char *path, bank::bank_t &bank);
 
 	private:
 		uint16_t fopen_internal(const char *path, void **internal_file);
@@ -97,6 +140,8 @@ namespace EMU::FS
 		filesystem_t::file_map_t::value_type *dir_map_entry;
 		min_vfs::ftype_t ftype;
 		File_t file_entry;
+		//file_entry has changes that haven't hit the disk yet, see flush
+		bool entry_dirty = false;
 	};
 }
 
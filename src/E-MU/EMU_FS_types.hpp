@@ -31,6 +31,7 @@ namespace EMU::FS
 
 	constexpr FAT_utils::FAT_attrs_t<uint16_t> FAT_ATTRS(ENDIANNESS, 0, 1,
 		0x7FFE, 0x7FFF, 0x8000);
+	typedef FAT_utils::FAT_t<FAT_ATTRS> FAT_t;
 
 	constexpr u16 MAX_CLUSTER_CNT = FAT_ATTRS.DATA_MAX;
 	constexpr u16 MAX_FAT_LEN = FAT_ATTRS.DATA_MAX;
@@ -0,0 +1,317 @@
+#include <string>
+#include <memory>
+#include <vector>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "Utils/ints.hpp"
+#include "Utils/testing_helpers.hpp"
+#include "Utils/FAT_utils.hpp"
+#include "min_vfs/min_vfs_base.hpp"
+#include "E-MU/EMU_FS_drv.hpp"
+#include "fs_test_data.hpp"
+#include "Helpers.hpp"
+
+/*Sequential extraction benchmark for the E-MU data path. Writes one bank
+ *in a single go, which leaves it contiguous, and two more a cluster at a
+ *time each, interleaved, so every cluster of theirs is its own run. Then
+ *reads them back whole with a few max_io_size settings; one cluster is
+ *what the driver used to do before runs got coalesced. Last, it writes a
+ *bank a cluster at a time, the way min_vfs::copy does, with and without
+ *preallocating it first.
+ *
+ *	EMU_FS_io_bench [iterations]
+ *
+ *Every read gets checked, so a single iteration doubles as a test.*/
+
+using namespace EMU::FS::testing;
+
+constexpr char BENCH_IMG[] = "io_bench.img";
+constexpr u32 CONTIG_CLS_CNT = 256; //8MiB
+constexpr u32 FRAG_CLS_CNT = 96; //3MiB each
+constexpr u32 WRITE_CLS_CNT = 64; //2MiB each
+
+constexpr uintmax_t MAX_IO_SIZES[] = {CLUSTER_SIZE, 8 * CLUSTER_SIZE,
+	EMU::FS::DEFAULT_MAX_IO_SIZE};
+
+static u8 pattern(const uintmax_t off, const u8 tag)
+{
+	return off ^ (off >> 11) ^ tag;
+}
+
+static void fill(u8 *buf, const uintmax_t off, const uintmax_t len,
+				 const u8 tag)
+{
+	for(uintmax_t i = 0; i < len; i++) buf[i] = pattern(off + i, tag);
+}
+
+static bool check(const u8 *buf, const uintmax_t len, const u8 tag)
+{
+	for(uintmax_t i = 0; i < len; i++)
+		if(buf[i] != pattern(i, tag)) return false;
+
+	return true;
+}
+
+static int bench(const uintmax_t iters)
+{
+	const std::string BASE_PATH = "/" + EXPECTED_ROOT_DIR[2].fname
+		+ "/io_bench_";
+	const std::string WRITE_NAMES[] = {BASE_PATH + "w0", BASE_PATH + "w1"};
+	const char TAGS[] = {'a', 'b', 'c'};
+	const u32 CLS_CNTS[] = {CONTIG_CLS_CNT, FRAG_CLS_CNT, FRAG_CLS_CNT};
+
+	u16 err, fsck_status;
+	double ms;
+
+	std::unique_ptr<EMU::FS::filesystem_t> fs;
+	min_vfs::stream_t streams[3];
+	std::unique_ptr<u8[]> buf;
+
+	/*-------------------------------Data setup-------------------------------*/
+	if(std::filesystem::exists(BENCH_IMG))
+		std::filesystem::remove_all(BENCH_IMG);
+
+	std::filesystem::copy_file(TEST_IMG_NAME, BENCH_IMG);
+
+	try
+	{
+		fs = std::make_unique<EMU::FS::filesystem_t>(BENCH_IMG);
+	}
+	catch(const min_vfs::FS_err &e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 1" << std::endl;
+		return 1;
+	}
+
+	for(u8 i = 0; i < 3; i++)
+	{
+		err = fs->fopen((BASE_PATH + TAGS[i]).c_str(), streams[i]);
+		if(err)
+		{
+			print_unexpected_err(err, 2);
+			return 2;
+		}
+	}
+
+	buf = std::make_unique<u8[]>(CONTIG_CLS_CNT * CLUSTER_SIZE);
+
+	fill(buf.get(), 0, CONTIG_CLS_CNT * CLUSTER_SIZE, TAGS[0]);
+	err = streams[0].write(buf.get(), CONTIG_CLS_CNT * CLUSTER_SIZE);
+	if(err)
+	{
+		print_unexpected_err(err, 3);
+		return 3;
+	}
+
+	for(u32 i = 0; i < FRAG_CLS_CNT; i++)
+	{
+		for(u8 j = 1; j < 3; j++)
+		{
+			fill(buf.get(), i * CLUSTER_SIZE, CLUSTER_SIZE, TAGS[j]);
+			err = streams[j].write(buf.get(), CLUSTER_SIZE);
+			if(err)
+			{
+				print_unexpected_err(err, 4);
+				return 4;
+			}
+		}
+	}
+	/*----------------------------End of data setup---------------------------*/
+
+	for(const uintmax_t max_io_size: MAX_IO_SIZES)
+	{
+		fs->max_io_size = max_io_size;
+
+		for(u8 i = 0; i < 2; i++)
+		{
+			const uintmax_t len = CLS_CNTS[i] * CLUSTER_SIZE;
+			const auto start = std::chrono::steady_clock::now();
+
+			for(uintmax_t j = 0; j < iters; j++)
+			{
+				streams[i].seek(0);
+				err = streams[i].read(buf.get(), len);
+				if(err)
+				{
+					print_unexpected_err(err, 5);
+					return 5;
+				}
+			}
+
+			ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count() / iters;
+
+			if(!check(buf.get(), len, TAGS[i]))
+			{
+				std::cerr << "File data mismatch!!!" << std::endl;
+				std::cerr << "Exit: 6" << std::endl;
+				return 6;
+			}
+
+			std::cout << std::left << std::setw(12)
+				<< (i ? "fragmented" : "contiguous") << std::right
+				<< std::setw(10) << max_io_size << " B max I/O"
+				<< std::setw(12) << std::fixed << std::setprecision(3) << ms
+				<< " ms" << std::setw(10) << std::setprecision(1)
+				<< len / ms / 1000 << " MB/s" << std::endl;
+		}
+	}
+
+	//Unaligned reads crossing from one run into the next
+	fs->max_io_size = 4 * CLUSTER_SIZE;
+	streams[0].seek(CLUSTER_SIZE / 2 + 3);
+	err = streams[0].read(buf.get(), 9 * CLUSTER_SIZE);
+	if(err)
+	{
+		print_unexpected_err(err, 7);
+		return 7;
+	}
+
+	for(uintmax_t i = 0; i < 9 * CLUSTER_SIZE; i++)
+	{
+		if(buf[i] != pattern(CLUSTER_SIZE / 2 + 3 + i, TAGS[0]))
+		{
+			std::cerr << "File data mismatch!!!" << std::endl;
+			std::cerr << "Exit: 8" << std::endl;
+			return 8;
+		}
+	}
+
+	for(u8 i = 0; i < 3; i++) streams[i].close();
+
+	for(u8 i = 0; i < 2; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		err = fs->fopen(WRITE_NAMES[i].c_str(), streams[0]);
+		if(err)
+		{
+			print_unexpected_err(err, 11);
+			return 11;
+		}
+
+		if(i)
+		{
+			err = streams[0].fallocate(WRITE_CLS_CNT * CLUSTER_SIZE);
+			if(err)
+			{
+				print_unexpected_err(err, 12);
+				return 12;
+			}
+		}
+
+		for(u32 j = 0; j < WRITE_CLS_CNT; j++)
+		{
+			fill(buf.get(), j * CLUSTER_SIZE, CLUSTER_SIZE, TAGS[0]);
+			err = streams[0].write(buf.get(), CLUSTER_SIZE);
+			if(err)
+			{
+				print_unexpected_err(err, 13);
+				return 13;
+			}
+		}
+
+		streams[0].flush();
+
+		ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+
+		streams[0].seek(0);
+		err = streams[0].read(buf.get(), WRITE_CLS_CNT * CLUSTER_SIZE);
+		if(err)
+		{
+			print_unexpected_err(err, 14);
+			return 14;
+		}
+
+		if(!check(buf.get(), WRITE_CLS_CNT * CLUSTER_SIZE, TAGS[0]))
+		{
+			std::cerr << "File data mismatch!!!" << std::endl;
+			std::cerr << "Exit: 15" << std::endl;
+			return 15;
+		}
+
+		std::cout << std::left << std::setw(12) << "write" << std::right
+			<< std::setw(20) << (i ? "preallocated" : "grown on write")
+			<< std::setw(12) << std::fixed << std::setprecision(3) << ms
+			<< " ms" << std::endl;
+
+		streams[0].close();
+	}
+
+	//The preallocated bank has to be a single run
+	for(const EMU::FS::dir_idx_t &idx: fs->dirs)
+	{
+		for(const EMU::FS::File_t &file: idx.files)
+		{
+			if(file.type != EMU::FS::File_type_e::STD
+				|| std::strncmp(file.name, "io_bench_w1", 11))
+				continue;
+
+			std::vector<u16> chain;
+
+			EMU::FS::FAT_t::follow_chain(fs->FAT.get(), fs->FAT_attrs.LENGTH,
+										 file.start_cluster, chain);
+
+			for(uintmax_t j = 1; j < chain.size(); j++)
+			{
+				if(chain[j] != chain[j - 1] + 1)
+				{
+					std::cerr << "Preallocated chain isn't contiguous!!!";
+					std::cerr << std::endl << "Exit: 16" << std::endl;
+					return 16;
+				}
+			}
+
+			if(chain.size() != WRITE_CLS_CNT)
+			{
+				std::cerr << "Preallocated chain length mismatch!!!";
+				std::cerr << std::endl << "Expected: " << WRITE_CLS_CNT;
+				std::cerr << std::endl << "Got: " << chain.size();
+				std::cerr << std::endl << "Exit: 17" << std::endl;
+				return 17;
+			}
+		}
+	}
+
+	/*-------------------------------Safety fsck------------------------------*/
+	fs->stream.flush();
+	fsck_status = 0;
+	err = EMU::FS::fsck(fs->path, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 9);
+		return 9;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck found errors!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 10" << std::endl;
+		return 10;
+	}
+	/*---------------------------End of safety fsck---------------------------*/
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const uintmax_t iters = argc > 1 ? std::max(std::stoull(argv[1]), 1ULL)
+		: 5;
+
+	std::cout << "Sequential extraction..." << std::endl;
+	const int err = bench(iters);
+	if(err) return err;
+	std::cout << "Sequential extraction OK!" << std::endl;
+
+	return 0;
+}
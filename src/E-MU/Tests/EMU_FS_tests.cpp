@@ -1,5 +1,6 @@
 ﻿#include <filesystem>
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <cstring>
@@ -10,6 +11,7 @@
 #include "Utils/ints.hpp"
 #include "Utils/utils.hpp"
 #include "Utils/testing_helpers.hpp"
+#include "Utils/FAT_utils.hpp"
 #include "E-MU/EMU_FS_types.hpp"
 #include "E-MU/EMU_FS_drv.hpp"
 #include "fs_test_data.hpp"
@@ -142,7 +144,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 	path = "/" + EXPECTED_ROOT_DIR[1].fname;
 
 	files.clear();
-	err = emu_fs.list((path + "/" + EXPECTED_DIR1[0].fname).c_str(), files);
+	err = emu_fs.list((path + "/" + EXPECTED_DIR1[0].fname).c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 15);
@@ -154,7 +156,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 	if(err) return 15 + err;
 
 	files.clear();
-	err = emu_fs.list((path + "/16-").c_str(), files);
+	err = emu_fs.list((path + "/16-").c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 18);
@@ -166,7 +168,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 
 	//filename only
 	files.clear();
-	err = emu_fs.list((path + "/lae dee em cee t").c_str(), files);
+	err = emu_fs.list((path + "/lae dee em cee t").c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 21);
@@ -178,7 +180,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 
 	//bank num + invalid filename
 	files.clear();
-	err = emu_fs.list((path + "/16-irrelevant").c_str(), files);
+	err = emu_fs.list((path + "/16-irrelevant").c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 24);
@@ -190,7 +192,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 
 	//invalid bank num + filename
 	files.clear();
-	err = emu_fs.list((path + "/256-lae dee em cee t").c_str(), files);
+	err = emu_fs.list((path + "/256-lae dee em cee t").c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 66);
@@ -229,7 +231,7 @@ static int list_tests(EMU::FS::filesystem_t &emu_fs)
 
 	//List file with '/' in name
 	files.clear();
-	err = emu_fs.list((EXPECTED_ROOT_DIR[0].fname + "/" + EXPECTED_DIR0[7].fname).c_str(), files);
+	err = emu_fs.list((EXPECTED_ROOT_DIR[0].fname + "/" + EXPECTED_DIR0[7].fname).c_str(), files, true);
 	if(err)
 	{
 		print_unexpected_err(err, 603);
@@ -627,7 +629,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 50);
@@ -710,7 +712,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 60);
@@ -827,7 +829,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 618);
@@ -910,7 +912,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 628);
@@ -1028,7 +1030,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 76);
@@ -1084,7 +1086,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 83);
@@ -1134,7 +1136,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 87);
@@ -1184,7 +1186,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 91);
@@ -1234,7 +1236,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 95);
@@ -1284,7 +1286,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 100);
@@ -1336,7 +1338,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 635);
@@ -1457,7 +1459,7 @@ static int trunc_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 110);
@@ -1597,7 +1599,7 @@ static int trunc_tests()
 	f_path = d_path + "/Trunc_test_1";
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 135);
@@ -3633,7 +3635,7 @@ static int remove_tests()
 	f_path = d_path + "/" + EXPECTED_DIR0[4].fname;
 	free_space = emu_fs->get_free_space();
 
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 144);
@@ -4429,7 +4431,7 @@ static int fopen_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 212);
@@ -4525,7 +4527,7 @@ static int fopen_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 222);
@@ -4580,7 +4582,7 @@ static int fopen_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 363);
@@ -5105,7 +5107,7 @@ static int write_tests()
 		return 278;
 	}
 
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 279);
@@ -5179,7 +5181,7 @@ static int write_tests()
 		return 287;
 	}
 
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 288);
@@ -5252,7 +5254,7 @@ static int write_tests()
 		return 296;
 	}
 
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 297);
@@ -5327,7 +5329,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 306);
@@ -5408,7 +5410,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 315);
@@ -5483,7 +5485,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 324);
@@ -5546,7 +5548,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 332);
@@ -5590,7 +5592,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 337);
@@ -5648,7 +5650,7 @@ static int write_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 691);
@@ -5805,7 +5807,7 @@ static int trunc_open_tests()
 		return 346;
 	}
 
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 347);
@@ -5861,7 +5863,7 @@ static int trunc_open_tests()
 	}
 
 	dentries.clear();
-	err = emu_fs->list(f_path.c_str(), dentries);
+	err = emu_fs->list(f_path.c_str(), dentries, true);
 	if(err)
 	{
 		print_unexpected_err(err, 354);
@@ -7057,6 +7059,626 @@ static int rename_open_tests()
 	return 0;
 }
 
+//Expects that mounting and fsck will already be tested
+static int mkfs_tests()
+{
+	constexpr char EMU_FS[] = "mkfs_fs.img";
+	constexpr uintmax_t BIG_FS_SIZE = 8ULL * 1024 * 1024 * 1024;
+
+	u16 err, expected_err, fsck_status;
+	uintmax_t cluster_size, fs_size;
+
+	std::ofstream temp;
+	std::vector<min_vfs::dentry_t> dentries;
+	std::unique_ptr<EMU::FS::filesystem_t> emu_fs;
+
+	expected_err = ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+	err = EMU::FS::mkfs("nx_file", "SHOULD NOT EXIST");
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 704);
+		return 704;
+	}
+
+	if(std::filesystem::exists(EMU_FS))
+		std::filesystem::remove_all(EMU_FS);
+
+	temp.open(EMU_FS);
+	if(!temp.is_open() || !temp.good())
+	{
+		std::cerr << "Failed to create file!!!" << std::endl;
+		std::cerr << "Exit: 705" << std::endl;
+		return 705;
+	}
+	temp.close();
+
+	expected_err = ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::DISK_TOO_SMALL);
+	err = EMU::FS::mkfs(EMU_FS, "SHOULD NOT EXIST");
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 706);
+		return 706;
+	}
+
+	/*-------------------------Same size as the test FS-----------------------*/
+	std::filesystem::resize_file(EMU_FS, EXPECTED_HEADER.block_cnt
+		* EMU::FS::BLK_SIZE);
+
+	err = EMU::FS::mkfs(EMU_FS, "Test mkfs E-MU FS");
+	if(err)
+	{
+		print_unexpected_err(err, 707);
+		return 707;
+	}
+
+	try
+	{
+		emu_fs = std::make_unique<EMU::FS::filesystem_t>(EMU_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 708" << std::endl;
+		return 708;
+	}
+
+	//Same layout as the disk the test FS came from
+	if(!headercmp(emu_fs->header, EXPECTED_HEADER))
+	{
+		std::cerr << "Header mismatch!!!" << std::endl;
+		std::cerr << "Expected: " << header_to_string(EXPECTED_HEADER, 0) << std::endl;
+		std::cerr << "Got: " << header_to_string(emu_fs->header, 0) << std::endl;
+		std::cerr << "Exit: 709" << std::endl;
+		return 709;
+	}
+
+	if(emu_fs->free_clusters != emu_fs->header.cluster_cnt)
+	{
+		std::cerr << "Free cluster count mismatch!!!" << std::endl;
+		std::cerr << "Expected: " << emu_fs->header.cluster_cnt << std::endl;
+		std::cerr << "Got: " << emu_fs->free_clusters << std::endl;
+		std::cerr << "Exit: 710" << std::endl;
+		return 710;
+	}
+
+	err = emu_fs->list("/", dentries);
+	if(err)
+	{
+		print_unexpected_err(err, 711);
+		return 711;
+	}
+
+	if(dentries.size())
+	{
+		std::cerr << "New FS isn't empty!!!" << std::endl;
+		std::cerr << "Exit: 712" << std::endl;
+		return 712;
+	}
+
+	emu_fs.reset();
+
+	fsck_status = 0;
+	err = EMU::FS::fsck(EMU_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 713);
+		return 713;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "New FS failed fsck!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 714" << std::endl;
+		return 714;
+	}
+	/*---------------------End of same size as the test FS--------------------*/
+
+	/*---------------------------------Big FS---------------------------------*/
+	//Too many 32KiB clusters, has to go for bigger ones
+	std::filesystem::resize_file(EMU_FS, BIG_FS_SIZE);
+
+	err = EMU::FS::mkfs(EMU_FS, "Test mkfs E-MU FS");
+	if(err)
+	{
+		print_unexpected_err(err, 715);
+		return 715;
+	}
+
+	try
+	{
+		emu_fs = std::make_unique<EMU::FS::filesystem_t>(EMU_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 716" << std::endl;
+		return 716;
+	}
+
+	cluster_size = 1 << (emu_fs->header.cluster_shift
+		+ EMU::FS::MIN_CLUSTER_SHIFT);
+	fs_size = (uintmax_t)emu_fs->header.block_cnt * EMU::FS::BLK_SIZE;
+
+	//Whatever's left over has to be less than a cluster and the FAT
+	if(emu_fs->header.cluster_shift != 4 || fs_size > BIG_FS_SIZE
+		|| BIG_FS_SIZE - fs_size >= cluster_size
+			+ emu_fs->header.FAT_blk_cnt * EMU::FS::BLK_SIZE)
+	{
+		std::cerr << "Bad layout for a big FS!!!" << std::endl;
+		std::cerr << header_to_string(emu_fs->header, 0) << std::endl;
+		std::cerr << "Exit: 717" << std::endl;
+		return 717;
+	}
+
+	emu_fs.reset();
+
+	fsck_status = 0;
+	err = EMU::FS::fsck(EMU_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 718);
+		return 718;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "New FS failed fsck!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 719" << std::endl;
+		return 719;
+	}
+
+	std::filesystem::remove(EMU_FS);
+	/*------------------------------End of big FS-----------------------------*/
+
+	return 0;
+}
+
+//Doesn't need the test FS, just mkfs
+static int defrag_tests()
+{
+	constexpr char EMU_FS[] = "defrag_fs.img";
+	constexpr char BROKEN_FS[] = "defrag_broken_fs.img";
+	constexpr char DIR_PATH[] = "/Defrag";
+	constexpr u8 FILE_CNT = 2;
+	constexpr u8 FILE_CLS_CNT = 4;
+
+	const std::string FILE_PATHS[FILE_CNT] = {"/Defrag/File A",
+		"/Defrag/File B"};
+
+	u16 err, expected_err, fsck_status, cls_val;
+	uintmax_t FAT_addr, data_end;
+
+	std::fstream fstr;
+	std::unique_ptr<u8[]> cluster, expected_cluster, image_a, image_b;
+	std::unique_ptr<EMU::FS::filesystem_t> emu_fs;
+	min_vfs::stream_t streams[FILE_CNT];
+	min_vfs::defrag_stats_t stats;
+
+	/*-------------------------------Data setup-------------------------------*/
+	for(const char *const path: {EMU_FS, BROKEN_FS})
+		if(std::filesystem::exists(path)) std::filesystem::remove_all(path);
+
+	std::ofstream(EMU_FS).close();
+	std::filesystem::resize_file(EMU_FS, EXPECTED_HEADER.block_cnt
+		* EMU::FS::BLK_SIZE);
+
+	err = EMU::FS::mkfs(EMU_FS, "Test defrag E-MU FS");
+	if(err)
+	{
+		print_unexpected_err(err, 720);
+		return 720;
+	}
+
+	try
+	{
+		emu_fs = std::make_unique<EMU::FS::filesystem_t>(EMU_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 721" << std::endl;
+		return 721;
+	}
+
+	err = emu_fs->mkdir(DIR_PATH);
+	if(err)
+	{
+		print_unexpected_err(err, 722);
+		return 722;
+	}
+
+	for(u8 i = 0; i < FILE_CNT; i++)
+	{
+		err = emu_fs->fopen(FILE_PATHS[i].c_str(), streams[i]);
+		if(err)
+		{
+			print_unexpected_err(err, 723);
+			return 723;
+		}
+	}
+
+	//A cluster at a time, taking turns, so no two clusters in a row match
+	cluster = std::make_unique<u8[]>(CLUSTER_SIZE);
+
+	for(u8 i = 0; i < FILE_CLS_CNT; i++)
+	{
+		for(u8 j = 0; j < FILE_CNT; j++)
+		{
+			std::memset(cluster.get(), j * FILE_CLS_CNT + i + 1, CLUSTER_SIZE);
+
+			err = streams[j].write(cluster.get(), CLUSTER_SIZE);
+			if(err)
+			{
+				print_unexpected_err(err, 724);
+				return 724;
+			}
+		}
+	}
+
+	for(u8 i = 0; i < FILE_CNT; i++) streams[i].close();
+
+	FAT_addr = emu_fs->header.FAT_blk_addr * EMU::FS::BLK_SIZE;
+	data_end = emu_fs->header.data_sctn_blk_addr * EMU::FS::BLK_SIZE
+		+ FILE_CNT * FILE_CLS_CNT * CLUSTER_SIZE;
+
+	emu_fs.reset();
+
+	std::filesystem::copy_file(EMU_FS, BROKEN_FS);
+	/*----------------------------End of data setup---------------------------*/
+
+	err = EMU::FS::defrag(EMU_FS, stats);
+	if(err)
+	{
+		print_unexpected_err(err, 725);
+		return 725;
+	}
+
+	if(stats.files != FILE_CNT || stats.fragments_before != FILE_CNT
+		* FILE_CLS_CNT || stats.fragments_after != FILE_CNT
+		|| !stats.clusters_moved)
+	{
+		std::cerr << "Bad defrag stats!!!" << std::endl;
+		std::cerr << "Files: " << stats.files << std::endl;
+		std::cerr << "Fragments: " << stats.fragments_before << " -> "
+			<< stats.fragments_after << std::endl;
+		std::cerr << "Clusters moved: " << stats.clusters_moved << std::endl;
+		std::cerr << "Exit: 726" << std::endl;
+		return 726;
+	}
+
+	try
+	{
+		emu_fs = std::make_unique<EMU::FS::filesystem_t>(EMU_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 727" << std::endl;
+		return 727;
+	}
+
+	expected_cluster = std::make_unique<u8[]>(CLUSTER_SIZE);
+
+	for(u8 i = 0; i < FILE_CNT; i++)
+	{
+		err = emu_fs->fopen(FILE_PATHS[i].c_str(), streams[i]);
+		if(err)
+		{
+			print_unexpected_err(err, 728);
+			return 728;
+		}
+
+		for(u8 j = 0; j < FILE_CLS_CNT; j++)
+		{
+			std::memset(expected_cluster.get(), i * FILE_CLS_CNT + j + 1,
+						CLUSTER_SIZE);
+
+			err = streams[i].read(cluster.get(), CLUSTER_SIZE);
+			if(err)
+			{
+				print_unexpected_err(err, 729);
+				return 729;
+			}
+
+			if(std::memcmp(cluster.get(), expected_cluster.get(),
+				CLUSTER_SIZE))
+			{
+				std::cerr << "Data mismatch after defrag!!!" << std::endl;
+				std::cerr << "File: " << FILE_PATHS[i] << ", cluster: "
+					<< (u16)j << std::endl;
+				std::cerr << "Exit: 730" << std::endl;
+				return 730;
+			}
+		}
+
+		streams[i].close();
+	}
+
+	emu_fs.reset();
+
+	fsck_status = 0;
+	err = EMU::FS::fsck(EMU_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 731);
+		return 731;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck found errors after defrag!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 732" << std::endl;
+		return 732;
+	}
+
+	/*---------------------Chain that runs into a free cluster-----------------*/
+	//Whichever chain ends first, its last cluster now looks free
+	fstr.open(BROKEN_FS, std::ios_base::binary | std::ios_base::in
+		| std::ios_base::out);
+
+	for(u16 i = EMU::FS::FAT_ATTRS.DATA_MIN; true; i++)
+	{
+		fstr.seekg(FAT_addr + i * 2);
+		fstr.read((char*)&cls_val, 2);
+
+		if constexpr(EMU::FS::ENDIANNESS != std::endian::native)
+			cls_val = std::byteswap(cls_val);
+
+		if(!fstr.good() || i > FILE_CNT * FILE_CLS_CNT)
+		{
+			std::cerr << "No chain end in the FAT!!!" << std::endl;
+			std::cerr << "Exit: 733" << std::endl;
+			return 733;
+		}
+
+		if(cls_val != EMU::FS::FAT_ATTRS.END_OF_CHAIN) continue;
+
+		cls_val = EMU::FS::FAT_ATTRS.FREE_CLUSTER;
+		fstr.seekp(FAT_addr + i * 2);
+		fstr.write((char*)&cls_val, 2);
+		break;
+	}
+
+	image_a = std::make_unique<u8[]>(data_end);
+	fstr.seekg(0);
+	fstr.read((char*)image_a.get(), data_end);
+	fstr.close();
+
+	expected_err = ret_val_setup(FAT_utils::LIBRARY_ID,
+								 (u8)FAT_utils::ERR::BAD_CHAIN_END);
+	err = EMU::FS::defrag(BROKEN_FS, stats);
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 734);
+		return 734;
+	}
+
+	image_b = std::make_unique<u8[]>(data_end);
+	fstr.open(BROKEN_FS, std::ios_base::binary | std::ios_base::in);
+	fstr.read((char*)image_b.get(), data_end);
+	fstr.close();
+
+	if(std::memcmp(image_a.get(), image_b.get(), data_end))
+	{
+		std::cerr << "Refused defrag still changed the FS!!!" << std::endl;
+		std::cerr << "Exit: 735" << std::endl;
+		return 735;
+	}
+	/*------------------End of chain that runs into a free cluster-------------*/
+
+	for(const char *const path: {EMU_FS, BROKEN_FS})
+		std::filesystem::remove(path);
+
+	return 0;
+}
+
+static int bank_list_tests()
+{
+	constexpr char EMU_FS[] = "bank_list_fs.img";
+	constexpr char DIR_PATH[] = "/Banks";
+	constexpr char BANK_PATH[] = "/Banks/Bank";
+	constexpr char SAMPLES_PATH[] = "/Banks/Bank/Samples";
+
+	const EMU::bank::layout_t &layout = EMU::bank::LAYOUTS[0];
+	//No presets, a single sample with a single frame in it
+	const u32 sample_addr = layout.preset_sctn_addr;
+	const u32 bank_size = sample_addr + EMU::bank::SAMPLE_HEADER_SIZE + 2;
+
+	u16 err, expected_err;
+	uintmax_t bank_addr;
+
+	std::unique_ptr<u8[]> bank;
+	std::unique_ptr<EMU::FS::filesystem_t> emu_fs;
+	min_vfs::stream_t stream;
+	std::vector<min_vfs::dentry_t> dentries;
+
+	/*-------------------------------Data setup-------------------------------*/
+	if(std::filesystem::exists(EMU_FS)) std::filesystem::remove_all(EMU_FS);
+
+	std::ofstream(EMU_FS).close();
+	std::filesystem::resize_file(EMU_FS, EXPECTED_HEADER.block_cnt
+		* EMU::FS::BLK_SIZE);
+
+	err = EMU::FS::mkfs(EMU_FS, "Test bank E-MU FS");
+	if(err)
+	{
+		print_unexpected_err(err, 736);
+		return 736;
+	}
+
+	try
+	{
+		emu_fs = std::make_unique<EMU::FS::filesystem_t>(EMU_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 737" << std::endl;
+		return 737;
+	}
+
+	bank = std::make_unique<u8[]>(bank_size);
+	std::memset(bank.get(), 0, bank_size);
+	std::memcpy(bank.get(), layout.signature, std::strlen(layout.signature));
+	std::memset(bank.get() + sample_addr, ' ', EMU::bank::NAME_LEN);
+	std::memcpy(bank.get() + sample_addr, "Kick", 4);
+
+	for(u8 i = 0; i < 4; i++)
+	{
+		bank[layout.sample_table_addr + i] =
+			EMU::bank::SAMPLE_ADDR_BIAS >> (i * 8);
+		bank[layout.sample_table_addr + 4 + i] = (EMU::bank::SAMPLE_ADDR_BIAS
+			+ EMU::bank::SAMPLE_HEADER_SIZE + 2) >> (i * 8);
+	}
+
+	err = emu_fs->mkdir(DIR_PATH);
+	if(!err) err = emu_fs->fopen(BANK_PATH, stream);
+	if(!err) err = stream.write(bank.get(), bank_size);
+	if(!err) err = stream.close();
+	if(err)
+	{
+		print_unexpected_err(err, 738);
+		return 738;
+	}
+	/*-------------------------------Data setup-------------------------------*/
+
+	/*-------------------------------Cached list------------------------------*/
+	for(u8 i = 0; i < 2; i++)
+	{
+		dentries.clear();
+		err = emu_fs->list(SAMPLES_PATH, dentries, false);
+		if(err)
+		{
+			print_unexpected_err(err, 739);
+			return 739;
+		}
+
+		if(dentries.size() != 1 || dentries[0].fname != "0-Kick"
+			|| emu_fs->banks.size() != 1)
+		{
+			std::cerr << "Bad bank listing!!!" << std::endl;
+			std::cerr << "Exit: 740" << std::endl;
+			return 740;
+		}
+	}
+
+	bank_addr = emu_fs->banks.begin()->first;
+	/*-------------------------------Cached list------------------------------*/
+
+	/*------------------------------Bank as a dir-----------------------------*/
+	dentries.clear();
+	err = emu_fs->list(BANK_PATH, dentries, false);
+	if(err)
+	{
+		print_unexpected_err(err, 746);
+		return 746;
+	}
+
+	if(dentries.size() != 2 || dentries[0].fname != "Presets"
+		|| dentries[1].fname != "Samples"
+		|| dentries[0].ftype != min_vfs::ftype_t::dir
+		|| dentries[1].ftype != min_vfs::ftype_t::dir)
+	{
+		std::cerr << "Bank's dirs not listed!!!" << std::endl;
+		std::cerr << "Exit: 747" << std::endl;
+		return 747;
+	}
+
+	//get_dir still gets the file
+	dentries.clear();
+	err = emu_fs->list(BANK_PATH, dentries, true);
+	if(err || dentries.size() != 1 || dentries[0].fname != "0-Bank"
+		|| dentries[0].ftype != min_vfs::ftype_t::file)
+	{
+		std::cerr << "Bank file not listed!!!" << std::endl;
+		std::cerr << "Error: " << err << std::endl;
+		std::cerr << "Exit: 748" << std::endl;
+		return 748;
+	}
+	/*------------------------------Bank as a dir-----------------------------*/
+
+	/*--------------------------Dropped on data write-------------------------*/
+	//Opening writes the entry, so the bank has to be looked into after that
+	err = emu_fs->fopen(BANK_PATH, stream);
+	if(!err) err = emu_fs->list(SAMPLES_PATH, dentries, false);
+	if(!err && !emu_fs->banks.contains(bank_addr))
+		err = ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NOT_FOUND);
+	if(!err) err = stream.seek(sample_addr);
+	if(!err) err = stream.write((void*)"Snare", 5);
+	if(err)
+	{
+		print_unexpected_err(err, 741);
+		return 741;
+	}
+
+	if(emu_fs->banks.contains(bank_addr))
+	{
+		std::cerr << "Bank survived a write to its file!!!" << std::endl;
+		std::cerr << "Exit: 742" << std::endl;
+		return 742;
+	}
+
+	dentries.clear();
+	err = emu_fs->list(SAMPLES_PATH, dentries, false);
+	if(err || dentries.size() != 1 || dentries[0].fname != "0-Snare")
+	{
+		std::cerr << "Stale bank listing after a write!!!" << std::endl;
+		std::cerr << "Error: " << err << std::endl;
+		std::cerr << "Exit: 743" << std::endl;
+		return 743;
+	}
+
+	stream.close();
+	/*--------------------------Dropped on data write-------------------------*/
+
+	/*-------------------------Dropped on entry write-------------------------*/
+	err = emu_fs->ftruncate(BANK_PATH, 0);
+	if(err)
+	{
+		print_unexpected_err(err, 744);
+		return 744;
+	}
+
+	expected_err = ret_val_setup(EMU::bank::LIBRARY_ID,
+								 (u8)EMU::bank::ERR::NOT_A_BANK);
+
+	dentries.clear();
+	err = emu_fs->list(SAMPLES_PATH, dentries, false);
+	if(err != expected_err || !emu_fs->banks.empty())
+	{
+		print_expected_err(expected_err, err, 745);
+		return 745;
+	}
+
+	//Not a bank anymore, so it's just a file again
+	dentries.clear();
+	err = emu_fs->list(BANK_PATH, dentries, false);
+	if(err || dentries.size() != 1
+		|| dentries[0].ftype != min_vfs::ftype_t::file)
+	{
+		std::cerr << "Non-bank file not listed!!!" << std::endl;
+		std::cerr << "Error: " << err << std::endl;
+		std::cerr << "Exit: 749" << std::endl;
+		return 749;
+	}
+	/*-------------------------Dropped on entry write-------------------------*/
+
+	emu_fs.reset();
+	std::filesystem::remove(EMU_FS);
+
+	return 0;
+}
+
 int main()
 {
 	int err;
@@ -7071,6 +7693,24 @@ int main()
 	std::cout << "fsck tests OK!" << std::endl;
 	std::cout << std::endl;
 
+	std::cout << "mkfs tests..." << std::endl;
+	err = mkfs_tests();
+	if(err) return err;
+	std::cout << "mkfs tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Defrag tests..." << std::endl;
+	err = defrag_tests();
+	if(err) return err;
+	std::cout << "Defrag tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Bank list tests..." << std::endl;
+	err = bank_list_tests();
+	if(err) return err;
+	std::cout << "Bank list tests OK!" << std::endl;
+	std::cout << std::endl;
+
 	std::cout << "Mount..." << std::endl;
 	try
 	{
@@ -145,6 +145,9 @@ void print_fsck_status(const u16 fsck_status)
 
 	if(fsck_status & (u16)EMU::FS::FSCK_STATUS::BAD_FILE)
 		std::cout << "\tBad file." << std::endl;
+
+	if(fsck_status & (u16)EMU::FS::FSCK_STATUS::LOST_CLUSTERS)
+		std::cout << "\tLost clusters." << std::endl;
 }
 
 bool dircmp(const EMU::FS::Dir_t &a, const EMU::FS::Dir_t &b)
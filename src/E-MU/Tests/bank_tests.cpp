@@ -0,0 +1,499 @@
+﻿#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+
+#include "Utils/ints.hpp"
+#include "Utils/utils.hpp"
+#include "min_vfs/min_vfs_base.hpp"
+#include "min_vfs/min_vfs.hpp"
+#include "E-MU/bank.hpp"
+
+using namespace EMU::bank;
+
+constexpr uintmax_t BANK_SIZE = 30 * 1024 * 1024;
+constexpr u32 PRESET_SIZES[] = {100, 200};
+constexpr u32 MONO_FRAMES = 1000;
+constexpr u32 STEREO_FRAMES = 4000;
+
+static void put_u32(std::vector<u8> &bank, const uintmax_t addr, const u32 val)
+{
+	for(u8 i = 0; i < 4; i++) bank[addr + i] = val >> (i * 8);
+}
+
+static void put_name(std::vector<u8> &bank, const uintmax_t addr,
+					 const char *name)
+{
+	std::memset(bank.data() + addr, ' ', NAME_LEN);
+	std::memcpy(bank.data() + addr, name, std::strlen(name));
+}
+
+static s16 frame_val(const u8 channel, const u32 frame)
+{
+	return (s16)(channel * 10000 + frame);
+}
+
+/*3X bank with two presets and three samples: mono, stereo and one mono
+ *sample taking up the rest of the 30 MB.*/
+static std::vector<u8> make_bank()
+{
+	const layout_t &layout = LAYOUTS[0];
+	std::vector<u8> bank(BANK_SIZE, 0);
+	u32 addr;
+
+	std::memcpy(bank.data(), layout.signature, std::strlen(layout.signature));
+	put_name(bank, NAME_ADDR, "Test bank");
+
+	addr = 0;
+	for(u8 i = 0; i < 2; i++)
+	{
+		put_u32(bank, layout.preset_table_addr + i * 4, addr);
+		put_name(bank, layout.preset_sctn_addr + addr,
+				 i ? "Pad" : "Drums");
+		addr += PRESET_SIZES[i];
+	}
+	put_u32(bank, layout.preset_table_addr + 2 * 4, addr);
+
+	const uintmax_t sample_sctn = layout.preset_sctn_addr + addr;
+	const u32 sizes[] =
+	{
+		SAMPLE_HEADER_SIZE + MONO_FRAMES * 2,
+		SAMPLE_HEADER_SIZE + STEREO_FRAMES * 4,
+		(u32)(BANK_SIZE - sample_sctn) - 2 * SAMPLE_HEADER_SIZE
+			- MONO_FRAMES * 2 - STEREO_FRAMES * 4
+	};
+	const char *names[] = {"Kick", "Strings", "Big one"};
+
+	addr = SAMPLE_ADDR_BIAS;
+	for(u8 i = 0; i < 3; i++)
+	{
+		const uintmax_t hdr = sample_sctn + addr - SAMPLE_ADDR_BIAS;
+		const u8 channels = i == 1 ? 2 : 1;
+		const u32 frames = (sizes[i] - SAMPLE_HEADER_SIZE) / 2 / channels;
+
+		put_u32(bank, layout.sample_table_addr + i * 4, addr);
+		put_name(bank, hdr, names[i]);
+		put_u32(bank, hdr + SAMPLE_RATE_OFFSET, 44100);
+		put_u32(bank, hdr + SAMPLE_FORMAT_OFFSET, i == 1 ? 0x00700001
+			: 0x00300001);
+
+		if(i < 2)
+			for(u8 c = 0; c < channels; c++)
+				for(u32 f = 0; f < frames; f++)
+				{
+					const u16 val = frame_val(c, f);
+					const uintmax_t pos = hdr + SAMPLE_HEADER_SIZE
+						+ ((uintmax_t)c * frames + f) * 2;
+
+					bank[pos] = val;
+					bank[pos + 1] = val >> 8;
+				}
+
+		addr += sizes[i];
+	}
+	put_u32(bank, layout.sample_table_addr + 3 * 4, addr);
+
+	return bank;
+}
+
+static reader_t counting_reader(const std::vector<u8> &bank,
+								uintmax_t &bytes_read)
+{
+	return [&bank, &bytes_read](uintmax_t pos, uintmax_t len,
+								void *dst) -> u16
+	{
+		if(pos > bank.size() || len > bank.size() - pos)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::END_OF_FILE);
+
+		std::memcpy(dst, bank.data() + pos, len);
+		bytes_read += len;
+		return 0;
+	};
+}
+
+static int open_tests()
+{
+	u16 err;
+	uintmax_t bytes_read = 0;
+	bank_t bank;
+
+	std::vector<u8> data = make_bank();
+
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err)
+	{
+		std::cerr << "Open failed: " << err << std::endl;
+		std::cerr << "Exit: 1" << std::endl;
+		return 1;
+	}
+
+	if(bank.name != "Test bank" || bank.presets.size() != 2
+		|| bank.samples.size() != 3)
+	{
+		std::cerr << "Bad bank: " << bank.name << ", "
+			<< bank.presets.size() << " presets, " << bank.samples.size()
+			<< " samples" << std::endl;
+		std::cerr << "Exit: 2" << std::endl;
+		return 2;
+	}
+
+	if(bytes_read > 16 * 1024)
+	{
+		std::cerr << "Open read " << bytes_read << " bytes" << std::endl;
+		std::cerr << "Exit: 3" << std::endl;
+		return 3;
+	}
+
+	data[0] = 'X';
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err != ret_val_setup(LIBRARY_ID, (u8)ERR::NOT_A_BANK))
+	{
+		std::cerr << "Expected NOT_A_BANK, got " << err << std::endl;
+		std::cerr << "Exit: 4" << std::endl;
+		return 4;
+	}
+	data[0] = LAYOUTS[0].signature[0];
+
+	//Second sample ends before it starts
+	put_u32(data, LAYOUTS[0].sample_table_addr + 2 * 4, SAMPLE_ADDR_BIAS);
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err != ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_OFFSET_TABLE))
+	{
+		std::cerr << "Expected BAD_OFFSET_TABLE, got " << err << std::endl;
+		std::cerr << "Exit: 5" << std::endl;
+		return 5;
+	}
+
+	return 0;
+}
+
+static int list_tests()
+{
+	u16 err;
+	uintmax_t bytes_read = 0;
+	bank_t bank;
+	std::vector<min_vfs::dentry_t> dentries;
+
+	const std::vector<u8> data = make_bank();
+
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err)
+	{
+		std::cerr << "Open failed: " << err << std::endl;
+		std::cerr << "Exit: 16" << std::endl;
+		return 16;
+	}
+
+	err = bank.list(obj_type_e::PRESET, dentries);
+	if(err || dentries.size() != 2 || dentries[0].fname != "0-Drums"
+		|| dentries[1].fname != "1-Pad"
+		|| dentries[1].fsize != PRESET_SIZES[1])
+	{
+		std::cerr << "Bad preset listing" << std::endl;
+		std::cerr << "Exit: 17" << std::endl;
+		return 17;
+	}
+
+	dentries.clear();
+	err = bank.list(obj_type_e::SAMPLE, dentries);
+	if(err || dentries.size() != 3 || dentries[0].fname != "0-Kick"
+		|| dentries[1].fname != "1-Strings"
+		|| dentries[2].fname != "2-Big one"
+		|| dentries[1].fsize != STEREO_FRAMES * 4)
+	{
+		std::cerr << "Bad sample listing" << std::endl;
+		std::cerr << "Exit: 18" << std::endl;
+		return 18;
+	}
+
+	//Tables plus a name per object
+	if(bytes_read > 16 * 1024)
+	{
+		std::cerr << "Listing read " << bytes_read << " bytes" << std::endl;
+		std::cerr << "Exit: 19" << std::endl;
+		return 19;
+	}
+
+	//Names only get read once
+	bytes_read = 0;
+	dentries.clear();
+	err = bank.list(obj_type_e::SAMPLE, dentries);
+	if(err || bytes_read)
+	{
+		std::cerr << "Second listing read " << bytes_read << " bytes"
+			<< std::endl;
+		std::cerr << "Exit: 20" << std::endl;
+		return 20;
+	}
+
+	return 0;
+}
+
+static int read_frames_tests()
+{
+	u16 err;
+	uintmax_t bytes_read = 0;
+	bank_t bank;
+	sample_info_t info;
+	std::vector<s16> frames;
+
+	const std::vector<u8> data = make_bank();
+
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err)
+	{
+		std::cerr << "Open failed: " << err << std::endl;
+		std::cerr << "Exit: 32" << std::endl;
+		return 32;
+	}
+
+	err = bank.get_sample_info(1, info);
+	if(err || info.sample_rate != 44100 || info.channels != 2
+		|| info.frame_cnt != STEREO_FRAMES)
+	{
+		std::cerr << "Bad sample info" << std::endl;
+		std::cerr << "Exit: 33" << std::endl;
+		return 33;
+	}
+
+	bytes_read = 0;
+	frames.resize(100 * 2);
+	err = bank.read_frames(1, 1234, 100, frames.data());
+	if(err)
+	{
+		std::cerr << "Read frames failed: " << err << std::endl;
+		std::cerr << "Exit: 34" << std::endl;
+		return 34;
+	}
+
+	for(u32 i = 0; i < 100; i++)
+	{
+		if(frames[i * 2] != frame_val(0, 1234 + i)
+			|| frames[i * 2 + 1] != frame_val(1, 1234 + i))
+		{
+			std::cerr << "Frame mismatch at " << i << std::endl;
+			std::cerr << "Exit: 35" << std::endl;
+			return 35;
+		}
+	}
+
+	if(bytes_read != 100 * 2 * 2)
+	{
+		std::cerr << "Read " << bytes_read << " bytes for 100 frames"
+			<< std::endl;
+		std::cerr << "Exit: 36" << std::endl;
+		return 36;
+	}
+
+	frames.resize(MONO_FRAMES);
+	err = bank.read_frames(0, 0, MONO_FRAMES, frames.data());
+	if(err || frames[0] != frame_val(0, 0)
+		|| frames[MONO_FRAMES - 1] != frame_val(0, MONO_FRAMES - 1))
+	{
+		std::cerr << "Bad mono frames" << std::endl;
+		std::cerr << "Exit: 37" << std::endl;
+		return 37;
+	}
+
+	err = bank.read_frames(0, MONO_FRAMES - 1, 2, frames.data());
+	if(err != ret_val_setup(min_vfs::LIBRARY_ID,
+		(u8)min_vfs::ERR::END_OF_FILE))
+	{
+		std::cerr << "Expected END_OF_FILE, got " << err << std::endl;
+		std::cerr << "Exit: 38" << std::endl;
+		return 38;
+	}
+
+	err = bank.read_frames(3, 0, 1, frames.data());
+	if(err != ret_val_setup(LIBRARY_ID, (u8)ERR::NO_SUCH_OBJECT))
+	{
+		std::cerr << "Expected NO_SUCH_OBJECT, got " << err << std::endl;
+		std::cerr << "Exit: 39" << std::endl;
+		return 39;
+	}
+
+	return 0;
+}
+
+constexpr char EXPORT_DIR[] = "bank_export";
+
+//Checks a WAV's header, then its frames against frame_val
+static int check_wav(const std::filesystem::path &path, const u8 channels,
+					 const u8 first_channel, const u32 frame_cnt,
+					 const int err_base)
+{
+	u8 header[WAV_HEADER_SIZE];
+	u32 val;
+	u16 frame;
+
+	std::ifstream wav(path, std::ios_base::binary);
+
+	wav.read((char*)header, WAV_HEADER_SIZE);
+
+	const u32 data_size = frame_cnt * channels * 2;
+
+	std::memcpy(&val, header + 40, 4);
+
+	if(!wav.good() || std::memcmp(header, "RIFF", 4)
+		|| std::memcmp(header + 8, "WAVEfmt ", 8) || header[22] != channels
+		|| val != data_size || std::filesystem::file_size(path)
+		!= WAV_HEADER_SIZE + data_size)
+	{
+		std::cerr << "Bad WAV header in " << path << std::endl;
+		std::cerr << "Exit: " << err_base << std::endl;
+		return err_base;
+	}
+
+	for(u32 i = 0; i < frame_cnt; i++)
+	{
+		for(u8 c = 0; c < channels; c++)
+		{
+			wav.read((char*)&frame, 2);
+			frame = std::endian::native == std::endian::little ? frame
+				: std::byteswap(frame);
+
+			if((s16)frame != frame_val(first_channel + c, i))
+			{
+				std::cerr << "Bad frame " << i << " in " << path << std::endl;
+				std::cerr << "Exit: " << err_base + 1 << std::endl;
+				return err_base + 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int export_tests()
+{
+	u16 err;
+	int res;
+	uintmax_t bytes_read = 0;
+	bank_t bank;
+
+	const std::vector<u8> data = make_bank();
+	const std::filesystem::path export_dir =
+		std::filesystem::current_path() / EXPORT_DIR;
+
+	std::filesystem::remove_all(export_dir);
+	std::filesystem::create_directory(export_dir);
+
+	err = bank.open(counting_reader(data, bytes_read), data.size());
+	if(err)
+	{
+		std::cerr << "Open failed: " << err << std::endl;
+		std::cerr << "Exit: 48" << std::endl;
+		return 48;
+	}
+
+	//Not a multiple of the kernels' width, so the tails get some use too
+	bank.io_size = 1002;
+
+	{
+		min_vfs::stream_t dst;
+
+		err = min_vfs::fopen(export_dir / "stereo.wav", dst);
+		if(!err) err = bank.export_wav(1, dst);
+		if(!err) err = dst.close();
+		if(err)
+		{
+			std::cerr << "Export failed: " << err << std::endl;
+			std::cerr << "Exit: 49" << std::endl;
+			return 49;
+		}
+	}
+
+	res = check_wav(export_dir / "stereo.wav", 2, 0, STEREO_FRAMES, 50);
+	if(res) return res;
+
+	std::atomic<u32> opened = 0;
+
+	bytes_read = 0;
+	err = bank.export_wavs({0, 1}, [&](const std::string &fname,
+									   min_vfs::stream_t &dst) -> u16
+	{
+		opened++;
+		return min_vfs::fopen(export_dir / fname, dst);
+	}, true, 3);
+
+	if(err || opened != 3)
+	{
+		std::cerr << "Batch export failed: " << err << ", " << opened
+			<< " files" << std::endl;
+		std::cerr << "Exit: 52" << std::endl;
+		return 52;
+	}
+
+	res = check_wav(export_dir / "0-Kick.wav", 1, 0, MONO_FRAMES, 53);
+	if(res) return res;
+
+	res = check_wav(export_dir / "1-Strings-L.wav", 1, 0, STEREO_FRAMES, 55);
+	if(res) return res;
+
+	res = check_wav(export_dir / "1-Strings-R.wav", 1, 1, STEREO_FRAMES, 57);
+	if(res) return res;
+
+	//The frames, plus the one header the first export didn't need
+	if(bytes_read != SAMPLE_HEADER_SIZE + (MONO_FRAMES + STEREO_FRAMES * 2)
+		* 2)
+	{
+		std::cerr << "Batch export read " << bytes_read << " bytes"
+			<< std::endl;
+		std::cerr << "Exit: 59" << std::endl;
+		return 59;
+	}
+
+	err = bank.export_wavs({0, 7}, [&](const std::string &fname,
+									   min_vfs::stream_t &dst) -> u16
+	{
+		return min_vfs::fopen(export_dir / fname, dst);
+	});
+
+	if(err != ret_val_setup(LIBRARY_ID, (u8)ERR::NO_SUCH_OBJECT))
+	{
+		std::cerr << "Expected NO_SUCH_OBJECT, got " << err << std::endl;
+		std::cerr << "Exit: 60" << std::endl;
+		return 60;
+	}
+
+	std::filesystem::remove_all(export_dir);
+
+	return 0;
+}
+
+int main()
+{
+	int err;
+
+	std::cout << "Open tests..." << std::endl;
+	err = open_tests();
+	if(err) return err;
+	std::cout << "Open OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "List tests..." << std::endl;
+	err = list_tests();
+	if(err) return err;
+	std::cout << "List OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Read frames tests..." << std::endl;
+	err = read_frames_tests();
+	if(err) return err;
+	std::cout << "Read frames OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Export tests..." << std::endl;
+	err = export_tests();
+	if(err) return err;
+	std::cout << "Export OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "ALL TESTS OK!!!" << std::endl;
+
+	return 0;
+}
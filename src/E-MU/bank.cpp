@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Utils/ints.hpp"
+#include "Utils/utils.hpp"
+#include "Utils/pcm_util.hpp"
+#include "Utils/job_util.hpp"
+#include "min_vfs/min_vfs_base.hpp"
+#include "bank.hpp"
+
+namespace EMU::bank
+{
+	constexpr std::endian ENDIANNESS = std::endian::little;
+
+	template <typename T>
+	static T get_int(const u8 *src)
+	{
+		T res;
+
+		std::memcpy(&res, src, sizeof(T));
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			res = std::byteswap(res);
+
+		return res;
+	}
+
+	static std::string clean_name(const u8 *src)
+	{
+		std::string res((const char*)src, NAME_LEN);
+
+		const size_t end = res.find_last_not_of(std::string(" \0", 2));
+		res.resize(end == std::string::npos ? 0 : end + 1);
+
+		return res;
+	}
+
+	reader_t stream_reader(min_vfs::stream_t &stream)
+	{
+		const std::shared_ptr<std::mutex> mtx = std::make_shared<std::mutex>();
+
+		return [&stream, mtx](uintmax_t pos, uintmax_t len, void *dst) -> u16
+		{
+			u16 err;
+
+			mtx->lock();
+			err = stream.seek(pos);
+			if(!err) err = stream.read(dst, len);
+			mtx->unlock();
+
+			return err;
+		};
+	}
+
+	std::string obj_to_fname(const obj_t &obj)
+	{
+		return std::to_string(obj.slot) + "-" + obj.name;
+	}
+
+	/*entry_cnt includes the end of the last object. Returns the end of the
+	 *last object (or entry 0 if there are none, which is fine as long as
+	 *nothing comes after it) through end.*/
+	static u16 parse_table(const u8 *table, const u16 entry_cnt,
+						   const uintmax_t base, const u32 bias,
+						   const uintmax_t bank_size, const u32 min_size,
+						   std::vector<obj_t> &objs, u32 &end)
+	{
+		u32 next;
+
+		end = get_int<u32>(table);
+
+		for(u16 i = 0; i < entry_cnt - 1; i++)
+		{
+			next = get_int<u32>(table + (i + 1) * 4);
+			if(!next) break;
+
+			if(next < end || end < bias)
+				return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_OFFSET_TABLE);
+
+			if(next > end)
+			{
+				if(next - end < min_size)
+					return ret_val_setup(LIBRARY_ID,
+										 (u8)ERR::BAD_OFFSET_TABLE);
+
+				objs.emplace_back(i, base + end - bias, next - end,
+								  std::string());
+			}
+
+			end = next;
+		}
+
+		if(!objs.empty() && base + end - bias > bank_size)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_OFFSET_TABLE);
+
+		return 0;
+	}
+
+	uint16_t bank_t::open(reader_t reader, const uintmax_t bank_size)
+	{
+		u8 sig[NAME_ADDR + NAME_LEN];
+		u16 err;
+		u32 presets_end, samples_end;
+
+		this->reader = reader;
+		layout = nullptr;
+		presets.clear();
+		samples.clear();
+		sample_infos.clear();
+		presets_indexed = false;
+		samples_indexed = false;
+
+		if(bank_size < sizeof(sig))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NOT_A_BANK);
+
+		err = reader(0, sizeof(sig), sig);
+		if(err) return err;
+
+		for(const layout_t &cur: LAYOUTS)
+		{
+			if(!std::memcmp(sig, cur.signature, std::strlen(cur.signature)))
+			{
+				layout = &cur;
+				break;
+			}
+		}
+
+		if(!layout || bank_size < layout->preset_sctn_addr)
+		{
+			layout = nullptr;
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NOT_A_BANK);
+		}
+
+		name = clean_name(sig + NAME_ADDR);
+
+		//Both tables in one go, they're right next to each other
+		const u32 tables_len = layout->preset_sctn_addr
+			- layout->preset_table_addr;
+		const std::unique_ptr<u8[]> tables =
+			std::make_unique<u8[]>(tables_len);
+
+		err = reader(layout->preset_table_addr, tables_len, tables.get());
+		if(err) return err;
+
+		err = parse_table(tables.get(), MAX_PRESETS + 1,
+						  layout->preset_sctn_addr, 0, bank_size, 1,
+						  presets, presets_end);
+		if(err) return err;
+
+		err = parse_table(tables.get() + (layout->sample_table_addr
+			- layout->preset_table_addr), MAX_SAMPLES,
+			(uintmax_t)layout->preset_sctn_addr + presets_end,
+			SAMPLE_ADDR_BIAS, bank_size, SAMPLE_HEADER_SIZE, samples,
+			samples_end);
+		if(err) return err;
+
+		sample_infos.resize(samples.size(), {0, 0, 0});
+
+		return 0;
+	}
+
+	uint16_t bank_t::open(min_vfs::stream_t &stream,
+						  const uintmax_t bank_size)
+	{
+		return open(stream_reader(stream), bank_size);
+	}
+
+	static u16 index_names(reader_t &reader, std::vector<obj_t> &objs)
+	{
+		u8 buffer[NAME_LEN];
+		u16 err;
+
+		for(obj_t &obj: objs)
+		{
+			if(!obj.name.empty()) continue;
+
+			err = reader(obj.addr, NAME_LEN, buffer);
+			if(err) return err;
+
+			obj.name = clean_name(buffer);
+		}
+
+		return 0;
+	}
+
+	uint16_t bank_t::list(const obj_type_e type,
+						  std::vector<min_vfs::dentry_t> &dentries)
+	{
+		u16 err;
+
+		if(!layout)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::INVALID_STATE);
+
+		const bool is_sample = type == obj_type_e::SAMPLE;
+		std::vector<obj_t> &objs = is_sample ? samples : presets;
+		bool &indexed = is_sample ? samples_indexed : presets_indexed;
+
+		if(!indexed)
+		{
+			err = index_names(reader, objs);
+			if(err) return err;
+
+			indexed = true;
+		}
+
+		dentries.reserve(dentries.size() + objs.size());
+
+		for(const obj_t &obj: objs)
+			dentries.emplace_back
+			(
+				obj_to_fname(obj),
+				obj.size - (is_sample ? SAMPLE_HEADER_SIZE : 0),
+				0, //ctime
+				0, //mtime
+				0, //atime
+				min_vfs::ftype_t::file
+			);
+
+		return 0;
+	}
+
+	uint16_t bank_t::get_sample_info(const u16 idx, sample_info_t &info)
+	{
+		u8 buffer[SAMPLE_HEADER_SIZE];
+		u16 err;
+
+		if(idx >= samples.size())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NO_SUCH_OBJECT);
+
+		sample_info_t &cached = sample_infos[idx];
+
+		if(!cached.channels)
+		{
+			obj_t &sample = samples[idx];
+
+			err = reader(sample.addr, SAMPLE_HEADER_SIZE, buffer);
+			if(err) return err;
+
+			if(sample.name.empty()) sample.name = clean_name(buffer);
+
+			cached.sample_rate = get_int<u32>(buffer + SAMPLE_RATE_OFFSET);
+			cached.channels = get_int<u32>(buffer + SAMPLE_FORMAT_OFFSET)
+				& STEREO_FLAG ? 2 : 1;
+			cached.frame_cnt = (sample.size - SAMPLE_HEADER_SIZE)
+				/ (2 * cached.channels);
+		}
+
+		info = cached;
+
+		return 0;
+	}
+
+	/*Stereo samples keep each channel in one piece, left then right, so
+	 *each channel's share is one read.*/
+	uint16_t bank_t::read_frames(const u16 idx, const u32 first_frame,
+								 const u32 frame_cnt, s16 *dst)
+	{
+		u16 err;
+		sample_info_t info;
+
+		err = get_sample_info(idx, info);
+		if(err) return err;
+
+		if(first_frame > info.frame_cnt
+			|| frame_cnt > info.frame_cnt - first_frame)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::END_OF_FILE);
+
+		if(!frame_cnt) return 0;
+
+		const uintmax_t data_addr = samples[idx].addr + SAMPLE_HEADER_SIZE;
+
+		if(info.channels == 1)
+		{
+			err = reader(data_addr + first_frame * 2, frame_cnt * 2, dst);
+			if(err) return err;
+
+			if constexpr(ENDIANNESS != std::endian::native)
+				for(u32 i = 0; i < frame_cnt; i++)
+					dst[i] = std::byteswap(dst[i]);
+
+			return 0;
+		}
+
+		const std::unique_ptr<s16[]> channel =
+			std::make_unique<s16[]>(frame_cnt);
+
+		for(u8 c = 0; c < info.channels; c++)
+		{
+			err = reader(data_addr + ((uintmax_t)c * info.frame_cnt
+				+ first_frame) * 2, frame_cnt * 2, channel.get());
+			if(err) return err;
+
+			for(u32 i = 0; i < frame_cnt; i++)
+			{
+				s16 frame = channel[i];
+
+				if constexpr(ENDIANNESS != std::endian::native)
+					frame = std::byteswap(frame);
+
+				dst[i * info.channels + c] = frame;
+			}
+		}
+
+		return 0;
+	}
+
+	static void put_le(u8 *dst, const u32 val, const u8 len)
+	{
+		for(u8 i = 0; i < len; i++) dst[i] = val >> (i * 8);
+	}
+
+	static void build_wav_header(u8 *dst, const u8 channels,
+								 const u32 sample_rate, const u32 frame_cnt)
+	{
+		const u32 data_size = frame_cnt * channels * 2;
+
+		std::memcpy(dst, "RIFF", 4);
+		put_le(dst + 4, WAV_HEADER_SIZE - 8 + data_size, 4);
+		std::memcpy(dst + 8, "WAVEfmt ", 8);
+		put_le(dst + 16, 16, 4); //fmt chunk size
+		put_le(dst + 20, 1, 2); //PCM
+		put_le(dst + 22, channels, 2);
+		put_le(dst + 24, sample_rate, 4);
+		put_le(dst + 28, sample_rate * channels * 2, 4); //bytes per second
+		put_le(dst + 32, channels * 2, 2); //bytes per frame
+		put_le(dst + 34, 16, 2); //bits per sample
+		std::memcpy(dst + 36, "data", 4);
+		put_le(dst + 40, data_size, 4);
+	}
+
+	/*Both the bank and WAVs are little endian, so frames go through as they
+	 *are, whatever the host. Stereo gets each channel's next io_size bytes
+	 *read and interleaved into a third buffer, mono goes straight out.
+	 *Doesn't touch anything in the bank_t, so it's fine to run it from
+	 *several threads at once.*/
+	static u16 write_wav(const reader_t &reader, const u32 io_size,
+						 const uintmax_t data_addr, const sample_info_t &info,
+						 const s8 channel, min_vfs::stream_t &dst)
+	{
+		u8 header[WAV_HEADER_SIZE];
+		u16 err;
+		u32 len;
+
+		const u8 out_channels = channel < 0 ? info.channels : 1;
+		const u32 buf_frames = std::min(std::max(io_size / 2, (u32)1),
+										info.frame_cnt);
+
+		build_wav_header(header, out_channels, info.sample_rate,
+						 info.frame_cnt);
+
+		//Just a hint, drivers that can't use it grow the file as it's written
+		err = dst.fallocate(WAV_HEADER_SIZE + (uintmax_t)info.frame_cnt
+			* out_channels * 2);
+		if(err && err != ret_val_setup(min_vfs::LIBRARY_ID,
+			(u8)min_vfs::ERR::UNSUPPORTED_OPERATION))
+			return err;
+
+		err = dst.write(header, WAV_HEADER_SIZE);
+		if(err) return err;
+
+		if(!buf_frames) return 0;
+
+		const std::unique_ptr<u16[]> buffer = std::make_unique<u16[]>(
+			(uintmax_t)buf_frames * (out_channels == 1 ? 1 : 4));
+		u16 *const right = buffer.get() + buf_frames;
+		u16 *const interleaved = right + buf_frames;
+
+		for(u32 done = 0; done < info.frame_cnt; done += len)
+		{
+			len = std::min(buf_frames, info.frame_cnt - done);
+
+			if(out_channels == 1)
+			{
+				err = reader(data_addr + ((uintmax_t)std::max(channel, (s8)0)
+					* info.frame_cnt + done) * 2, len * 2, buffer.get());
+				if(err) return err;
+
+				err = dst.write(buffer.get(), len * 2);
+				if(err) return err;
+
+				continue;
+			}
+
+			err = reader(data_addr + (uintmax_t)done * 2, len * 2,
+						 buffer.get());
+			if(err) return err;
+
+			err = reader(data_addr + ((uintmax_t)info.frame_cnt + done) * 2,
+						 len * 2, right);
+			if(err) return err;
+
+			pcm_util::interleave_16(buffer.get(), right, interleaved, len);
+
+			err = dst.write(interleaved, len * 4);
+			if(err) return err;
+		}
+
+		return 0;
+	}
+
+	uint16_t bank_t::export_wav(const u16 idx, min_vfs::stream_t &dst,
+								const s8 channel)
+	{
+		u16 err;
+		sample_info_t info;
+
+		err = get_sample_info(idx, info);
+		if(err) return err;
+
+		if(channel >= info.channels)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NO_SUCH_OBJECT);
+
+		return write_wav(reader, io_size, samples[idx].addr
+			+ SAMPLE_HEADER_SIZE, info, channel, dst);
+	}
+
+	struct export_job_t
+	{
+		u16 idx;
+		s8 channel;
+		std::string fname;
+	};
+
+	/*Sample headers get read up front, one thread, so the workers only ever
+	 *read frames and never touch the bank_t's caches.*/
+	uint16_t bank_t::export_wavs(const std::vector<u16> &idxs,
+								 const open_dst_t &open_dst, const bool split,
+								 u32 thread_cnt)
+	{
+		u16 err, first_err = 0;
+		sample_info_t info;
+
+		std::vector<export_job_t> jobs;
+
+		for(const u16 idx: idxs)
+		{
+			err = get_sample_info(idx, info);
+			if(err)
+			{
+				if(!first_err) first_err = err;
+				continue;
+			}
+
+			const std::string fname = obj_to_fname(samples[idx]);
+
+			if(split && info.channels == 2)
+			{
+				jobs.emplace_back(idx, 0, fname + "-L.wav");
+				jobs.emplace_back(idx, 1, fname + "-R.wav");
+			}
+			else jobs.emplace_back(idx, -1, fname + ".wav");
+		}
+
+		err = job_util::run_jobs(jobs.size(), thread_cnt,
+			[&](const size_t i) -> u16
+		{
+			const export_job_t &job = jobs[i];
+			min_vfs::stream_t dst;
+
+			u16 job_err = open_dst(job.fname, dst);
+			if(job_err) return job_err;
+
+			job_err = write_wav(reader, io_size, samples[job.idx].addr
+				+ SAMPLE_HEADER_SIZE, sample_infos[job.idx], job.channel, dst);
+
+			const u16 close_err = dst.close();
+
+			return job_err ? job_err : close_err;
+		});
+
+		return first_err ? first_err : err;
+	}
+}
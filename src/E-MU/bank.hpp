@@ -0,0 +1,152 @@
+#ifndef EMU_BANK_HEADER
+#define EMU_BANK_HEADER
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "library_IDs.hpp"
+#include "Utils/ints.hpp"
+#include "min_vfs/min_vfs_base.hpp"
+
+/*Parser for the contents of E-MU bank files. Only the offset tables at the
+ *start of the bank get read up front; names, sample headers and sample data
+ *are read when asked for, so looking into a big bank costs kilobytes.
+ *
+ *The layout comes from third party bank tools (emu3bsd), not from anything
+ *we've been able to check here: there are no real banks in the test data.
+ *Everything that depends on it is in this header.*/
+namespace EMU::bank
+{
+	constexpr u8 LIBRARY_ID = (u8)Library_IDs::EMU_BANK;
+
+	enum class ERR: u8
+	{
+		NOT_A_BANK = 1,
+		BAD_OFFSET_TABLE,
+		NO_SUCH_OBJECT
+	};
+
+	constexpr u8 NAME_LEN = 16;
+	constexpr u32 NAME_ADDR = 16; //bank name, after the signature
+	constexpr u16 MAX_PRESETS = 256;
+	constexpr u16 MAX_SAMPLES = 1000;
+
+	/*Sample addresses are what the sampler's memory looked like, starting
+	 *at this. Relative to the end of the preset section in the file.*/
+	constexpr u32 SAMPLE_ADDR_BIAS = 0x400000;
+
+	//Sample header: name, 9 u32 params, rate, format, 16 more u32 params
+	constexpr u32 SAMPLE_RATE_OFFSET = NAME_LEN + 9 * 4;
+	constexpr u32 SAMPLE_FORMAT_OFFSET = SAMPLE_RATE_OFFSET + 4;
+	constexpr u32 SAMPLE_HEADER_SIZE = SAMPLE_FORMAT_OFFSET + 4 + 16 * 4;
+	constexpr u32 STEREO_FLAG = 0x00400000;
+
+	//Default for bank_t::io_size
+	constexpr u32 DEFAULT_IO_SIZE = 64 * 1024;
+	constexpr u8 WAV_HEADER_SIZE = 44;
+
+	/*Both tables are u32s, one entry per object plus one for the end of the
+	 *last one; the first 0 after entry 0 ends them early. Preset offsets are
+	 *relative to the preset section.*/
+	struct layout_t
+	{
+		const char *signature;
+		u32 preset_table_addr;
+		u32 sample_table_addr;
+		u32 preset_sctn_addr;
+	};
+
+	constexpr layout_t LAYOUTS[] =
+	{
+		{"EMULATOR 3X", 0x17CA, 0x1BD2, 0x2B72},
+		{"EMULATOR THS", 0x17CE, 0x1BD6, 0x2B76}
+	};
+
+	enum class obj_type_e: u8
+	{
+		PRESET,
+		SAMPLE
+	};
+
+	struct sample_info_t
+	{
+		u32 sample_rate;
+		u8 channels;
+		u32 frame_cnt; //per channel
+	};
+
+	struct obj_t
+	{
+		u16 slot;
+		u32 addr; //in the bank file
+		u32 size;
+		std::string name; //empty until indexed
+	};
+
+	//pos is relative to the start of the bank
+	typedef std::function<u16(uintmax_t pos, uintmax_t len, void *dst)>
+		reader_t;
+
+	//Opens (creates) where an exported WAV goes, see bank_t::export_wavs
+	typedef std::function<u16(const std::string &fname,
+							  min_vfs::stream_t &dst)> open_dst_t;
+
+	//Seeks and reads under a lock, so it can be shared between threads
+	reader_t stream_reader(min_vfs::stream_t &stream);
+
+	struct bank_t
+	{
+		reader_t reader;
+		const layout_t *layout = nullptr;
+		std::string name;
+		std::vector<obj_t> presets, samples;
+		std::vector<sample_info_t> sample_infos; //channels == 0: not read yet
+		bool presets_indexed = false, samples_indexed = false;
+
+		/*Sample data gets streamed out in reads of at most this many bytes
+		 *per channel. EMU::FS::filesystem_t::open_bank sets it to the
+		 *cluster size.*/
+		u32 io_size = DEFAULT_IO_SIZE;
+
+		/*Reads the signature and the offset tables, nothing else. bank_size
+		 *is only used to check the tables.*/
+		uint16_t open(reader_t reader, const uintmax_t bank_size);
+		uint16_t open(min_vfs::stream_t &stream, const uintmax_t bank_size);
+
+		//Reads every object's name the first time around
+		uint16_t list(const obj_type_e type,
+					  std::vector<min_vfs::dentry_t> &dentries);
+
+		//Only reads that sample's header, the first time. idx is the
+		//position in samples, not the slot.
+		uint16_t get_sample_info(const u16 idx, sample_info_t &info);
+
+		/*Decodes frame_cnt frames starting at first_frame into dst,
+		 *interleaved (L, R for stereo), as native s16. Only the frames
+		 *asked for get read.*/
+		uint16_t read_frames(const u16 idx, const u32 first_frame,
+							 const u32 frame_cnt, s16 *dst);
+
+		/*Writes a sample to dst as a 16 bit PCM WAV, io_size at a time;
+		 *nothing bigger than that is ever held in memory. channel < 0 gets
+		 *every channel, otherwise just that one as a mono WAV.*/
+		uint16_t export_wav(const u16 idx, min_vfs::stream_t &dst,
+							const s8 channel = -1);
+
+		/*Exports the samples at idxs, thread_cnt of them at a time (0: one
+		 *per hardware thread). Each one's WAV gets "slot-name.wav", or
+		 *"slot-name-L.wav" and "-R.wav" if split is set and it's stereo.
+		 *open_dst gets called from the worker threads, and so does reader,
+		 *which has to be fine with that. A failed export doesn't stop the
+		 *rest, the first error is what gets returned.*/
+		uint16_t export_wavs(const std::vector<u16> &idxs,
+							 const open_dst_t &open_dst,
+							 const bool split = false, u32 thread_cnt = 0);
+	};
+
+	//"slot-name", same as files in an E-MU dir
+	std::string obj_to_fname(const obj_t &obj);
+}
+#endif
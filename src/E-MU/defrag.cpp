@@ -0,0 +1,210 @@
+﻿#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <bit>
+
+#include "Utils/ints.hpp"
+#include "Utils/utils.hpp"
+#include "Utils/FAT_utils.hpp"
+#include "EMU_FS_types.hpp"
+#include "fs_common.hpp"
+#include "EMU_FS_drv.hpp"
+
+namespace EMU::FS
+{
+	//Upper bound for a single read or write while moving clusters around. Big
+	//enough for one of the largest clusters.
+	constexpr uintmax_t DEFRAG_MAX_IO_SIZE = 1 << MAX_CLUSTER_SHIFT;
+
+	/*Offline defrag. Files get laid out contiguously from the start of the
+	 *data section, dir by dir in dir list order. All the data gets moved
+	 *first, then the FAT and the file list are switched over together at the
+	 *end, so the metadata is never half old and half new. Expects a sane FS,
+	 *run fsck first.*/
+	uint16_t defrag(const std::filesystem::path &fs_path,
+					min_vfs::defrag_stats_t &stats)
+	{
+		u16 err, start_cls;
+
+		std::fstream stream;
+		std::unique_ptr<u8[]> dir_list, file_list;
+		std::vector<u16> starts;
+		std::vector<u32> file_offsets; //within the file list
+
+		Header_t header;
+		Dir_t dir;
+		File_t file;
+		FAT_utils::FAT_cache_t<u16> FAT;
+		FAT_utils::defrag_plan_t<u16> plan;
+		FAT_utils::frag_stats_t frag_stats;
+
+		if(!std::filesystem::exists(fs_path)
+			|| !std::filesystem::is_regular_file(fs_path))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+
+		const uintmax_t blk_count = std::filesystem::file_size(fs_path)
+			/ BLK_SIZE;
+
+		if(!blk_count)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::WRONG_FS);
+
+		stream.open(fs_path, std::ios_base::binary | std::ios_base::in
+			| std::ios_base::out);
+
+		if(!stream.is_open() || !stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		dir_list = std::make_unique<u8[]>(BLK_SIZE);
+		stream.read((char*)dir_list.get(), BLK_SIZE);
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		if(std::memcmp(dir_list.get(), MAGIC, 4))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::WRONG_FS);
+
+		load_header(dir_list.get(), header);
+
+		//Anything fsck would have to fix first
+		if(header.cluster_shift + MIN_CLUSTER_SHIFT > MAX_CLUSTER_SHIFT)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::INVALID_STATE);
+
+		if(!header.cluster_cnt || header.cluster_cnt > MAX_CLUSTER_CNT)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_CLUSTER_CNT);
+
+		if(header.FAT_blk_cnt * (BLK_SIZE / 2) < header.cluster_cnt
+			+ FAT_ATTRS.DATA_MIN)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_FAT_BLK_CNT);
+
+		if(header.file_list_blk_addr + header.file_list_blk_cnt > 0x10000)
+			return ret_val_setup(LIBRARY_ID,
+								 (u8)ERR::BAD_FILE_LIST_ADDR_OR_CNT);
+
+		const u32 CLUSTER_SIZE = calc_cluster_size(header.cluster_shift);
+		const u32 END_OF_FILE_LIST = header.file_list_blk_addr
+			+ header.file_list_blk_cnt;
+
+		if(blk_count < header.block_cnt || blk_count < header.data_sctn_blk_addr
+			+ (uintmax_t)header.cluster_cnt * (CLUSTER_SIZE / BLK_SIZE))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::DISK_TOO_SMALL);
+
+		FAT = FAT_utils::FAT_cache_t<u16>(FAT_ATTRS,
+			FAT_utils::FAT_dyna_attrs_t<u16>(header.cluster_cnt
+				+ FAT_ATTRS.DATA_MIN, header.FAT_blk_addr * BLK_SIZE));
+
+		err = FAT.load(stream, FAT_ATTRS);
+		if(err) return err;
+
+		//Both lists are small, read each of them in one go
+		dir_list = std::make_unique<u8[]>(header.dir_list_blk_cnt * BLK_SIZE);
+		stream.seekg(header.dir_list_blk_addr * BLK_SIZE);
+		stream.read((char*)dir_list.get(), header.dir_list_blk_cnt * BLK_SIZE);
+
+		file_list = std::make_unique<u8[]>(header.file_list_blk_cnt
+			* BLK_SIZE);
+		stream.seekg(header.file_list_blk_addr * BLK_SIZE);
+		stream.read((char*)file_list.get(), header.file_list_blk_cnt
+			* BLK_SIZE);
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		for(u32 i = 0; i < header.dir_list_blk_cnt * DIRS_PER_BLOCK; i++)
+		{
+			const u8 *const dir_entry = dir_list.get() + i
+				* On_disk_sizes::DIR_ENTRY;
+
+			if(!is_valid_dir((Dir_type_e)dir_entry[0x11])) continue;
+
+			load_dir<false>(dir_entry, dir);
+
+			for(const u16 block: dir.blocks)
+			{
+				if(block < header.file_list_blk_addr
+					|| block >= END_OF_FILE_LIST)
+					continue;
+
+				for(u8 j = 0; j < FILES_PER_BLOCK; j++)
+				{
+					const u32 offset = (block - header.file_list_blk_addr)
+						* BLK_SIZE + j * On_disk_sizes::FILE_ENTRY;
+
+					if(!is_valid_file((File_type_e)file_list[offset + 0x1A]))
+						continue;
+
+					load_file<false>(file_list.get() + offset, file);
+
+					if(!FAT_t::in_data_range(file.start_cluster)
+						|| file.start_cluster >= FAT.length())
+						continue;
+
+					starts.push_back(file.start_cluster);
+					file_offsets.push_back(offset);
+				}
+			}
+		}
+
+		err = FAT_utils::plan_defrag(FAT.get(), FAT_ATTRS, FAT.length(),
+									 starts, plan, frag_stats);
+		if(err) return err;
+
+		stats.files = frag_stats.chains;
+		stats.fragments_before = frag_stats.fragments;
+		stats.seeks_before = frag_stats.seeks;
+		stats.clusters_moved = 0;
+
+		if(!plan.is_identity())
+		{
+			err = FAT_utils::move_clusters(stream, FAT_ATTRS, plan,
+				CLUSTER_SIZE, header.data_sctn_blk_addr * BLK_SIZE,
+				DEFRAG_MAX_IO_SIZE, stats.clusters_moved);
+			if(err) return err;
+
+			FAT_utils::apply_defrag_plan(FAT, FAT_ATTRS, plan);
+
+			for(uintmax_t i = 0; i < starts.size(); i++)
+			{
+				starts[i] = plan.dst_of[starts[i]];
+				start_cls = starts[i];
+
+				if constexpr(ENDIANNESS != std::endian::native)
+					start_cls = std::byteswap(start_cls);
+
+				//start cluster comes right after the name and bank number
+				std::memcpy(file_list.get() + file_offsets[i] + 0x12,
+							&start_cls, 2);
+			}
+
+			err = FAT.commit(stream, FAT_ATTRS);
+			if(err) return err;
+
+			stream.seekp(header.file_list_blk_addr * BLK_SIZE);
+			stream.write((char*)file_list.get(), header.file_list_blk_cnt
+				* BLK_SIZE);
+			stream.flush();
+
+			if(!stream.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID,
+									 (u8)min_vfs::ERR::IO_ERROR);
+		}
+
+		err = FAT_utils::get_frag_stats(FAT.get(), FAT_ATTRS, FAT.length(),
+										starts, frag_stats);
+		if(err) return err;
+
+		stats.fragments_after = frag_stats.fragments;
+		stats.seeks_after = frag_stats.seeks;
+
+		return 0;
+	}
+}
@@ -1,14 +1,18 @@
 ﻿#include <filesystem>
 #include <cstring>
 #include <bit>
+#include <array>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "Utils/ints.hpp"
+#include "Utils/bit_util.hpp"
+#include "Utils/FAT_utils.hpp"
 #include "EMU_FS_types.hpp"
 #include "fs_common.hpp"
 #include "EMU_FS_drv.hpp"
 
-#include <iostream>
-
 namespace EMU::FS
 {
 	template <typename T>
@@ -23,31 +27,449 @@ namespace EMU::FS
 			|| (addr_a <= addr_b && final_addr_a >= final_addr_b);
 	}
 
-	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status)
+	/*A metadata region, read in one go and checked in memory. Fixes only
+	 *mark blocks dirty; they get written back at the very end, one write per
+	 *run of dirty blocks. Whatever lies past the end of the disk reads as
+	 *zeroes and never gets written.*/
+	struct region_t
 	{
+		uintmax_t blk_addr;
+		uintmax_t blk_cnt;
+		uintmax_t on_disk_blk_cnt;
 		std::unique_ptr<u8[]> data;
+		bit_util::bitset_t dirty;
+
+		u8 *block(const uintmax_t idx)
+		{
+			return data.get() + idx * BLK_SIZE;
+		}
+	};
+
+	typedef std::array<u16, MAX_BLOCKS_PER_DIR> dir_blocks_t;
+	typedef std::chrono::steady_clock fsck_clock_t;
+
+	static uint16_t read_region(std::fstream &stream, const uintmax_t disk_blk_cnt,
+								const uintmax_t blk_addr, const uintmax_t blk_cnt,
+								region_t &region)
+	{
+		region.blk_addr = blk_addr;
+		region.blk_cnt = blk_cnt;
+		region.on_disk_blk_cnt = blk_addr >= disk_blk_cnt ? 0
+			: std::min(blk_cnt, disk_blk_cnt - blk_addr);
+		region.data = std::make_unique<u8[]>(blk_cnt * BLK_SIZE);
+		region.dirty.assign(blk_cnt, false);
+
+		if(!region.on_disk_blk_cnt) return 0;
+
+		stream.seekg(blk_addr * BLK_SIZE);
+		stream.read((char*)region.data.get(), region.on_disk_blk_cnt * BLK_SIZE);
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	static uint16_t write_region(std::fstream &stream, const region_t &region)
+	{
+		uintmax_t end;
+
+		for(uintmax_t i = region.dirty.find_first_set();
+			i < region.on_disk_blk_cnt; i = region.dirty.find_first_set(end))
+		{
+			end = std::min(region.dirty.find_first_unset(i),
+						   region.on_disk_blk_cnt);
+
+			stream.seekp((region.blk_addr + i) * BLK_SIZE);
+			stream.write((char*)region.data.get() + i * BLK_SIZE,
+						 (end - i) * BLK_SIZE);
+		}
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	static void push_phase(min_vfs::fsck_timings_t &timings, const char *name,
+						   const fsck_clock_t::time_point start)
+	{
+		timings.push_back({name, fsck_clock_t::now() - start});
+	}
+
+	/*Runs after pass 1 has counted every name. Only touches names, so it's
+	 *safe to run alongside the file list checks.*/
+	static void fix_dir_names(region_t &dir_list, std::unordered_map<std::string,
+							  std::pair<uintmax_t, bool>> &dir_name_map)
+	{
+		//Max 16 digits
+		constexpr u64 MAX_VAL = 9'999'999'999'999'999;
+
+		bool should_write;
+		u8 digit_cnt;
+		u64 next_tgt;
+
+		Dir_t dir;
+		std::string dedup_name;
+
+		for(uintmax_t i = 0; i < dir_list.blk_cnt; i++)
+		{
+			u8 *const data = dir_list.block(i);
+
+			for(u16 offset = 0; offset < BLK_SIZE; offset += On_disk_sizes::DIR_ENTRY)
+			{
+				if(!is_valid_dir((Dir_type_e)data[offset + 0x11]))
+					continue;
+
+				load_dir<false>(data + offset, dir);
+
+				std::pair<uintmax_t, bool> &entry = dir_name_map.find(dir.name)->second;
+
+				if(!entry.second)
+				{
+					entry.second = true;
+					continue;
+				}
+
+				should_write = false;
+				digit_cnt = 1;
+				next_tgt = 10;
+
+				for(u64 k = 2; k < MAX_VAL; k++)
+				{
+					if(k == next_tgt)
+					{
+						digit_cnt++;
+						next_tgt *= 10;
+					}
+
+					const std::string num_str = std::to_string(k);
+
+					if(digit_cnt > 14) dedup_name = num_str;
+					else
+					{
+						dedup_name = dir.name;
+						dedup_name.resize(std::min(dedup_name.size(), (size_t)(16 - digit_cnt - 1)));
+						dedup_name += "_" + num_str;
+					}
+
+					if(!dir_name_map.contains(dedup_name))
+					{
+						prepare_dir_name(dedup_name, dir.name);
+						dir.name[16] = 0;
+
+						should_write = true;
+						dir_name_map[dedup_name].second = true;
+						break;
+					}
+				}
+
+				if(should_write)
+				{
+					write_dir(data + offset, dir);
+					dir_list.dirty.set(i);
+				}
+			}
+		}
+	}
+
+	static void set_FAT_entry(region_t &FAT_region, u16 *FAT,
+							  const uintmax_t idx, const u16 val)
+	{
+		u16 cur = val;
+
+		FAT[idx] = val;
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			cur = std::byteswap(cur);
+
+		std::memcpy(FAT_region.data.get() + idx * 2, &cur, 2);
+		FAT_region.dirty.set(idx * 2 / BLK_SIZE);
+	}
+
+	/*FAT[0] and everything past the last cluster. Doesn't overlap with the
+	 *start clusters the file list checks look at.*/
+	static void check_reserved_clusters(region_t &FAT_region, u16 *FAT,
+										const uintmax_t FAT_len,
+										const u16 cluster_cnt, u16 &fsck_status)
+	{
+		auto mark_reserved = [&](const uintmax_t idx)
+		{
+			if(FAT[idx] == FAT_ATTRS.RESERVED) return;
+
+			set_FAT_entry(FAT_region, FAT, idx, FAT_ATTRS.RESERVED);
+			fsck_status |= (u16)FSCK_STATUS::UNMARKED_RESERVED_CLUSTERS;
+		};
+
+		mark_reserved(0);
+
+		for(uintmax_t i = cluster_cnt + FAT_ATTRS.DATA_MIN; i < FAT_len; i++)
+			mark_reserved(i);
+	}
+
+	/*Checks the files of a single dir. Pass 1 made sure no two dirs share a
+	 *file list block, so dirs can be checked in parallel as long as each
+	 *worker keeps its own dirty list.*/
+	static void check_dir_files(region_t &file_list, const u16 *FAT,
+								const Header_t &header,
+								const dir_blocks_t &blocks,
+								u16 &fsck_status, std::vector<uintmax_t> &dirty)
+	{
+		const u16 BLOCKS_PER_CLUSTER = calc_cluster_size(header.cluster_shift)
+			/ BLK_SIZE;
+
+		bool should_write, dupe;
+
+		File_t file;
+		std::pair<u16, bool> bank_num_map[0x100] = {};
+
+		//Chains get checked all together afterwards, see check_chains
+		dupe = false;
+		for(const u16 block: blocks)
+		{
+			if(block < header.file_list_blk_addr
+				|| block >= file_list.blk_addr + file_list.blk_cnt)
+				continue;
+
+			const uintmax_t idx = block - file_list.blk_addr;
+			u8 *const data = file_list.block(idx);
+
+			for(u16 cur = 0; cur < BLK_SIZE; cur += On_disk_sizes::FILE_ENTRY)
+			{
+				if(!is_valid_file((File_type_e)data[cur + 0x1A]))
+					continue;
+
+				should_write = false;
+				load_file<false>(data + cur, file);
+
+				//Only map. Fix in a second pass.
+				if(bank_num_map[file.bank_num].first)
+				{
+					dupe = true;
+					fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+				}
+
+				bank_num_map[file.bank_num].first++;
+
+				//Check start cluster
+				if((file.start_cluster >= FAT_ATTRS.DATA_MIN && file.start_cluster < header.cluster_cnt)
+					&& (FAT[file.start_cluster] < FAT_ATTRS.DATA_MIN || FAT[file.start_cluster] >= header.cluster_cnt)
+					&& FAT[file.start_cluster] != FAT_ATTRS.END_OF_CHAIN)
+				{
+					file.start_cluster = FAT_ATTRS.END_OF_CHAIN;
+					fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+					should_write = true;
+				}
+
+				//Check cluster count
+				if(file.cluster_cnt > header.cluster_cnt)
+				{
+					file.cluster_cnt = header.cluster_cnt;
+					fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+					should_write = true;
+				}
+
+				//Check block count
+				if(file.block_cnt > BLOCKS_PER_CLUSTER)
+				{
+					file.block_cnt = BLOCKS_PER_CLUSTER;
+					fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+					should_write = true;
+				}
+
+				//Check byte count
+				if(file.byte_cnt > BLK_SIZE)
+				{
+					file.byte_cnt = BLK_SIZE;
+					fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+					should_write = true;
+				}
+
+				if(should_write)
+				{
+					write_file(data + cur, file);
+					dirty.push_back(idx);
+				}
+			}
+		}
+
+		if(!dupe) return;
+
+		//Fix duplicate bank numbers
+		for(const u16 block: blocks)
+		{
+			if(block < header.file_list_blk_addr
+				|| block >= file_list.blk_addr + file_list.blk_cnt)
+				continue;
+
+			const uintmax_t idx = block - file_list.blk_addr;
+			u8 *const data = file_list.block(idx);
+
+			for(u16 cur = 0; cur < BLK_SIZE; cur += On_disk_sizes::FILE_ENTRY)
+			{
+				if(!is_valid_file((File_type_e)data[cur + 0x1A]))
+					continue;
+
+				load_file<false>(data + cur, file);
+
+				if(bank_num_map[file.bank_num].second)
+				{
+					for(u8 m = 0; m < 0xFF; m++)
+					{
+						if(bank_num_map[m].first) continue;
+
+						file.bank_num = m;
+						bank_num_map[m].first = 1;
+						break;
+					}
+
+					write_file(data + cur, file);
+					dirty.push_back(idx);
+				}
+
+				bank_num_map[file.bank_num].second = true;
+			}
+		}
+	}
+
+	/*Every chain at once, after the per-file checks. Links past the last
+	 *cluster get cut off first. Then every file must start a chain of its
+	 *own: not somewhere mid-chain, not one some earlier file already starts
+	 *and not a loop. Files that keep their chain get their cluster count
+	 *fixed to match it. Whatever no file can reach anymore gets freed.*/
+	static void check_chains(region_t &file_list, region_t &FAT_region,
+							 u16 *FAT, const uintmax_t FAT_len,
+							 const Header_t &header,
+							 const std::vector<dir_blocks_t> &dir_blocks,
+							 u16 &fsck_status)
+	{
+		const u16 LEN = std::min<uintmax_t>(header.cluster_cnt
+			+ FAT_ATTRS.DATA_MIN, FAT_len);
+
+		bool should_write;
+
+		File_t file;
+		std::vector<u16> starts;
+		bit_util::bitset_t claimed(LEN);
+		FAT_utils::FAT_analysis_t<u16> analysis;
+
+		for(uintmax_t i = FAT_ATTRS.DATA_MIN; i < LEN; i++)
+		{
+			if(FAT_t::in_data_range(FAT[i]) && FAT[i] >= LEN)
+			{
+				set_FAT_entry(FAT_region, FAT, i, FAT_ATTRS.END_OF_CHAIN);
+				fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+			}
+		}
+
+		FAT_utils::analyse_FAT(FAT, FAT_ATTRS, LEN, analysis);
+
+		for(const dir_blocks_t &blocks: dir_blocks)
+		{
+			for(const u16 block: blocks)
+			{
+				if(block < header.file_list_blk_addr
+					|| block >= file_list.blk_addr + file_list.blk_cnt)
+					continue;
+
+				const uintmax_t idx = block - file_list.blk_addr;
+				u8 *const data = file_list.block(idx);
+
+				for(u16 cur = 0; cur < BLK_SIZE; cur += On_disk_sizes::FILE_ENTRY)
+				{
+					if(!is_valid_file((File_type_e)data[cur + 0x1A]))
+						continue;
+
+					load_file<false>(data + cur, file);
+
+					if(!file.cluster_cnt || file.start_cluster >= LEN
+						|| !analysis.used[file.start_cluster])
+						continue;
+
+					should_write = false;
+
+					if(analysis.in_degree[file.start_cluster]
+						|| claimed[file.start_cluster]
+						|| analysis.cyclic[file.start_cluster])
+					{
+						file.start_cluster = FAT_ATTRS.END_OF_CHAIN;
+						file.cluster_cnt = 0;
+						should_write = true;
+					}
+					else
+					{
+						claimed.set(file.start_cluster);
+						starts.push_back(file.start_cluster);
+
+						if(analysis.length[file.start_cluster]
+							!= file.cluster_cnt)
+						{
+							file.cluster_cnt =
+								analysis.length[file.start_cluster];
+							should_write = true;
+						}
+					}
+
+					if(should_write)
+					{
+						fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
+						write_file(data + cur, file);
+						file_list.dirty.set(idx);
+					}
+				}
+			}
+		}
+
+		FAT_utils::find_orphans(analysis, starts);
+
+		if(!analysis.orphan_cnt) return;
+
+		fsck_status |= (u16)FSCK_STATUS::LOST_CLUSTERS;
+
+		for(uintmax_t i = analysis.orphans.find_first_set(); i < LEN;
+			i = analysis.orphans.find_first_set(i + 1))
+			set_FAT_entry(FAT_region, FAT, i, FAT_ATTRS.FREE_CLUSTER);
+	}
+
+	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status)
+	{
+		min_vfs::fsck_timings_t timings;
+
+		return fsck(fs_path, fsck_status, timings);
+	}
+
+	/*Every metadata region gets read whole, checked and fixed in memory, then
+	 *written back once. Once the dir list's first pass is done, the dir name
+	 *fixes, the reserved cluster checks and the file list checks don't
+	 *depend on each other, so they run on their own threads; the file list
+	 *checks get split up by dir.*/
+	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status,
+				  min_vfs::fsck_timings_t &timings)
+	{
+		const fsck_clock_t::time_point fsck_start = fsck_clock_t::now();
+		fsck_clock_t::time_point phase_start = fsck_start;
+
 		std::unique_ptr<u16[]> FAT;
 
 		bool bad_file_list_addr, should_write, should_write_alt, dupe;
-		u8 digit_cnt;
-		u16 err, next_file_list_blk, sum, cur, offset;
-		u64 min_block_cnt, next_tgt;
-		uintmax_t block_addr, FAT_len;
+		u16 err, next_file_list_blk, sum, cur;
+		u64 min_block_cnt;
+		uintmax_t FAT_len, worker_cnt, dirs_per_worker;
 
 		std::fstream stream;
 		std::vector<bool> map;
-		std::vector<std::pair<u8, bool>> bank_num_map;
-		std::string dedup_name;
+		std::vector<dir_blocks_t> dir_blocks;
 
 		typedef std::unordered_map<std::string, std::pair<uintmax_t, bool>>
 			name_map_t;
 
 		name_map_t dir_name_map;
-		name_map_t::iterator dir_it;
 
+		region_t header_region, dir_list, FAT_region, file_list;
 		Header_t header;
 		Dir_t dir;
-		File_t file;
 
 		const uintmax_t blk_count = std::filesystem::file_size(fs_path)
 			/ BLK_SIZE;
@@ -64,16 +486,16 @@ namespace EMU::FS
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::IO_ERROR);
 
-		data = std::make_unique<u8[]>(BLK_SIZE);
-		stream.read((char*)data.get(), BLK_SIZE);
+		//The superblock and the next dir content block
+		err = read_region(stream, blk_count, 0, FIRST_NON_RESERVED_BLK,
+						  header_region);
+		if(err) return err;
 
-		if(!stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID,
-								 (u8)min_vfs::ERR::IO_ERROR);
+		u8 *const data = header_region.data.get();
 
 		/*--------------------------Superblock checks-------------------------*/
 		//Check magic
-		if(std::memcmp(data.get(), MAGIC, 4))
+		if(std::memcmp(data, MAGIC, 4))
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::WRONG_FS);
 
@@ -83,7 +505,7 @@ namespace EMU::FS
 
 		for(u16 i = 0; i < BLK_SIZE - 2; i += 2)
 		{
-			std::memcpy(&cur, data.get() + i, 2);
+			std::memcpy(&cur, data + i, 2);
 
 			if constexpr(ENDIANNESS != std::endian::native)
 				cur = std::byteswap(cur);
@@ -91,7 +513,7 @@ namespace EMU::FS
 			sum += cur;
 		}
 
-		std::memcpy(&cur, data.get() + 510, 2);
+		std::memcpy(&cur, data + 510, 2);
 
 		if constexpr(ENDIANNESS != std::endian::native)
 			cur = std::byteswap(cur);
@@ -105,7 +527,7 @@ namespace EMU::FS
 			should_write = true;
 		}
 
-		load_header(data.get(), header);
+		load_header(data, header);
 
 		if(header.cluster_shift + MIN_CLUSTER_SHIFT > MAX_CLUSTER_SHIFT)
 		{
@@ -231,47 +653,58 @@ namespace EMU::FS
 
 		if(should_write && !should_write_alt)
 		{
-			write_header(data.get(), header);
-			stream.seekp(0);
-			stream.write((char*)data.get(), BLK_SIZE);
+			write_header(data, header);
+			header_region.dirty.set(0);
 		}
 
-		stream.seekg(BLK_SIZE);
-		stream.read((char*)&next_file_list_blk, 2);
+		std::memcpy(&next_file_list_blk, data + BLK_SIZE, 2);
 		if constexpr(ENDIANNESS != std::endian::native)
 			next_file_list_blk = std::byteswap(next_file_list_blk);
-		
+
+		push_phase(timings, "superblock", phase_start);
+		phase_start = fsck_clock_t::now();
+
+		err = read_region(stream, blk_count, header.dir_list_blk_addr,
+						  header.dir_list_blk_cnt, dir_list);
+		if(err) return err;
+
+		err = read_region(stream, blk_count, header.FAT_blk_addr,
+						  header.FAT_blk_cnt, FAT_region);
+		if(err) return err;
+
+		err = read_region(stream, blk_count, header.file_list_blk_addr,
+						  header.file_list_blk_cnt, file_list);
+		if(err) return err;
+
+		push_phase(timings, "read", phase_start);
+		phase_start = fsck_clock_t::now();
+
 		/*---------------------------Root dir checks--------------------------*/
-		const u16 END_OF_FILE_BLKS = header.file_list_blk_addr + header.file_list_blk_cnt;
+		const u32 END_OF_FILE_BLKS = header.file_list_blk_addr + header.file_list_blk_cnt;
 		map.resize(header.file_list_blk_cnt);
 		dupe = false;
 
-		for(u32 i = 0; i < header.dir_list_blk_cnt; i++)
+		for(uintmax_t i = 0; i < dir_list.blk_cnt; i++)
 		{
-			block_addr = header.dir_list_blk_addr * BLK_SIZE + i * BLK_SIZE;
-			stream.seekg(block_addr);
-			stream.read((char*)data.get(), BLK_SIZE);
-			offset = 0;
+			u8 *const block = dir_list.block(i);
 
-			should_write_alt = false;
-			for(u8 j = 0; j < DIRS_PER_BLOCK; j++, offset += On_disk_sizes::DIR_ENTRY)
+			for(u16 offset = 0; offset < BLK_SIZE; offset += On_disk_sizes::DIR_ENTRY)
 			{
-				if(!is_valid_dir((Dir_type_e)data[offset + 0x11]))
+				if(!is_valid_dir((Dir_type_e)block[offset + 0x11]))
 					continue;
 
-				dir.addr = block_addr + offset;
-				load_dir<false>(data.get() + offset, dir);
+				load_dir<false>(block + offset, dir);
 
-				name_map_t::iterator dir_it = dir_name_map.find(dir.name);
+				std::pair<uintmax_t, bool> &name_cnt = dir_name_map[dir.name];
 
 				//Map only. Fix in a second pass.
-				if(dir_it != dir_name_map.end())
+				if(name_cnt.first)
 				{
-					dir_it->second.first++;
 					fsck_status |= (u16)FSCK_STATUS::BAD_DIR;
 					dupe = true;
 				}
-				else dir_name_map[dir.name] = {1, false};
+
+				name_cnt.first++;
 
 				//Check for multiple references to the same block
 				should_write = false;
@@ -284,99 +717,24 @@ namespace EMU::FS
 							dir.blocks[k] = 0xFFFF;
 							fsck_status |= (u16)FSCK_STATUS::BAD_DIR;
 							should_write = true;
-							should_write_alt = true;
 						}
 						else map[dir.blocks[k] - header.file_list_blk_addr] = true;
-					}					
+					}
 				}
 
 				if(should_write)
-					write_dir(data.get() + offset, dir);
-			}
-
-			if(should_write_alt)
-			{
-				stream.seekp(block_addr);
-				stream.write((char*)data.get(), BLK_SIZE);
-			}
-		}
-
-		if(dupe)
-		{
-			//Second pass to fix duplicate names
-			for(u32 i = 0; i < header.dir_list_blk_cnt; i++)
-			{
-				block_addr = header.dir_list_blk_addr * BLK_SIZE + i * BLK_SIZE;
-				stream.seekg(block_addr);
-				stream.read((char*)data.get(), BLK_SIZE);
-				offset = 0;
-
-				should_write_alt = false;
-				for(u8 j = 0; j < DIRS_PER_BLOCK; j++, offset += On_disk_sizes::DIR_ENTRY)
 				{
-					if(!is_valid_dir((Dir_type_e)data[offset + 0x11]))
-						continue;
-
-					dir.addr = block_addr + offset;
-					load_dir<false>(data.get() + offset, dir);
-
-					dir_it = dir_name_map.find(dir.name);
-
-					if(dir_it->second.second)
-					{
-						//Max 16 digits
-						constexpr u64 MAX_VAL = 9'999'999'999'999'999;
-						digit_cnt = 1;
-						next_tgt = 10;
-
-						for(u64 k = 2; k < MAX_VAL; k++)
-						{
-							if(k == next_tgt)
-							{
-								digit_cnt++;
-								next_tgt *= 10;
-							}
-
-							const std::string num_str = std::to_string(k);
-
-							if(digit_cnt > 14) dedup_name = num_str;
-							else
-							{
-								dedup_name = dir.name;
-								dedup_name.resize(std::min(dedup_name.size(), (size_t)(16 - digit_cnt - 1)));
-								dedup_name += "_" + num_str;
-							}
-
-							if(!dir_name_map.contains(dedup_name))
-							{
-								prepare_dir_name(dedup_name, dir.name);
-								dir.name[16] = 0;
-
-								should_write = true;
-								dir_name_map[dedup_name].second = true;
-								break;
-							}
-						}
-					}
-					else dir_it->second.second = true;
-
-					if(should_write)
-					{
-						write_dir(data.get() + offset, dir);
-						should_write_alt = true;
-					}
+					write_dir(block + offset, dir);
+					dir_list.dirty.set(i);
 				}
 
-				if(should_write_alt)
-				{
-					stream.seekp(block_addr);
-					stream.write((char*)data.get(), BLK_SIZE);
-				}
+				//The name fixes may rewrite the entry while the files get checked
+				dir_blocks.emplace_back();
+				std::copy_n(dir.blocks, MAX_BLOCKS_PER_DIR, dir_blocks.back().begin());
 			}
 		}
 
 		//Check next dir content block
-		should_write = false;
 		for(s64 i = header.file_list_blk_cnt - 1; i >= 0; i--)
 		{
 			/*We want the first block in the last group of unused blocks. So the
@@ -387,35 +745,29 @@ namespace EMU::FS
 				{
 					next_file_list_blk = i + 1 + header.file_list_blk_addr;
 					fsck_status |= (u16)FSCK_STATUS::BAD_NEXT_DIR_CONTENT_BLK;
-					should_write = true;
+
+					if constexpr(ENDIANNESS != std::endian::native)
+						next_file_list_blk = std::byteswap(next_file_list_blk);
+
+					std::memcpy(data + BLK_SIZE, &next_file_list_blk, 2);
+					header_region.dirty.set(1);
 				}
 
 				break;
 			}
 		}
 
-		if(should_write)
-		{
-			stream.seekp(BLK_SIZE);
-
-			if constexpr(ENDIANNESS != std::endian::native)
-				next_file_list_blk = std::byteswap(next_file_list_blk);
-
-			stream.write((char*)&next_file_list_blk, 2);
-		}
-
 		//TODO: Make dir entries contiguous
 		//TODO: Defragment dir contents
 		//TODO: Maybe mark last
 		/*-----------------------End of root dir checks-----------------------*/
 
-		/*-------------------------Internal FAT checks------------------------*/
-		//TODO: Map all chain starts
-		//TODO: Check for chain integrity
+		push_phase(timings, "dir blocks", phase_start);
+		phase_start = fsck_clock_t::now();
+
 		FAT_len = header.FAT_blk_cnt * (BLK_SIZE / 2);
 		FAT = std::make_unique<u16[]>(FAT_len);
-		stream.seekg(header.FAT_blk_addr * BLK_SIZE);
-		stream.read((char*)FAT.get(), FAT_len * 2);
+		std::memcpy(FAT.get(), FAT_region.data.get(), FAT_len * 2);
 
 		if constexpr(ENDIANNESS != std::endian::native)
 		{
@@ -423,195 +775,102 @@ namespace EMU::FS
 				FAT[i] = std::byteswap(FAT[i]);
 		}
 
-		should_write = false;
+		/*---------------------------Parallel checks--------------------------*/
+		worker_cnt = std::min<uintmax_t>(std::max(std::thread::hardware_concurrency(),
+			1U), dir_blocks.size());
+		dirs_per_worker = worker_cnt ? (dir_blocks.size() + worker_cnt - 1)
+			/ worker_cnt : 0;
 
-		if(FAT[0] != FAT_ATTRS.RESERVED)
-		{
-			FAT[0] = FAT_ATTRS.RESERVED;
-			fsck_status |= (u16)FSCK_STATUS::UNMARKED_RESERVED_CLUSTERS;
-			should_write = true;
-		}
+		std::vector<std::thread> workers;
+		std::vector<u16> worker_status(worker_cnt + 2, 0);
+		std::vector<std::vector<uintmax_t>> worker_dirty(worker_cnt);
+		std::vector<fsck_clock_t::duration> worker_time(worker_cnt + 2);
 
-		for(uintmax_t i = header.cluster_cnt + FAT_ATTRS.DATA_MIN; i < FAT_len; i++)
+		if(dupe)
 		{
-			if(FAT[i] != FAT_ATTRS.RESERVED)
+			workers.emplace_back([&]()
 			{
-				FAT[i] = FAT_ATTRS.RESERVED;
-				fsck_status |= (u16)FSCK_STATUS::UNMARKED_RESERVED_CLUSTERS;
-				should_write = true;
-			}
+				const fsck_clock_t::time_point start = fsck_clock_t::now();
+
+				fix_dir_names(dir_list, dir_name_map);
+				worker_time[worker_cnt] = fsck_clock_t::now() - start;
+			});
 		}
 
-		if(should_write)
+		workers.emplace_back([&]()
 		{
-			stream.seekg(header.FAT_blk_addr * BLK_SIZE);
+			const fsck_clock_t::time_point start = fsck_clock_t::now();
 
-			for(uintmax_t i = 0; i < FAT_len; i++)
-			{
-				cur = FAT[i];
+			check_reserved_clusters(FAT_region, FAT.get(), FAT_len,
+									header.cluster_cnt,
+									worker_status[worker_cnt + 1]);
+			worker_time[worker_cnt + 1] = fsck_clock_t::now() - start;
+		});
 
-				if constexpr(ENDIANNESS != std::endian::native)
-					cur = std::byteswap(cur);
-
-				stream.write((char*)&cur, 2);
-			}
-		}
-		/*---------------------End of internal FAT checks---------------------*/
-
-		/*--------------------------File list checks--------------------------*/
-		data = std::make_unique<u8[]>(BLK_SIZE * 2);
-
-		//TODO: Find and fix double chain references
-		/*TODO: Find and fix chain collisions (or pointing to somewhere in
-		another chain). Pointing somewhere mid-chain should be fairly easy to
-		detect if we track chain starts. If we're pointing to a seemingly valid
-		cluster which isn't a chain start, it's a bad start cluster.*/
-		/*TODO: Remove unreferenced chains at the end of pass 1.*/
-		for(u32 i = 0; i < header.dir_list_blk_cnt; i++)
+		for(uintmax_t i = 0; i < worker_cnt; i++)
 		{
-			block_addr = header.dir_list_blk_addr * BLK_SIZE + i * BLK_SIZE;
-			stream.seekg(block_addr);
-			stream.read((char*)data.get(), BLK_SIZE);
-			offset = 0;
-
-			for(u8 j = 0; j < DIRS_PER_BLOCK; j++, offset += On_disk_sizes::DIR_ENTRY)
+			workers.emplace_back([&, i]()
 			{
-				if(!is_valid_dir((Dir_type_e)data[offset + 0x11]))
-					continue;
-
-				dir.addr = block_addr + offset;
-				load_dir<false>(data.get() + offset, dir);
-				
-				bank_num_map.clear();
-				bank_num_map.resize(0xFF);
-
-				dupe = false;
-				for(u8 k = 0; k < MAX_BLOCKS_PER_DIR; k++)
-				{
-					if(dir.blocks[k] < header.file_list_blk_addr || dir.blocks[k] >= END_OF_FILE_BLKS)
-						continue;
-
-					stream.seekg(dir.blocks[k] * BLK_SIZE);
-					stream.read((char*)data.get() + BLK_SIZE, BLK_SIZE);
-					cur = 0;
-
-					should_write_alt = false;
-					for(u8 l = 0; l < FILES_PER_BLOCK; l++, cur += On_disk_sizes::FILE_ENTRY)
-					{
-						if(!is_valid_file((File_type_e)data[BLK_SIZE + cur + 0x1A]))
-							continue;
-
-						should_write = false;
-						load_file<false>(data.get() + BLK_SIZE + cur, file);
-
-						//Only map. Fix in a second pass.
-						if(bank_num_map[file.bank_num].first)
-						{
-							dupe = true;
-							fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
-						}
+				const fsck_clock_t::time_point start = fsck_clock_t::now();
+				const uintmax_t end = std::min((i + 1) * dirs_per_worker,
+											   dir_blocks.size());
 
-						bank_num_map[file.bank_num].first++;
+				for(uintmax_t j = i * dirs_per_worker; j < end; j++)
+					check_dir_files(file_list, FAT.get(), header, dir_blocks[j],
+									worker_status[i], worker_dirty[i]);
 
-						//Check start cluster
-						if((file.start_cluster >= FAT_ATTRS.DATA_MIN && file.start_cluster < header.cluster_cnt)
-							&& (FAT[file.start_cluster] < FAT_ATTRS.DATA_MIN || FAT[file.start_cluster] >= header.cluster_cnt)
-							&& FAT[file.start_cluster] != FAT_ATTRS.END_OF_CHAIN)
-						{
-							file.start_cluster = FAT_ATTRS.END_OF_CHAIN;
-							fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
-							should_write = true;
-						}
-
-						//Check cluster count
-						if(file.cluster_cnt > header.cluster_cnt)
-						{
-							file.cluster_cnt = header.cluster_cnt;
-							fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
-							should_write = true;
-						}
-
-						//Check block count
-						if(file.block_cnt > BLOCKS_PER_CLUSTER)
-						{
-							file.block_cnt = BLOCKS_PER_CLUSTER;
-							fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
-							should_write = true;
-						}
-
-						//Check byte count
-						if(file.byte_cnt > BLK_SIZE)
-						{
-							file.byte_cnt = BLK_SIZE;
-							fsck_status |= (u16)FSCK_STATUS::BAD_FILE;
-							should_write = true;
-						}
-
-						if(should_write)
-						{
-							write_file(data.get() + BLK_SIZE + cur, file);
-							should_write_alt = true;
-						}
-					}
+				worker_time[i] = fsck_clock_t::now() - start;
+			});
+		}
 
-					if(should_write_alt)
-					{
-						stream.seekp(dir.blocks[k] * BLK_SIZE);
-						stream.write((char*)data.get() + BLK_SIZE, BLK_SIZE);
-					}
-				}
+		for(std::thread &worker: workers)
+			worker.join();
 
-				if(dupe)
-				{
-					for(std::pair<u8, bool> &entry : bank_num_map)
-						entry.second = false;
+		for(uintmax_t i = 0; i < worker_cnt; i++)
+		{
+			for(const uintmax_t idx: worker_dirty[i])
+				file_list.dirty.set(idx);
+		}
 
-					//Fix duplicate bank numbers
-					for(u8 k = 0; k < MAX_BLOCKS_PER_DIR; k++)
-					{
-						if(dir.blocks[k] < header.file_list_blk_addr || dir.blocks[k] >= END_OF_FILE_BLKS)
-							continue;
+		for(const u16 status: worker_status)
+			fsck_status |= status;
 
-						stream.seekg(dir.blocks[k] * BLK_SIZE);
-						stream.read((char*)data.get() + BLK_SIZE, BLK_SIZE);
-						cur = 0;
+		const fsck_clock_t::time_point chains_start = fsck_clock_t::now();
 
-						should_write_alt = false;
-						for(u8 l = 0; l < FILES_PER_BLOCK; l++, cur += On_disk_sizes::FILE_ENTRY)
-						{
-							if(!is_valid_file((File_type_e)data[BLK_SIZE + cur + 0x1A]))
-								continue;
+		//Needs the fixed start clusters and cluster counts
+		if(header.cluster_cnt)
+			check_chains(file_list, FAT_region, FAT.get(), FAT_len, header,
+						 dir_blocks, fsck_status);
 
-							load_file<false>(data.get() + BLK_SIZE + cur, file);
+		const fsck_clock_t::duration chains_time = fsck_clock_t::now()
+			- chains_start;
 
-							if(bank_num_map[file.bank_num].second)
-							{
-								for(u8 m = 0; m < 0xFF; m++)
-								{
-									if(bank_num_map[m].first) continue;
+		timings.push_back({"dir names", worker_time[worker_cnt]});
+		timings.push_back({"FAT", worker_time[worker_cnt + 1]});
+		timings.push_back({"file lists", worker_cnt ? *std::max_element(
+			worker_time.begin(), worker_time.begin() + worker_cnt)
+			: fsck_clock_t::duration::zero()});
+		timings.push_back({"chains", chains_time});
+		push_phase(timings, "checks", phase_start);
+		phase_start = fsck_clock_t::now();
+		/*-----------------------End of parallel checks-----------------------*/
 
-									file.bank_num = m;
-									bank_num_map[m].first = 1;
-									break;
-								}
+		//Same order the checks used to write in
+		for(const region_t *region: {&header_region, &dir_list, &FAT_region,
+			&file_list})
+		{
+			err = write_region(stream, *region);
+			if(err) return err;
+		}
 
-								write_file(data.get() + BLK_SIZE + cur, file);
-								should_write_alt = true;
-							}
+		stream.flush();
 
-							bank_num_map[file.bank_num].second = true;
-						}
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
 
-						if(should_write_alt)
-						{
-							stream.seekp(dir.blocks[k] * BLK_SIZE);
-							stream.write((char*)data.get() + BLK_SIZE, BLK_SIZE);
-						}
-					}
-				}
-			}
-		}
-		/*-----------------------End of file list checks----------------------*/
+		push_phase(timings, "write", phase_start);
+		push_phase(timings, "total", fsck_start);
 
 		return 0;
 	}
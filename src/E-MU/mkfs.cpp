@@ -1,15 +1,156 @@
 #include <filesystem>
+#include <fstream>
 #include <string>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <bit>
 
 #include "Utils/ints.hpp"
 #include "Utils/utils.hpp"
+#include "Utils/sparse_util.hpp"
 #include "min_vfs/min_vfs_base.hpp"
+#include "EMU_FS_types.hpp"
+#include "fs_common.hpp"
+#include "EMU_FS_drv.hpp"
 
 namespace EMU::FS
 {
+	//Same as the disks we've got to look at, whatever their size
+	constexpr u32 MKFS_DIR_LIST_BLK_CNT = 2;
+	constexpr u32 MKFS_FILE_LIST_BLK_CNT = 101;
+
+	//Mounting wants room for cluster_cnt + 1 in the FAT
+	constexpr u16 MKFS_MAX_CLUSTER_CNT = MAX_CLUSTER_CNT - 1;
+
+	static u32 FAT_blk_cnt(const u32 cluster_cnt)
+	{
+		return div_int_round_to_pos_inf<u32>((cluster_cnt
+			+ FAT_ATTRS.DATA_MIN) * 2, BLK_SIZE);
+	}
+
+	/*Everything before the data section is contiguous: superblock, next dir
+	 *content block, FAT, dir list and file list. It all gets built in memory
+	 *and written in one go. The data section never gets written; whatever's
+	 *there gets punched out where the host allows it, otherwise it's left
+	 *as is, free clusters' contents don't matter. E-MU disks have no label,
+	 *so that one's ignored.*/
 	uint16_t mkfs(const std::filesystem::path &fs_path, const std::string &label)
 	{
-		return ret_val_setup(min_vfs::LIBRARY_ID,
-							 (u8)min_vfs::ERR::UNSUPPORTED_OPERATION);
+		constexpr u32 LIST_BLK_CNT = FIRST_NON_RESERVED_BLK
+			+ MKFS_DIR_LIST_BLK_CNT + MKFS_FILE_LIST_BLK_CNT;
+
+		u16 cur;
+		u32 cluster_cnt, blocks_per_cluster;
+		uintmax_t meta_size;
+
+		std::fstream stream;
+		std::unique_ptr<u8[]> meta;
+
+		Header_t header;
+
+		if(!std::filesystem::exists(fs_path)
+			|| !std::filesystem::is_regular_file(fs_path))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+
+		const uintmax_t disk_blk_cnt = std::filesystem::file_size(fs_path)
+			/ BLK_SIZE;
+
+		if(disk_blk_cnt <= LIST_BLK_CNT)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::DISK_TOO_SMALL);
+
+		//Smallest clusters that still get the whole disk
+		header.cluster_shift = 0;
+
+		while(true)
+		{
+			blocks_per_cluster = calc_cluster_size(header.cluster_shift)
+				/ BLK_SIZE;
+
+			if((disk_blk_cnt - LIST_BLK_CNT) / blocks_per_cluster
+				<= MKFS_MAX_CLUSTER_CNT || header.cluster_shift
+				== MAX_CLUSTER_SHIFT - MIN_CLUSTER_SHIFT)
+				break;
+
+			header.cluster_shift++;
+		}
+
+		/*Fewer clusters never need a bigger FAT, so sizing the FAT for the
+		 *upper bound first always leaves enough room.*/
+		cluster_cnt = std::min<uintmax_t>((disk_blk_cnt - LIST_BLK_CNT)
+			/ blocks_per_cluster, MKFS_MAX_CLUSTER_CNT);
+
+		header.FAT_blk_cnt = FAT_blk_cnt(cluster_cnt);
+
+		if(disk_blk_cnt < LIST_BLK_CNT + header.FAT_blk_cnt + blocks_per_cluster)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::DISK_TOO_SMALL);
+
+		cluster_cnt = std::min<uintmax_t>((disk_blk_cnt - LIST_BLK_CNT
+			- header.FAT_blk_cnt) / blocks_per_cluster, MKFS_MAX_CLUSTER_CNT);
+
+		header.cluster_cnt = cluster_cnt;
+		header.FAT_blk_addr = FIRST_NON_RESERVED_BLK;
+		header.dir_list_blk_addr = header.FAT_blk_addr + header.FAT_blk_cnt;
+		header.dir_list_blk_cnt = MKFS_DIR_LIST_BLK_CNT;
+		header.file_list_blk_addr = header.dir_list_blk_addr
+			+ header.dir_list_blk_cnt;
+		header.file_list_blk_cnt = MKFS_FILE_LIST_BLK_CNT;
+		header.data_sctn_blk_addr = header.file_list_blk_addr
+			+ header.file_list_blk_cnt;
+		header.block_cnt = header.data_sctn_blk_addr
+			+ cluster_cnt * blocks_per_cluster;
+
+		//Both lists are all deleted entries, so zeroes are all they need
+		meta_size = header.data_sctn_blk_addr * BLK_SIZE;
+		meta = std::make_unique<u8[]>(meta_size);
+		std::memset(meta.get(), 0, meta_size);
+
+		std::memcpy(meta.get(), MAGIC, 4);
+		write_header(meta.get(), header);
+
+		//No dir content blocks in use yet
+		cur = header.file_list_blk_addr;
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			cur = std::byteswap(cur);
+
+		std::memcpy(meta.get() + BLK_SIZE, &cur, 2);
+
+		//FAT[0], then everything past the last cluster
+		cur = FAT_ATTRS.RESERVED;
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			cur = std::byteswap(cur);
+
+		u8 *const FAT = meta.get() + header.FAT_blk_addr * BLK_SIZE;
+
+		std::memcpy(FAT, &cur, 2);
+
+		for(u32 i = cluster_cnt + FAT_ATTRS.DATA_MIN;
+			i < header.FAT_blk_cnt * (BLK_SIZE / 2); i++)
+			std::memcpy(FAT + i * 2, &cur, 2);
+
+		//in | out so it doesn't truncate
+		stream.open(fs_path, std::ios_base::binary | std::ios_base::in
+			| std::ios_base::out);
+
+		if(!stream.is_open() || !stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		stream.write((char*)meta.get(), meta_size);
+		stream.close();
+
+		if(stream.fail())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		sparse_util::punch_hole(fs_path, meta_size, (uintmax_t)cluster_cnt
+			* blocks_per_cluster * BLK_SIZE);
+
+		return 0;
 	}
 }
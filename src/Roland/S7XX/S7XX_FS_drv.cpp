@@ -16,6 +16,7 @@
 #include "Utils/utils.hpp"
 #include "Utils/str_util.hpp"
 #include "Utils/FAT_utils.hpp"
+#include "Utils/job_util.hpp"
 #include "min_vfs/min_vfs_base.hpp"
 #include "Roland/S7XX/host_FS_utils.hpp"
 
@@ -192,43 +193,149 @@ namespace S7XX::FS
 		return 0;
 	}
 
-	//includes first two clusters, which are always reserved
-	static uint16_t FAT_find_length(std::fstream &fstr)
+	constexpr u32 LISTS_SIZE = On_disk_addrs::VOLUME_PARAMS
+		- On_disk_addrs::VOLUME_LIST;
+
+	static u8* cached_list_entry(filesystem_t &fs, const u32 list_addr,
+								 const u16 slot)
+	{
+		return fs.lists.get() + (list_addr - On_disk_addrs::VOLUME_LIST)
+			+ slot * On_disk_sizes::LIST_ENTRY;
+	}
+
+	static bool cached_entry_in_use(filesystem_t &fs, const u32 list_addr,
+									const u16 slot)
+	{
+		const u8 name0 = *cached_list_entry(fs, list_addr, slot);
+
+		return name0 && name0 != 0xFE;
+	}
+
+	//Writes len bytes of a cached entry, starting at offset, to disk
+	static void store_list_entry(filesystem_t &fs, const u32 list_addr,
+								 const u16 slot, const u8 offset = 0,
+								 const u8 len = On_disk_sizes::LIST_ENTRY)
+	{
+		fs.stream.seekp(list_addr + slot * On_disk_sizes::LIST_ENTRY + offset);
+		fs.stream.write((char*)cached_list_entry(fs, list_addr, slot) + offset,
+						len);
+	}
+
+	static u16 get_cached_u16(filesystem_t &fs, const u32 list_addr,
+							  const u16 slot, const u8 offset)
+	{
+		u16 val;
+
+		std::memcpy(&val, cached_list_entry(fs, list_addr, slot) + offset, 2);
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			val = std::byteswap(val);
+
+		return val;
+	}
+
+	//Only changes the cache
+	static void put_cached_u16(filesystem_t &fs, const u32 list_addr,
+							   const u16 slot, const u8 offset, u16 val)
+	{
+		if constexpr(ENDIANNESS != std::endian::native)
+			val = std::byteswap(val);
+
+		std::memcpy(cached_list_entry(fs, list_addr, slot) + offset, &val, 2);
+	}
+
+	static void set_cached_u16(filesystem_t &fs, const u32 list_addr,
+							   const u16 slot, const u8 offset, const u16 val)
+	{
+		put_cached_u16(fs, list_addr, slot, offset, val);
+		store_list_entry(fs, list_addr, slot, offset, 2);
+	}
+
+	static void load_lists(filesystem_t &fs)
+	{
+		fs.lists = std::make_unique<u8[]>(LISTS_SIZE);
+
+		fs.stream.seekg(On_disk_addrs::VOLUME_LIST);
+		fs.stream.read((char*)fs.lists.get(), LISTS_SIZE);
+	}
+
+	//What find_slot_from_name compares: up to 16 chars, with '/' as '\\'
+	static std::string index_key(const char *name)
+	{
+		std::string key(name, strnlen(name, 16));
+
+		std::replace(key.begin(), key.end(), '/', '\\');
+
+		return key;
+	}
+
+	static void index_slot(filesystem_t &fs, const u8 type_idx, const u16 slot)
+	{
+		const u32 list_addr = TYPE_ATTRS[type_idx].LIST_ADDR;
+
+		if(!cached_entry_in_use(fs, list_addr, slot)) return;
+
+		fs.name_indexes[type_idx].emplace(
+			index_key((char*)cached_list_entry(fs, list_addr, slot)), slot);
+		fs.used_slots[type_idx].set(slot);
+	}
+
+	//Has to happen before the cached entry changes, the key comes from it
+	static void unindex_slot(filesystem_t &fs, const u8 type_idx,
+							 const u16 slot)
 	{
-		uint16_t i, cur_val;
+		filesystem_t::name_index_t &index = fs.name_indexes[type_idx];
+
+		if(!fs.used_slots[type_idx].test(slot)) return;
+
+		const std::pair<filesystem_t::name_index_t::iterator,
+			filesystem_t::name_index_t::iterator> range = index.equal_range(
+				index_key((char*)cached_list_entry(fs,
+					TYPE_ATTRS[type_idx].LIST_ADDR, slot)));
+
+		for(filesystem_t::name_index_t::iterator it = range.first;
+			it != range.second; it++)
+		{
+			if(it->second == slot)
+			{
+				index.erase(it);
+				break;
+			}
+		}
 
-		fstr.seekg(On_disk_addrs::FAT + FAT_ATTRS.DATA_MIN * 2);
-		i = FAT_ATTRS.DATA_MIN;
+		fs.used_slots[type_idx].reset(slot);
+	}
 
-		do
+	static void index_lists(filesystem_t &fs)
+	{
+		for(u8 i = 1; i < 6; i++)
 		{
-			fstr.read((char*)&cur_val, 2);
-		} while(cur_val != 0xFFFF && ++i < MAX_FAT_LENGTH);
+			fs.name_indexes[i].clear();
+			fs.used_slots[i].assign(TYPE_ATTRS[i].MAX_CNT, false);
 
-		return i;
+			for(u16 j = 0; j < TYPE_ATTRS[i].MAX_CNT; j++) index_slot(fs, i, j);
+		}
 	}
 
-	typedef uint16_t (*load_list_entry_f)(std::fstream &src, const uint16_t slot,
+	typedef uint16_t (*load_list_entry_f)(filesystem_t &fs, const uint16_t slot,
 		List_entry_t &dst);
 
 	template <type_attrs_t MAPPED_TYPE_ATTRS>
-	static uint16_t load_list_entry(std::fstream &src, const uint16_t slot,
+	static uint16_t load_list_entry(filesystem_t &fs, const uint16_t slot,
 							 List_entry_t &dst)
 	{
 		if constexpr(!MAPPED_TYPE_ATTRS.TYPE_IDX) return 0;
 
-		const std::streampos entry_base = MAPPED_TYPE_ATTRS.LIST_ADDR + slot
-			* On_disk_sizes::LIST_ENTRY;
-
-		src.seekg(entry_base);
+		const u8 *const entry = cached_list_entry(fs,
+			MAPPED_TYPE_ATTRS.LIST_ADDR, slot);
 
-		src.read(dst.name, 16);
+		std::memcpy(dst.name, entry, 16);
 		dst.name[16] = 0;
 
 		if(!dst.name[0] || dst.name[0] == (char)0xFE)
 			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::EMPTY_ENTRY);
 
-		src.read((char*)&dst.type, 1);
+		dst.type = (Element_type_t)entry[0x10];
 
 		if(dst.type != MAPPED_TYPE_ATTRS.ELEMENT_TYPE)
 			return ret_val_setup(LIBRARY_ID,
@@ -236,17 +343,13 @@ namespace S7XX::FS
 
 		std::replace(dst.name, dst.name + sizeof(List_entry_t::name), '/', '\\');
 
-		src.seekg(entry_base + (std::streamoff)0x12);
+		std::memcpy(&dst.next_idx, entry + 0x12, 2);
+		std::memcpy(&dst.prev_idx, entry + 0x14, 2);
+		std::memcpy(&dst.cur_idx, entry + 0x16, 2);
 
-		src.read((char*)&dst.next_idx, 2);
-		src.read((char*)&dst.prev_idx, 2);
-		src.read((char*)&dst.cur_idx, 2);
-
-		src.seekg(entry_base + (std::streamoff)0x1B);
-
-		src.read((char*)&dst.program_num, 1);
-		src.read((char*)&dst.start_segment, 2);
-		src.read((char*)&dst.segment_cnt, 2);
+		dst.program_num = entry[0x1B];
+		std::memcpy(&dst.start_segment, entry + 0x1C, 2);
+		std::memcpy(&dst.segment_cnt, entry + 0x1E, 2);
 
 		if constexpr(std::endian::native != ENDIANNESS)
 		{
@@ -267,23 +370,13 @@ namespace S7XX::FS
 		load_list_entry<TYPE_ATTRS[4]>, load_list_entry<TYPE_ATTRS[5]>
 	};
 
-	typedef uint16_t (*find_free_slot_f)(std::fstream &fstr);
+	typedef uint16_t (*find_free_slot_f)(filesystem_t &fs);
 
+	//MAX_CNT if they're all taken
 	template <const type_attrs_t MAPPED_TYPE_ATTRS>
-	static uint16_t find_free_slot(std::fstream &fstr)
+	static uint16_t find_free_slot(filesystem_t &fs)
 	{
-		char name0;
-		uint16_t i;
-
-		for(i = 0; i < MAPPED_TYPE_ATTRS.MAX_CNT; i++)
-		{
-			fstr.seekg(MAPPED_TYPE_ATTRS.LIST_ADDR + i * On_disk_sizes::LIST_ENTRY);
-			name0 = fstr.get();
-
-			if(!name0 || name0 == (char)0xFE) break;
-		}
-
-		return i;
+		return fs.used_slots[MAPPED_TYPE_ATTRS.TYPE_IDX].find_first_unset();
 	}
 
 	constexpr find_free_slot_f FIND_FREE_SLOT_FUNCS[] =
@@ -294,16 +387,18 @@ namespace S7XX::FS
 	};
 
 	typedef void (*write_list_entry_f)(List_entry_t src, const uint16_t slot,
-		std::fstream &dst);
+		filesystem_t &fs);
 
 	template <type_attrs_t TYPE_ATTRS>
 	static void write_list_entry(List_entry_t src, const uint16_t slot,
-							  std::fstream &dst)
+							  filesystem_t &fs)
 	{
 		if constexpr((u8)TYPE_ATTRS.ELEMENT_TYPE == 0)
 			throw min_vfs::FS_err(ret_val_setup(LIBRARY_ID, (u8)ERR::WTF));
 
-		const std::streampos entry_base = TYPE_ATTRS.LIST_ADDR + slot * On_disk_sizes::LIST_ENTRY;
+		u8 *const entry = cached_list_entry(fs, TYPE_ATTRS.LIST_ADDR, slot);
+
+		unindex_slot(fs, TYPE_ATTRS.TYPE_IDX, slot);
 
 		if constexpr(std::endian::native != ENDIANNESS)
 		{
@@ -314,24 +409,23 @@ namespace S7XX::FS
 			src.segment_cnt = std::byteswap(src.segment_cnt);
 		}
 
-		dst.seekp(entry_base);
+		/*The bytes we don't know about keep whatever the cache (the disk)
+		 *had, so the whole entry can go out in one write.*/
+		std::memcpy(entry, src.name, 16);
+		entry[0x10] = (u8)src.type;
 
-		dst.write(src.name, 16);
-		dst.write((char*)&src.type, 1);
-
-		dst.seekp(entry_base + (std::streamoff)0x12);
-
-		dst.write((char*)&src.next_idx, 2);
-		dst.write((char*)&src.prev_idx, 2);
-		dst.write((char*)&src.cur_idx, 2);
+		std::memcpy(entry + 0x12, &src.next_idx, 2);
+		std::memcpy(entry + 0x14, &src.prev_idx, 2);
+		std::memcpy(entry + 0x16, &src.cur_idx, 2);
 
 		/*Valgrind complains about an uninitialized value here, but I can't
 		 *figure it out.*/
-		dst.seekp(entry_base + (std::streamoff)0x1B);
+		entry[0x1B] = src.program_num;
+		std::memcpy(entry + 0x1C, &src.start_segment, 2);
+		std::memcpy(entry + 0x1E, &src.segment_cnt, 2);
 
-		dst.write((char*)&src.program_num, 1);
-		dst.write((char*)&src.start_segment, 2);
-		dst.write((char*)&src.segment_cnt, 2);
+		store_list_entry(fs, TYPE_ATTRS.LIST_ADDR, slot);
+		index_slot(fs, TYPE_ATTRS.TYPE_IDX, slot);
 	}
 
 	constexpr write_list_entry_f WRITE_LIST_ENTRY_FUNCS[6] =
@@ -383,10 +477,6 @@ namespace S7XX::FS
 		}
 		else
 		{
-			u16 cls_cnt;
-
-			fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + idx
-				* On_disk_sizes::LIST_ENTRY);
 			dst =
 			{
 				.fname = std::string(16, '\0'),
@@ -398,24 +488,15 @@ namespace S7XX::FS
 				.ftype = min_vfs::ftype_t::file
 			};
 
-			fs.stream.read(dst.fname.data(), 16);
+			std::memcpy(dst.fname.data(),
+						cached_list_entry(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, idx), 16);
 			dst.fname = std::to_string(idx) + "-" + dst.fname;
 
 			if(TYPE_ATTRS_ENTRY.ELEMENT_TYPE == Element_type_t::sample)
-			{
-				fs.stream.seekp(14, std::fstream::cur);
-				fs.stream.read((char*)&cls_cnt, 2);
+				dst.fsize += get_cached_u16(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, idx,
+											0x1E) * AUDIO_SEGMENT_SIZE;
 
-				if constexpr(ENDIANNESS != std::endian::native)
-					cls_cnt = std::byteswap(cls_cnt);
-
-				dst.fsize += cls_cnt * AUDIO_SEGMENT_SIZE;
-			}
-
-			if(!fs.stream.good())
-				return ret_val_setup(min_vfs::LIBRARY_ID,
-									 (u8)min_vfs::ERR::IO_ERROR);
-			else return 0;
+			return 0;
 		}
 	}
 
@@ -432,7 +513,6 @@ namespace S7XX::FS
 								 const bool get_dir)
 	{
 		char name[17];
-		u16 cls_cnt;
 
 		const dir_map_t::const_iterator dir_it =
 			DIR_NAME_TO_ATTRS.find(split_path[0]);
@@ -472,9 +552,8 @@ namespace S7XX::FS
 		for(u16 i = 0, j = 0; i < mapped_type_attrs.MAX_CNT &&
 			j < fs.header.TOC.*mapped_type_attrs.TOC_PTR; i++)
 		{
-			fs.stream.seekg(mapped_type_attrs.LIST_ADDR + i
-				* On_disk_sizes::LIST_ENTRY);
-			fs.stream.read(name, 16);
+			std::memcpy(name,
+						cached_list_entry(fs, mapped_type_attrs.LIST_ADDR, i), 16);
 
 			if(name[0] && name[0] != (char)0xFE)
 			{
@@ -499,15 +578,9 @@ namespace S7XX::FS
 					+ dentries.back().fname;
 
 				if(mapped_type_attrs.ELEMENT_TYPE == Element_type_t::sample)
-				{
-					fs.stream.seekp(14, std::fstream::cur);
-					fs.stream.read((char*)&cls_cnt, 2);
-
-					if constexpr(ENDIANNESS != std::endian::native)
-						cls_cnt = std::byteswap(cls_cnt);
-
-					dentries.back().fsize += cls_cnt * AUDIO_SEGMENT_SIZE;
-				}
+					dentries.back().fsize += get_cached_u16(fs,
+						mapped_type_attrs.LIST_ADDR, i, 0x1E)
+						* AUDIO_SEGMENT_SIZE;
 
 				if(split_path.size() > 1) return 0;
 
@@ -515,10 +588,6 @@ namespace S7XX::FS
 			}
 		}
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID,
-								 (u8)min_vfs::ERR::IO_ERROR);
-
 		if(split_path.size() > 1)
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::NOT_FOUND);
@@ -528,29 +597,23 @@ namespace S7XX::FS
 
 	typedef uint16_t (*find_slot_from_name_f)(filesystem_t &fs, const char name[]);
 
+	/*Same names can show up more than once; like the HW, we go with the
+	first one. MAX_CNT if there's no such name.*/
 	template <const type_attrs_t &TYPE_ATTRS_ENTRY>
 	static uint16_t find_slot_from_name(filesystem_t &fs, const char name[16])
 	{
-		u16 abs_idx, j;
-		char tmp[16];
+		u16 slot = TYPE_ATTRS_ENTRY.MAX_CNT;
 
-		for(abs_idx = 0, j = 0; abs_idx < TYPE_ATTRS_ENTRY.MAX_CNT && j < fs.header.TOC.*TYPE_ATTRS_ENTRY.TOC_PTR; abs_idx++)
-		{
-			fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + abs_idx * On_disk_sizes::LIST_ENTRY);
-			fs.stream.read(tmp, 16);
-
-			if(tmp[0] && tmp[0] != (char)0xFE)
-			{
-				std::replace(tmp, tmp + 16, '/', '\\');
-				if(!std::strncmp(tmp, name, 16)) break;
-
-				j++;
-			}
-		}
+		const std::pair<filesystem_t::name_index_t::const_iterator,
+			filesystem_t::name_index_t::const_iterator> range =
+			fs.name_indexes[TYPE_ATTRS_ENTRY.TYPE_IDX].equal_range(
+				index_key(name));
 
-		if(j == fs.header.TOC.*TYPE_ATTRS_ENTRY.TOC_PTR) abs_idx = TYPE_ATTRS_ENTRY.MAX_CNT;
+		for(filesystem_t::name_index_t::const_iterator it = range.first;
+			it != range.second; it++)
+			slot = std::min(slot, it->second);
 
-		return abs_idx;
+		return slot;
 	}
 
 	constexpr find_slot_from_name_f find_volume_from_name = find_slot_from_name<TYPE_ATTRS[1]>;
@@ -565,108 +628,161 @@ namespace S7XX::FS
 		find_patch_from_name, find_partial_from_name, find_sample_from_name
 	};
 
-	static uint16_t reloc_cluster(filesystem_t &fs, const uint16_t cluster, const uint16_t offset)
+	static void map_sample_owners(filesystem_t &fs)
 	{
-		//copy -> repoint -> free
+		u16 start_cls;
 
-		const u16 new_cluster = FAT_utils::find_next_free_cluster(fs.FAT.get(),
-										FAT_ATTRS, fs.fat_attrs.LENGTH, offset);
+		fs.sample_owners.clear();
 
-		if(new_cluster == FAT_ATTRS.END_OF_CHAIN)
-			return ret_val_setup(min_vfs::LIBRARY_ID,
-								 (u8)min_vfs::ERR::NO_SPACE_LEFT);
+		for(u16 i = 0, j = 0; i < MAX_SAMPLE_COUNT
+			&& j < fs.header.TOC.sample_cnt; i++)
+		{
+			if(!cached_entry_in_use(fs, On_disk_addrs::SAMPLE_LIST, i)) continue;
 
-		char name0;
-		u16 tgt_end_n_cls_val, tgt_end_o_cls_val, tgt_end_o_cls, rd_strt_cls;
+			j++;
 
-		std::unique_ptr<char[]> cur_clus;
+			start_cls = get_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, i, 0x1C);
 
-		cur_clus = std::make_unique<char[]>(AUDIO_SEGMENT_SIZE);
+			if(FAT_t::in_data_range(start_cls))
+				fs.sample_owners[start_cls] = i;
+		}
+	}
 
-		fs.stream.seekg(On_disk_addrs::AUDIO_SECTION
-			+ (cluster - FAT_ATTRS.DATA_MIN) * AUDIO_SEGMENT_SIZE);
-		fs.stream.read(cur_clus.get(), AUDIO_SEGMENT_SIZE);
+	static void update_sample_owner(filesystem_t &fs, const u16 old_start,
+									const u16 new_start, const u16 idx)
+	{
+		if(old_start == new_start) return;
 
-		fs.stream.seekp(On_disk_addrs::AUDIO_SECTION
-			+ (new_cluster - FAT_ATTRS.DATA_MIN) * AUDIO_SEGMENT_SIZE);
-		fs.stream.write(cur_clus.get(), AUDIO_SEGMENT_SIZE);
+		const std::unordered_map<u16, u16>::iterator owner =
+			fs.sample_owners.find(old_start);
 
-		cur_clus.reset();
+		if(owner != fs.sample_owners.end() && owner->second == idx)
+			fs.sample_owners.erase(owner);
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+		if(FAT_t::in_data_range(new_start)) fs.sample_owners[new_start] = idx;
+	}
 
-		//mark new cluster
-		tgt_end_o_cls_val = fs.FAT[cluster];
+	//Cap on how much cluster data reloc_clusters holds at once
+	constexpr u16 RELOC_IO_CLUSTERS = 128;
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			tgt_end_o_cls_val = std::byteswap(tgt_end_o_cls_val);
+	/*Cap on how many segments read_write_sample moves with one read/write, so
+	 *it doesn't sit on fs.mtx for too long*/
+	constexpr u16 SAMPLE_IO_CLUSTERS = 64;
+
+	/*Moves every cluster in srcs (sorted, no repeats) to the first free ones
+	 *at or after offset. The destinations come out of one scan of the FAT,
+	 *data gets copied a run of consecutive clusters at a time, and the FAT
+	 *and the owners' start segments get patched in one pass each. FAT changes
+	 *only go to the cache; the caller commits them.*/
+	static uint16_t reloc_clusters(filesystem_t &fs, const std::vector<u16> &srcs,
+								   const uint16_t offset)
+	{
+		//copy -> repoint -> free
 
-		fs.stream.seekp(On_disk_addrs::FAT + 2 * new_cluster);
-		fs.stream.write((char*)&tgt_end_o_cls_val, 2);
+		std::vector<u16> dsts, preds;
+		std::unique_ptr<char[]> buffer;
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+		dsts.reserve(srcs.size());
 
-		fs.FAT[new_cluster] = fs.FAT[cluster];
+		for(u16 next = offset; dsts.size() < srcs.size(); next = dsts.back() + 1)
+		{
+			const u16 dst = next > FAT_ATTRS.DATA_MAX ? FAT_ATTRS.END_OF_CHAIN
+				: FAT_t::find_next_free_cluster(fs.FAT.get(),
+												fs.fat_attrs.LENGTH, next);
 
-		if(cluster == FAT_ATTRS.END_OF_CHAIN) return 0;
+			if(dst == FAT_ATTRS.END_OF_CHAIN)
+				return ret_val_setup(min_vfs::LIBRARY_ID,
+									 (u8)min_vfs::ERR::NO_SPACE_LEFT);
 
-		//update FAT
-		tgt_end_n_cls_val = new_cluster;
+			dsts.push_back(dst);
+		}
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			tgt_end_n_cls_val = std::byteswap(tgt_end_n_cls_val);
+		buffer = std::make_unique<char[]>(AUDIO_SEGMENT_SIZE
+			* std::min(srcs.size(), (size_t)RELOC_IO_CLUSTERS));
 
-		for(u16 i = FAT_ATTRS.DATA_MIN; i < fs.fat_attrs.LENGTH; i++)
+		for(size_t i = 0; i < srcs.size();)
 		{
-			if(fs.FAT[i] == cluster)
-			{
-				fs.stream.seekp(On_disk_addrs::FAT + 2 * i);
-				fs.stream.write((char*)&tgt_end_n_cls_val, 2);
+			size_t run = 1;
 
-				fs.FAT[i] = new_cluster;
-			}
+			while(i + run < srcs.size() && run < RELOC_IO_CLUSTERS
+				&& srcs[i + run] == srcs[i] + run
+				&& dsts[i + run] == dsts[i] + run)
+				run++;
+
+			fs.stream.seekg(On_disk_addrs::AUDIO_SECTION
+				+ (srcs[i] - FAT_ATTRS.DATA_MIN) * AUDIO_SEGMENT_SIZE);
+			fs.stream.read(buffer.get(), run * AUDIO_SEGMENT_SIZE);
+
+			fs.stream.seekp(On_disk_addrs::AUDIO_SECTION
+				+ (dsts[i] - FAT_ATTRS.DATA_MIN) * AUDIO_SEGMENT_SIZE);
+			fs.stream.write(buffer.get(), run * AUDIO_SEGMENT_SIZE);
+
+			if(!fs.stream.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID,
+									 (u8)min_vfs::ERR::IO_ERROR);
+
+			i += run;
 		}
 
-		//update sample list
-		tgt_end_o_cls = cluster;
+		buffer.reset();
+		fs.chain_gen++;
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			tgt_end_o_cls = std::byteswap(tgt_end_o_cls);
+		//Where a cluster ends up, if it's one of the ones being moved
+		const auto moved = [&srcs, &dsts](const u16 cls) -> u16
+		{
+			const std::vector<u16>::const_iterator it =
+				std::lower_bound(srcs.begin(), srcs.end(), cls);
+
+			if(it == srcs.end() || *it != cls) return cls;
+
+			return dsts[it - srcs.begin()];
+		};
 
-		for(u16 i = 0, j = 0; i < MAX_SAMPLE_COUNT && j < fs.header.TOC.sample_cnt; i++)
+		/*Only one thing can point at a cluster: either the previous cluster in
+		the chain or, for the first one, the sample that owns it. Look them all
+		up before the FAT starts changing under us.*/
+		preds.reserve(srcs.size());
+		for(const u16 src: srcs) preds.push_back(fs.FAT.predecessor(src));
+
+		for(size_t i = 0; i < srcs.size(); i++)
 		{
-			fs.stream.seekg(On_disk_addrs::SAMPLE_LIST + i
-				* On_disk_sizes::LIST_ENTRY);
-			name0 = fs.stream.get();
+			//mark new cluster
+			fs.FAT.set(dsts[i], moved(fs.FAT[srcs[i]]));
 
-			if(name0 && name0 != (char)0xFE)
+			//links from other moved clusters were just taken care of
+			if(preds[i] != FAT_ATTRS.END_OF_CHAIN)
 			{
-				fs.stream.seekg(On_disk_addrs::SAMPLE_LIST + i
-					* On_disk_sizes::LIST_ENTRY + 0x1C);
-				fs.stream.read((char*)&rd_strt_cls, 2);
+				if(moved(preds[i]) == preds[i]) fs.FAT.set(preds[i], dsts[i]);
 
-				if(rd_strt_cls == tgt_end_o_cls)
-				{
-					fs.stream.seekp(On_disk_addrs::SAMPLE_LIST + i
-						* On_disk_sizes::LIST_ENTRY + 0x1C);
-					fs.stream.write((char*)&tgt_end_n_cls_val, 2);
-				}
+				continue;
+			}
 
-				j++;
+			const std::unordered_map<u16, u16>::const_iterator owner =
+				fs.sample_owners.find(srcs[i]);
+
+			if(owner == fs.sample_owners.end()) continue;
+
+			const u16 owner_idx = owner->second;
+
+			set_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, owner_idx, 0x1C,
+						   dsts[i]);
+
+			update_sample_owner(fs, srcs[i], dsts[i], owner_idx);
+
+			//Open files would write their old start back otherwise
+			for(std::pair<const std::string, std::pair<uintmax_t,
+				internal_file_t>> &file: fs.open_files)
+			{
+				internal_file_t &internal_file = file.second.second;
+
+				if(internal_file.type_idx == (u8)ftype_IDs::SAMPLES
+					&& internal_file.list_entry.cur_idx == owner_idx)
+					internal_file.list_entry.start_segment = dsts[i];
 			}
 		}
 
 		//free
-		tgt_end_n_cls_val = FAT_ATTRS.FREE_CLUSTER;
-
-		if constexpr(ENDIANNESS != std::endian::native)
-			tgt_end_n_cls_val = std::byteswap(tgt_end_n_cls_val);
-
-		fs.stream.seekp(On_disk_addrs::FAT + 2 * cluster);
-		fs.stream.write((char*)&tgt_end_n_cls_val, 2);
-		fs.FAT[cluster] = FAT_ATTRS.FREE_CLUSTER;
+		for(const u16 src: srcs) fs.FAT.set(src, FAT_ATTRS.FREE_CLUSTER);
 
 		if(!fs.stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID,
@@ -677,134 +793,245 @@ namespace S7XX::FS
 
 	static uint16_t free_OS_cls(filesystem_t &fs)
 	{
-		constexpr u16 FREE_CLS = ENDIANNESS != std::endian::native ?
-			std::byteswap(FAT_ATTRS.FREE_CLUSTER) : FAT_ATTRS.FREE_CLUSTER;
-
 		u16 err;
 
-		fs.stream.seekp(On_disk_addrs::FAT + FAT_ATTRS.DATA_MIN * 2);
-
 		for(u8 i = 0; i < S760_OS_CLUSTERS; i++)
-		{
-			fs.stream.write((char*)&FREE_CLS, 2);
-			fs.FAT[i + FAT_ATTRS.DATA_MIN] = FAT_ATTRS.FREE_CLUSTER;
-		}
+			fs.FAT.set(i + FAT_ATTRS.DATA_MIN, FAT_ATTRS.FREE_CLUSTER);
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
-
-		err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream, FAT_ATTRS,
-									   fs.fat_attrs, (u16)1,
+		err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
 									   (u16)(fs.FAT[1] + S760_OS_CLUSTERS));
 		if(err) return err;
 
-		return 0;
+		return fs.FAT.commit(fs.stream, FAT_ATTRS);
 	}
 
-	typedef uint16_t(*count_clusters_f)(filesystem_t &fs, const uint16_t idx,
-									std::unordered_map<u16, u16> &sample_map);
+	constexpr u32 PARAMS_SIZE = On_disk_addrs::SAMPLE_PARAMS
+		- On_disk_addrs::VOLUME_PARAMS;
 
-	static uint16_t count_clusters_partial(filesystem_t &fs, const uint16_t idx,
-									std::unordered_map<u16, u16> &sample_map)
+	//Where the i-th reference to the next type down is in a params entry
+	static constexpr u16 ref_offset(const u8 type_idx, const u8 i)
 	{
-		const std::streamoff list_entry_base = On_disk_addrs::PARTIAL_LIST + idx
-			* On_disk_sizes::LIST_ENTRY;
-		const std::streamoff params_entry_base = On_disk_addrs::PARTIAL_PARAMS
-			+ idx * On_disk_sizes::PARTIAL_PARAMS_ENTRY;
+		//A partial's 4 sample indices are 16 bytes apart
+		return type_idx == (u8)ftype_IDs::PARTIALS ? 0x10 * (i + 1)
+			: 0x10 + TYPE_ATTRS_EXT[type_idx].SIZE_BEFORE_INDICES + i * 2;
+	}
+
+	//Slots of the next type down a params entry points at, sorted
+	static void parse_refs(const u8 type_idx, const u8 *const params,
+						   std::vector<u16> &dst)
+	{
+		const type_attrs_ext_t &ext = TYPE_ATTRS_EXT[type_idx];
+		const u16 child_max = TYPE_ATTRS[type_idx + 1].MAX_CNT;
+
+		u16 idx;
 
-		u16 cluster_cnt, temp;
-		std::set<u16> local_s_set;
+		dst.clear();
 
-		for(u8 i = 0; i < 4; i++)
+		for(u8 i = 0; i < ext.IDX_CNT; i++)
 		{
-			fs.stream.seekg(params_entry_base + 0x10 * (i + 1));
-			fs.stream.read((char*)&temp, 2);
+			std::memcpy(&idx, params + ref_offset(type_idx, i), 2);
 
 			if constexpr(ENDIANNESS != std::endian::native)
-				temp = std::byteswap(temp);
+				idx = std::byteswap(idx);
 
-			local_s_set.insert(temp);
+			//unused ones are 0xFFFF
+			if(idx < child_max) dst.push_back(idx);
 		}
 
+		std::sort(dst.begin(), dst.end());
+		dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+	}
+
+	//Built from the params on disk, once, the first time anything needs it
+	static uint16_t ensure_deps(filesystem_t &fs)
+	{
+		dep_graph_t &deps = fs.deps;
+
+		std::unique_ptr<u8[]> params;
+
+		if(deps.built) return 0;
+
+		params = std::make_unique<u8[]>(PARAMS_SIZE);
+
+		fs.stream.seekg(On_disk_addrs::VOLUME_PARAMS);
+		fs.stream.read((char*)params.get(), PARAMS_SIZE);
+
 		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
 
-		//it's probably better to split this into 2 steps because the first loop
-		//would most likely read a single block and cache it. otherwise, we'd
-		//keep seeking to fairly distant parts of the FS and reading stuff
+		for(u8 i = 1; i < 6; i++)
+		{
+			deps.children[i].assign(TYPE_ATTRS[i].MAX_CNT, {});
+			deps.parents[i].assign(TYPE_ATTRS[i].MAX_CNT, {});
+			deps.samples[i].assign(TYPE_ATTRS[i].MAX_CNT, {});
+			deps.samples_valid[i].assign(TYPE_ATTRS[i].MAX_CNT, false);
+		}
+
+		for(u8 i = 1; i < (u8)ftype_IDs::SAMPLES; i++)
+		{
+			const type_attrs_t &attrs = TYPE_ATTRS[i];
+
+			for(u16 j = 0; j < attrs.MAX_CNT; j++)
+			{
+				if(!cached_entry_in_use(fs, attrs.LIST_ADDR, j)) continue;
+
+				parse_refs(i, params.get() + (attrs.PARAMS_ADDR
+					- On_disk_addrs::VOLUME_PARAMS) + j
+					* attrs.PARAMS_ENTRY_SIZE, deps.children[i][j]);
+
+				for(const u16 child: deps.children[i][j])
+					deps.parents[i + 1][child].push_back(j);
+			}
+		}
+
+		deps.built = true;
+
+		return 0;
+	}
+
+	/*Forgets the samples a slot and everything above it reach. If a slot's
+	 *aren't known, neither are its parents', so we can stop there.*/
+	static void invalidate_deps(filesystem_t &fs, const u8 type_idx,
+								const u16 slot)
+	{
+		dep_graph_t &deps = fs.deps;
 
-		cluster_cnt = 0;
+		if(!deps.samples_valid[type_idx].test(slot)) return;
 
-		for(const u16 index: local_s_set)
+		deps.samples_valid[type_idx].reset(slot);
+		deps.samples[type_idx][slot].clear();
+
+		if(type_idx > (u8)ftype_IDs::VOLS)
+			for(const u16 parent: deps.parents[type_idx][slot])
+				invalidate_deps(fs, type_idx - 1, parent);
+	}
+
+	//Every sample a slot ends up referencing, without repeats
+	static const std::vector<u16>& reachable_samples(filesystem_t &fs,
+													 const u8 type_idx,
+													 const u16 slot)
+	{
+		dep_graph_t &deps = fs.deps;
+		std::vector<u16> &dst = deps.samples[type_idx][slot];
+
+		if(deps.samples_valid[type_idx].test(slot)) return dst;
+
+		if(type_idx == (u8)ftype_IDs::PARTIALS)
+			dst = deps.children[type_idx][slot];
+		else
 		{
-			fs.stream.seekg(On_disk_addrs::SAMPLE_LIST + index * On_disk_sizes::LIST_ENTRY + 0x1E);
-			fs.stream.read((char*)&temp, 2);
+			dst.clear();
 
-			if constexpr(ENDIANNESS != std::endian::native)
-				temp = std::byteswap(temp);
+			for(const u16 child: deps.children[type_idx][slot])
+			{
+				const std::vector<u16> &below = reachable_samples(fs,
+					type_idx + 1, child);
+
+				dst.insert(dst.end(), below.begin(), below.end());
+			}
 
-			cluster_cnt += temp;
-			sample_map[index] = temp;
+			std::sort(dst.begin(), dst.end());
+			dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
 		}
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			cluster_cnt = std::byteswap(cluster_cnt);
+		deps.samples_valid[type_idx].set(slot);
 
-		fs.stream.seekp(list_entry_base + 0x1E);
-		fs.stream.write((char*)&cluster_cnt, 2);
+		return dst;
+	}
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+	/*Same total the HW keeps in the list entry: the clusters of every sample
+	 *the slot reaches, each one counted once.*/
+	static u16 compute_total(filesystem_t &fs, const u8 type_idx,
+							 const u16 slot)
+	{
+		u16 total = 0;
 
-		return 0;
+		for(const u16 sample: reachable_samples(fs, type_idx, slot))
+		{
+			if(cached_entry_in_use(fs, On_disk_addrs::SAMPLE_LIST, sample))
+				total += get_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, sample,
+										0x1E);
+		}
+
+		return total;
 	}
 
-	template <const type_attrs_t TYPE_ATTRS_ENTRY,
-		const type_attrs_ext_t TYPE_ATTRS_EXT_ENTRY, count_clusters_f NEXT_FUNC>
-	static uint16_t count_clusters(filesystem_t &fs, const uint16_t idx,
-								   std::unordered_map<u16, u16> &sample_map)
+	static void write_total(filesystem_t &fs, const u8 type_idx,
+							const u16 slot)
 	{
-		const std::streamoff list_entry_base = TYPE_ATTRS_ENTRY.LIST_ADDR + idx
-			* On_disk_sizes::LIST_ENTRY;
-		const std::streamoff params_entry_base = TYPE_ATTRS_ENTRY.PARAMS_ADDR
-			+ idx * TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE;
+		const u32 list_addr = TYPE_ATTRS[type_idx].LIST_ADDR;
 
-		//might wanna move to the heap
-		u16 indices[TYPE_ATTRS_EXT_ENTRY.IDX_CNT];
-		u16 err, cluster_cnt;
+		if(!cached_entry_in_use(fs, list_addr, slot)) return;
 
-		std::unordered_map<u16, u16> local_s_map;
+		const u16 total = compute_total(fs, type_idx, slot);
 
-		fs.stream.seekg(params_entry_base + 0x10
-			+ TYPE_ATTRS_EXT_ENTRY.SIZE_BEFORE_INDICES);
-		fs.stream.read((char*)indices, TYPE_ATTRS_EXT_ENTRY.IDX_CNT * 2);
+		if(total != get_cached_u16(fs, list_addr, slot, 0x1E))
+			set_cached_u16(fs, list_addr, slot, 0x1E, total);
+	}
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID,
-								 (u8)min_vfs::ERR::IO_ERROR);
+	//Rewrites the totals of slots and of everything that references them
+	static void update_totals(filesystem_t &fs, u8 type_idx,
+							  std::vector<u16> slots)
+	{
+		std::vector<u16> above;
 
-		for(u16 index: indices)
+		for(; type_idx >= (u8)ftype_IDs::VOLS; type_idx--)
 		{
-			if constexpr(ENDIANNESS != std::endian::native)
-				index = std::byteswap(index);
+			std::sort(slots.begin(), slots.end());
+			slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
 
-			err = NEXT_FUNC(fs, index, local_s_map);
-			if(err) return err;
+			if(type_idx != (u8)ftype_IDs::SAMPLES)
+				for(const u16 slot: slots) write_total(fs, type_idx, slot);
+
+			above.clear();
+
+			if(type_idx > (u8)ftype_IDs::VOLS)
+				for(const u16 slot: slots)
+					for(const u16 parent: fs.deps.parents[type_idx][slot])
+						above.push_back(parent);
+
+			slots.swap(above);
 		}
+	}
+
+	//For after a params write to a volume, perf, patch or partial
+	static uint16_t refresh_deps(filesystem_t &fs, const u8 type_idx,
+								 const u16 slot)
+	{
+		const type_attrs_t &attrs = TYPE_ATTRS[type_idx];
+
+		u16 err;
+		u8 params[On_disk_sizes::PATCH_PARAMS_ENTRY];
+		std::vector<u16> refs;
+
+		err = ensure_deps(fs);
+		if(err) return err;
 
-		cluster_cnt = 0;
+		dep_graph_t &deps = fs.deps;
 
-		for(const std::pair<u16, u16> entry: local_s_map)
+		if(cached_entry_in_use(fs, attrs.LIST_ADDR, slot))
 		{
-			cluster_cnt += entry.second;
-			sample_map.insert(entry);
+			fs.stream.seekg(attrs.PARAMS_ADDR + slot * attrs.PARAMS_ENTRY_SIZE);
+			fs.stream.read((char*)params, attrs.PARAMS_ENTRY_SIZE);
+
+			if(!fs.stream.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID,
+									 (u8)min_vfs::ERR::IO_ERROR);
+
+			parse_refs(type_idx, params, refs);
 		}
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			cluster_cnt = std::byteswap(cluster_cnt);
+		for(const u16 child: deps.children[type_idx][slot])
+			std::erase(deps.parents[type_idx + 1][child], slot);
+
+		for(const u16 child: refs)
+			deps.parents[type_idx + 1][child].push_back(slot);
 
-		fs.stream.seekp(list_entry_base + 0x1E);
-		fs.stream.write((char*)&cluster_cnt, 2);
+		deps.children[type_idx][slot] = std::move(refs);
+
+		invalidate_deps(fs, type_idx, slot);
+		update_totals(fs, type_idx, {slot});
 
 		if(!fs.stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID,
@@ -813,15 +1040,26 @@ namespace S7XX::FS
 		return 0;
 	}
 
-	constexpr count_clusters_f count_patch_clusters = count_clusters<
-		TYPE_ATTRS[(u8)ftype_IDs::PATCHES],
-		TYPE_ATTRS_EXT[(u8)ftype_IDs::PATCHES], count_clusters_partial>;
-	constexpr count_clusters_f count_perf_clusters = count_clusters<
-		TYPE_ATTRS[(u8)ftype_IDs::PERFS], TYPE_ATTRS_EXT[(u8)ftype_IDs::PERFS],
-		count_patch_clusters>;
-	constexpr count_clusters_f count_volume_clusters = count_clusters<
-		TYPE_ATTRS[(u8)ftype_IDs::VOLS], TYPE_ATTRS_EXT[(u8)ftype_IDs::VOLS],
-		count_perf_clusters>;
+	//Brings the totals above every sample that changed size up to date
+	static uint16_t update_sample_deps(filesystem_t &fs)
+	{
+		u16 err;
+		std::vector<u16> dirty;
+
+		if(fs.deps.dirty_samples.empty()) return 0;
+
+		err = ensure_deps(fs);
+		if(err) return err;
+
+		dirty.swap(fs.deps.dirty_samples);
+		update_totals(fs, (u8)ftype_IDs::SAMPLES, std::move(dirty));
+
+		if(!fs.stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
 
 	constexpr u16 DUMMY_CLS_CNT = 0xFFFF;
 
@@ -836,11 +1074,7 @@ namespace S7XX::FS
 	{
 		u16 err;
 
-		err = FAT_utils::write_chain(fs.stream, FAT_ATTRS, fs.fat_attrs, chain);
-		if(err) return err;
-
-		err = FAT_utils::write_chain(fs.FAT.get(), FAT_ATTRS,
-									 fs.fat_attrs.LENGTH, chain);
+		err = FAT_utils::write_chain(fs.FAT, FAT_ATTRS, chain);
 		if(err) return err;
 
 		return 0;
@@ -849,11 +1083,7 @@ namespace S7XX::FS
 	template <const type_attrs_t &TYPE_ATTRS_ENTRY>
 	static bool file_exists(filesystem_t &fs, const u16 idx)
 	{
-		fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + idx
-			* On_disk_sizes::LIST_ENTRY);
-		const u8 name0 = fs.stream.get();
-
-		return name0 && name0 != 0xFE;
+		return cached_entry_in_use(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, idx);
 	}
 
 	template <const type_attrs_t &TYPE_ATTRS_ENTRY>
@@ -862,10 +1092,13 @@ namespace S7XX::FS
 		for(u16 i = 0, j = 0; i < idx && i < TYPE_ATTRS_ENTRY.MAX_CNT && j <
 			fs.header.TOC.*TYPE_ATTRS_ENTRY.TOC_PTR; i++)
 		{
-			fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + i
-				* On_disk_sizes::LIST_ENTRY);
+			u8 *const entry = cached_list_entry(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, i);
 
-			if(!fs.stream.peek()) fs.stream.put(0xFE);
+			if(!*entry)
+			{
+				*entry = 0xFE;
+				store_list_entry(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, i, 0, 1);
+			}
 		}
 
 		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR)
@@ -891,7 +1124,7 @@ namespace S7XX::FS
 		list_entry.segment_cnt = 0;
 		list_entry.start_segment = 0;
 
-		write_list_entry<TYPE_ATTRS_ENTRY>(list_entry, list_entry.cur_idx, fs.stream);
+		write_list_entry<TYPE_ATTRS_ENTRY>(list_entry, list_entry.cur_idx, fs);
 		fs.stream.flush();
 
 		if(!fs.stream.good())
@@ -915,7 +1148,8 @@ namespace S7XX::FS
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::IO_ERROR);
 
-		return 0;
+		//Whatever references this slot now reaches its samples
+		return refresh_deps(fs, TYPE_ATTRS_ENTRY.TYPE_IDX, list_entry.cur_idx);
 	}
 
 	static constexpr Media_type_t media_type_from_OS_size(const uint32_t size)
@@ -928,45 +1162,39 @@ namespace S7XX::FS
 
 	static uint16_t reloc_OS_clusters(filesystem_t &fs)
 	{
-		u16 err, sp_os_cls_val, temp;
+		u16 err, sp_os_cls_val;
+		std::vector<u16> in_use;
 
 		//Might wanna check FAT[1], too.
 		if(fs.fat_attrs.LENGTH - FAT_ATTRS.DATA_MIN < S760_OS_CLUSTERS)
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::NO_SPACE_LEFT);
 
-		sp_os_cls_val = 0xFFFE;
-		temp = 0xFFFE;
-
-		if constexpr(ENDIANNESS != std::endian::native)
-			temp = std::byteswap(temp);
-
-		err = 0;
 		for(u8 i = FAT_ATTRS.DATA_MIN; i < S760_OS_CLUSTERS
 			+ FAT_ATTRS.DATA_MIN; i++)
 		{
 			if((fs.FAT[i] >= FAT_ATTRS.DATA_MIN && fs.FAT[i]
 				<= FAT_ATTRS.DATA_MAX) || fs.FAT[i] == FAT_ATTRS.END_OF_CHAIN)
-			{
-				err = reloc_cluster(fs, i, S760_OS_CLUSTERS
-					+ FAT_ATTRS.DATA_MIN);
+				in_use.push_back(i);
+		}
 
-				if(err) return err;
-			}
+		//All of them at once, see reloc_clusters
+		if(!in_use.empty())
+		{
+			err = reloc_clusters(fs, in_use, S760_OS_CLUSTERS
+				+ FAT_ATTRS.DATA_MIN);
 
-			if(i == 57 + FAT_ATTRS.DATA_MIN)
-			{
-				sp_os_cls_val = 0xFFFD;
-				temp = 0xFFFD;
+			if(err) return err;
+		}
 
-				if constexpr(ENDIANNESS != std::endian::native)
-					temp = std::byteswap(temp);
-			}
+		sp_os_cls_val = 0xFFFE;
 
-			fs.stream.seekp(On_disk_addrs::FAT + 2 * i);
-			fs.stream.write((char*)&temp, 2);
+		for(u8 i = FAT_ATTRS.DATA_MIN; i < S760_OS_CLUSTERS
+			+ FAT_ATTRS.DATA_MIN; i++)
+		{
+			if(i == 57 + FAT_ATTRS.DATA_MIN) sp_os_cls_val = 0xFFFD;
 
-			fs.FAT[i] = sp_os_cls_val;
+			fs.FAT.set(i, sp_os_cls_val);
 		}
 
 		/*NOTE: Right now, we assume all clusters will be either free or in use.
@@ -980,10 +1208,11 @@ namespace S7XX::FS
 		count from FAT[i].*/
 
 		//update FAT's free cls cnt
-		err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream, FAT_ATTRS,
-									   fs.fat_attrs, (u16)1,
+		err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
 									   (u16)(fs.FAT[1] - S760_OS_CLUSTERS));
-		return err;
+		if(err) return err;
+
+		return fs.FAT.commit(fs.stream, FAT_ATTRS);
 	}
 
 	static uint16_t truncate_OS(filesystem_t &fs, List_entry_t &list_entry,
@@ -1032,26 +1261,20 @@ namespace S7XX::FS
 	{
 		u16 err;
 
-		err = FAT_utils::shrink_chain(fs.stream, FAT_ATTRS, fs.fat_attrs, chain,
-									  cls_cnt);
-		if(err) return err;
-
-		err = FAT_utils::shrink_chain(fs.FAT.get(), FAT_ATTRS,
-									  fs.fat_attrs.LENGTH, chain, cls_cnt);
+		err = FAT_utils::shrink_chain(fs.FAT, FAT_ATTRS, chain, cls_cnt);
 		if(err) return err;
 
 		const s32 diff = cls_cnt - chain.size();
 
-		err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream, FAT_ATTRS,
-									   fs.fat_attrs, (u16)1,
+		err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
 									   (u16)(fs.FAT[1] - diff));
 		if(err) return err;
 
-		return 0;
+		return fs.FAT.commit(fs.stream, FAT_ATTRS);
 	}
 
-	static uint16_t truncate_sample(filesystem_t &fs, List_entry_t &list_entry,
-									uintmax_t size, const bool is_new)
+	static uint16_t resize_sample(filesystem_t &fs, List_entry_t &list_entry,
+								  uintmax_t size, const bool is_new)
 	{
 		constexpr u8 MIN_SIZE = On_disk_sizes::SAMPLE_PARAMS_ENTRY;
 		u16 err;
@@ -1067,11 +1290,13 @@ namespace S7XX::FS
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::FILE_TOO_LARGE);
 
+		//The chain may move or lose clusters
+		fs.chain_gen++;
+
 		if(!is_new)
 		{
-			err = FAT_utils::follow_chain(fs.FAT.get(), FAT_ATTRS,
-										  fs.fat_attrs.LENGTH,
-								 list_entry.start_segment, chain);
+			err = FAT_t::follow_chain(fs.FAT.get(), fs.fat_attrs.LENGTH,
+									  list_entry.start_segment, chain);
 
 			if(err && err != ret_val_setup(FAT_utils::LIBRARY_ID,
 				(u8)FAT_utils::ERR::BAD_START)) return err;
@@ -1089,22 +1314,26 @@ namespace S7XX::FS
 					return ret_val_setup(min_vfs::LIBRARY_ID,
 										 (u8)min_vfs::ERR::NO_SPACE_LEFT);
 
-				err = FAT_utils::find_free_chain(fs.stream, FAT_ATTRS,
-												 fs.fat_attrs, tgt_cls_cnt,
-									 chain);
+				err = FAT_t::find_free_chain(fs.FAT.get(), fs.fat_attrs.LENGTH,
+											 tgt_cls_cnt, chain);
 				if(err) return err;
 			}
 
+			const u16 old_start = list_entry.start_segment;
+
 			list_entry.segment_cnt = is_new ? 0 : chain.size();
 			list_entry.start_segment = list_entry.segment_cnt ? chain[0]
 				: FAT_ATTRS.END_OF_CHAIN;
 
 			write_list_entry<TYPE_ATTRS[5]>(list_entry, list_entry.cur_idx,
-											fs.stream);
+											fs);
 			if(!fs.stream.good())
 				return ret_val_setup(min_vfs::LIBRARY_ID,
 									 (u8)min_vfs::ERR::IO_ERROR);
 
+			update_sample_owner(fs, old_start, list_entry.start_segment,
+								list_entry.cur_idx);
+
 			err = unzero_all_before<TYPE_ATTRS[5]>(fs, list_entry.cur_idx);
 			if(err) return err;
 
@@ -1113,10 +1342,12 @@ namespace S7XX::FS
 				err = write_chain(fs, chain);
 				if(err) return err;
 
-				err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream,
-											   FAT_ATTRS, fs.fat_attrs, (u16)1,
+				err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
 											   (u16)(fs.FAT[1] - diff));
 				if(err) return err;
+
+				err = fs.FAT.commit(fs.stream, FAT_ATTRS);
+				if(err) return err;
 			}
 
 			if(is_new)
@@ -1140,16 +1371,21 @@ namespace S7XX::FS
 		}
 		else if(tgt_cls_cnt < list_entry.segment_cnt)
 		{
+			const u16 old_start = list_entry.start_segment;
+
 			list_entry.segment_cnt = tgt_cls_cnt;
 			list_entry.start_segment = list_entry.segment_cnt && chain.size()
 				? chain[0] : FAT_ATTRS.END_OF_CHAIN;
 
 			write_list_entry<TYPE_ATTRS[5]>(list_entry, list_entry.cur_idx,
-											fs.stream);
+											fs);
 			if(!fs.stream.good())
 				return ret_val_setup(min_vfs::LIBRARY_ID,
 									 (u8)min_vfs::ERR::IO_ERROR);
 
+			update_sample_owner(fs, old_start, list_entry.start_segment,
+								list_entry.cur_idx);
+
 			err = shrink_chain(fs, chain, tgt_cls_cnt);
 			if(err) return err;
 
@@ -1163,6 +1399,17 @@ namespace S7XX::FS
 		return 0;
 	}
 
+	static uint16_t truncate_sample(filesystem_t &fs, List_entry_t &list_entry,
+									uintmax_t size, const bool is_new)
+	{
+		const u16 err = resize_sample(fs, list_entry, size, is_new);
+
+		fs.deps.dirty_samples.push_back(list_entry.cur_idx);
+		const u16 deps_err = update_sample_deps(fs);
+
+		return err ? err : deps_err;
+	}
+
 	constexpr truncate_file_f TRUNC_FUNCS[6] =
 	{
 		truncate_OS, alloc_file<TYPE_ATTRS[1]>, alloc_file<TYPE_ATTRS[2]>,
@@ -1197,82 +1444,154 @@ namespace S7XX::FS
 		return 0;
 	}
 
+	typedef uint16_t(*delete_files_f)(filesystem_t &fs,
+									  const std::vector<u16> &idxs);
+
+	/*Deletes every slot in idxs (sorted, all in use) in one go: params and
+	 *list entries get cleared a run of consecutive slots per write, and the
+	 *FAT and TOC are written and the stream flushed once at the end. On an
+	 *error, whatever came before the bad slot still gets deleted.*/
 	template <const type_attrs_t &TYPE_ATTRS_ENTRY>
-	static uint16_t delete_file(filesystem_t &fs, const uint16_t idx)
+	static uint16_t delete_files(filesystem_t &fs, const std::vector<u16> &idxs)
 	{
-		char name0;
-		u16 err;
+		u16 err, local_err;
+		size_t done;
 		std::vector<u16> chain;
-		std::ostreambuf_iterator<std::fstream::char_type,
-			std::fstream::traits_type> obi(fs.stream);
-
-		fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + idx
-			* On_disk_sizes::LIST_ENTRY);
-		name0 = fs.stream.get();
-
-		if(!name0 || name0 == (char)0xFE)
-			return ret_val_setup(LIBRARY_ID, (u8)ERR::EMPTY_ENTRY);
+		std::unique_ptr<char[]> fill;
 
-		//HW does it, but do we wanna bother? It should be pointless.
-		obi = fs.stream.seekp(TYPE_ATTRS_ENTRY.PARAMS_ADDR + idx
-			* TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE);
-		for(u16 i = 0; i < TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE; i++)
-			*obi++ = 0xFF;
+		err = 0;
 
 		if constexpr(TYPE_ATTRS_ENTRY.ELEMENT_TYPE == Element_type_t::sample)
 		{
-			u16 start_cluster, cluster_cnt;
+			u16 freed = 0;
 
-			//chain setup
-			fs.stream.seekg(TYPE_ATTRS_ENTRY.LIST_ADDR + idx
-				* On_disk_sizes::LIST_ENTRY + 0x1C);
-			fs.stream.read((char*)&start_cluster, 2);
-			fs.stream.read((char*)&cluster_cnt, 2);
+			//Freed clusters can go to another sample right after
+			fs.chain_gen++;
 
-			if constexpr(ENDIANNESS != std::endian::native)
+			//Chains only get freed in the cache here
+			for(done = 0; done < idxs.size(); done++)
 			{
-				start_cluster = std::byteswap(start_cluster);
-				cluster_cnt = std::byteswap(cluster_cnt);
+				const u16 idx = idxs[done];
+				const u16 start_cluster = get_cached_u16(fs,
+					TYPE_ATTRS_ENTRY.LIST_ADDR, idx, 0x1C);
+				const u16 cluster_cnt = get_cached_u16(fs,
+					TYPE_ATTRS_ENTRY.LIST_ADDR, idx, 0x1E);
+
+				//follow_chain appends
+				chain.clear();
+				err = FAT_t::follow_chain(fs.FAT.get(), fs.fat_attrs.LENGTH,
+										  start_cluster, chain);
+				if(err) break;
+
+				if(chain.size() != cluster_cnt)
+				{
+					err = ret_val_setup(LIBRARY_ID, (u8)ERR::CHAIN_SIZE_MISMATCH);
+					break;
+				}
+
+				update_sample_owner(fs, start_cluster, FAT_ATTRS.END_OF_CHAIN,
+									idx);
+
+				err = FAT_utils::free_chain(fs.FAT, FAT_ATTRS, chain);
+				if(err) break;
+
+				freed += chain.size();
 			}
 
-			err = FAT_utils::follow_chain(fs.FAT.get(), FAT_ATTRS,
-										  fs.fat_attrs.LENGTH, start_cluster,
-								 chain);
-			if(err) return err;
+			if(freed)
+			{
+				local_err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
+													 (u16)(fs.FAT[1] + freed));
+				if(local_err) return local_err;
 
-			if(chain.size() != cluster_cnt)
-				return ret_val_setup(LIBRARY_ID, (u8)ERR::CHAIN_SIZE_MISMATCH);
+				local_err = fs.FAT.commit(fs.stream, FAT_ATTRS);
+				if(local_err) return local_err;
+			}
+		}
+		else done = idxs.size();
 
-			//free chain
-			err = FAT_utils::free_chain(fs.stream, FAT_ATTRS, fs.fat_attrs,
-										chain);
-			if(err) return err;
+		if(!done) return err;
 
-			err = FAT_utils::free_chain(fs.FAT.get(), FAT_ATTRS,
-										fs.fat_attrs.LENGTH, chain);
-			if(err) return err;
+		//HW does it, but do we wanna bother? It should be pointless.
+		fill = std::make_unique<char[]>(done * TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE);
+		std::fill_n(fill.get(), done * TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE, 0xFF);
 
-			err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream, FAT_ATTRS,
-										   fs.fat_attrs, (u16)1,
-										   (u16)(fs.FAT[1] + chain.size()));
-			if(err) return err;
+		for(size_t i = 0; i < done;)
+		{
+			size_t run = 1;
+
+			while(i + run < done && idxs[i + run] == idxs[i] + run) run++;
+
+			fs.stream.seekp(TYPE_ATTRS_ENTRY.PARAMS_ADDR + idxs[i]
+				* TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE);
+			fs.stream.write(fill.get(), run * TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE);
+
+			i += run;
+		}
+
+		fill.reset();
+
+		for(size_t i = 0; i < done; i++)
+		{
+			u8 *const entry = cached_list_entry(fs, TYPE_ATTRS_ENTRY.LIST_ADDR,
+												idxs[i]);
+
+			unindex_slot(fs, TYPE_ATTRS_ENTRY.TYPE_IDX, idxs[i]);
+			entry[0] = 0xFE;
+			std::fill_n(entry + 1, On_disk_sizes::LIST_ENTRY - 1, 0);
 		}
 
-		obi = fs.stream.seekp(TYPE_ATTRS_ENTRY.LIST_ADDR + idx
+		//Whatever's between them in the cache is what's on disk already
+		fs.stream.seekp(TYPE_ATTRS_ENTRY.LIST_ADDR + idxs[0]
 			* On_disk_sizes::LIST_ENTRY);
+		fs.stream.write((char*)cached_list_entry(fs, TYPE_ATTRS_ENTRY.LIST_ADDR,
+			idxs[0]), (idxs[done - 1] - idxs[0] + 1) * On_disk_sizes::LIST_ENTRY);
 
-		*obi++ = 0xFE;
-		for(u8 i = 0; i < On_disk_sizes::LIST_ENTRY - 1; i++) *obi++ = 0;
+		fs.header.TOC.*TYPE_ATTRS_ENTRY.TOC_PTR -= done;
+		local_err = write_TOC(fs.header.TOC, fs.stream);
+		if(local_err) return local_err;
 
-		fs.header.TOC.*TYPE_ATTRS_ENTRY.TOC_PTR -= 1;
-		err = write_TOC(fs.header.TOC, fs.stream);
+		if constexpr(TYPE_ATTRS_ENTRY.ELEMENT_TYPE == Element_type_t::sample)
+		{
+			fs.deps.dirty_samples.insert(fs.deps.dirty_samples.end(),
+										 idxs.begin(), idxs.begin() + done);
+			local_err = update_sample_deps(fs);
+			if(local_err) return local_err;
+		}
+		else
+		{
+			for(size_t i = 0; i < done; i++)
+			{
+				local_err = refresh_deps(fs, TYPE_ATTRS_ENTRY.TYPE_IDX, idxs[i]);
+				if(local_err) return local_err;
+			}
+		}
 
 		fs.stream.flush();
 
 		if(!fs.stream.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)ERR::IO_ERROR);
 
-		return 0;
+		return err;
+	}
+
+	constexpr delete_files_f DELETE_BATCH_FUNCS[] =
+	{
+		nullptr,
+		delete_files<TYPE_ATTRS[1]>,
+		delete_files<TYPE_ATTRS[2]>,
+		delete_files<TYPE_ATTRS[3]>,
+		delete_files<TYPE_ATTRS[4]>,
+		delete_files<TYPE_ATTRS[5]>
+	};
+
+	template <const type_attrs_t &TYPE_ATTRS_ENTRY>
+	static uint16_t delete_file(filesystem_t &fs, const uint16_t idx)
+	{
+		if(!cached_entry_in_use(fs, TYPE_ATTRS_ENTRY.LIST_ADDR, idx))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::EMPTY_ENTRY);
+
+		return delete_files<TYPE_ATTRS_ENTRY>(fs, {idx});
 	}
 
 	constexpr delete_file_f DELETE_FUNCS[] =
@@ -1290,33 +1609,31 @@ namespace S7XX::FS
 	{
 		const std::string DIR_PATH = "/"
 			+ std::string(DIR_NAMES[mapped_type_attrs.TYPE_IDX]) + "/";
-		const u16 INITIAL_CNT = fs.header.TOC.*mapped_type_attrs.TOC_PTR;
+		const bit_util::bitset_t &used = fs.used_slots[mapped_type_attrs.TYPE_IDX];
 
 		u16 err, local_err;
+		std::vector<u16> idxs;
 
 		err = 0;
 
-		for(u16 i = 0, j = 0; i < mapped_type_attrs.MAX_CNT && j < INITIAL_CNT;
-			i++)
+		for(uintmax_t i = used.find_first_set(); i < used.size();
+			i = used.find_first_set(i + 1))
 		{
 			if(fs.open_files.contains(DIR_PATH + std::to_string(i)))
 			{
 				err |= ret_val_setup(min_vfs::LIBRARY_ID,
 									 (u8)min_vfs::ERR::ALREADY_OPEN);
-				j++;
 				continue;
 			}
 
-			local_err = DELETE_FUNCS[(u8)mapped_type_attrs.TYPE_IDX](fs, i);
-
-			if(!local_err) j++;
-			else
-			{
-				if(local_err != ret_val_setup(LIBRARY_ID, (u8)ERR::EMPTY_ENTRY))
-					return local_err;
-			}
+			idxs.push_back(i);
 		}
 
+		if(idxs.empty()) return err;
+
+		local_err = DELETE_BATCH_FUNCS[mapped_type_attrs.TYPE_IDX](fs, idxs);
+		if(local_err) return local_err;
+
 		return err;
 	}
 
@@ -1440,9 +1757,9 @@ namespace S7XX::FS
 	{
 		u16 next_cls, err;
 
-		err = FAT_utils::get_next_or_free_cluster(fs.FAT.get(), FAT_ATTRS,
-												  fs.fat_attrs.LENGTH, cur_cls,
-											next_cls);
+		err = FAT_t::get_next_or_free_cluster(fs.FAT.get(),
+											  fs.fat_attrs.LENGTH, cur_cls,
+											  next_cls);
 		if(err)
 		{
 			if(err == ret_val_setup(FAT_utils::LIBRARY_ID, (u8)FAT_utils::ERR::ALLOC))
@@ -1450,19 +1767,27 @@ namespace S7XX::FS
 				if(next_cls != FAT_ATTRS.END_OF_CHAIN)
 				{
 					if(!list_entry.segment_cnt)
+					{
+						update_sample_owner(fs, list_entry.start_segment,
+											next_cls, list_entry.cur_idx);
 						list_entry.start_segment = next_cls;
+					}
 
 					list_entry.segment_cnt++;
+					//filesystem_t::write updates the totals once it's done
+					fs.deps.dirty_samples.push_back(list_entry.cur_idx);
 
-					WRITE_LIST_ENTRY_FUNCS[1 + ((u8)list_entry.type - (u8)Element_type_t::volume)](list_entry, list_entry.cur_idx, fs.stream);
+					WRITE_LIST_ENTRY_FUNCS[1 + ((u8)list_entry.type - (u8)Element_type_t::volume)](list_entry, list_entry.cur_idx, fs);
 					if(!fs.stream.good())
 						throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR));
 
-					err = FAT_utils::extend_chain(fs.FAT.get(), fs.stream, FAT_ATTRS, fs.fat_attrs, cur_cls, next_cls);
+					//Committed by filesystem_t::write once the whole write
+					//is done, so we don't hit the FAT for every cluster.
+					err = FAT_utils::extend_chain(fs.FAT, FAT_ATTRS, cur_cls, next_cls);
 					if(err)
 						return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
-					err = FAT_utils::write_cluster(fs.FAT.get(), fs.stream, FAT_ATTRS, fs.fat_attrs, (u16)1, (u16)(fs.FAT[1] - 1));
+					err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1, (u16)(fs.FAT[1] - 1));
 					if(err)
 						return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 				}
@@ -1479,9 +1804,8 @@ namespace S7XX::FS
 										 const uintmax_t pos)
 	{
 		u16 err;
-		err = FAT_utils::get_nth_cluster(fs.FAT.get(), FAT_ATTRS,
-										 fs.fat_attrs.LENGTH, cls,
-								   start_cls_idx);
+		err = FAT_t::get_nth_cluster(fs.FAT.get(), fs.fat_attrs.LENGTH, cls,
+									 start_cls_idx);
 
 		if(err)
 		{
@@ -1494,7 +1818,7 @@ namespace S7XX::FS
 				if(err) return err;
 
 				cls = internal_file.list_entry.start_segment;
-				err = FAT_utils::get_nth_cluster(fs.FAT.get(), FAT_ATTRS, fs.fat_attrs.LENGTH, cls, start_cls_idx);
+				err = FAT_t::get_nth_cluster(fs.FAT.get(), fs.fat_attrs.LENGTH, cls, start_cls_idx);
 				if(err) return err;
 			}
 		}
@@ -1502,304 +1826,1086 @@ namespace S7XX::FS
 		return 0;
 	}
 
-	//TODO: Clean this shit up.
-	template <const bool write, const bool first_cls>
-	static u16 get_cls_then_read_write(filesystem_t &fs,
-									   internal_file_t &internal_file, u16 &cls,
-									   void *const dst, const u16 len,
-									   const u16 start_cls_idx,
-									   const uintmax_t pos,
-									   const u16 cls_pos_off)
+	//Moves cls one segment down the chain, allocating one if writing past the end
+	template <const bool write>
+	static u16 next_cls(filesystem_t &fs, internal_file_t &internal_file,
+						u16 &cls)
+	{
+		if constexpr(write)
+		{
+			try
+			{
+				cls = get_or_alloc_next_cls(fs, cls, internal_file.list_entry);
+			}
+			catch(min_vfs::FS_err e)
+			{
+				return e.err_code;
+			}
+		}
+		else cls = fs.FAT[cls];
+
+		if(cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX)
+			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+
+		return 0;
+	}
+
+	/*Gets the cls_idx-th segment of the file. Starts from where the file's last
+	 *transfer ended if that's still good and not past the segment we want,
+	 *otherwise walks the chain from the start (and grows the file, if writing
+	 *further than one segment past its end). Needs fs.mtx.*/
+	template <const bool write>
+	static u16 seek_cls(filesystem_t &fs, internal_file_t &internal_file,
+						u16 &cls, const u16 cls_idx, const uintmax_t pos)
+	{
+		if(internal_file.chain_gen == fs.chain_gen
+			&& internal_file.cursor_idx <= cls_idx
+			&& (cls_idx < internal_file.list_entry.segment_cnt
+				|| cls_idx == internal_file.cursor_idx + 1))
+		{
+			cls = internal_file.cursor_cls;
+
+			for(u16 i = internal_file.cursor_idx; i < cls_idx; i++)
+			{
+				const u16 err = next_cls<write>(fs, internal_file, cls);
+
+				if(err) return err;
+			}
+
+			return 0;
+		}
+
+		cls = internal_file.list_entry.start_segment;
+
+		if constexpr(write)
+		{
+			const u16 err = get_or_alloc_nth_cls(fs, cls, cls_idx, internal_file,
+												 pos);
+
+			if(err) return err;
+		}
+		else
+		{
+			const u16 err = FAT_t::get_nth_cluster(fs.FAT.get(),
+												   fs.fat_attrs.LENGTH, cls, cls_idx);
+
+			if(err)
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+		}
+
+		if(cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX)
+			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+
+		return 0;
+	}
+
+	template <const bool write>
+	static uint16_t read_write_sample(filesystem_t &fs,
+									  internal_file_t &internal_file,
+									  uintmax_t &pos, uintmax_t len, void *dst)
+	{
+		u32 dst_off = 0;
+
+		if(pos < On_disk_sizes::SAMPLE_PARAMS_ENTRY)
+		{
+			constexpr u8 base_pos = 0;
+			const u32 local_pos = pos - base_pos;
+			const u32 remaining = On_disk_sizes::SAMPLE_PARAMS_ENTRY - local_pos;
+			const u8 local_len = std::min((uintmax_t)remaining, len);
+
+			fs.mtx.lock();
+			fs.stream.seekg(On_disk_addrs::SAMPLE_PARAMS
+				+ On_disk_sizes::SAMPLE_PARAMS_ENTRY
+				* internal_file.list_entry.cur_idx + local_pos);
+
+			if constexpr(write) fs.stream.write((char*)dst + dst_off, local_len);
+			else fs.stream.read((char*)dst + dst_off, local_len);
+			fs.mtx.unlock();
+
+			if(!fs.stream.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+
+			len -= local_len;
+			pos += local_len;
+			if(!len) return 0;
+
+			dst_off += local_len;
+		}
+
+		if(pos < MAX_SAMPLE_SIZE + On_disk_sizes::SAMPLE_PARAMS_ENTRY)
+		{
+			constexpr u8 base_pos = On_disk_sizes::SAMPLE_PARAMS_ENTRY;
+			const u32 local_pos = pos - base_pos;
+			const u32 file_size = internal_file.list_entry.segment_cnt
+				* AUDIO_SEGMENT_SIZE;
+			const u32 remaining = write
+				? (MAX_SAMPLE_SIZE > local_pos ? MAX_SAMPLE_SIZE - local_pos
+					: 0)
+				: (file_size > local_pos ? file_size - local_pos : 0);
+			const u32 local_len = std::min((uintmax_t)remaining, len);
+			const u16 start_cls_idx = local_pos / AUDIO_SEGMENT_SIZE;
+			const u16 pos_in_first_cls = local_pos - start_cls_idx
+				* AUDIO_SEGMENT_SIZE;
+
+			u16 cls_idx = start_cls_idx, cls_off = pos_in_first_cls;
+			u32 left = local_len;
+
+			/*One read/write per run of consecutive segments. The lock's only
+			 *held for one run; in between, writing/truncating the OS may move
+			 *our clusters, which bumps fs.chain_gen so seek_cls knows not to
+			 *trust where we left off.*/
+			while(left)
+			{
+				u16 err, cls, run_cnt = 1;
+				u32 run_len = std::min((u32)(AUDIO_SEGMENT_SIZE - cls_off), left);
+
+				fs.mtx.lock();
+				err = seek_cls<write>(fs, internal_file, cls, cls_idx, pos);
+
+				if(err)
+				{
+					fs.mtx.unlock();
+					return err;
+				}
+
+				/*A segment that isn't next to the run or can't be had ends it;
+				 *the next seek_cls gets it again, or fails.*/
+				while(run_len < left && run_cnt < SAMPLE_IO_CLUSTERS)
+				{
+					u16 next = cls + run_cnt - 1;
+
+					if(next_cls<write>(fs, internal_file, next)
+						|| next != cls + run_cnt) break;
+
+					run_len += std::min((u32)AUDIO_SEGMENT_SIZE, left - run_len);
+					run_cnt++;
+				}
+
+				fs.stream.seekg(On_disk_addrs::AUDIO_SECTION + AUDIO_SEGMENT_SIZE
+					* (cls - FAT_ATTRS.DATA_MIN) + cls_off);
+
+				if constexpr(write) fs.stream.write((char*)dst + dst_off, run_len);
+				else fs.stream.read((char*)dst + dst_off, run_len);
+
+				internal_file.chain_gen = fs.chain_gen;
+				internal_file.cursor_idx = cls_idx + run_cnt - 1;
+				internal_file.cursor_cls = cls + run_cnt - 1;
+				const bool good = fs.stream.good();
+				fs.mtx.unlock();
+
+				if(!good)
+					return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+
+				left -= run_len;
+				len -= run_len;
+				pos += run_len;
+				dst_off += run_len;
+				cls_idx += run_cnt;
+				cls_off = 0;
+			}
+
+			if(!len) return 0;
+		}
+
+		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+	}
+
+	template <const type_attrs_t TYPE_ATTRS_ENTRY, const bool write>
+	static uint16_t read_write_file(filesystem_t &fs,
+									internal_file_t &internal_file,
+									uintmax_t &pos, uintmax_t len, void *dst)
+	{
+		u32 dst_off = 0;
+
+		if(pos < TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE)
+		{
+			constexpr u8 base_pos = 0;
+			const u32 local_pos = pos - base_pos;
+			const u32 remaining = TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE - local_pos;
+			const u16 local_len = std::min((uintmax_t)remaining, len);
+
+			fs.mtx.lock();
+			fs.stream.seekg(TYPE_ATTRS_ENTRY.PARAMS_ADDR
+				+ TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE
+				* internal_file.list_entry.cur_idx + local_pos);
+
+			if constexpr(write) fs.stream.write((char*)dst + dst_off, local_len);
+			else fs.stream.read((char*)dst + dst_off, local_len);
+
+			//The indices might've changed
+			const u16 err = write && fs.stream.good() ? refresh_deps(fs,
+				TYPE_ATTRS_ENTRY.TYPE_IDX, internal_file.list_entry.cur_idx)
+				: 0;
+			fs.mtx.unlock();
+
+			if(err) return err;
+
+			if(!fs.stream.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+
+			len -= local_len;
+			pos += local_len;
+			if(!len) return 0;
+		}
+
+		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+	}
+
+	constexpr read_file_f READ_FUNCS[6] =
+	{
+		read_write_OS<false>, read_write_file<TYPE_ATTRS[1], false>,
+		read_write_file<TYPE_ATTRS[2], false>, read_write_file<TYPE_ATTRS[3], false>,
+		read_write_file<TYPE_ATTRS[4], false>, read_write_sample<false>
+	};
+
+	constexpr read_file_f WRITE_FUNCS[6] =
+	{
+		read_write_OS<true>, read_write_file<TYPE_ATTRS[1], true>,
+		read_write_file<TYPE_ATTRS[2], true>, read_write_file<TYPE_ATTRS[3], true>,
+		read_write_file<TYPE_ATTRS[4], true>, read_write_sample<true>
+	};
+
+	static u16 find_from_name_or_free(filesystem_t &fs, const u8 type_id, const char fname[16])
+	{
+		u16 idx;
+
+		idx = FIND_FROM_NAME_FUNCS[type_id](fs, fname);
+
+		if(idx >= TYPE_ATTRS[type_id].MAX_CNT)
+			idx = FIND_FREE_SLOT_FUNCS[type_id](fs);
+
+		return idx;
+	}
+
+	//A.K.A. mount
+	filesystem_t::filesystem_t(const char *path): min_vfs::filesystem_t(path)
+	{
+		u16 err;
+		const uintmax_t disk_size = std::filesystem::file_size(this->path);
+
+		//base constructor already does basic checks
+
+		if(disk_size < On_disk_sizes::HEADER)
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::WRONG_FS));
+
+		err = load_header(stream, header);
+		if(err) throw min_vfs::FS_err(err);
+
+		if(!stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+
+		if(std::memcmp(header.machine_name, MACHINE_NAME, 10))
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::WRONG_FS));
+
+		if(!is_HDD((u8)header.media_type))
+			throw min_vfs::FS_err(ret_val_setup(LIBRARY_ID,
+												(u8)ERR::MEDIA_TYPE_NOT_HDD));
+
+		if(disk_size < MIN_DISK_SIZE)
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+											(u8)min_vfs::ERR::DISK_TOO_SMALL));
+
+		err = load_TOC(stream, header.TOC);
+		if(err) throw min_vfs::FS_err(err);
+
+		if(!this->stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+
+		if(disk_size / BLK_SIZE < header.TOC.block_cnt)
+			throw(min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+										(u8)min_vfs::ERR::FS_SIZE_MISMATCH)));
+
+		fat_attrs = FAT_utils::FAT_dyna_attrs_t(FAT_find_length(stream),
+												On_disk_addrs::FAT);
+
+		if(!this->stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+
+		//might wanna make it a !=
+		if(header.TOC.block_cnt < On_disk_addrs::AUDIO_SECTION / BLK_SIZE
+			+ (fat_attrs.LENGTH - FAT_ATTRS.DATA_MIN)
+			* (AUDIO_SEGMENT_SIZE / BLK_SIZE))
+			throw(min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+										(u8)min_vfs::ERR::FS_SIZE_MISMATCH)));
+
+		FAT = FAT_utils::FAT_cache_t<u16>(FAT_ATTRS, fat_attrs);
+		FAT.load(stream, FAT_ATTRS);
+
+		if(!stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+
+		//Every list lookup works on this from here on
+		load_lists(*this);
+		index_lists(*this);
+
+		if(!stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+
+		map_sample_owners(*this);
+
+		if(!stream.good())
+			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
+												(u8)min_vfs::ERR::IO_ERROR));
+	}
+
+	/*---------------------------Volume export/import--------------------------*/
+
+	//Needs fs.mtx
+	static uint16_t find_closure(filesystem_t &fs, const u16 vol_idx,
+								 filesystem_t::closure_t &closure)
+	{
+		u16 err;
+
+		if(vol_idx >= MAX_VOLUME_COUNT)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::IDX_OUT_OF_RANGE);
+
+		if(!cached_entry_in_use(fs, On_disk_addrs::VOLUME_LIST, vol_idx))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::EMPTY_ENTRY);
+
+		err = ensure_deps(fs);
+		if(err) return err;
+
+		for(std::vector<u16> &slots: closure) slots.clear();
+
+		closure[(u8)ftype_IDs::VOLS].push_back(vol_idx);
+
+		for(u8 i = (u8)ftype_IDs::VOLS; i < (u8)ftype_IDs::SAMPLES; i++)
+		{
+			std::vector<u16> &below = closure[i + 1];
+
+			for(const u16 slot: closure[i])
+				for(const u16 child: fs.deps.children[i][slot])
+					if(cached_entry_in_use(fs, TYPE_ATTRS[i + 1].LIST_ADDR,
+										   child))
+						below.push_back(child);
+
+			std::sort(below.begin(), below.end());
+			below.erase(std::unique(below.begin(), below.end()), below.end());
+		}
+
+		return 0;
+	}
+
+	/*What export_volume calls a slot's file: what Host_FS::sanitize_filename
+	 *makes of "idx-name", so Host_FS::build_index can find it again.*/
+	static std::string host_fname(filesystem_t &fs, const u8 type_idx,
+								  const u16 slot)
+	{
+		const char *const raw = (char*)cached_list_entry(fs,
+			TYPE_ATTRS[type_idx].LIST_ADDR, slot);
+
+		u16 idx;
+		std::string name(raw, strnlen(raw, 16)), fname;
+
+		Host_FS::sanitize_filename(name);
+		fname = std::to_string(slot) + "-" + name;
+
+		//build_index wouldn't find names with no category
+		if(!Host_FS::parse_host_fname(fname, idx))
+			fname = std::to_string(slot) + "-___-" + name.substr(0, 12);
+
+		return fname;
+	}
+
+	/*Params of slots (sorted), to or from buf, one I/O per run of consecutive
+	 *slots. Needs fs.mtx.*/
+	template <const bool write>
+	static void params_io(filesystem_t &fs, const u8 type_idx,
+						  const std::vector<u16> &slots, char *const buf)
+	{
+		const type_attrs_t &attrs = TYPE_ATTRS[type_idx];
+
+		for(size_t i = 0; i < slots.size();)
+		{
+			size_t run = 1;
+
+			while(i + run < slots.size() && slots[i + run] == slots[i] + run)
+				run++;
+
+			fs.stream.seekg(attrs.PARAMS_ADDR + slots[i]
+				* attrs.PARAMS_ENTRY_SIZE);
+
+			if constexpr(write)
+				fs.stream.write(buf + i * attrs.PARAMS_ENTRY_SIZE,
+								run * attrs.PARAMS_ENTRY_SIZE);
+			else fs.stream.read(buf + i * attrs.PARAMS_ENTRY_SIZE,
+								run * attrs.PARAMS_ENTRY_SIZE);
+
+			i += run;
+		}
+	}
+
+	//Samples with no audio have an empty chain. Needs fs.mtx.
+	static uint16_t sample_chain(filesystem_t &fs, const u16 slot,
+								 std::vector<u16> &chain)
+	{
+		const u16 start = get_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, slot,
+										 0x1C);
+		const u16 cls_cnt = get_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, slot,
+										   0x1E);
+
+		chain.clear();
+
+		if(!cls_cnt) return 0;
+
+		const u16 err = FAT_t::follow_chain(fs.FAT.get(), fs.fat_attrs.LENGTH,
+											start, chain);
+		if(err) return err;
+
+		if(chain.size() != cls_cnt)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::CHAIN_SIZE_MISMATCH);
+
+		return 0;
+	}
+
+	/*Moves cnt segments of a sample, starting at segment first, between buf
+	 *and the disk, one I/O per run of consecutive clusters. The lock's only
+	 *held for this, so chain gets followed again if clusters moved since gen
+	 *(see filesystem_t::chain_gen); if the sample isn't cls_cnt clusters long
+	 *anymore, that's an error.*/
+	template <const bool write>
+	static uint16_t sample_chunk_io(filesystem_t &fs, const u16 slot,
+									const u16 cls_cnt, std::vector<u16> &chain,
+									u32 &gen, const size_t first,
+									const size_t cnt, char *const buf)
+	{
+		u16 err = 0;
+
+		fs.mtx.lock();
+
+		if(gen != fs.chain_gen)
+		{
+			err = sample_chain(fs, slot, chain);
+			gen = fs.chain_gen;
+
+			if(!err && chain.size() != cls_cnt)
+				err = ret_val_setup(LIBRARY_ID, (u8)ERR::CHAIN_SIZE_MISMATCH);
+		}
+
+		for(size_t i = first; !err && i < first + cnt;)
+		{
+			size_t run = 1;
+
+			while(i + run < first + cnt && chain[i + run] == chain[i] + run)
+				run++;
+
+			fs.stream.seekg(On_disk_addrs::AUDIO_SECTION + AUDIO_SEGMENT_SIZE
+				* (chain[i] - FAT_ATTRS.DATA_MIN));
+
+			if constexpr(write)
+				fs.stream.write(buf + (i - first) * AUDIO_SEGMENT_SIZE,
+								run * AUDIO_SEGMENT_SIZE);
+			else fs.stream.read(buf + (i - first) * AUDIO_SEGMENT_SIZE,
+								run * AUDIO_SEGMENT_SIZE);
+
+			if(!fs.stream.good())
+				err = ret_val_setup(min_vfs::LIBRARY_ID,
+									(u8)min_vfs::ERR::IO_ERROR);
+
+			i += run;
+		}
+
+		fs.mtx.unlock();
+
+		return err;
+	}
+
+	//Same as min_vfs::copy would write: params, then the audio
+	static uint16_t export_sample(filesystem_t &fs, const u16 slot,
+								  const std::filesystem::path &dst_path)
+	{
+		u16 err, cls_cnt;
+		u32 gen = 0;
+		char params[On_disk_sizes::SAMPLE_PARAMS_ENTRY];
+		std::vector<u16> chain;
+		std::unique_ptr<char[]> buffer;
+
+		fs.mtx.lock();
+		fs.stream.seekg(On_disk_addrs::SAMPLE_PARAMS + slot
+			* On_disk_sizes::SAMPLE_PARAMS_ENTRY);
+		fs.stream.read(params, sizeof(params));
+		cls_cnt = get_cached_u16(fs, On_disk_addrs::SAMPLE_LIST, slot, 0x1E);
+		const bool good = fs.stream.good();
+		fs.mtx.unlock();
+
+		if(!good)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		std::ofstream dst(dst_path, std::ios_base::binary
+			| std::ios_base::trunc);
+
+		dst.write(params, sizeof(params));
+
+		buffer = std::make_unique<char[]>(AUDIO_SEGMENT_SIZE
+			* std::min(cls_cnt, SAMPLE_IO_CLUSTERS));
+
+		for(size_t i = 0; i < cls_cnt && dst.good(); i += SAMPLE_IO_CLUSTERS)
+		{
+			const size_t cnt = std::min((size_t)(cls_cnt - i),
+										(size_t)SAMPLE_IO_CLUSTERS);
+
+			err = sample_chunk_io<false>(fs, slot, cls_cnt, chain, gen, i, cnt,
+										 buffer.get());
+			if(err) return err;
+
+			dst.write(buffer.get(), cnt * AUDIO_SEGMENT_SIZE);
+		}
+
+		dst.close();
+
+		if(!dst.good())
+			return ret_val_setup(Host_FS::LIBRARY_ID, (u8)Host_FS::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	//The sample's chain has to be allocated already
+	static uint16_t import_sample(filesystem_t &fs, const u16 slot,
+								  const std::filesystem::path &src_path,
+								  const uintmax_t audio_size)
 	{
-		if constexpr(first_cls)
+		const u16 cls_cnt = size_to_clusters(audio_size);
+
+		u16 err;
+		u32 gen = 0;
+		std::vector<u16> chain;
+		std::unique_ptr<char[]> buffer;
+
+		std::ifstream src(src_path, std::ios_base::binary);
+
+		src.seekg(On_disk_sizes::SAMPLE_PARAMS_ENTRY);
+
+		buffer = std::make_unique<char[]>(AUDIO_SEGMENT_SIZE
+			* std::min(cls_cnt, SAMPLE_IO_CLUSTERS));
+
+		for(size_t i = 0; i < cls_cnt; i += SAMPLE_IO_CLUSTERS)
+		{
+			const size_t cnt = std::min((size_t)(cls_cnt - i),
+										(size_t)SAMPLE_IO_CLUSTERS);
+			const uintmax_t len = std::min((uintmax_t)cnt * AUDIO_SEGMENT_SIZE,
+										   audio_size - i * AUDIO_SEGMENT_SIZE);
+
+			src.read(buffer.get(), len);
+
+			if(!src.good())
+				return ret_val_setup(Host_FS::LIBRARY_ID,
+									 (u8)Host_FS::ERR::IO_ERROR);
+
+			//Whatever's past the end of the last segment
+			std::fill(buffer.get() + len, buffer.get() + cnt
+				* AUDIO_SEGMENT_SIZE, 0);
+
+			err = sample_chunk_io<true>(fs, slot, cls_cnt, chain, gen, i, cnt,
+										buffer.get());
+			if(err) return err;
+		}
+
+		return 0;
+	}
+
+	typedef std::array<std::vector<u16>, 6> slots_by_type_t;
+
+	/*Takes back what import_metadata put in, for when the audio doesn't make
+	 *it. Whatever got removed in the meantime is left alone. Needs fs.mtx.*/
+	static uint16_t drop_imported(filesystem_t &fs,
+								  const slots_by_type_t &new_slots)
+	{
+		u16 err = 0;
+		std::vector<u16> idxs;
+
+		for(u8 i = (u8)ftype_IDs::VOLS; i <= (u8)ftype_IDs::SAMPLES; i++)
+		{
+			idxs.clear();
+
+			for(const u16 slot: new_slots[i])
+				if(cached_entry_in_use(fs, TYPE_ATTRS[i].LIST_ADDR, slot))
+					idxs.push_back(slot);
+
+			if(idxs.empty()) continue;
+
+			const u16 local_err = DELETE_BATCH_FUNCS[i](fs, idxs);
+
+			if(!err) err = local_err;
+		}
+
+		return err;
+	}
+
+	/*Everything import_volume does to the FS but the audio. Finds slots and
+	 *clusters for all of it before touching anything, then writes params and
+	 *list entries a run of slots at a time, and the TOC and FAT once. Needs
+	 *fs.mtx.*/
+	static uint16_t import_metadata(filesystem_t &fs,
+									const slots_by_type_t &old_slots,
+									std::array<std::unique_ptr<char[]>, 6>
+										&params,
+									const std::vector<uintmax_t> &audio_sizes,
+									slots_by_type_t &new_slots,
+									std::vector<std::vector<u16>> &chains)
+	{
+		constexpr u8 SAMPLES = (u8)ftype_IDs::SAMPLES;
+
+		u16 err;
+		u32 cls_total = 0;
+		slots_by_type_t remap; //old -> new, DUMMY_IDX if it's not in the dump
+		std::vector<u16> refs;
+
+		err = ensure_deps(fs);
+		if(err) return err;
+
+		for(u8 i = (u8)ftype_IDs::VOLS; i <= SAMPLES; i++)
+		{
+			new_slots[i].clear();
+			remap[i].assign(old_slots[i].empty() ? 0 : old_slots[i].back() + 1,
+							DUMMY_IDX);
+
+			for(const u16 old: old_slots[i])
+			{
+				const uintmax_t slot = fs.used_slots[i].find_first_unset(
+					new_slots[i].empty() ? 0 : new_slots[i].back() + 1);
+
+				if(slot >= TYPE_ATTRS[i].MAX_CNT)
+					return ret_val_setup(min_vfs::LIBRARY_ID,
+										 (u8)min_vfs::ERR::NO_SPACE_LEFT);
+
+				remap[i][old] = slot;
+				new_slots[i].push_back(slot);
+			}
+		}
+
+		for(const uintmax_t audio_size: audio_sizes)
+			cls_total += size_to_clusters(audio_size);
+
+		if(cls_total > fs.FAT[1])
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NO_SPACE_LEFT);
+
+		//Nothing's been changed up to here
+		for(u8 i = (u8)ftype_IDs::VOLS; i < SAMPLES; i++)
+		{
+			const u16 entry_size = TYPE_ATTRS[i].PARAMS_ENTRY_SIZE;
+			const u16 child_max = TYPE_ATTRS[i + 1].MAX_CNT;
+
+			for(size_t j = 0; j < old_slots[i].size(); j++)
+			{
+				u8 *const entry = (u8*)params[i].get() + j * entry_size;
+
+				for(u8 k = 0; k < TYPE_ATTRS_EXT[i].IDX_CNT; k++)
+				{
+					u16 idx;
+
+					std::memcpy(&idx, entry + ref_offset(i, k), 2);
+
+					if constexpr(ENDIANNESS != std::endian::native)
+						idx = std::byteswap(idx);
+
+					if(idx >= child_max) continue; //unused
+
+					idx = idx < remap[i + 1].size() ? remap[i + 1][idx]
+						: DUMMY_IDX;
+
+					if constexpr(ENDIANNESS != std::endian::native)
+						idx = std::byteswap(idx);
+
+					std::memcpy(entry + ref_offset(i, k), &idx, 2);
+				}
+			}
+		}
+
+		chains.assign(old_slots[SAMPLES].size(), {});
+
+		for(size_t i = 0; i < chains.size(); i++)
 		{
-			if constexpr(write)
-			{
-				const u16 err = get_or_alloc_nth_cls(fs, cls, start_cls_idx,
-													 internal_file, pos);
+			const u16 cls_cnt = size_to_clusters(audio_sizes[i]);
 
-				if(err) return err;
-			}
-			else
+			if(!cls_cnt) continue;
+
+			err = FAT_t::find_contig_free_chain(fs.FAT.get(),
+												fs.fat_attrs.LENGTH, cls_cnt,
+												chains[i]);
+			if(!err) err = write_chain(fs, chains[i]);
+
+			if(err)
 			{
-				const u16 err = FAT_utils::get_nth_cluster(fs.FAT.get(),
-														FAT_ATTRS,
-														fs.fat_attrs.LENGTH,
-														cls, start_cls_idx);
+				/*Only in the cache so far. chains[i] may be partly written,
+				 *and freeing what's still free doesn't hurt.*/
+				for(size_t j = 0; j <= i; j++)
+					FAT_utils::free_chain(fs.FAT, FAT_ATTRS, chains[j]);
 
-				if(err)
-					return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+				return err;
 			}
 		}
-		else
+
+		if(cls_total)
 		{
-			if constexpr(write)
+			err = FAT_utils::write_cluster(fs.FAT, FAT_ATTRS, (u16)1,
+										   (u16)(fs.FAT[1] - cls_total));
+			if(err) return err;
+		}
+
+		for(u8 i = (u8)ftype_IDs::VOLS; i <= SAMPLES; i++)
+		{
+			const type_attrs_t &attrs = TYPE_ATTRS[i];
+
+			for(size_t j = 0; j < new_slots[i].size(); j++)
 			{
-				try
+				const u16 slot = new_slots[i][j];
+				u8 *const entry = cached_list_entry(fs, attrs.LIST_ADDR, slot);
+
+				//Params start with the name
+				std::memcpy(entry, params[i].get() + j * attrs.PARAMS_ENTRY_SIZE,
+							16);
+
+				//Either would make the entry read as free
+				if(!entry[0] || entry[0] == 0xFE) entry[0] = ' ';
+
+				entry[0x10] = (u8)attrs.ELEMENT_TYPE;
+				entry[0x11] = 0;
+				std::fill_n(entry + 0x18, 4, 0);
+
+				put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x12, DUMMY_IDX);
+				put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x14, DUMMY_IDX);
+				put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x16, slot);
+
+				if(i == SAMPLES && !chains[j].empty())
 				{
-					cls = get_or_alloc_next_cls(fs, cls, internal_file.list_entry);
+					put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x1C,
+								   chains[j][0]);
+					put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x1E,
+								   chains[j].size());
+					update_sample_owner(fs, FAT_ATTRS.END_OF_CHAIN,
+										chains[j][0], slot);
 				}
-				catch(min_vfs::FS_err e)
+				else
 				{
-					return e.err_code;
+					put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x1C,
+								   i == SAMPLES ? FAT_ATTRS.END_OF_CHAIN : 0);
+					put_cached_u16(fs, attrs.LIST_ADDR, slot, 0x1E, 0);
 				}
+
+				index_slot(fs, i, slot);
 			}
-			else cls = fs.FAT[cls];
 		}
 
-		if(cls < FAT_ATTRS.DATA_MIN || cls > FAT_ATTRS.DATA_MAX)
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+		for(u8 i = (u8)ftype_IDs::VOLS; i < SAMPLES; i++)
+		{
+			dep_graph_t &deps = fs.deps;
 
-		fs.stream.seekg(On_disk_addrs::AUDIO_SECTION + AUDIO_SEGMENT_SIZE *
-			(cls - FAT_ATTRS.DATA_MIN) + cls_pos_off);
+			for(size_t j = 0; j < new_slots[i].size(); j++)
+			{
+				const u16 slot = new_slots[i][j];
 
-		if constexpr(write) fs.stream.write((char*)dst, len);
-		else fs.stream.read((char*)dst, len);
+				parse_refs(i, (u8*)params[i].get() + j
+					* TYPE_ATTRS[i].PARAMS_ENTRY_SIZE, refs);
 
-		if(!fs.stream.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+				for(const u16 child: deps.children[i][slot])
+					std::erase(deps.parents[i + 1][child], slot);
 
-		return 0;
-	}
+				for(const u16 child: refs)
+					deps.parents[i + 1][child].push_back(slot);
 
-	template <const bool write>
-	static uint16_t read_write_sample(filesystem_t &fs,
-									  internal_file_t &internal_file,
-									  uintmax_t &pos, uintmax_t len, void *dst)
-	{
-		u32 dst_off = 0;
+				deps.children[i][slot] = refs;
 
-		if(pos < On_disk_sizes::SAMPLE_PARAMS_ENTRY)
+				invalidate_deps(fs, i, slot);
+
+				//Whatever pointed at the free slot reaches more now
+				if(i > (u8)ftype_IDs::VOLS)
+					for(const u16 parent: deps.parents[i][slot])
+						invalidate_deps(fs, i - 1, parent);
+			}
+		}
+
+		//The new slots' totals go out with their entries
+		for(u8 i = (u8)ftype_IDs::VOLS; i < SAMPLES; i++)
+			for(const u16 slot: new_slots[i])
+				put_cached_u16(fs, TYPE_ATTRS[i].LIST_ADDR, slot, 0x1E,
+							   compute_total(fs, i, slot));
+
+		for(u8 i = (u8)ftype_IDs::VOLS; i <= SAMPLES; i++)
 		{
-			constexpr u8 base_pos = 0;
-			const u32 local_pos = pos - base_pos;
-			const u32 remaining = On_disk_sizes::SAMPLE_PARAMS_ENTRY - local_pos;
-			const u8 local_len = std::min((uintmax_t)remaining, len);
+			const type_attrs_t &attrs = TYPE_ATTRS[i];
 
-			fs.mtx.lock();
-			fs.stream.seekg(On_disk_addrs::SAMPLE_PARAMS
-				+ On_disk_sizes::SAMPLE_PARAMS_ENTRY
-				* internal_file.list_entry.cur_idx + local_pos);
+			if(new_slots[i].empty()) continue;
 
-			if constexpr(write) fs.stream.write((char*)dst + dst_off, local_len);
-			else fs.stream.read((char*)dst + dst_off, local_len);
-			fs.mtx.unlock();
+			u16 first = new_slots[i].front();
+			const u16 last = new_slots[i].back();
 
-			if(!fs.stream.good())
-				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+			//Same as unzero_all_before
+			for(u16 j = 0; j < last; j++)
+			{
+				u8 *const entry = cached_list_entry(fs, attrs.LIST_ADDR, j);
 
-			len -= local_len;
-			pos += local_len;
-			if(!len) return 0;
+				if(!*entry)
+				{
+					*entry = 0xFE;
+					first = std::min(first, j);
+				}
+			}
 
-			dst_off += local_len;
+			params_io<true>(fs, i, new_slots[i], params[i].get());
+
+			fs.stream.seekp(attrs.LIST_ADDR + first * On_disk_sizes::LIST_ENTRY);
+			fs.stream.write((char*)cached_list_entry(fs, attrs.LIST_ADDR, first),
+							(last - first + 1) * On_disk_sizes::LIST_ENTRY);
+
+			fs.header.TOC.*attrs.TOC_PTR += new_slots[i].size();
 		}
 
-		if(pos < MAX_SAMPLE_SIZE + On_disk_sizes::SAMPLE_PARAMS_ENTRY)
-		{
-			constexpr u8 base_pos = On_disk_sizes::SAMPLE_PARAMS_ENTRY;
-			const u32 local_pos = pos - base_pos;
-			const u32 file_size = internal_file.list_entry.segment_cnt
-				* AUDIO_SEGMENT_SIZE;
-			const u32 remaining = write
-				? (MAX_SAMPLE_SIZE > local_pos ? MAX_SAMPLE_SIZE - local_pos
-					: 0)
-				: (file_size > local_pos ? file_size - local_pos : 0);
-			const u32 local_len = std::min((uintmax_t)remaining, len);
-			const u16 start_cls_idx = local_pos / AUDIO_SEGMENT_SIZE;
-			const u16 pos_in_first_cls = local_pos - start_cls_idx
-				* AUDIO_SEGMENT_SIZE;
-			const u16 first_cls_len = std::min((u32)(AUDIO_SEGMENT_SIZE
-				- pos_in_first_cls), local_len);
-			const u16 whole_cls = (local_len - first_cls_len)
-				/ AUDIO_SEGMENT_SIZE;
+		err = write_TOC(fs.header.TOC, fs.stream);
+		if(err) return err;
 
-			u16 err, cls = internal_file.list_entry.start_segment;
+		err = fs.FAT.commit(fs.stream, FAT_ATTRS);
+		if(err) return err;
 
-			fs.mtx.lock();
-			err = get_cls_then_read_write<write, true>(fs, internal_file,
-													cls, (char*)dst + dst_off,
-													first_cls_len,
-													start_cls_idx, pos,
-													pos_in_first_cls);
-			fs.mtx.unlock();
+		//Totals of whatever already pointed at the new slots
+		for(u8 i = SAMPLES; i >= (u8)ftype_IDs::VOLS; i--)
+			update_totals(fs, i, new_slots[i]);
 
-			if(err) return err;
+		fs.stream.flush();
 
-			len -= first_cls_len;
-			pos += first_cls_len;
-			dst_off += first_cls_len;
+		if(!fs.stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
 
-			for(u16 i = 0; i < whole_cls; i++)
-			{
-				/*We must lock before getting the next cluster and only unlock
-				 *after reading/writing its data; otherwise, writing/truncating
-				 *the OS may relocate a cluster after we get its address but
-				 *before we read/write its data, which would lead to accessing
-				 *data at the old cluster address.*/
-				fs.mtx.lock();
-				err = get_cls_then_read_write<write, false>(fs, internal_file,
-													cls, (char*)dst + dst_off,
-													AUDIO_SEGMENT_SIZE, 0, 0,
-													0);
-				fs.mtx.unlock();
+		return 0;
+	}
 
-				if(err) return err;
+	uint16_t filesystem_t::volume_closure(const u16 vol_idx, closure_t &closure)
+	{
+		mtx.lock();
+		const u16 err = find_closure(*this, vol_idx, closure);
+		mtx.unlock();
 
-				len -= AUDIO_SEGMENT_SIZE;
-				pos += AUDIO_SEGMENT_SIZE;
-				dst_off += AUDIO_SEGMENT_SIZE;
-			}
+		return err;
+	}
 
-			if(len)
-			{
-				fs.mtx.lock();
-				err = get_cls_then_read_write<write, false>(fs, internal_file,
-													cls, (char*)dst + dst_off,
-													len, 0, 0, 0);
-				fs.mtx.unlock();
+	uint16_t filesystem_t::hold_samples(const std::vector<u16> &slots,
+										std::vector<void*> &held)
+	{
+		for(const u16 slot: slots)
+		{
+			void *file;
 
-				if(err) return err;
+			const u16 err = fopen_internal((std::string(DIR_NAMES[
+				(u8)ftype_IDs::SAMPLES]) + "/" + std::to_string(slot)
+				+ "-").c_str(), &file);
 
-				pos += len;
-				len = 0;
+			if(err)
+			{
+				release_samples(held);
+				return err;
 			}
 
-			if(!len) return 0;
+			held.push_back(file);
 		}
 
-		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
+		return 0;
 	}
 
-	template <const type_attrs_t TYPE_ATTRS_ENTRY, const bool write>
-	static uint16_t read_write_file(filesystem_t &fs,
-									internal_file_t &internal_file,
-									uintmax_t &pos, uintmax_t len, void *dst)
+	void filesystem_t::release_samples(std::vector<void*> &held)
 	{
-		u32 dst_off = 0;
+		for(void *const file: held) fclose(file);
 
-		if(pos < TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE)
-		{
-			constexpr u8 base_pos = 0;
-			const u32 local_pos = pos - base_pos;
-			const u32 remaining = TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE - local_pos;
-			const u16 local_len = std::min((uintmax_t)remaining, len);
+		held.clear();
+	}
 
-			fs.mtx.lock();
-			fs.stream.seekg(TYPE_ATTRS_ENTRY.PARAMS_ADDR
-				+ TYPE_ATTRS_ENTRY.PARAMS_ENTRY_SIZE
-				* internal_file.list_entry.cur_idx + local_pos);
+	uint16_t filesystem_t::export_volume(const u16 vol_idx,
+										 const std::filesystem::path &dst_dir,
+										 const u32 thread_cnt)
+	{
+		constexpr u8 SAMPLES = (u8)ftype_IDs::SAMPLES;
 
-			if constexpr(write) fs.stream.write((char*)dst + dst_off, local_len);
-			else fs.stream.read((char*)dst + dst_off, local_len);
-			fs.mtx.unlock();
+		u16 err;
+		std::error_code ec;
+		closure_t closure;
+		std::array<std::vector<std::string>, 6> fnames;
+		std::array<std::unique_ptr<char[]>, 6> params;
+		std::vector<void*> held;
 
-			if(!fs.stream.good())
-				return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+		mtx.lock();
+		err = find_closure(*this, vol_idx, closure);
 
-			len -= local_len;
-			pos += local_len;
-			if(!len) return 0;
+		for(u8 i = (u8)ftype_IDs::VOLS; !err && i <= SAMPLES; i++)
+		{
+			for(const u16 slot: closure[i])
+				fnames[i].push_back(host_fname(*this, i, slot));
+
+			if(i == SAMPLES) continue;
+
+			params[i] = std::make_unique<char[]>(closure[i].size()
+				* TYPE_ATTRS[i].PARAMS_ENTRY_SIZE);
+			params_io<false>(*this, i, closure[i], params[i].get());
 		}
 
-		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::END_OF_FILE);
-	}
+		if(!err && !stream.good())
+			err = ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
-	constexpr read_file_f READ_FUNCS[6] =
-	{
-		read_write_OS<false>, read_write_file<TYPE_ATTRS[1], false>,
-		read_write_file<TYPE_ATTRS[2], false>, read_write_file<TYPE_ATTRS[3], false>,
-		read_write_file<TYPE_ATTRS[4], false>, read_write_sample<false>
-	};
+		if(!err) err = hold_samples(closure[SAMPLES], held);
+		mtx.unlock();
 
-	constexpr read_file_f WRITE_FUNCS[6] =
-	{
-		read_write_OS<true>, read_write_file<TYPE_ATTRS[1], true>,
-		read_write_file<TYPE_ATTRS[2], true>, read_write_file<TYPE_ATTRS[3], true>,
-		read_write_file<TYPE_ATTRS[4], true>, read_write_sample<true>
-	};
+		if(err) return err;
 
-	static u16 find_from_name_or_free(filesystem_t &fs, const u8 type_id, const char fname[16])
-	{
-		u16 idx;
+		for(u8 i = (u8)ftype_IDs::VOLS; !err && i <= SAMPLES; i++)
+		{
+			const std::filesystem::path dir = dst_dir / DIR_NAMES[i];
+			const u16 entry_size = TYPE_ATTRS[i].PARAMS_ENTRY_SIZE;
 
-		idx = FIND_FROM_NAME_FUNCS[type_id](fs, fname);
+			std::filesystem::create_directories(dir, ec);
+			if(ec)
+				err = ret_val_setup(Host_FS::LIBRARY_ID,
+									(u8)Host_FS::ERR::IO_ERROR);
 
-		if(idx >= TYPE_ATTRS[type_id].MAX_CNT)
-			idx = FIND_FREE_SLOT_FUNCS[type_id](fs.stream);
+			if(i == SAMPLES) continue;
 
-		return idx;
+			for(size_t j = 0; !err && j < closure[i].size(); j++)
+			{
+				std::ofstream dst(dir / fnames[i][j], std::ios_base::binary
+					| std::ios_base::trunc);
+
+				dst.write(params[i].get() + j * entry_size, entry_size);
+				dst.close();
+
+				if(!dst.good())
+					err = ret_val_setup(Host_FS::LIBRARY_ID,
+										(u8)Host_FS::ERR::IO_ERROR);
+			}
+		}
+
+		const std::filesystem::path sample_dir = dst_dir / DIR_NAMES[SAMPLES];
+
+		if(!err)
+			err = job_util::run_jobs(closure[SAMPLES].size(), thread_cnt,
+							[&](const size_t i) -> u16
+			{
+				return export_sample(*this, closure[SAMPLES][i],
+									 sample_dir / fnames[SAMPLES][i]);
+			});
+
+		mtx.lock();
+		release_samples(held);
+		mtx.unlock();
+
+		return err;
 	}
 
-	//A.K.A. mount
-	filesystem_t::filesystem_t(const char *path): min_vfs::filesystem_t(path)
+	uint16_t filesystem_t::import_volume(const std::filesystem::path &src_dir,
+										 u16 &vol_idx, const u32 thread_cnt)
 	{
+		constexpr u8 SAMPLES = (u8)ftype_IDs::SAMPLES;
+
 		u16 err;
-		const uintmax_t disk_size = std::filesystem::file_size(this->path);
+		std::array<Host_FS::host_index_t, 6> host;
+		slots_by_type_t old_slots, new_slots;
+		std::array<std::unique_ptr<char[]>, 6> params;
+		std::vector<uintmax_t> audio_sizes;
+		std::vector<std::vector<u16>> chains;
+		std::vector<void*> held;
+
+		//Everything but the audio gets read up front
+		for(u8 i = (u8)ftype_IDs::VOLS; i <= SAMPLES; i++)
+		{
+			const std::filesystem::path dir = src_dir / DIR_NAMES[i];
+			const u16 entry_size = TYPE_ATTRS[i].PARAMS_ENTRY_SIZE;
 
-		//base constructor already does basic checks
+			//A volume that doesn't reference anything only has its own dir
+			if(i != (u8)ftype_IDs::VOLS && !std::filesystem::is_directory(dir))
+				continue;
 
-		if(disk_size < On_disk_sizes::HEADER)
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::WRONG_FS));
+			err = Host_FS::build_index(dir, host[i]);
+			if(err) return err;
 
-		err = load_header(stream, header);
-		if(err) throw min_vfs::FS_err(err);
+			for(u16 j = 0; j < host[i].size(); j++)
+				if(!host[i][j].empty()) old_slots[i].push_back(j);
 
-		if(!stream.good())
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::IO_ERROR));
+			params[i] = std::make_unique<char[]>(old_slots[i].size()
+				* entry_size);
 
-		if(std::memcmp(header.machine_name, MACHINE_NAME, 10))
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::WRONG_FS));
+			for(size_t j = 0; j < old_slots[i].size(); j++)
+			{
+				std::ifstream src(host[i][old_slots[i][j]], std::ios_base::binary
+					| std::ios_base::ate);
 
-		if(!is_HDD((u8)header.media_type))
-			throw min_vfs::FS_err(ret_val_setup(LIBRARY_ID,
-												(u8)ERR::MEDIA_TYPE_NOT_HDD));
+				const uintmax_t size = src.tellg();
 
-		if(disk_size < MIN_DISK_SIZE)
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-											(u8)min_vfs::ERR::DISK_TOO_SMALL));
+				if(!src.good())
+					return ret_val_setup(Host_FS::LIBRARY_ID,
+										 (u8)Host_FS::ERR::IO_ERROR);
 
-		err = load_TOC(stream, header.TOC);
-		if(err) throw min_vfs::FS_err(err);
+				if(i == SAMPLES)
+				{
+					if(size < entry_size)
+						return ret_val_setup(Host_FS::LIBRARY_ID,
+											 (u8)Host_FS::ERR::BAD_FILE_SIZE);
 
-		if(!this->stream.good())
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::IO_ERROR));
+					audio_sizes.push_back(size - entry_size);
 
-		if(disk_size / BLK_SIZE < header.TOC.block_cnt)
-			throw(min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-										(u8)min_vfs::ERR::FS_SIZE_MISMATCH)));
+					if(size_to_clusters(audio_sizes.back()) == DUMMY_CLS_CNT)
+						return ret_val_setup(min_vfs::LIBRARY_ID,
+											 (u8)min_vfs::ERR::FILE_TOO_LARGE);
+				}
+				else if(size != entry_size)
+					return ret_val_setup(Host_FS::LIBRARY_ID,
+										 (u8)Host_FS::ERR::BAD_FILE_SIZE);
 
-		fat_attrs = FAT_utils::FAT_dyna_attrs_t(FAT_find_length(stream),
-												On_disk_addrs::FAT);
+				src.seekg(0);
+				src.read(params[i].get() + j * entry_size, entry_size);
 
-		if(!this->stream.good())
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::IO_ERROR));
+				if(!src.good())
+					return ret_val_setup(Host_FS::LIBRARY_ID,
+										 (u8)Host_FS::ERR::IO_ERROR);
+			}
+		}
 
-		//might wanna make it a !=
-		if(header.TOC.block_cnt < On_disk_addrs::AUDIO_SECTION / BLK_SIZE
-			+ (fat_attrs.LENGTH - FAT_ATTRS.DATA_MIN)
-			* (AUDIO_SEGMENT_SIZE / BLK_SIZE))
-			throw(min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-										(u8)min_vfs::ERR::FS_SIZE_MISMATCH)));
+		if(old_slots[(u8)ftype_IDs::VOLS].empty())
+			return ret_val_setup(Host_FS::LIBRARY_ID, (u8)Host_FS::ERR::NOT_FOUND);
+
+		mtx.lock();
+		err = import_metadata(*this, old_slots, params, audio_sizes, new_slots,
+							  chains);
+		if(err)
+		{
+			mtx.unlock();
+			return err;
+		}
 
-		stream.seekg(On_disk_addrs::FAT);
-		FAT = std::make_unique<u16[]>(fat_attrs.LENGTH);
-		stream.read((char*)FAT.get(), fat_attrs.LENGTH * 2);
+		err = hold_samples(new_slots[SAMPLES], held);
+		mtx.unlock();
 
-		if(!stream.good())
-			throw min_vfs::FS_err(ret_val_setup(min_vfs::LIBRARY_ID,
-												(u8)min_vfs::ERR::IO_ERROR));
+		if(!err)
+			err = job_util::run_jobs(new_slots[SAMPLES].size(), thread_cnt,
+							[&](const size_t i) -> u16
+			{
+				return import_sample(*this, new_slots[SAMPLES][i],
+									 host[SAMPLES][old_slots[SAMPLES][i]],
+									 audio_sizes[i]);
+			});
 
-		if constexpr(ENDIANNESS != std::endian::native)
+		mtx.lock();
+		release_samples(held);
+
+		//Samples with garbage for audio aren't worth keeping
+		if(err)
 		{
-			for(u16 i = 1; i < fat_attrs.LENGTH; i++)
-				FAT[i] = std::byteswap(FAT[i]);
+			const u16 local_err = drop_imported(*this, new_slots);
+
+			if(local_err) err = local_err;
 		}
+
+		mtx.unlock();
+
+		if(err) return err;
+
+		vol_idx = new_slots[(u8)ftype_IDs::VOLS][0];
+
+		return 0;
 	}
 
 	filesystem_t& filesystem_t::operator=(filesystem_t &&other) noexcept
@@ -1812,6 +2918,12 @@ namespace S7XX::FS
 		this->header = other.header;
 		this->fat_attrs = other.fat_attrs;
 		this->FAT = std::move(other.FAT);
+		this->sample_owners = std::move(other.sample_owners);
+		this->lists = std::move(other.lists);
+		this->name_indexes = std::move(other.name_indexes);
+		this->used_slots = std::move(other.used_slots);
+		this->deps = std::move(other.deps);
+		this->chain_gen = other.chain_gen;
 
 		/*This shouldn't work, especially since we're copying. I'm not sure
 		 *moving a map would leave its nodes intact anyway. It seems like a bad
@@ -1985,8 +3097,7 @@ namespace S7XX::FS
 
 			if(idx >= mapped_type_attrs.MAX_CNT)
 			{
-				idx = FIND_FREE_SLOT_FUNCS[mapped_type_attrs.TYPE_IDX](
-					this->stream);
+				idx = FIND_FREE_SLOT_FUNCS[mapped_type_attrs.TYPE_IDX](*this);
 
 				if(idx >= mapped_type_attrs.MAX_CNT)
 					return ret_val_setup(min_vfs::LIBRARY_ID,
@@ -2013,7 +3124,7 @@ namespace S7XX::FS
 			else
 			{
 				const u16 err =
-					LOAD_LIST_ENTRY_FUNCS[mapped_type_attrs.TYPE_IDX](stream,
+					LOAD_LIST_ENTRY_FUNCS[mapped_type_attrs.TYPE_IDX](*this,
 															idx, list_entry);
 				is_new = err == ret_val_setup(LIBRARY_ID,
 											  (uint8_t)ERR::EMPTY_ENTRY);
@@ -2087,8 +3198,11 @@ namespace S7XX::FS
 
 		//here we only want the name
 		idx_and_name_from_name(split_new_path[1], final_name);
-		stream.seekp(mapped_type_attrs.LIST_ADDR + idx * On_disk_sizes::LIST_ENTRY);
-		stream.write(final_name.data(), 16);
+		unindex_slot(*this, mapped_type_attrs.TYPE_IDX, idx);
+		std::memcpy(cached_list_entry(*this, mapped_type_attrs.LIST_ADDR, idx),
+					final_name.data(), 16);
+		store_list_entry(*this, mapped_type_attrs.LIST_ADDR, idx, 0, 16);
+		index_slot(*this, mapped_type_attrs.TYPE_IDX, idx);
 		stream.flush();
 
 		if(!stream.good())
@@ -2236,10 +3350,10 @@ namespace S7XX::FS
 			else
 			{
 				if(idx < mapped_type_attrs.MAX_CNT)
-					err = LOAD_LIST_ENTRY_FUNCS[mapped_type_attrs.TYPE_IDX](this->stream, idx, list_entry);
+					err = LOAD_LIST_ENTRY_FUNCS[mapped_type_attrs.TYPE_IDX](*this, idx, list_entry);
 				else
 				{
-					idx = FIND_FREE_SLOT_FUNCS[mapped_type_attrs.TYPE_IDX](this->stream);
+					idx = FIND_FREE_SLOT_FUNCS[mapped_type_attrs.TYPE_IDX](*this);
 
 					if(idx >= mapped_type_attrs.MAX_CNT)
 						return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::NO_SPACE_LEFT);
@@ -2305,16 +3419,27 @@ namespace S7XX::FS
 
 	uint16_t filesystem_t::write(void *internal_file, uintmax_t &pos, uintmax_t len, void *src)
 	{
-		return WRITE_FUNCS[((internal_file_t*)internal_file)->type_idx](*this, *((internal_file_t*)internal_file), pos, len, src);
+		const u16 err = WRITE_FUNCS[((internal_file_t*)internal_file)->type_idx](*this, *((internal_file_t*)internal_file), pos, len, src);
+
+		//Whatever got allocated, even if we failed halfway through
+		mtx.lock();
+		const u16 commit_err = FAT.commit(stream, FAT_ATTRS);
+		const u16 deps_err = update_sample_deps(*this);
+		mtx.unlock();
+
+		return err ? err : commit_err ? commit_err : deps_err;
 	}
 
 	uint16_t filesystem_t::flush(void *internal_file)
 	{
 		mtx.lock();
+		const u16 commit_err = FAT.commit(stream, FAT_ATTRS);
 		stream.flush();
 		const bool str_status = stream.good();
 		mtx.unlock();
 
+		if(commit_err) return commit_err;
+
 		if(str_status) return 0;
 		else return ret_val_setup(min_vfs::LIBRARY_ID,
 			(u8)min_vfs::ERR::IO_ERROR);
@@ -1,13 +1,18 @@
 ﻿#ifndef S7XX_FS_UTILS_HEADER_GUARD
 #define S7XX_FS_UTILS_HEADER_GUARD
 
+#include <array>
 #include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <memory>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 #include "min_vfs/min_vfs_base.hpp"
 #include "library_IDs.hpp"
+#include "Utils/bit_util.hpp"
 #include "S7XX_FS_types.hpp"
 
 namespace S7XX::FS
@@ -16,13 +21,15 @@ namespace S7XX::FS
 	
 	namespace FSCK_ERR
 	{
-		constexpr u8 TOC_INCONSISTENCY = 1 << 0;
-		constexpr u8 TOO_LARGE = 1 << 1;
-		constexpr u8 BAD_CLS0_VAL = 1 << 2;
-		constexpr u8 UNMARKED_RESVD_CLS = 1 << 3;
-		constexpr u8 FREE_CLS_CNT_MISMATCH = 1 << 4;
-		constexpr u8 BAD_FENTRY = 1 << 5;
-		constexpr u8 INACCESSIBLE_FENTRIES = 1 << 6;
+		constexpr u16 TOC_INCONSISTENCY = 1 << 0;
+		constexpr u16 TOO_LARGE = 1 << 1;
+		constexpr u16 BAD_CLS0_VAL = 1 << 2;
+		constexpr u16 UNMARKED_RESVD_CLS = 1 << 3;
+		constexpr u16 FREE_CLS_CNT_MISMATCH = 1 << 4;
+		constexpr u16 BAD_FENTRY = 1 << 5;
+		constexpr u16 INACCESSIBLE_FENTRIES = 1 << 6;
+		constexpr u16 BAD_SAMPLE_CHAIN = 1 << 7;
+		constexpr u16 LOST_CLUSTERS = 1 << 8;
 	}
 
 	enum struct ERR: uint8_t
@@ -51,17 +58,77 @@ namespace S7XX::FS
 		IDX_OUT_OF_RANGE
 	};
 
+	struct mkfs_job_t
+	{
+		std::filesystem::path fs_path;
+		std::string label;
+	};
+
 	uint16_t mkfs(const std::filesystem::path &fs_path, const std::string &label);
+	/*Formats every image in jobs, thread_cnt at a time (0: one per hardware
+	 *thread). errs gets each job's result, the first failed job's one gets
+	 *returned.*/
+	uint16_t mkfs(const std::vector<mkfs_job_t> &jobs, std::vector<u16> &errs,
+				  u32 thread_cnt = 0);
 	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status);
+	/*With report_only, fsck_status still gets everything that'd be fixed,
+	 *but nothing gets written and the image can be read-only. Timings get
+	 *appended; "write" is left out when report_only.*/
+	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status,
+				  min_vfs::fsck_timings_t &timings,
+				  const bool report_only = false);
+	uint16_t defrag(const std::filesystem::path &fs_path,
+					min_vfs::defrag_stats_t &stats);
 
 	struct internal_file_t;
 
+	/*Who references who, volumes down to samples, by type_idx. Kept so the
+	 *cluster totals in the list entries can be redone for just the slots a
+	 *change affects.*/
+	struct dep_graph_t
+	{
+		bool built = false;
+
+		//Slots of the next type down each slot references...
+		std::array<std::vector<std::vector<u16>>, 6> children;
+		//...and the slots of the next type up that reference each slot
+		std::array<std::vector<std::vector<u16>>, 6> parents;
+
+		//Every sample each slot reaches, only valid where the bit's set
+		std::array<std::vector<std::vector<u16>>, 6> samples;
+		std::array<bit_util::bitset_t, 6> samples_valid;
+
+		//Samples whose size changed since the totals were last updated
+		std::vector<u16> dirty_samples;
+	};
+
 	struct filesystem_t: min_vfs::filesystem_t
 	{
 		Header_t header;
 		FAT_utils::FAT_dyna_attrs_t<uint16_t> fat_attrs;
 
-		std::unique_ptr<u16[]> FAT;
+		FAT_utils::FAT_cache_t<u16> FAT;
+
+		//start cluster -> sample idx, so relocating doesn't need list scans
+		std::unordered_map<u16, u16> sample_owners;
+
+		/*VOLUME_LIST through SAMPLE_LIST, as they are on disk. Read once at
+		mount; list entries are only read from here, and changes go here
+		before being written out.*/
+		std::unique_ptr<u8[]> lists;
+
+		/*Both by type_idx; 0, the OS, is unused. Names are the same as
+		find_slot_from_name compares, so it doesn't need to scan the lists,
+		and find_free_slot only has to look for the first unset bit.*/
+		typedef std::unordered_multimap<std::string, u16> name_index_t;
+		std::array<name_index_t, 6> name_indexes;
+		std::array<bit_util::bitset_t, 6> used_slots;
+
+		dep_graph_t deps;
+
+		/*Bumped whenever sample clusters get moved or freed, so open files
+		know their cursor (see internal_file_t) may be off.*/
+		u32 chain_gen = 1;
 
 		/*TODO: Use u16s as keys. Lower 13 bits for the actual file idx, upper
 		3 for the type_idx.*/
@@ -93,8 +160,40 @@ namespace S7XX::FS
 		uint16_t write(void *internal_file, uintmax_t &pos, uintmax_t len, void *src);
 		uint16_t flush(void *internal_file);
 
+		/*A volume and everything it needs, by type_idx: the perfs it
+		references, their patches, their partials and their samples. Sorted,
+		only slots in use.*/
+		typedef std::array<std::vector<u16>, 6> closure_t;
+
+		uint16_t volume_closure(const u16 vol_idx, closure_t &closure);
+
+		/*Writes a volume's closure to dst_dir, one dir per type like the FS
+		shows them and one file per slot with what min_vfs::copy would've
+		written, named so Host_FS::build_index finds them. Samples go out
+		thread_cnt at a time (0: one per hardware thread), and are kept open
+		until they're done so nothing can remove them in between. dst_dir
+		should be empty, import_volume takes whatever it finds in there.*/
+		uint16_t export_volume(const u16 vol_idx,
+							   const std::filesystem::path &dst_dir,
+							   const u32 thread_cnt = 0);
+
+		/*Brings back what export_volume wrote, into free slots. References
+		between the files get pointed at their new slots, ones to anything
+		that isn't there get cleared. All the metadata goes in at once, before
+		any sample data, which gets written thread_cnt samples at a time.
+		vol_idx gets the (first) volume's new slot. If any sample fails,
+		everything that got imported gets deleted again.*/
+		uint16_t import_volume(const std::filesystem::path &src_dir,
+							   u16 &vol_idx, const u32 thread_cnt = 0);
+
 	private:
 		uint16_t fopen_internal(const char *path, void **internal_file);
+
+		/*Open the samples like fopen would, so remove and rename leave them
+		alone while a volume transfer uses them. Need mtx.*/
+		uint16_t hold_samples(const std::vector<u16> &slots,
+							  std::vector<void*> &held);
+		void release_samples(std::vector<void*> &held);
 	};
 
 	struct internal_file_t
@@ -102,6 +201,12 @@ namespace S7XX::FS
 		filesystem_t::file_map_t::value_type *map_entry;
 		u8 type_idx;
 		List_entry_t list_entry;
+
+		/*Samples only. Where the last data transfer ended: segment cursor_idx
+		of the chain is cluster cursor_cls, as long as chain_gen still matches
+		the filesystem's. Saves walking the chain from the start each time.*/
+		u32 chain_gen = 0;
+		u16 cursor_idx = 0, cursor_cls = 0;
 	};
 }
 #endif
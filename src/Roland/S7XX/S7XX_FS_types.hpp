@@ -61,6 +61,7 @@ namespace S7XX::FS
 
 	constexpr FAT_utils::FAT_attrs_t<uint16_t> FAT_ATTRS(ENDIANNESS, 0, 2,
 		0xFFF5, 0xFFF8, 0xFFFF);
+	typedef FAT_utils::FAT_t<FAT_ATTRS> FAT_t;
 
 	constexpr uint32_t MIN_DISK_SIZE = On_disk_addrs::AUDIO_SECTION + AUDIO_SEGMENT_SIZE;
 	constexpr uint16_t MAX_FAT_LENGTH = FAT_ATTRS.DATA_MAX + 1;
@@ -209,6 +209,12 @@ void print_fsck_status(const u16 fsck_status)
 
 	if(fsck_status & S7XX::FS::FSCK_ERR::INACCESSIBLE_FENTRIES)
 		std::cout << "Inaccessible file entries." << std::endl;
+
+	if(fsck_status & S7XX::FS::FSCK_ERR::BAD_SAMPLE_CHAIN)
+		std::cout << "Bad sample chain." << std::endl;
+
+	if(fsck_status & S7XX::FS::FSCK_ERR::LOST_CLUSTERS)
+		std::cout << "Lost clusters." << std::endl;
 }
 
 bool comp_FATs(S7XX::FS::filesystem_t &fs)
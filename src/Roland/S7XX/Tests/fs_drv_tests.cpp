@@ -142,6 +142,223 @@ int fsck_tests()
 		return 52;
 	}
 
+	//Report only, then fix the same errors
+	constexpr char BROKEN_FS[] = "fsck_broken_fs.img";
+	constexpr char BROKEN_FS_COPY[] = "fsck_broken_fs_copy.img";
+	constexpr u16 EXPECTED_STATUS = S7XX::FS::FSCK_ERR::TOC_INCONSISTENCY
+		| S7XX::FS::FSCK_ERR::FREE_CLS_CNT_MISMATCH
+		| S7XX::FS::FSCK_ERR::BAD_FENTRY;
+
+	u16 val;
+	std::fstream broken_fstr;
+	min_vfs::fsck_timings_t timings;
+
+	for(const char *const path: {BROKEN_FS, BROKEN_FS_COPY})
+		if(std::filesystem::exists(path)) std::filesystem::remove(path);
+
+	std::filesystem::copy_file(TEST_FS_PATH, BROKEN_FS);
+
+	broken_fstr.open(BROKEN_FS, std::fstream::in | std::fstream::out
+		| std::fstream::binary);
+
+	//First volume's element type
+	broken_fstr.seekp(S7XX::FS::On_disk_addrs::VOLUME_LIST + 0x10);
+	broken_fstr.put(0x55);
+
+	//Perf count
+	broken_fstr.seekg(S7XX::FS::On_disk_addrs::TOC + 22);
+	broken_fstr.read((char*)&val, 2);
+	val++;
+	broken_fstr.seekp(S7XX::FS::On_disk_addrs::TOC + 22);
+	broken_fstr.write((char*)&val, 2);
+
+	//Free cluster count
+	broken_fstr.seekg(S7XX::FS::On_disk_addrs::FAT + 2);
+	broken_fstr.read((char*)&val, 2);
+	val--;
+	broken_fstr.seekp(S7XX::FS::On_disk_addrs::FAT + 2);
+	broken_fstr.write((char*)&val, 2);
+
+	if(!broken_fstr.good())
+	{
+		std::cerr << "IO error!!!" << std::endl;
+		std::cerr << "Exit: 556" << std::endl;
+		return 556;
+	}
+
+	broken_fstr.close();
+	std::filesystem::copy_file(BROKEN_FS, BROKEN_FS_COPY);
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(BROKEN_FS, fsck_status, timings, true);
+	if(err)
+	{
+		print_unexpected_err(err, 557);
+		return 557;
+	}
+
+	if(fsck_status != EXPECTED_STATUS)
+	{
+		std::cerr << "Report only fsck status mismatch!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 558" << std::endl;
+		return 558;
+	}
+
+	if(!filecmp(BROKEN_FS, BROKEN_FS_COPY, 0,
+		S7XX::FS::On_disk_addrs::VOLUME_PARAMS))
+	{
+		std::cerr << "Report only fsck changed the FS!!!" << std::endl;
+		std::cerr << "Exit: 559" << std::endl;
+		return 559;
+	}
+
+	if(timings.empty() || std::string_view(timings.back().name) != "total"
+		|| std::any_of(timings.begin(), timings.end(),
+			[](const min_vfs::fsck_phase_t &phase)
+			{
+				return std::string_view(phase.name) == "write";
+			}))
+	{
+		std::cerr << "Bad fsck timings!!!" << std::endl;
+		std::cerr << "Exit: 560" << std::endl;
+		return 560;
+	}
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(BROKEN_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 561);
+		return 561;
+	}
+
+	if(fsck_status != EXPECTED_STATUS)
+	{
+		std::cerr << "fsck status mismatch!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 562" << std::endl;
+		return 562;
+	}
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(BROKEN_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 563);
+		return 563;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck didn't fix everything!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 564" << std::endl;
+		return 564;
+	}
+
+	//A sample with audio that starts on a free cluster gets emptied
+	constexpr char BAD_START_FS[] = "fsck_bad_start_fs.img";
+	constexpr uintmax_t BAD_START_ENTRY = S7XX::FS::On_disk_addrs::SAMPLE_LIST
+		+ 3 * S7XX::FS::On_disk_sizes::LIST_ENTRY;
+	//Its old chain gets freed, so the free count changes too
+	constexpr u16 BAD_START_STATUS = S7XX::FS::FSCK_ERR::BAD_SAMPLE_CHAIN
+		| S7XX::FS::FSCK_ERR::LOST_CLUSTERS
+		| S7XX::FS::FSCK_ERR::FREE_CLS_CNT_MISMATCH;
+
+	u16 cls, cls_cnt;
+
+	if(std::filesystem::exists(BAD_START_FS))
+		std::filesystem::remove(BAD_START_FS);
+
+	std::filesystem::copy_file(TEST_FS_PATH, BAD_START_FS);
+
+	broken_fstr.open(BAD_START_FS, std::fstream::in | std::fstream::out
+		| std::fstream::binary);
+
+	//First free cluster. Free's 0 either way round, no need to swap.
+	broken_fstr.seekg(S7XX::FS::On_disk_addrs::FAT
+		+ S7XX::FS::FAT_ATTRS.DATA_MIN * 2);
+
+	for(cls = S7XX::FS::FAT_ATTRS.DATA_MIN; broken_fstr.good(); cls++)
+	{
+		broken_fstr.read((char*)&val, 2);
+		if(val == S7XX::FS::FAT_ATTRS.FREE_CLUSTER) break;
+	}
+
+	val = cls;
+
+	if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+		val = std::byteswap(val);
+
+	broken_fstr.seekp(BAD_START_ENTRY + 0x1C);
+	broken_fstr.write((char*)&val, 2);
+
+	if(!broken_fstr.good())
+	{
+		std::cerr << "IO error!!!" << std::endl;
+		std::cerr << "Exit: 620" << std::endl;
+		return 620;
+	}
+
+	broken_fstr.close();
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(BAD_START_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 621);
+		return 621;
+	}
+
+	if(fsck_status != BAD_START_STATUS)
+	{
+		std::cerr << "fsck status mismatch!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 622" << std::endl;
+		return 622;
+	}
+
+	broken_fstr.open(BAD_START_FS, std::fstream::in | std::fstream::binary);
+	broken_fstr.seekg(BAD_START_ENTRY + 0x1C);
+	broken_fstr.read((char*)&cls, 2);
+	broken_fstr.read((char*)&cls_cnt, 2);
+	broken_fstr.close();
+
+	if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+	{
+		cls = std::byteswap(cls);
+		cls_cnt = std::byteswap(cls_cnt);
+	}
+
+	if(cls != S7XX::FS::FAT_ATTRS.END_OF_CHAIN || cls_cnt)
+	{
+		std::cerr << "Sample wasn't emptied!!!" << std::endl;
+		std::cerr << "Start: " << cls << ", segments: " << cls_cnt
+			<< std::endl;
+		std::cerr << "Exit: 623" << std::endl;
+		return 623;
+	}
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(BAD_START_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 624);
+		return 624;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck didn't fix everything!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 625" << std::endl;
+		return 625;
+	}
+
+	for(const char *const path: {BROKEN_FS, BROKEN_FS_COPY, BAD_START_FS})
+		std::filesystem::remove(path);
+
 	return 0;
 }
 
@@ -250,6 +467,79 @@ int mkfs_tests(std::unique_ptr<S7XX::FS::filesystem_t> &dst_fs)
 		return 46;
 	}
 
+	//Batch mode, one bad job shouldn't stop the others
+	constexpr u8 BATCH_CNT = 4;
+
+	std::vector<S7XX::FS::mkfs_job_t> jobs;
+	std::vector<u16> errs;
+
+	for(u8 i = 0; i < BATCH_CNT; i++)
+	{
+		jobs.push_back({"test_batch_fs_" + std::to_string(i) + ".img",
+						"Test ins S7XX FS"});
+
+		std::ofstream(jobs.back().fs_path).close();
+		std::filesystem::resize_file(jobs.back().fs_path, ins_fs_tgt_size);
+	}
+
+	jobs.insert(jobs.begin() + 1, {"nx_file", "SHOULD NOT EXIST"});
+
+	expected_err = ret_val_setup(S7XX::FS::LIBRARY_ID, (u8)S7XX::FS::ERR::INVALID_PATH);
+	err = S7XX::FS::mkfs(jobs, errs, 2);
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 565);
+		return 565;
+	}
+
+	for(size_t i = 0; i < jobs.size(); i++)
+	{
+		if(i == 1)
+		{
+			if(errs[i] != expected_err)
+			{
+				print_expected_err(expected_err, errs[i], 566);
+				return 566;
+			}
+
+			continue;
+		}
+
+		if(errs[i])
+		{
+			print_unexpected_err(errs[i], 567);
+			return 567;
+		}
+
+		//Same label and size, so the same metadata as the single one
+		if(!filecmp(INS_FS_PATH, jobs[i].fs_path, 0,
+			S7XX::FS::On_disk_addrs::AUDIO_SECTION))
+		{
+			std::cerr << "Batch FS " << jobs[i].fs_path
+				<< " doesn't match!!!" << std::endl;
+			std::cerr << "Exit: 568" << std::endl;
+			return 568;
+		}
+
+		fsck_status = 0;
+		err = S7XX::FS::fsck(jobs[i].fs_path, fsck_status);
+		if(err)
+		{
+			print_unexpected_err(err, 569);
+			return 569;
+		}
+
+		if(fsck_status)
+		{
+			std::cerr << "New batch FS failed fsck!!!" << std::endl;
+			print_fsck_status(fsck_status);
+			std::cerr << "Exit: 570" << std::endl;
+			return 570;
+		}
+
+		std::filesystem::remove(jobs[i].fs_path);
+	}
+
 	return 0;
 }
 
@@ -5010,85 +5300,1151 @@ static int remove_open_tests()
 	return 0;
 }
 
-//Host FS utils are a dependency of the driver, so its tests should be run
-//first.
-int main()
+//Raw audio of every sample, in sample list order, straight off the chains.
+static u16 dump_samples(S7XX::FS::filesystem_t &fs,
+						std::vector<std::string> &samples)
 {
-	u16 err;
+	u16 err, start_cls;
+	char name0;
 
-	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs, dst_fs;
+	std::vector<u16> chain;
 
-	//test standalone functions first
-	std::cout << "fsck tests..." << std::endl;
-	err = fsck_tests();
-	if(err) return err;
-	std::cout << "fsck tests OK!" << std::endl;
-	std::cout << std::endl;
+	for(u16 i = 0; i < S7XX::FS::MAX_SAMPLE_COUNT; i++)
+	{
+		const uintmax_t entry_addr = S7XX::FS::On_disk_addrs::SAMPLE_LIST
+			+ i * S7XX::FS::On_disk_sizes::LIST_ENTRY;
 
-	std::cout << "mkfs tests..." << std::endl;
-	err = mkfs_tests(dst_fs);
-	if(err) return err;
-	std::cout << "mkfs tests OK!" << std::endl;
-	std::cout << std::endl;
+		fs.stream.seekg(entry_addr);
+		name0 = fs.stream.get();
 
-	std::cout << "Mount tests..." << std::endl;
-	err = mount_tests(s7xx_fs);
-	if(err) return err;
-	std::cout << "Mount OK!" << std::endl;
-	std::cout << std::endl;
+		if(!name0 || name0 == (char)0xFE) continue;
 
-	std::cout << "List tests..." << std::endl;
-	err = list_tests(*s7xx_fs);
-	if(err) return err;
-	std::cout << "List tests OK!" << std::endl;
-	std::cout << std::endl;
+		fs.stream.seekg(entry_addr + 0x1C);
+		fs.stream.read((char*)&start_cls, 2);
 
-	std::cout << "Delete tests..." << std::endl;
-	err = del_tests();
-	if(err) return err;
-	std::cout << "Delete tests OK!" << std::endl;
-	std::cout << std::endl;
+		if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+			start_cls = std::byteswap(start_cls);
 
-	std::cout << "Truncate tests..." << std::endl;
-	err = trunc_tests();
-	if(err) return err;
-	std::cout << "Truncate tests OK!" << std::endl;
-	std::cout << std::endl;
+		samples.emplace_back();
+		if(!S7XX::FS::FAT_t::in_data_range(start_cls)) continue;
 
-	std::cout << "Rename tests..." << std::endl;
-	err = rename_tests();
-	if(err) return err;
-	std::cout << "Rename tests OK!" << std::endl;
-	std::cout << std::endl;
+		chain.clear();
+		err = S7XX::FS::FAT_t::follow_chain(fs.FAT.get(), fs.FAT.length(),
+											start_cls, chain);
+		if(err) return err;
 
-	std::cout << "fopen/fclose tests..." << std::endl;
-	err = fopen_tests();
-	if(err) return err;
-	std::cout << "fopen/fclose tests OK!" << std::endl;
-	std::cout << std::endl;
+		samples.back().resize(chain.size() * S7XX::AUDIO_SEGMENT_SIZE);
 
-	std::cout << "Read tests..." << std::endl;
-	err = read_tests();
-	if(err) return err;
-	std::cout << "Read tests OK!" << std::endl;
-	std::cout << std::endl;
+		for(uintmax_t j = 0; j < chain.size(); j++)
+		{
+			fs.stream.seekg(S7XX::FS::On_disk_addrs::AUDIO_SECTION
+				+ (chain[j] - S7XX::FS::FAT_ATTRS.DATA_MIN)
+				* S7XX::AUDIO_SEGMENT_SIZE);
+			fs.stream.read(samples.back().data() + j
+				* S7XX::AUDIO_SEGMENT_SIZE, S7XX::AUDIO_SEGMENT_SIZE);
+		}
+	}
 
-	std::cout << "Truncate while open tests..." << std::endl;
-	err = trunc_open_tests();
-	if(err) return err;
-	std::cout << "Truncate while open tests OK!" << std::endl;
-	std::cout << std::endl;
+	if(!fs.stream.good())
+		return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
-	std::cout << "Write tests..." << std::endl;
-	err = write_tests();
-	if(err) return err;
-	std::cout << "Write tests OK!" << std::endl;
-	std::cout << std::endl;
+	return 0;
+}
 
-	std::cout << "Remove while open tests..." << std::endl;
-	err = remove_open_tests();
-	if(err) return err;
-	std::cout << "Remove while open tests OK!" << std::endl;
+//Expects fsck, delete and truncate to work.
+static int defrag_tests()
+{
+	constexpr char S7XX_FS[] = "defrag_fs.img";
+
+	u16 err, expected_err, fsck_status;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	std::vector<std::string> samples_before, samples_after;
+	min_vfs::defrag_stats_t stats;
+
+	expected_err = ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+	err = S7XX::FS::defrag("nx_file", stats);
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 524);
+		return 524;
+	}
+
+	/*-------------------------------Data setup-------------------------------*/
+	if(std::filesystem::exists(S7XX_FS))
+		std::filesystem::remove_all(S7XX_FS);
+
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 525" << std::endl;
+		return 525;
+	}
+
+	/*Free up a 94 cluster hole near the start, then create a bigger sample.
+	 *It fills the hole and continues past the last sample, so it ends up in 2
+	 *fragments.*/
+	err = s7xx_fs->remove("Samples/1-");
+	if(err)
+	{
+		print_unexpected_err(err, 526);
+		return 526;
+	}
+
+	err = s7xx_fs->ftruncate("Samples/8191-", 0);
+	if(err)
+	{
+		print_unexpected_err(err, 527);
+		return 527;
+	}
+
+	err = s7xx_fs->ftruncate("Samples/8191-",
+							 S7XX::FS::On_disk_sizes::SAMPLE_PARAMS_ENTRY
+							 + 120 * S7XX::AUDIO_SEGMENT_SIZE);
+	if(err)
+	{
+		print_unexpected_err(err, 538);
+		return 538;
+	}
+
+	err = dump_samples(*s7xx_fs, samples_before);
+	if(err)
+	{
+		print_unexpected_err(err, 528);
+		return 528;
+	}
+
+	s7xx_fs.reset();
+	/*----------------------------End of data setup---------------------------*/
+
+	/*---------------------------------Defrag---------------------------------*/
+	err = S7XX::FS::defrag(S7XX_FS, stats);
+	if(err)
+	{
+		print_unexpected_err(err, 529);
+		return 529;
+	}
+
+	if(stats.files != 5 || stats.fragments_before <= stats.files
+		|| stats.fragments_after != stats.files || stats.seeks_after != 1
+		|| !stats.clusters_moved)
+	{
+		std::cerr << "Bad defrag stats!!!" << std::endl;
+		std::cerr << "Files: " << stats.files << std::endl;
+		std::cerr << "Fragments: " << stats.fragments_before << " -> "
+			<< stats.fragments_after << std::endl;
+		std::cerr << "Seeks: " << stats.seeks_before << " -> "
+			<< stats.seeks_after << std::endl;
+		std::cerr << "Clusters moved: " << stats.clusters_moved << std::endl;
+		std::cerr << "Exit: 530" << std::endl;
+		return 530;
+	}
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(S7XX_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 531);
+		return 531;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck found errors!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 532" << std::endl;
+		return 532;
+	}
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 533" << std::endl;
+		return 533;
+	}
+
+	err = dump_samples(*s7xx_fs, samples_after);
+	if(err)
+	{
+		print_unexpected_err(err, 534);
+		return 534;
+	}
+
+	if(samples_before != samples_after)
+	{
+		std::cerr << "Sample data changed!!!" << std::endl;
+		std::cerr << "Exit: 535" << std::endl;
+		return 535;
+	}
+
+	s7xx_fs.reset();
+
+	//Nothing left to do on an already defragged FS
+	err = S7XX::FS::defrag(S7XX_FS, stats);
+	if(err)
+	{
+		print_unexpected_err(err, 536);
+		return 536;
+	}
+
+	if(stats.clusters_moved || stats.fragments_before != stats.files)
+	{
+		std::cerr << "Defragged FS got defragged again!!!" << std::endl;
+		std::cerr << "Exit: 537" << std::endl;
+		return 537;
+	}
+	/*------------------------------End of defrag-----------------------------*/
+
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+static int volume_xfer_tests()
+{
+	constexpr char S7XX_FS[] = "volume_xfer_fs.img";
+	constexpr char DST_FS[] = "volume_xfer_dst_fs.img";
+	constexpr char DUMP_DIR[] = "volume_xfer_dump";
+	constexpr uintmax_t DST_FS_SIZE = 80 * 1024 * 1024;
+	constexpr size_t EXPECTED_CLOSURE_SIZES[] = {0, 1, 1, 4, 5, 5};
+
+	u16 err, expected_err, fsck_status, vol_idx, perf_idx;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	min_vfs::stream_t stream;
+	S7XX::FS::filesystem_t::closure_t closure, dst_closure;
+	std::vector<std::string> samples_before, samples_after;
+
+	/*-------------------------------Data setup-------------------------------*/
+	for(const char *const path: {S7XX_FS, DST_FS, DUMP_DIR})
+		if(std::filesystem::exists(path)) std::filesystem::remove_all(path);
+
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 539" << std::endl;
+		return 539;
+	}
+
+	//The test volume doesn't reference anything, point it at the perf
+	err = s7xx_fs->fopen("Volumes/0-", stream);
+	if(err)
+	{
+		print_unexpected_err(err, 540);
+		return 540;
+	}
+
+	perf_idx = 0;
+	stream.seek((uintmax_t)0x20);
+	err = stream.write(&perf_idx, 2);
+	if(err)
+	{
+		print_unexpected_err(err, 541);
+		return 541;
+	}
+
+	stream.close();
+
+	err = dump_samples(*s7xx_fs, samples_before);
+	if(err)
+	{
+		print_unexpected_err(err, 542);
+		return 542;
+	}
+	/*----------------------------End of data setup---------------------------*/
+
+	expected_err = ret_val_setup(S7XX::FS::LIBRARY_ID,
+								 (u8)S7XX::FS::ERR::EMPTY_ENTRY);
+	err = s7xx_fs->volume_closure(1, closure);
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 543);
+		return 543;
+	}
+
+	err = s7xx_fs->volume_closure(0, closure);
+	if(err)
+	{
+		print_unexpected_err(err, 544);
+		return 544;
+	}
+
+	//Patch 3 isn't used by the perf
+	for(u8 i = 1; i < 6; i++)
+	{
+		if(closure[i].size() != EXPECTED_CLOSURE_SIZES[i])
+		{
+			std::cerr << "Closure size mismatch for type " << (u16)i << "!!!";
+			std::cerr << std::endl << "Expected: "
+				<< EXPECTED_CLOSURE_SIZES[i] << std::endl;
+			std::cerr << "Got: " << closure[i].size() << std::endl;
+			std::cerr << "Exit: 545" << std::endl;
+			return 545;
+		}
+	}
+
+	err = s7xx_fs->export_volume(0, DUMP_DIR, 2);
+	if(err)
+	{
+		print_unexpected_err(err, 546);
+		return 546;
+	}
+
+	//The samples are only held open while they're going out
+	if(s7xx_fs->get_open_file_count())
+	{
+		std::cerr << "Files left open!!!" << std::endl;
+		std::cerr << "Exit: 618" << std::endl;
+		return 618;
+	}
+
+	s7xx_fs.reset();
+
+	/*-------------------------Import into an empty FS-------------------------*/
+	std::ofstream(DST_FS).close();
+	std::filesystem::resize_file(DST_FS, DST_FS_SIZE);
+
+	err = S7XX::FS::mkfs(DST_FS, "Volume xfer test");
+	if(err)
+	{
+		print_unexpected_err(err, 547);
+		return 547;
+	}
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(DST_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 548" << std::endl;
+		return 548;
+	}
+
+	err = s7xx_fs->import_volume(DUMP_DIR, vol_idx, 2);
+	if(err)
+	{
+		print_unexpected_err(err, 549);
+		return 549;
+	}
+
+	if(s7xx_fs->get_open_file_count())
+	{
+		std::cerr << "Files left open!!!" << std::endl;
+		std::cerr << "Exit: 619" << std::endl;
+		return 619;
+	}
+
+	err = s7xx_fs->volume_closure(vol_idx, dst_closure);
+	if(err)
+	{
+		print_unexpected_err(err, 550);
+		return 550;
+	}
+
+	//Everything gets packed at the start of an empty FS
+	for(u8 i = 1; i < 6; i++)
+	{
+		for(u16 j = 0; j < dst_closure[i].size(); j++)
+		{
+			if(dst_closure[i].size() != closure[i].size()
+				|| dst_closure[i][j] != j)
+			{
+				std::cerr << "Imported closure mismatch for type " << (u16)i
+					<< "!!!" << std::endl;
+				std::cerr << "Exit: 551" << std::endl;
+				return 551;
+			}
+		}
+	}
+
+	err = dump_samples(*s7xx_fs, samples_after);
+	if(err)
+	{
+		print_unexpected_err(err, 552);
+		return 552;
+	}
+
+	//The test FS's samples are all used, and all in order
+	if(samples_before != samples_after)
+	{
+		std::cerr << "Sample data changed!!!" << std::endl;
+		std::cerr << "Exit: 553" << std::endl;
+		return 553;
+	}
+
+	s7xx_fs.reset();
+
+	fsck_status = 0;
+	err = S7XX::FS::fsck(DST_FS, fsck_status);
+	if(err)
+	{
+		print_unexpected_err(err, 554);
+		return 554;
+	}
+
+	if(fsck_status)
+	{
+		std::cerr << "fsck found errors!!!" << std::endl;
+		print_fsck_status(fsck_status);
+		std::cerr << "Exit: 555" << std::endl;
+		return 555;
+	}
+	/*----------------------End of import into an empty FS---------------------*/
+
+	for(const char *const path: {S7XX_FS, DST_FS, DUMP_DIR})
+		std::filesystem::remove_all(path);
+
+	return 0;
+}
+
+//Cluster total (0x1E) of a list entry, as it is on disk
+static u16 read_cls_total(S7XX::FS::filesystem_t &fs, const uintmax_t list_addr,
+						  const u16 idx)
+{
+	u16 total;
+
+	fs.stream.seekg(list_addr + idx * S7XX::FS::On_disk_sizes::LIST_ENTRY
+		+ 0x1E);
+	fs.stream.read((char*)&total, 2);
+
+	if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+		total = std::byteswap(total);
+
+	return total;
+}
+
+static int dep_totals_tests()
+{
+	constexpr char S7XX_FS[] = "dep_totals_fs.img";
+
+	struct expected_total_t
+	{
+		uintmax_t list_addr;
+		u16 idx;
+		u16 total;
+	};
+
+	//Sample 2 is 38 segments, only partial 2 uses it, and only patch 0 uses
+	//partial 2. Patch 1 and the volume don't reach it.
+	constexpr expected_total_t EXPECTED_TOTALS[] =
+	{
+		{S7XX::FS::On_disk_addrs::VOLUME_LIST, 0, 130},
+		{S7XX::FS::On_disk_addrs::PERF_LIST, 0, 366 - 38},
+		{S7XX::FS::On_disk_addrs::PATCH_LIST, 0, 264 - 38},
+		{S7XX::FS::On_disk_addrs::PATCH_LIST, 1, 188},
+		{S7XX::FS::On_disk_addrs::PARTIAL_LIST, 2, 0}
+	};
+
+	u16 err;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+
+	if(std::filesystem::exists(S7XX_FS)) std::filesystem::remove(S7XX_FS);
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 571" << std::endl;
+		return 571;
+	}
+
+	//First thing after mounting, so the graph gets built by the delete
+	err = s7xx_fs->remove("Samples/2-");
+	if(err)
+	{
+		print_unexpected_err(err, 572);
+		return 572;
+	}
+
+	//Once as the driver left it, once after a remount
+	for(u8 pass = 0; pass < 2; pass++)
+	{
+		for(const expected_total_t &expected: EXPECTED_TOTALS)
+		{
+			const u16 total = read_cls_total(*s7xx_fs, expected.list_addr,
+											 expected.idx);
+
+			if(total != expected.total)
+			{
+				std::cerr << "Cluster total mismatch!!!" << std::endl;
+				std::cerr << "Expected: " << expected.total << std::endl;
+				std::cerr << "Got: " << total << std::endl;
+				std::cerr << "Exit: " << 573 + pass << std::endl;
+				return 573 + pass;
+			}
+		}
+
+		s7xx_fs.reset();
+
+		try
+		{
+			s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+		}
+		catch(min_vfs::FS_err e)
+		{
+			std::cerr << e.what() << std::endl;
+			std::cerr << e.err_code << std::endl;
+			std::cerr << "Exit: 575" << std::endl;
+			return 575;
+		}
+	}
+
+	s7xx_fs.reset();
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+static int list_cache_tests()
+{
+	constexpr char S7XX_FS[] = "list_cache_fs.img";
+	constexpr u32 LISTS_SIZE = S7XX::FS::On_disk_addrs::VOLUME_PARAMS
+		- S7XX::FS::On_disk_addrs::VOLUME_LIST;
+
+	u16 err;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	std::unique_ptr<char[]> on_disk_lists;
+	std::vector<min_vfs::dentry_t> dentries;
+	min_vfs::dentry_t expected_dentry;
+	min_vfs::stream_t stream;
+	std::ifstream fstr;
+	std::vector<char> segment(S7XX::AUDIO_SEGMENT_SIZE, 0x55);
+
+	if(std::filesystem::exists(S7XX_FS)) std::filesystem::remove(S7XX_FS);
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 576" << std::endl;
+		return 576;
+	}
+
+	//Gets listed before the write, so the cache is warm
+	err = s7xx_fs->list("/Samples/3-", dentries);
+	if(err)
+	{
+		print_unexpected_err(err, 577);
+		return 577;
+	}
+
+	expected_dentry = dentries[0];
+	expected_dentry.fsize += S7XX::AUDIO_SEGMENT_SIZE;
+
+	//Growing the sample by one segment
+	err = s7xx_fs->fopen("/Samples/3-", stream);
+	if(err)
+	{
+		print_unexpected_err(err, 578);
+		return 578;
+	}
+
+	stream.seek(dentries[0].fsize);
+	err = stream.write(segment.data(), segment.size());
+	if(err)
+	{
+		print_unexpected_err(err, 579);
+		return 579;
+	}
+
+	stream.close();
+
+	//Once as the driver left it, once after a remount
+	for(u8 pass = 0; pass < 2; pass++)
+	{
+		dentries.clear();
+		err = s7xx_fs->list("/Samples/3-", dentries);
+		if(err)
+		{
+			print_unexpected_err(err, 580 + pass);
+			return 580 + pass;
+		}
+
+		if(dentries[0] != expected_dentry)
+		{
+			std::cerr << "Dentry mismatch!!!" << std::endl;
+
+			std::cerr << "Expected dentry:" << std::endl;
+			std::cerr << expected_dentry.to_string(1) << std::endl;
+
+			std::cerr << "Got:" << std::endl;
+			std::cerr << dentries[0].to_string(1) << std::endl;
+
+			std::cerr << "Exit: " << 582 + pass << std::endl;
+			return 582 + pass;
+		}
+
+		if(pass) break;
+
+		//The cached lists shouldn't have anything the disk doesn't
+		on_disk_lists = std::make_unique<char[]>(LISTS_SIZE);
+
+		fstr.open(S7XX_FS, std::ios::in | std::ios::binary);
+		fstr.seekg(S7XX::FS::On_disk_addrs::VOLUME_LIST);
+		fstr.read(on_disk_lists.get(), LISTS_SIZE);
+		fstr.close();
+
+		if(!std::equal(on_disk_lists.get(), on_disk_lists.get() + LISTS_SIZE,
+			(char*)s7xx_fs->lists.get()))
+		{
+			std::cerr << "Cached lists don't match the disk!!!" << std::endl;
+			std::cerr << "Exit: 584" << std::endl;
+			return 584;
+		}
+
+		s7xx_fs.reset();
+
+		try
+		{
+			s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+		}
+		catch(min_vfs::FS_err e)
+		{
+			std::cerr << e.what() << std::endl;
+			std::cerr << e.err_code << std::endl;
+			std::cerr << "Exit: 585" << std::endl;
+			return 585;
+		}
+	}
+
+	s7xx_fs.reset();
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+static int name_collision_tests()
+{
+	constexpr char S7XX_FS[] = "name_collision_fs.img";
+
+	u16 err, expected_err;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	std::vector<min_vfs::dentry_t> dentries;
+	std::string name, name_path;
+
+	if(std::filesystem::exists(S7XX_FS)) std::filesystem::remove(S7XX_FS);
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 586" << std::endl;
+		return 586;
+	}
+
+	err = s7xx_fs->list("/Samples/2-", dentries);
+	if(err)
+	{
+		print_unexpected_err(err, 587);
+		return 587;
+	}
+
+	//All 16 chars, padding included
+	name = dentries[0].fname.substr(2);
+	name_path = "/Samples/" + name;
+
+	//Sample 3 gets sample 2's name
+	err = s7xx_fs->rename("/Samples/3-", ("/Samples/3-" + name).c_str());
+	if(err)
+	{
+		print_unexpected_err(err, 588);
+		return 588;
+	}
+
+	//Lowest slot first, like the HW
+	for(const u16 slot: {2, 3})
+	{
+		dentries.clear();
+		err = s7xx_fs->list(name_path.c_str(), dentries);
+		if(err)
+		{
+			print_unexpected_err(err, 589);
+			return 589;
+		}
+
+		if(dentries.size() != 1 || dentries[0].fname != std::to_string(slot) + "-" + name)
+		{
+			std::cerr << "Name lookup mismatch!!!" << std::endl;
+			std::cerr << "Expected slot: " << slot << std::endl;
+			std::cerr << "Got: " << dentries[0].fname << std::endl;
+			std::cerr << "Exit: 590" << std::endl;
+			return 590;
+		}
+
+		err = s7xx_fs->remove(name_path.c_str());
+		if(err)
+		{
+			print_unexpected_err(err, 591);
+			return 591;
+		}
+	}
+
+	expected_err = ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+	err = s7xx_fs->remove(name_path.c_str());
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 592);
+		return 592;
+	}
+
+	//Sample 4 wasn't part of it
+	dentries.clear();
+	err = s7xx_fs->list("/Samples/4-", dentries);
+	if(err)
+	{
+		print_unexpected_err(err, 593);
+		return 593;
+	}
+
+	s7xx_fs.reset();
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+//Expects list and remove to work.
+static int partial_del_tests()
+{
+	constexpr char S7XX_FS[] = "partial_del_fs.img";
+	constexpr u16 BAD_SLOT = 3;
+	//Samples 0 to 2, the ones before the bad one
+	constexpr u16 FREED_CLUSTERS = 94 + 94 + 38;
+
+	u16 err, expected_err, val, free_cnt, free_in_FAT;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	std::vector<min_vfs::dentry_t> dentries;
+	std::fstream broken_fstr;
+
+	if(std::filesystem::exists(S7XX_FS)) std::filesystem::remove(S7XX_FS);
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	broken_fstr.open(S7XX_FS, std::fstream::in | std::fstream::out
+		| std::fstream::binary);
+
+	//One more cluster than the chain has
+	broken_fstr.seekg(S7XX::FS::On_disk_addrs::SAMPLE_LIST + BAD_SLOT
+		* S7XX::FS::On_disk_sizes::LIST_ENTRY + 0x1E);
+	broken_fstr.read((char*)&val, 2);
+
+	if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+		val = std::byteswap(val);
+
+	val++;
+
+	if constexpr(S7XX::FS::ENDIANNESS != std::endian::native)
+		val = std::byteswap(val);
+
+	broken_fstr.seekp(S7XX::FS::On_disk_addrs::SAMPLE_LIST + BAD_SLOT
+		* S7XX::FS::On_disk_sizes::LIST_ENTRY + 0x1E);
+	broken_fstr.write((char*)&val, 2);
+
+	if(!broken_fstr.good())
+	{
+		std::cerr << "IO error!!!" << std::endl;
+		std::cerr << "Exit: 594" << std::endl;
+		return 594;
+	}
+
+	broken_fstr.close();
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 595" << std::endl;
+		return 595;
+	}
+
+	free_cnt = s7xx_fs->FAT[1];
+	free_in_FAT = FAT_utils::count_free_clusters(s7xx_fs->FAT.get(),
+		S7XX::FS::FAT_ATTRS, s7xx_fs->fat_attrs.LENGTH);
+
+	expected_err = ret_val_setup(S7XX::FS::LIBRARY_ID,
+								 (u8)S7XX::FS::ERR::CHAIN_SIZE_MISMATCH);
+	err = s7xx_fs->remove("/Samples");
+	if(err != expected_err)
+	{
+		print_expected_err(expected_err, err, 596);
+		return 596;
+	}
+
+	//Once as the driver left it, once after a remount
+	for(u8 pass = 0; pass < 2; pass++)
+	{
+		//Everything from the bad sample on is still there
+		dentries.clear();
+		err = s7xx_fs->list("/Samples/", dentries);
+		if(err)
+		{
+			print_unexpected_err(err, 597 + pass);
+			return 597 + pass;
+		}
+
+		if(dentries.size() != 2 || !dentries[0].fname.starts_with("3-")
+			|| !dentries[1].fname.starts_with("4-")
+			|| s7xx_fs->header.TOC.sample_cnt != 2)
+		{
+			std::cerr << "Samples left mismatch!!!" << std::endl;
+			std::cerr << "Expected: 3 and 4" << std::endl;
+			std::cerr << "Got " << dentries.size() << ", TOC says "
+				<< s7xx_fs->header.TOC.sample_cnt << std::endl;
+			std::cerr << "Exit: " << 599 + pass << std::endl;
+			return 599 + pass;
+		}
+
+		//Only what came before got freed, and the count agrees with the FAT
+		if(s7xx_fs->FAT[1] != free_cnt + FREED_CLUSTERS
+			|| FAT_utils::count_free_clusters(s7xx_fs->FAT.get(),
+				S7XX::FS::FAT_ATTRS, s7xx_fs->fat_attrs.LENGTH)
+				!= free_in_FAT + FREED_CLUSTERS)
+		{
+			std::cerr << "Free cluster count mismatch!!!" << std::endl;
+			std::cerr << "Expected: " << free_cnt + FREED_CLUSTERS
+				<< std::endl;
+			std::cerr << "Got: " << s7xx_fs->FAT[1] << std::endl;
+			std::cerr << "Exit: " << 601 + pass << std::endl;
+			return 601 + pass;
+		}
+
+		if(pass) break;
+
+		s7xx_fs.reset();
+
+		try
+		{
+			s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+		}
+		catch(min_vfs::FS_err e)
+		{
+			std::cerr << e.what() << std::endl;
+			std::cerr << e.err_code << std::endl;
+			std::cerr << "Exit: 603" << std::endl;
+			return 603;
+		}
+	}
+
+	s7xx_fs.reset();
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+//A stream that sat still while its chain got moved around under it
+static int stale_cursor_tests()
+{
+	constexpr char S7XX_FS[] = "stale_cursor_fs.img";
+	constexpr uintmax_t HEADER_SIZE = S7XX::FS::On_disk_sizes::SAMPLE_PARAMS_ENTRY;
+	//Sample 3 is 8 segments, sample 2 38 and right before it
+	constexpr u16 SHORT_CNT = 2, LONG_CNT = 8, GROWN_CNT = 38 + LONG_CNT
+		- SHORT_CNT;
+
+	u16 err;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs;
+	min_vfs::stream_t stale_stream, stream;
+	std::vector<char> segment(S7XX::AUDIO_SEGMENT_SIZE),
+		p_segment(S7XX::AUDIO_SEGMENT_SIZE, 0x50),
+		q_segments((GROWN_CNT - 38) * S7XX::AUDIO_SEGMENT_SIZE, 0x51);
+
+	if(std::filesystem::exists(S7XX_FS)) std::filesystem::remove(S7XX_FS);
+	std::filesystem::copy_file(TEST_FS_PATH, S7XX_FS);
+
+	try
+	{
+		s7xx_fs = std::make_unique<S7XX::FS::filesystem_t>(S7XX_FS);
+	}
+	catch(min_vfs::FS_err e)
+	{
+		std::cerr << e.what() << std::endl;
+		std::cerr << e.err_code << std::endl;
+		std::cerr << "Exit: 604" << std::endl;
+		return 604;
+	}
+
+	//Leaves the stream's cursor at segment 4
+	err = s7xx_fs->fopen("/Samples/3-", stale_stream);
+	if(err)
+	{
+		print_unexpected_err(err, 605);
+		return 605;
+	}
+
+	stale_stream.seek(HEADER_SIZE + 4 * S7XX::AUDIO_SEGMENT_SIZE);
+	err = stale_stream.read(segment.data(), segment.size());
+	if(err)
+	{
+		print_unexpected_err(err, 606);
+		return 606;
+	}
+
+	err = s7xx_fs->ftruncate("/Samples/3-", HEADER_SIZE + SHORT_CNT
+		* S7XX::AUDIO_SEGMENT_SIZE);
+	if(err)
+	{
+		print_unexpected_err(err, 607);
+		return 607;
+	}
+
+	//Sample 2 gets the clusters sample 3 just let go of
+	err = s7xx_fs->fopen("/Samples/2-", stream);
+	if(err)
+	{
+		print_unexpected_err(err, 608);
+		return 608;
+	}
+
+	stream.seek(HEADER_SIZE + 38 * S7XX::AUDIO_SEGMENT_SIZE);
+	err = stream.write(q_segments.data(), q_segments.size());
+	if(err)
+	{
+		print_unexpected_err(err, 609);
+		return 609;
+	}
+
+	stream.close();
+
+	err = s7xx_fs->ftruncate("/Samples/3-", HEADER_SIZE + LONG_CNT
+		* S7XX::AUDIO_SEGMENT_SIZE);
+	if(err)
+	{
+		print_unexpected_err(err, 610);
+		return 610;
+	}
+
+	//Picks up right after the cursor
+	stale_stream.seek(HEADER_SIZE + 5 * S7XX::AUDIO_SEGMENT_SIZE);
+	err = stale_stream.write(p_segment.data(), p_segment.size());
+	if(err)
+	{
+		print_unexpected_err(err, 611);
+		return 611;
+	}
+
+	stale_stream.close();
+
+	err = s7xx_fs->fopen("/Samples/3-", stream);
+	if(err)
+	{
+		print_unexpected_err(err, 612);
+		return 612;
+	}
+
+	stream.seek(HEADER_SIZE + 5 * S7XX::AUDIO_SEGMENT_SIZE);
+	err = stream.read(segment.data(), segment.size());
+	if(err)
+	{
+		print_unexpected_err(err, 613);
+		return 613;
+	}
+
+	stream.close();
+
+	if(segment != p_segment)
+	{
+		std::cerr << "Data mismatch in sample 3!!!" << std::endl;
+		std::cerr << "Exit: 614" << std::endl;
+		return 614;
+	}
+
+	err = s7xx_fs->fopen("/Samples/2-", stream);
+	if(err)
+	{
+		print_unexpected_err(err, 615);
+		return 615;
+	}
+
+	segment.resize(q_segments.size());
+	stream.seek(HEADER_SIZE + 38 * S7XX::AUDIO_SEGMENT_SIZE);
+	err = stream.read(segment.data(), segment.size());
+	if(err)
+	{
+		print_unexpected_err(err, 616);
+		return 616;
+	}
+
+	stream.close();
+
+	if(segment != q_segments)
+	{
+		std::cerr << "Data mismatch in sample 2!!!" << std::endl;
+		std::cerr << "Exit: 617" << std::endl;
+		return 617;
+	}
+
+	s7xx_fs.reset();
+	std::filesystem::remove(S7XX_FS);
+
+	return 0;
+}
+
+//Host FS utils are a dependency of the driver, so its tests should be run
+//first.
+int main()
+{
+	u16 err;
+
+	std::unique_ptr<S7XX::FS::filesystem_t> s7xx_fs, dst_fs;
+
+	//test standalone functions first
+	std::cout << "fsck tests..." << std::endl;
+	err = fsck_tests();
+	if(err) return err;
+	std::cout << "fsck tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "mkfs tests..." << std::endl;
+	err = mkfs_tests(dst_fs);
+	if(err) return err;
+	std::cout << "mkfs tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Mount tests..." << std::endl;
+	err = mount_tests(s7xx_fs);
+	if(err) return err;
+	std::cout << "Mount OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "List tests..." << std::endl;
+	err = list_tests(*s7xx_fs);
+	if(err) return err;
+	std::cout << "List tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Delete tests..." << std::endl;
+	err = del_tests();
+	if(err) return err;
+	std::cout << "Delete tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Truncate tests..." << std::endl;
+	err = trunc_tests();
+	if(err) return err;
+	std::cout << "Truncate tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Rename tests..." << std::endl;
+	err = rename_tests();
+	if(err) return err;
+	std::cout << "Rename tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "fopen/fclose tests..." << std::endl;
+	err = fopen_tests();
+	if(err) return err;
+	std::cout << "fopen/fclose tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Read tests..." << std::endl;
+	err = read_tests();
+	if(err) return err;
+	std::cout << "Read tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Truncate while open tests..." << std::endl;
+	err = trunc_open_tests();
+	if(err) return err;
+	std::cout << "Truncate while open tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Write tests..." << std::endl;
+	err = write_tests();
+	if(err) return err;
+	std::cout << "Write tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Remove while open tests..." << std::endl;
+	err = remove_open_tests();
+	if(err) return err;
+	std::cout << "Remove while open tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Defrag tests..." << std::endl;
+	err = defrag_tests();
+	if(err) return err;
+	std::cout << "Defrag tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Volume export/import tests..." << std::endl;
+	err = volume_xfer_tests();
+	if(err) return err;
+	std::cout << "Volume export/import tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Dependency total tests..." << std::endl;
+	err = dep_totals_tests();
+	if(err) return err;
+	std::cout << "Dependency total tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "List cache tests..." << std::endl;
+	err = list_cache_tests();
+	if(err) return err;
+	std::cout << "List cache tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Name collision tests..." << std::endl;
+	err = name_collision_tests();
+	if(err) return err;
+	std::cout << "Name collision tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Partial delete tests..." << std::endl;
+	err = partial_del_tests();
+	if(err) return err;
+	std::cout << "Partial delete tests OK!" << std::endl;
+	std::cout << std::endl;
+
+	std::cout << "Stale cursor tests..." << std::endl;
+	err = stale_cursor_tests();
+	if(err) return err;
+	std::cout << "Stale cursor tests OK!" << std::endl;
 	std::cout << std::endl;
 
 	std::cout << "ALL TESTS OK!" << std::endl;
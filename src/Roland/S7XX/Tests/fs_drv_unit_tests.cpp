@@ -204,7 +204,10 @@ static int reloc_cluster()
 	/*----------------------Reloc first cluster in chain----------------------*/
 	cls = s7xx_fs->FAT[S7XX::FS::FAT_ATTRS.DATA_MIN];
 
-	err = S7XX::FS::reloc_cluster(*s7xx_fs, S7XX::FS::FAT_ATTRS.DATA_MIN, S7XX::FS::S760_OS_CLUSTERS);
+	err = S7XX::FS::reloc_clusters(*s7xx_fs, {S7XX::FS::FAT_ATTRS.DATA_MIN}, S7XX::FS::S760_OS_CLUSTERS);
+
+	//reloc_clusters leaves committing the FAT to its caller
+	if(!err) err = s7xx_fs->FAT.commit(s7xx_fs->stream, S7XX::FS::FAT_ATTRS);
 	if(err)
 	{
 		std::cerr << "Unexpected error!!!" << std::endl;
@@ -280,7 +283,10 @@ static int reloc_cluster()
 	constexpr u16 OTHER_CLS_ADDR = S7XX::FS::FAT_ATTRS.DATA_MIN + 1;
 	cls = s7xx_fs->FAT[OTHER_CLS_ADDR];
 
-	err = S7XX::FS::reloc_cluster(*s7xx_fs, OTHER_CLS_ADDR, S7XX::FS::S760_OS_CLUSTERS);
+	err = S7XX::FS::reloc_clusters(*s7xx_fs, {OTHER_CLS_ADDR}, S7XX::FS::S760_OS_CLUSTERS);
+
+	//reloc_clusters leaves committing the FAT to its caller
+	if(!err) err = s7xx_fs->FAT.commit(s7xx_fs->stream, S7XX::FS::FAT_ATTRS);
 	if(err)
 	{
 		std::cerr << "Unexpected error!!!" << std::endl;
@@ -559,6 +565,8 @@ static int file_exists()
 
 	s7xx_fs->stream.seekp(S7XX::FS::On_disk_addrs::VOLUME_LIST + 2 * S7XX::FS::On_disk_sizes::LIST_ENTRY);
 	s7xx_fs->stream.put(0);
+	//lookups only go to the list cache
+	s7xx_fs->lists[2 * S7XX::FS::On_disk_sizes::LIST_ENTRY] = 0;
 
 	res = S7XX::FS::file_exists<S7XX::FS::TYPE_ATTRS[1]>(*s7xx_fs, 2);
 	if(res)
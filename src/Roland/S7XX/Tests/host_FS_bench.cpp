@@ -0,0 +1,136 @@
+﻿#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+
+#include "Utils/ints.hpp"
+#include "Utils/utils.hpp"
+#include "Roland/S7XX/host_FS_utils.hpp"
+
+/*Host dump lookup benchmark. Fills a dir with a full sample list's worth of
+ *(empty) files, then looks every idx up: with build_index and the table it
+ *makes, and with find_from_index scanning the dir each time, which is what
+ *every lookup used to cost. The scans only get done for scan_cnt idxs
+ *spread over the whole range, the total for every idx is extrapolated.
+ *
+ *	S7XX_host_FS_bench [scan_cnt]
+ *
+ *Every path gets checked, so a run with a small scan_cnt doubles as a test.*/
+
+constexpr char BENCH_DIR[] = "host_fs_bench";
+constexpr u16 SAMPLE_CNT = 8192;
+
+static std::string sample_fname(const u16 idx)
+{
+	//Same shape as what sanitize_filename leaves, category and all
+	return std::to_string(idx) + "-TST-Sample_" + std::to_string(idx);
+}
+
+static int bench(const u16 scan_cnt)
+{
+	u16 err;
+	double ms;
+	std::filesystem::path file_path;
+	S7XX::Host_FS::host_index_t index;
+
+	/*-------------------------------Data setup-------------------------------*/
+	if(std::filesystem::exists(BENCH_DIR))
+		std::filesystem::remove_all(BENCH_DIR);
+
+	std::filesystem::create_directory(BENCH_DIR);
+
+	//Created in reverse, so directory order isn't idx order either way
+	for(u16 i = SAMPLE_CNT; i--;)
+		std::ofstream(std::filesystem::path(BENCH_DIR) / sample_fname(i));
+
+	//Neither of these are S7XX files
+	std::ofstream(std::filesystem::path(BENCH_DIR) / "notes.txt");
+	std::filesystem::create_directory(std::filesystem::path(BENCH_DIR)
+		/ "1-TST-Not_a_file");
+	/*----------------------------End of data setup---------------------------*/
+
+	auto start = std::chrono::steady_clock::now();
+
+	err = S7XX::Host_FS::build_index(BENCH_DIR, index);
+	if(err)
+	{
+		std::cerr << "Unexpected error 0x" << std::hex << err << std::dec << "!!!" << std::endl;
+		return 2;
+	}
+
+	for(u16 i = 0; i < SAMPLE_CNT; i++)
+	{
+		err = S7XX::Host_FS::find_from_index(index, i, file_path);
+		if(err)
+		{
+			std::cerr << "Unexpected error 0x" << std::hex << err << std::dec << "!!!" << std::endl;
+			return 3;
+		}
+
+		if(file_path.filename() != sample_fname(i))
+		{
+			std::cerr << "File path mismatch!!!" << std::endl;
+			std::cerr << "\tExpected: " << sample_fname(i) << std::endl;
+			std::cerr << "\tGot: " << file_path << std::endl;
+			return 4;
+		}
+	}
+
+	ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::left << std::setw(16) << "index" << std::right
+		<< std::setw(12) << std::fixed << std::setprecision(3) << ms
+		<< " ms for " << SAMPLE_CNT << " lookups" << std::endl;
+
+	start = std::chrono::steady_clock::now();
+
+	for(u16 i = 0; i < scan_cnt; i++)
+	{
+		const u16 idx = (u32)i * SAMPLE_CNT / scan_cnt;
+
+		err = S7XX::Host_FS::find_from_index(BENCH_DIR, idx, file_path);
+		if(err)
+		{
+			std::cerr << "Unexpected error 0x" << std::hex << err << std::dec << "!!!" << std::endl;
+			return 5;
+		}
+
+		if(file_path.filename() != sample_fname(idx))
+		{
+			std::cerr << "File path mismatch!!!" << std::endl;
+			std::cerr << "\tExpected: " << sample_fname(idx) << std::endl;
+			std::cerr << "\tGot: " << file_path << std::endl;
+			return 6;
+		}
+	}
+
+	ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count() / scan_cnt;
+
+	std::cout << std::left << std::setw(16) << "scan per lookup" << std::right
+		<< std::setw(12) << std::fixed << std::setprecision(3)
+		<< ms * SAMPLE_CNT << " ms for " << SAMPLE_CNT << " lookups ("
+		<< scan_cnt << " timed)" << std::endl;
+
+	std::filesystem::remove_all(BENCH_DIR);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const u16 scan_cnt = argc > 1 ? std::clamp(std::stoi(argv[1]), 1,
+		(int)SAMPLE_CNT) : 256;
+
+	std::cout << "Host dump lookups..." << std::endl;
+	const int err = bench(scan_cnt);
+	if(err) return err;
+	std::cout << "Host dump lookups OK!" << std::endl;
+
+	return 0;
+}
@@ -84,6 +84,110 @@ static int find_from_index_tests()
 	return 0;
 }
 
+static int build_index_tests()
+{
+	u16 expected_err, err;
+	std::string expected_file_path;
+	std::filesystem::path dir_path, file_path;
+	S7XX::Host_FS::host_index_t index;
+
+	expected_err = ret_val_setup(S7XX::Host_FS::LIBRARY_ID, (u8)S7XX::Host_FS::ERR::INVALID_PATH);
+	err = S7XX::Host_FS::build_index("nx_dir", index);
+	if(err != expected_err)
+	{
+		std::cerr << "Error mismatch!!!" << std::endl;
+		std::cerr << "\tExpected 0x" << std::hex << expected_err << std::endl;
+		std::cerr << "\tGot 0x" << err << std::dec << std::endl;
+		return 12;
+	}
+
+	dir_path = HOST_FS_TEST_DATA::REF_HOST_FS_PATH;
+	dir_path /= "Samples/";
+
+	err = S7XX::Host_FS::build_index(dir_path, index);
+	if(err)
+	{
+		std::cerr << "Unexpected error 0x" << std::hex << err << std::dec << "!!!" << std::endl;
+		return 13;
+	}
+
+	if(index.size() != std::size(HOST_FS_TEST_DATA::EXPECTED_SAMPLE_NAMES))
+	{
+		std::cerr << "Index size mismatch!!!" << std::endl;
+		std::cerr << "\tExpected: " << std::size(HOST_FS_TEST_DATA::EXPECTED_SAMPLE_NAMES) << std::endl;
+		std::cerr << "\tGot: " << index.size() << std::endl;
+		return 14;
+	}
+
+	for(u16 i = 0; i < index.size(); i++)
+	{
+		expected_file_path = dir_path.string();
+		expected_file_path += HOST_FS_TEST_DATA::EXPECTED_SAMPLE_NAMES[i];
+
+		err = S7XX::Host_FS::find_from_index(index, i, file_path);
+		if(err)
+		{
+			std::cerr << "Unexpected error 0x" << std::hex << err << std::dec << "!!!" << std::endl;
+			return 15;
+		}
+
+		if(file_path.string() != expected_file_path)
+		{
+			std::cerr << "File path mismatch!!!" << std::endl;
+			std::cerr << "\tExpected: " << expected_file_path << std::endl;
+			std::cerr << "\tGot: " << file_path << std::endl;
+			return 16;
+		}
+	}
+
+	expected_err = ret_val_setup(S7XX::Host_FS::LIBRARY_ID, (u8)S7XX::Host_FS::ERR::NOT_FOUND);
+	err = S7XX::Host_FS::find_from_index(index, 456, file_path);
+	if(err != expected_err)
+	{
+		std::cerr << "Error mismatch!!!" << std::endl;
+		std::cerr << "\tExpected 0x" << std::hex << expected_err << std::endl;
+		std::cerr << "\tGot 0x" << err << std::dec << std::endl;
+		return 17;
+	}
+
+	return 0;
+}
+
+static int parse_host_fname_tests()
+{
+	constexpr std::string_view FNAMES[] =
+	{
+		"1-ABC-TEST", "0-TST-Test_01   -L", "8191-TST-", "9999-A-B-123456789012",
+		"12345-TST-Test", "-TST-Test", "1-AB-Test", "1-ABCD-Test",
+		"1-ABC-1234567890123", "1-A\nC-Test", "1-ABC-Te\rt", "1_ABC-Test",
+		"1-ABC_Test", "01-ABC-Test", "1-ABC"
+	};
+
+	u16 idx;
+
+	for(const std::string_view fname: FNAMES)
+	{
+		const std::string fname_str(fname);
+		const bool expected = std::regex_match(fname_str, S7XX::Host_FS::S7XX_HOST_FNAME_REGEX);
+
+		if(S7XX::Host_FS::parse_host_fname(fname, idx) != expected)
+		{
+			std::cerr << "Host fname match mismatch for " << fname_str << "!!!" << std::endl;
+			std::cerr << "\tExpected: " << expected << std::endl;
+			return 18;
+		}
+
+		if(expected && idx != std::stoi(fname_str.substr(0, fname_str.find('-'))))
+		{
+			std::cerr << "Host fname idx mismatch for " << fname_str << "!!!" << std::endl;
+			std::cerr << "\tGot: " << idx << std::endl;
+			return 19;
+		}
+	}
+
+	return 0;
+}
+
 static int sanitize_filename_tests()
 {
 	std::string test_str = OG_FILENAME;
@@ -152,5 +256,25 @@ int main()
 	}
 	std::cout << "Find from index tests OK!" << std::endl;
 
+	std::cout << "Parse host fname tests..." << std::endl;
+	err = parse_host_fname_tests();
+	if(err)
+	{
+		std::cerr << "Parse host fname tests failed!!!" << std::endl;
+		std::cerr << "Err " << err << std::endl;
+		return err;
+	}
+	std::cout << "Parse host fname tests OK!" << std::endl;
+
+	std::cout << "Build index tests..." << std::endl;
+	err = build_index_tests();
+	if(err)
+	{
+		std::cerr << "Build index tests failed!!!" << std::endl;
+		std::cerr << "Err " << err << std::endl;
+		return err;
+	}
+	std::cout << "Build index tests OK!" << std::endl;
+
 	return 0;
 }
@@ -0,0 +1,165 @@
+﻿#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <bit>
+
+#include "Utils/ints.hpp"
+#include "Utils/utils.hpp"
+#include "Utils/FAT_utils.hpp"
+#include "S7XX_FS_types.hpp"
+#include "S7XX_FS_drv.hpp"
+#include "fs_drv_helpers.hpp"
+
+namespace S7XX::FS
+{
+	//Upper bound for a single read or write while moving clusters around
+	constexpr uintmax_t DEFRAG_MAX_IO_SIZE = 4 * 1024 * 1024;
+
+	/*Offline defrag. Samples get laid out contiguously, in sample list order,
+	 *from the start of the audio section; the S760 OS clusters stay put. All
+	 *the data gets moved first, then the FAT and the sample list's start
+	 *segments are switched over together at the end, so the metadata is never
+	 *half old and half new. The TOC and the free cluster count don't change.*/
+	uint16_t defrag(const std::filesystem::path &fs_path,
+					min_vfs::defrag_stats_t &stats)
+	{
+		constexpr u32 SAMPLE_LIST_SIZE = MAX_SAMPLE_COUNT
+			* On_disk_sizes::LIST_ENTRY;
+
+		char magic[10];
+		u8 media_type;
+		u16 err, start_cls, FAT_len;
+
+		std::fstream fs_fstr;
+		std::unique_ptr<u8[]> list;
+		std::vector<u16> starts, slots;
+
+		FAT_utils::FAT_cache_t<u16> FAT;
+		FAT_utils::defrag_plan_t<u16> plan;
+		FAT_utils::frag_stats_t frag_stats;
+
+		if(!std::filesystem::exists(fs_path)
+			|| !std::filesystem::is_regular_file(fs_path))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::NOT_FOUND);
+
+		const uintmax_t disk_size = std::filesystem::file_size(fs_path);
+
+		//Same as fsck, too small to tell whether it's an S7XX FS at all
+		if(disk_size < MIN_DISK_SIZE)
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::WRONG_FS);
+
+		fs_fstr.open(fs_path, std::fstream::in | std::fstream::out
+			| std::fstream::binary);
+
+		if(!fs_fstr.is_open() || !fs_fstr.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		fs_fstr.seekg(4);
+		fs_fstr.read(magic, sizeof(magic));
+
+		if(std::memcmp(magic, MACHINE_NAME, sizeof(magic)))
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::WRONG_FS);
+
+		fs_fstr.seekg(15);
+		media_type = fs_fstr.get();
+
+		if(!is_HDD(media_type))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::MEDIA_TYPE_NOT_HDD);
+
+		FAT_len = FAT_find_length(fs_fstr);
+
+		if(disk_size < On_disk_addrs::AUDIO_SECTION + (uintmax_t)(FAT_len
+			- FAT_ATTRS.DATA_MIN) * AUDIO_SEGMENT_SIZE)
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::TOO_SMALL);
+
+		FAT = FAT_utils::FAT_cache_t<u16>(FAT_ATTRS,
+			FAT_utils::FAT_dyna_attrs_t<u16>(FAT_len, On_disk_addrs::FAT));
+
+		err = FAT.load(fs_fstr, FAT_ATTRS);
+		if(err) return err;
+
+		list = std::make_unique<u8[]>(SAMPLE_LIST_SIZE);
+		fs_fstr.seekg(On_disk_addrs::SAMPLE_LIST);
+		fs_fstr.read((char*)list.get(), SAMPLE_LIST_SIZE);
+
+		if(!fs_fstr.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		for(u16 i = 0; i < MAX_SAMPLE_COUNT; i++)
+		{
+			const u8 *const entry = list.get() + i * On_disk_sizes::LIST_ENTRY;
+
+			if(!entry[0] || entry[0] == 0xFE) continue;
+
+			std::memcpy(&start_cls, entry + 0x1C, 2);
+
+			if constexpr(ENDIANNESS != std::endian::native)
+				start_cls = std::byteswap(start_cls);
+
+			if(!FAT_t::in_data_range(start_cls) || start_cls >= FAT_len)
+				continue;
+
+			starts.push_back(start_cls);
+			slots.push_back(i);
+		}
+
+		err = FAT_utils::plan_defrag(FAT.get(), FAT_ATTRS, FAT_len, starts,
+									 plan, frag_stats);
+		if(err) return err;
+
+		stats.files = frag_stats.chains;
+		stats.fragments_before = frag_stats.fragments;
+		stats.seeks_before = frag_stats.seeks;
+		stats.clusters_moved = 0;
+
+		if(!plan.is_identity())
+		{
+			err = FAT_utils::move_clusters(fs_fstr, FAT_ATTRS, plan,
+				AUDIO_SEGMENT_SIZE, On_disk_addrs::AUDIO_SECTION,
+				DEFRAG_MAX_IO_SIZE, stats.clusters_moved);
+			if(err) return err;
+
+			FAT_utils::apply_defrag_plan(FAT, FAT_ATTRS, plan);
+
+			for(uintmax_t i = 0; i < starts.size(); i++)
+			{
+				starts[i] = plan.dst_of[starts[i]];
+				start_cls = starts[i];
+
+				if constexpr(ENDIANNESS != std::endian::native)
+					start_cls = std::byteswap(start_cls);
+
+				std::memcpy(list.get() + slots[i] * On_disk_sizes::LIST_ENTRY
+					+ 0x1C, &start_cls, 2);
+			}
+
+			err = FAT.commit(fs_fstr, FAT_ATTRS);
+			if(err) return err;
+
+			fs_fstr.seekp(On_disk_addrs::SAMPLE_LIST);
+			fs_fstr.write((char*)list.get(), SAMPLE_LIST_SIZE);
+			fs_fstr.flush();
+
+			if(!fs_fstr.good())
+				return ret_val_setup(min_vfs::LIBRARY_ID,
+									 (u8)min_vfs::ERR::IO_ERROR);
+		}
+
+		err = FAT_utils::get_frag_stats(FAT.get(), FAT_ATTRS, FAT_len, starts,
+										frag_stats);
+		if(err) return err;
+
+		stats.fragments_after = frag_stats.fragments;
+		stats.seeks_after = frag_stats.seeks;
+
+		return 0;
+	}
+}
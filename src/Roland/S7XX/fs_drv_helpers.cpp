@@ -1,22 +1,21 @@
 ﻿#include <cstdint>
+#include <cstring>
 #include <fstream>
 
 #include "S7XX_FS_types.hpp"
 
 namespace S7XX::FS
 {
-	uint16_t load_TOC(std::fstream &src, TOC_t &dst)
+	void load_TOC(const u8 *src, TOC_t &dst)
 	{
-		src.seekg(On_disk_addrs::TOC);
-
-		src.read(dst.name, 16);
+		std::memcpy(dst.name, src, 16);
 		dst.name[16] = 0;
-		src.read((char*)&dst.block_cnt, 4);
-		src.read((char*)&dst.volume_cnt, 2);
-		src.read((char*)&dst.perf_cnt, 2);
-		src.read((char*)&dst.patch_cnt, 2);
-		src.read((char*)&dst.partial_cnt, 2);
-		src.read((char*)&dst.sample_cnt, 2);
+		std::memcpy(&dst.block_cnt, src + 16, 4);
+		std::memcpy(&dst.volume_cnt, src + 20, 2);
+		std::memcpy(&dst.perf_cnt, src + 22, 2);
+		std::memcpy(&dst.patch_cnt, src + 24, 2);
+		std::memcpy(&dst.partial_cnt, src + 26, 2);
+		std::memcpy(&dst.sample_cnt, src + 28, 2);
 
 		if constexpr(std::endian::native != ENDIANNESS)
 		{
@@ -27,11 +26,9 @@ namespace S7XX::FS
 			dst.partial_cnt = std::byteswap(dst.partial_cnt);
 			dst.sample_cnt = std::byteswap(dst.sample_cnt);
 		}
-
-		return 0;
 	}
 
-	uint16_t write_TOC(TOC_t src, std::fstream &dst)
+	void write_TOC(TOC_t src, u8 *dst)
 	{
 		if constexpr(std::endian::native != ENDIANNESS)
 		{
@@ -43,16 +40,52 @@ namespace S7XX::FS
 			src.sample_cnt = std::byteswap(src.sample_cnt);
 		}
 
-		dst.seekp(On_disk_addrs::TOC);
+		std::memcpy(dst, src.name, 16);
+		std::memcpy(dst + 16, &src.block_cnt, 4);
+		std::memcpy(dst + 20, &src.volume_cnt, 2);
+		std::memcpy(dst + 22, &src.perf_cnt, 2);
+		std::memcpy(dst + 24, &src.patch_cnt, 2);
+		std::memcpy(dst + 26, &src.partial_cnt, 2);
+		std::memcpy(dst + 28, &src.sample_cnt, 2);
+	}
 
-		dst.write(src.name, 16);
-		dst.write((char*)&src.block_cnt, 4);
-		dst.write((char*)&src.volume_cnt, 2);
-		dst.write((char*)&src.perf_cnt, 2);
-		dst.write((char*)&src.patch_cnt, 2);
-		dst.write((char*)&src.partial_cnt, 2);
-		dst.write((char*)&src.sample_cnt, 2);
+	uint16_t load_TOC(std::fstream &src, TOC_t &dst)
+	{
+		u8 buf[On_disk_sizes::TOC];
+
+		src.seekg(On_disk_addrs::TOC);
+		src.read((char*)buf, sizeof(buf));
+
+		load_TOC(buf, dst);
 
 		return 0;
 	}
+
+	uint16_t write_TOC(TOC_t src, std::fstream &dst)
+	{
+		u8 buf[On_disk_sizes::TOC];
+
+		write_TOC(src, buf);
+
+		dst.seekp(On_disk_addrs::TOC);
+		dst.write((char*)buf, sizeof(buf));
+
+		return 0;
+	}
+
+	//includes first two clusters, which are always reserved
+	uint16_t FAT_find_length(std::fstream &fstr)
+	{
+		uint16_t i, cur_val;
+
+		fstr.seekg(On_disk_addrs::FAT + FAT_ATTRS.DATA_MIN * 2);
+		i = FAT_ATTRS.DATA_MIN;
+
+		do
+		{
+			fstr.read((char*)&cur_val, 2);
+		} while(cur_val != 0xFFFF && ++i < MAX_FAT_LENGTH);
+
+		return i;
+	}
 }
\ No newline at end of file
@@ -21,7 +21,12 @@ namespace S7XX::FS
 		return block_cnt / (AUDIO_SEGMENT_SIZE / BLK_SIZE);
 	}
 
+	//On_disk_sizes::TOC bytes, already read/to be written in one go
+	void load_TOC(const u8 *src, TOC_t &dst);
+	void write_TOC(TOC_t src, u8 *dst);
+
 	uint16_t load_TOC(std::fstream &src, TOC_t &dst);
 	uint16_t write_TOC(TOC_t src, std::fstream &dst);
+	uint16_t FAT_find_length(std::fstream &fstr);
 }
 #endif // !
\ No newline at end of file
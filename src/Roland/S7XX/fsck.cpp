@@ -1,11 +1,20 @@
 ﻿#include <cstdint>
+#include <array>
+#include <functional>
 #include <filesystem>
 #include <fstream>
 #include <cstring>
 #include <bit>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include "Utils/ints.hpp"
 #include "Utils/utils.hpp"
+#include "Utils/FAT_utils.hpp"
+#include "Utils/bit_util.hpp"
 #include "S7XX_FS_types.hpp"
 #include "S7XX_FS_drv.hpp"
 #include "fs_drv_constants.hpp"
@@ -13,13 +22,332 @@
 
 namespace S7XX::FS
 {
+	typedef std::chrono::steady_clock fsck_clock_t;
+
+	//The FAT and every list, back to back on disk
+	constexpr u32 META_ADDR = On_disk_addrs::FAT;
+	constexpr u32 META_SIZE = On_disk_addrs::VOLUME_PARAMS - META_ADDR;
+
+	/*Part of the disk, read in one go and checked in memory. Fixes only mark
+	 *blocks dirty; they get written back at the very end, one write per run
+	 *of dirty blocks.*/
+	struct region_t
+	{
+		u32 addr;
+		u32 size;
+		std::unique_ptr<u8[]> data;
+		bit_util::bitset_t dirty;
+
+		u8 *at(const u32 disk_addr)
+		{
+			return data.get() + (disk_addr - addr);
+		}
+	};
+
+	/*What one of the checks found. The checks run alongside each other, so
+	 *they keep their own status and dirty blocks until they're all done.*/
+	struct check_t
+	{
+		u16 status = 0;
+		std::vector<u32> dirty; //blocks of the region
+		fsck_clock_t::duration time = fsck_clock_t::duration::zero();
+	};
+
+	static uint16_t read_region(std::fstream &stream, const u32 addr,
+								const u32 size, region_t &region)
+	{
+		region.addr = addr;
+		region.size = size;
+		region.data = std::make_unique<u8[]>(size);
+		region.dirty.assign(div_int_round_to_pos_inf(size, (u32)BLK_SIZE),
+							false);
+
+		stream.seekg(addr);
+		stream.read((char*)region.data.get(), size);
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	static uint16_t write_region(std::fstream &stream, const region_t &region)
+	{
+		uintmax_t end;
+
+		for(uintmax_t i = region.dirty.find_first_set(); i < region.dirty.size();
+			i = region.dirty.find_first_set(end))
+		{
+			end = region.dirty.find_first_unset(i);
+
+			stream.seekp(region.addr + i * BLK_SIZE);
+			stream.write((char*)region.data.get() + i * BLK_SIZE,
+						 std::min<uintmax_t>(end * BLK_SIZE, region.size)
+						 - i * BLK_SIZE);
+		}
+
+		if(!stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID,
+								 (u8)min_vfs::ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	static void mark_dirty(const region_t &region, const u32 disk_addr,
+						   const u32 len, check_t &check)
+	{
+		const u32 last = (disk_addr - region.addr + len - 1) / BLK_SIZE;
+
+		for(u32 i = (disk_addr - region.addr) / BLK_SIZE; i <= last; i++)
+		{
+			if(check.dirty.empty() || check.dirty.back() != i)
+				check.dirty.push_back(i);
+		}
+	}
+
+	static void push_phase(min_vfs::fsck_timings_t &timings, const char *name,
+						   const fsck_clock_t::time_point start)
+	{
+		timings.push_back({name, fsck_clock_t::now() - start});
+	}
+
+	//FAT is the native copy, meta gets the on-disk value
+	static void set_FAT_entry(region_t &meta, u16 FAT[], const u32 idx,
+							  const u16 val, check_t &check)
+	{
+		u16 disk_val = val;
+
+		FAT[idx] = val;
+
+		if constexpr(ENDIANNESS != std::endian::native)
+			disk_val = std::byteswap(disk_val);
+
+		std::memcpy(meta.at(On_disk_addrs::FAT + idx * 2), &disk_val, 2);
+		mark_dirty(meta, On_disk_addrs::FAT + idx * 2, 2, check);
+	}
+
+	/*One type's list. Every used entry has to say it's of that type, and
+	 *empty entries before the last used one get marked deleted, or nothing
+	 *past them can be reached. Only touches the type's own list, so every
+	 *type can be checked at once.*/
+	static void check_list(region_t &meta, const u8 type_idx, u16 &entry_cnt,
+						   check_t &check)
+	{
+		const type_attrs_t &attrs = TYPE_ATTRS[type_idx];
+		const fsck_clock_t::time_point start = fsck_clock_t::now();
+
+		u16 first_nul_entry, last_used_entry;
+
+		u8 *const list = meta.at(attrs.LIST_ADDR);
+
+		entry_cnt = 0;
+		first_nul_entry = 0xFFFF;
+		last_used_entry = 0;
+
+		for(u16 i = 0; i < attrs.MAX_CNT; i++)
+		{
+			u8 *const entry = list + i * On_disk_sizes::LIST_ENTRY;
+
+			if(!entry[0])
+			{
+				if(first_nul_entry == 0xFFFF) first_nul_entry = i;
+				continue;
+			}
+
+			if(entry[0] == 0xFE) continue;
+
+			last_used_entry = i;
+			entry_cnt++;
+
+			if(entry[0x10] != (u8)attrs.ELEMENT_TYPE)
+			{
+				check.status |= FSCK_ERR::BAD_FENTRY;
+				entry[0x10] = (u8)attrs.ELEMENT_TYPE;
+				mark_dirty(meta, attrs.LIST_ADDR + i * On_disk_sizes::LIST_ENTRY
+					+ 0x10, 1, check);
+			}
+		}
+
+		if(last_used_entry > first_nul_entry)
+		{
+			check.status |= FSCK_ERR::INACCESSIBLE_FENTRIES;
+
+			for(u16 i = first_nul_entry; i < last_used_entry; i++)
+			{
+				u8 *const entry = list + i * On_disk_sizes::LIST_ENTRY;
+
+				if(entry[0]) continue;
+
+				entry[0] = 0xFE;
+				mark_dirty(meta, attrs.LIST_ADDR + i * On_disk_sizes::LIST_ENTRY,
+						   1, check);
+			}
+		}
+
+		check.time = fsck_clock_t::now() - start;
+	}
+
+	/*Cluster 0's value and the reserved clusters past the end of the disk,
+	 *counting free clusters as it goes. Then links past the last cluster get
+	 *cut off and every chain gets analysed, for match_sample_chains. Doesn't
+	 *touch the lists, so it runs alongside check_list.*/
+	static void check_FAT(region_t &meta, u16 FAT[], const u16 expected_cls_cnt,
+						  const u16 FAT_len, u16 &free_cls_cnt,
+						  FAT_utils::FAT_analysis_t<u16> &analysis,
+						  check_t &check)
+	{
+		const fsck_clock_t::time_point start = fsck_clock_t::now();
+
+		if(FAT[0] != 0xFFFA)
+		{
+			check.status |= FSCK_ERR::BAD_CLS0_VAL;
+			set_FAT_entry(meta, FAT, 0, 0xFFFA, check);
+		}
+
+		free_cls_cnt = 0;
+
+		for(u32 i = FAT_ATTRS.DATA_MIN; i < 0x10000; i++)
+		{
+			if((i >= expected_cls_cnt + FAT_ATTRS.DATA_MIN)
+				&& (FAT[i] < FAT_ATTRS.END_OF_CHAIN + 1))
+			{
+				check.status |= FSCK_ERR::UNMARKED_RESVD_CLS;
+				set_FAT_entry(meta, FAT, i, FAT_ATTRS.RESERVED, check);
+			}
+
+			if(FAT[i] == FAT_ATTRS.FREE_CLUSTER) free_cls_cnt++;
+		}
+
+		for(u32 i = FAT_ATTRS.DATA_MIN; i < FAT_len; i++)
+		{
+			if(FAT_t::in_data_range(FAT[i]) && FAT[i] >= FAT_len)
+			{
+				check.status |= FSCK_ERR::BAD_SAMPLE_CHAIN;
+				set_FAT_entry(meta, FAT, i, FAT_ATTRS.END_OF_CHAIN, check);
+			}
+		}
+
+		FAT_utils::analyse_FAT(FAT, FAT_ATTRS, FAT_len, analysis);
+
+		check.time = fsck_clock_t::now() - start;
+	}
+
+	/*Every sample with audio has to start a chain of its own: on a cluster
+	 *that's in use, not somewhere mid-chain, not one some other sample
+	 *already starts and not a loop. The ones that
+	 *don't get emptied, the way the driver leaves new ones; the rest get
+	 *their segment count fixed to match their chain. Clusters no sample can
+	 *reach anymore get freed and added to the free count. Needs both the
+	 *sample list and the FAT checked.*/
+	static void match_sample_chains(region_t &meta, u16 FAT[],
+									const u16 FAT_len, u16 &free_cls_cnt,
+									FAT_utils::FAT_analysis_t<u16> &analysis,
+									check_t &check)
+	{
+		const fsck_clock_t::time_point start = fsck_clock_t::now();
+
+		u16 cls_start, segment_cnt;
+
+		std::vector<u16> starts;
+		bit_util::bitset_t claimed(FAT_len);
+
+		u8 *const list = meta.at(On_disk_addrs::SAMPLE_LIST);
+
+		for(u16 i = 0; i < MAX_SAMPLE_COUNT; i++)
+		{
+			u8 *const entry = list + i * On_disk_sizes::LIST_ENTRY;
+
+			if(!entry[0] || entry[0] == 0xFE) continue;
+
+			std::memcpy(&cls_start, entry + 0x1C, 2);
+			std::memcpy(&segment_cnt, entry + 0x1E, 2);
+
+			if constexpr(ENDIANNESS != std::endian::native)
+			{
+				cls_start = std::byteswap(cls_start);
+				segment_cnt = std::byteswap(segment_cnt);
+			}
+
+			if(!segment_cnt) continue;
+
+			//Left with no audio, same as the driver's empty samples
+			if(cls_start >= FAT_len || !analysis.used[cls_start]
+				|| analysis.in_degree[cls_start] || claimed[cls_start]
+				|| analysis.cyclic[cls_start])
+			{
+				cls_start = FAT_ATTRS.END_OF_CHAIN;
+				segment_cnt = 0;
+			}
+			else
+			{
+				claimed.set(cls_start);
+				starts.push_back(cls_start);
+
+				if(analysis.length[cls_start] == segment_cnt) continue;
+
+				segment_cnt = analysis.length[cls_start];
+			}
+
+			check.status |= FSCK_ERR::BAD_SAMPLE_CHAIN;
+
+			if constexpr(ENDIANNESS != std::endian::native)
+			{
+				cls_start = std::byteswap(cls_start);
+				segment_cnt = std::byteswap(segment_cnt);
+			}
+
+			std::memcpy(entry + 0x1C, &cls_start, 2);
+			std::memcpy(entry + 0x1E, &segment_cnt, 2);
+			mark_dirty(meta, On_disk_addrs::SAMPLE_LIST
+				+ i * On_disk_sizes::LIST_ENTRY + 0x1C, 4, check);
+		}
+
+		FAT_utils::find_orphans(analysis, starts);
+
+		if(analysis.orphan_cnt)
+		{
+			check.status |= FSCK_ERR::LOST_CLUSTERS;
+			free_cls_cnt += analysis.orphan_cnt;
+
+			for(uintmax_t i = analysis.orphans.find_first_set(); i < FAT_len;
+				i = analysis.orphans.find_first_set(i + 1))
+				set_FAT_entry(meta, FAT, i, FAT_ATTRS.FREE_CLUSTER, check);
+		}
+
+		check.time = fsck_clock_t::now() - start;
+	}
+
 	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status)
 	{
-		u8 media_type, element_type;
-		char magic[10], name0;
-		u16 err, entry_cnt, first_nul_entry, last_used_entry, expected_cls_cnt, cls_val, FAT_free_cls_cnt, FAT_len, free_cls_cnt;
+		min_vfs::fsck_timings_t timings;
+
+		return fsck(fs_path, fsck_status, timings);
+	}
+
+	/*The header block and everything from the FAT through the last list get
+	 *read in one go each, checked and fixed in memory, then only the blocks
+	 *that changed get written back. Each list and the FAT get checked on
+	 *their own thread; matching the samples to their chains needs both the
+	 *sample list and the FAT, so it goes last.*/
+	uint16_t fsck(const std::filesystem::path &fs_path, u16 &fsck_status,
+				  min_vfs::fsck_timings_t &timings, const bool report_only)
+	{
+		const fsck_clock_t::time_point fsck_start = fsck_clock_t::now();
+		fsck_clock_t::time_point phase_start = fsck_start;
+
+		bool TOC_dirty;
+		u16 err, expected_cls_cnt, FAT_free_cls_cnt, FAT_len, free_cls_cnt;
+
+		std::array<u16, 6> entry_cnts;
+		std::array<check_t, 6> list_checks; //by type_idx, 0 is unused
+		check_t FAT_check, chain_check;
+		std::unique_ptr<u16[]> FAT;
+		std::vector<std::thread> workers;
 
 		TOC_t TOC;
+		region_t header_region, meta;
+		FAT_utils::FAT_analysis_t<u16> analysis;
 
 		std::fstream fs_fstr;
 
@@ -36,169 +364,143 @@ namespace S7XX::FS
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::WRONG_FS);
 
-		fs_fstr.open(fs_path, std::fstream::in | std::fstream::out
-			| std::fstream::binary);
+		fs_fstr.open(fs_path, report_only
+			? std::fstream::in | std::fstream::binary
+			: std::fstream::in | std::fstream::out | std::fstream::binary);
 
 		if(!fs_fstr.is_open() || !fs_fstr.good())
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::IO_ERROR);
 
-		fs_fstr.seekg(4);
-		fs_fstr.read(magic, sizeof(magic));
+		err = read_region(fs_fstr, 0, BLK_SIZE, header_region);
+		if(err) return err;
 
-		if(std::memcmp(magic, MACHINE_NAME, sizeof(magic)))
+		/*-----------------------------Header checks----------------------------*/
+		if(std::memcmp(header_region.data.get() + 4, MACHINE_NAME, 10))
 			return ret_val_setup(min_vfs::LIBRARY_ID,
 								 (u8)min_vfs::ERR::WRONG_FS);
 
-		fs_fstr.seekg(15);
-		media_type = fs_fstr.get();
-
-		if(!is_HDD(media_type))
+		if(!is_HDD(header_region.data[15]))
 			return ret_val_setup(LIBRARY_ID, (u8)ERR::MEDIA_TYPE_NOT_HDD);
 
-		//check size
-		err = load_TOC(fs_fstr, TOC);
-		if(err) return err;
+		load_TOC(header_region.at(On_disk_addrs::TOC), TOC);
+		TOC_dirty = false;
 
 		if(TOC.block_cnt > MAX_BLK_CNT)
 		{
 			fsck_status |= FSCK_ERR::TOO_LARGE;
 			TOC.block_cnt = MAX_BLK_CNT;
+			TOC_dirty = true;
 		}
 
 		if(TOC.block_cnt * BLK_SIZE > std::filesystem::file_size(fs_path))
 			return ret_val_setup(LIBRARY_ID, (u8)ERR::TOO_SMALL);
 
-		//check lists and list + TOC consistency
-		for(u8 i = 1; i < 6; i++)
-		{
-			entry_cnt = 0;
-			first_nul_entry = 0xFFFF;
-			last_used_entry = 0;
-
-			for(u16 j = 0; j < TYPE_ATTRS[i].MAX_CNT; j++)
-			{
-				fs_fstr.seekg(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY);
-				name0 = fs_fstr.get();
-
-				if(name0)
-				{
-					if(name0 != (char)0xFE)
-					{
-						last_used_entry = j;
-						entry_cnt++;
-
-						fs_fstr.seekg(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY + 0x10);
-						element_type = fs_fstr.get();
-
-						if(element_type != (u8)TYPE_ATTRS[i].ELEMENT_TYPE)
-						{
-							fsck_status |= FSCK_ERR::BAD_FENTRY;
-
-							fs_fstr.seekp(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY + 0x10);
-							fs_fstr.put((char)TYPE_ATTRS[i].ELEMENT_TYPE);
-						}
-					}
-				}
-				else if(first_nul_entry == 0xFFFF) first_nul_entry = j;
-			}
+		//TODO: check FS-type vs first 114 clusters
+		expected_cls_cnt = block_cnt_to_cls_cnt(TOC.block_cnt
+			- (On_disk_addrs::AUDIO_SECTION / BLK_SIZE));
+		FAT_len = std::min<u32>(expected_cls_cnt + FAT_ATTRS.DATA_MIN,
+								MAX_FAT_LENGTH);
+		/*-------------------------End of header checks-------------------------*/
 
-			if(entry_cnt != TOC.*TYPE_ATTRS[i].TOC_PTR)
-			{
-				fsck_status |= FSCK_ERR::TOC_INCONSISTENCY;
-				TOC.*TYPE_ATTRS[i].TOC_PTR = entry_cnt;
-			}
+		push_phase(timings, "header", phase_start);
+		phase_start = fsck_clock_t::now();
 
-			if(last_used_entry > first_nul_entry)
-			{
-				fsck_status |= FSCK_ERR::INACCESSIBLE_FENTRIES;
-
-				for(u16 j = first_nul_entry; j < last_used_entry; j++)
-				{
-					fs_fstr.seekg(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY);
-					name0 = fs_fstr.get();
-
-					if(!name0)
-					{
-						fs_fstr.seekp(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY);
-						fs_fstr.put(0xFE);
-					}
-				}
-			}
-		}
-
-		err = write_TOC(TOC, fs_fstr);
+		err = read_region(fs_fstr, META_ADDR, META_SIZE, meta);
 		if(err) return err;
 
-		//TODO: check FS-type vs first 114 clusters
-		//check FAT
-		expected_cls_cnt = block_cnt_to_cls_cnt(TOC.block_cnt - (On_disk_addrs::AUDIO_SECTION / BLK_SIZE));
+		push_phase(timings, "read", phase_start);
+		phase_start = fsck_clock_t::now();
 
-		fs_fstr.seekg(On_disk_addrs::FAT);
-		fs_fstr.read((char*)&cls_val, 2);
+		FAT = std::make_unique<u16[]>(0x10000);
+		std::memcpy(FAT.get(), meta.at(On_disk_addrs::FAT), On_disk_sizes::FAT);
 
 		if constexpr(ENDIANNESS != std::endian::native)
-			cls_val = std::byteswap(cls_val);
-
-		if(cls_val != 0xFFFA)
 		{
-			fsck_status |= FSCK_ERR::BAD_CLS0_VAL;
-			cls_val = 0xFFFA;
+			for(u32 i = 0; i < 0x10000; i++)
+				FAT[i] = std::byteswap(FAT[i]);
+		}
 
-			if constexpr(ENDIANNESS != std::endian::native)
-				cls_val = std::byteswap(cls_val);
+		FAT_free_cls_cnt = FAT[1];
 
-			fs_fstr.seekp(On_disk_addrs::FAT);
-			fs_fstr.write((char *)&cls_val, 2);
+		/*----------------------------Parallel checks---------------------------*/
+		for(u8 i = 1; i < 6; i++)
+		{
+			workers.emplace_back(check_list, std::ref(meta), i,
+								 std::ref(entry_cnts[i]),
+								 std::ref(list_checks[i]));
 		}
 
-		fs_fstr.read((char *)&FAT_free_cls_cnt, 2);
+		check_FAT(meta, FAT.get(), expected_cls_cnt, FAT_len, free_cls_cnt,
+				  analysis, FAT_check);
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			FAT_free_cls_cnt = std::byteswap(FAT_free_cls_cnt);
+		for(std::thread &worker: workers)
+			worker.join();
 
-		free_cls_cnt = 0;
+		//Frees lost clusters, so the free count has to wait for it
+		match_sample_chains(meta, FAT.get(), FAT_len, free_cls_cnt, analysis,
+							chain_check);
 
-		for(u32 i = FAT_ATTRS.DATA_MIN; i < 0x10000; i++)
+		for(u8 i = 1; i < 6; i++)
 		{
-			fs_fstr.read((char *)&cls_val, 2);
-
-			if constexpr(ENDIANNESS != std::endian::native)
-				cls_val = std::byteswap(cls_val);
-
-			if((i >= expected_cls_cnt + FAT_ATTRS.DATA_MIN) && (cls_val < FAT_ATTRS.END_OF_CHAIN + 1))
+			if(entry_cnts[i] != TOC.*TYPE_ATTRS[i].TOC_PTR)
 			{
-				fsck_status |= FSCK_ERR::UNMARKED_RESVD_CLS;
-				cls_val = FAT_ATTRS.RESERVED;
-
-				if constexpr(ENDIANNESS != std::endian::native)
-					cls_val = std::byteswap(cls_val);
-
-				fs_fstr.seekp(On_disk_addrs::FAT + i * 2);
-				fs_fstr.write((char *)&cls_val, 2);
-
-				if constexpr(ENDIANNESS != std::endian::native)
-					cls_val = FAT_ATTRS.RESERVED;
+				fsck_status |= FSCK_ERR::TOC_INCONSISTENCY;
+				TOC.*TYPE_ATTRS[i].TOC_PTR = entry_cnts[i];
+				TOC_dirty = true;
 			}
-
-			if(cls_val == FAT_ATTRS.FREE_CLUSTER) free_cls_cnt++;
 		}
 
 		if(free_cls_cnt != FAT_free_cls_cnt)
 		{
 			fsck_status |= FSCK_ERR::FREE_CLS_CNT_MISMATCH;
+			set_FAT_entry(meta, FAT.get(), 1, free_cls_cnt, chain_check);
+		}
 
-			if constexpr(ENDIANNESS != std::endian::native)
-				free_cls_cnt = std::byteswap(free_cls_cnt);
+		for(const check_t *check: {&list_checks[1], &list_checks[2],
+			&list_checks[3], &list_checks[4], &list_checks[5], &FAT_check,
+			&chain_check})
+		{
+			fsck_status |= check->status;
 
-			fs_fstr.seekp(On_disk_addrs::FAT + 2);
-			fs_fstr.write((char *)&free_cls_cnt, 2);
+			for(const u32 blk: check->dirty)
+				meta.dirty.set(blk);
 		}
 
-		if(!fs_fstr.is_open() || !fs_fstr.good())
-			return ret_val_setup(LIBRARY_ID, (u8)ERR::IO_ERROR);
+		if(TOC_dirty)
+		{
+			write_TOC(TOC, header_region.at(On_disk_addrs::TOC));
+			header_region.dirty.set(0);
+		}
+
+		timings.push_back({"lists", std::max_element(list_checks.begin() + 1,
+			list_checks.end(), [](const check_t &a, const check_t &b)
+			{
+				return a.time < b.time;
+			})->time});
+		timings.push_back({"FAT", FAT_check.time});
+		timings.push_back({"chains", chain_check.time});
+		push_phase(timings, "checks", phase_start);
+		phase_start = fsck_clock_t::now();
+		/*------------------------End of parallel checks------------------------*/
+
+		if(!report_only)
+		{
+			for(const region_t *region: {&header_region, &meta})
+			{
+				err = write_region(fs_fstr, *region);
+				if(err) return err;
+			}
+
+			fs_fstr.flush();
+
+			if(!fs_fstr.good())
+				return ret_val_setup(LIBRARY_ID, (u8)ERR::IO_ERROR);
+
+			push_phase(timings, "write", phase_start);
+		}
 
-		//TODO: Check sample list + FAT consistency (and maybe chains)
+		push_phase(timings, "total", fsck_start);
 
 		return 0;
 	}
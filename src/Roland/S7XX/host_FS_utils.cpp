@@ -42,6 +42,33 @@ namespace S7XX::Host_FS
 		str_util::rtrim(filename);
 	}
 
+	bool parse_host_fname(const std::string_view fname, u16 &idx)
+	{
+		constexpr u8 MAX_DIGITS = 4, CATEGORY_LEN = 3, MAX_NAME_LEN = 12;
+
+		size_t digits = 0;
+
+		while(digits < fname.size() && digits <= MAX_DIGITS
+			&& fname[digits] >= '0' && fname[digits] <= '9') digits++;
+
+		if(!digits || digits > MAX_DIGITS) return false;
+
+		//idx-CAT-name
+		const size_t name_pos = digits + 1 + CATEGORY_LEN + 1;
+
+		if(fname.size() < name_pos || fname.size() - name_pos > MAX_NAME_LEN
+			|| fname[digits] != '-' || fname[name_pos - 1] != '-')
+			return false;
+
+		//. doesn't match line terminators
+		if(fname.find_first_of("\n\r", digits + 1) != fname.npos) return false;
+
+		idx = 0;
+		for(size_t i = 0; i < digits; i++) idx = idx * 10 + fname[i] - '0';
+
+		return true;
+	}
+
 	uint16_t find_from_index(const std::filesystem::path &dir_path, const u16 idx, std::filesystem::path &file_path)
 	{
 		u16 f_idx;
@@ -53,13 +80,9 @@ namespace S7XX::Host_FS
 		{
 			if(!dentry.is_regular_file()) continue;
 
-			const std::string fname = dentry.path().filename().string();
-
-			if(!std::regex_match(fname, S7XX_HOST_FNAME_REGEX))
+			if(!parse_host_fname(dentry.path().filename().string(), f_idx))
 				continue;
 
-			f_idx = std::stoi(fname.substr(0, fname.find_first_of('-')));
-
 			if(f_idx == idx)
 			{
 				file_path = dentry.path();
@@ -70,6 +93,44 @@ namespace S7XX::Host_FS
 		return ret_val_setup(LIBRARY_ID, (u8)ERR::NOT_FOUND);
 	}
 
+	uint16_t build_index(const std::filesystem::path &dir_path, host_index_t &index)
+	{
+		u16 f_idx;
+		std::error_code ec;
+
+		index.clear();
+
+		if(!std::filesystem::exists(dir_path) || !std::filesystem::is_directory(dir_path))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::INVALID_PATH);
+
+		for(std::filesystem::directory_iterator it(dir_path, ec), end; it != end; it.increment(ec))
+		{
+			if(!it->is_regular_file()) continue;
+
+			if(!parse_host_fname(it->path().filename().string(), f_idx))
+				continue;
+
+			if(f_idx >= index.size()) index.resize(f_idx + 1);
+
+			if(index[f_idx].empty()) index[f_idx] = it->path();
+		}
+
+		//The iterator ends early on errors
+		if(ec) return ret_val_setup(LIBRARY_ID, (u8)ERR::IO_ERROR);
+
+		return 0;
+	}
+
+	uint16_t find_from_index(const host_index_t &index, const u16 idx, std::filesystem::path &file_path)
+	{
+		if(idx >= index.size() || index[idx].empty())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NOT_FOUND);
+
+		file_path = index[idx];
+
+		return 0;
+	}
+
 	namespace FILE_SIZES
 	{
 		constexpr u16 VOL = 272;
@@ -4,6 +4,8 @@
 #include <filesystem>
 #include <regex>
 #include <bit>
+#include <string_view>
+#include <vector>
 
 #include "library_IDs.hpp"
 #include "Utils/ints.hpp"
@@ -37,7 +39,22 @@ namespace S7XX::Host_FS
 	//The native FS driver does not touch the endianness
 	constexpr std::endian ENDIANNESS = std::endian::little;
 
+	/*idx -> path of the file with that idx in a host dir, empty where there's
+	none. See build_index.*/
+	typedef std::vector<std::filesystem::path> host_index_t;
+
 	void sanitize_filename(std::string &filename);
+
+	/*Same as matching S7XX_HOST_FNAME_REGEX and reading the number in front,
+	without the regex. Returns false if fname doesn't match.*/
+	bool parse_host_fname(const std::string_view fname, u16 &idx);
+
 	uint16_t find_from_index(const std::filesystem::path &dir_path, const u16 idx, std::filesystem::path &file_path);
+
+	/*Scans dir_path once and maps every idx in it to its file. If more than
+	one file has the same idx, the first one the scan finds wins, same as
+	with find_from_index. Anything already in index is dropped.*/
+	uint16_t build_index(const std::filesystem::path &dir_path, host_index_t &index);
+	uint16_t find_from_index(const host_index_t &index, const u16 idx, std::filesystem::path &file_path);
 }
 #endif // !S7XX_HOST_FS_UTILS_INCLUDE_GUARD
@@ -4,23 +4,34 @@
 #include <fstream>
 #include <algorithm>
 #include <bit>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include "Utils/ints.hpp"
 #include "Utils/utils.hpp"
+#include "Utils/sparse_util.hpp"
+#include "Utils/job_util.hpp"
 #include "S7XX_FS_drv.hpp"
 #include "fs_drv_constants.hpp"
+#include "fs_drv_helpers.hpp"
 
 namespace S7XX::FS
 {
 	constexpr char SB_TXT[] = "S-7XX FS, formatted by sample_thing";
 
-	uint16_t mkfs(const std::filesystem::path &fs_path, const std::string &label)
+	/*Everything before the audio section: header, TOC, OS, FAT, lists and
+	 *params, contiguous. meta has to be AUDIO_SECTION bytes; it gets
+	 *overwritten whole, so workers can reuse theirs.*/
+	static uint16_t mkfs(const std::filesystem::path &fs_path,
+						 const std::string &label, u8 *meta)
 	{
-		u8 temp_u8;
-		u16 cluster_cnt, temp_u16;
-		u32 blk_cnt, temp_u32;
+		u16 cluster_cnt, cur;
+		u32 blk_cnt;
 		uintmax_t disk_size;
-		std::ofstream dst_ofs;
+
+		std::fstream stream;
+		TOC_t TOC;
 
 		if(!std::filesystem::exists(fs_path) || !std::filesystem::is_regular_file(fs_path))
 			return ret_val_setup(LIBRARY_ID, (u8)ERR::INVALID_PATH);
@@ -30,80 +41,104 @@ namespace S7XX::FS
 		if(disk_size < MIN_DISK_SIZE)
 			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::DISK_TOO_SMALL);
 
-		//out mode truncates, so use in | out mode
-		dst_ofs.open(fs_path, std::ofstream::in | std::ofstream::binary);
-
-		if(!dst_ofs.is_open() || !dst_ofs.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+		blk_cnt = std::min(disk_size / BLK_SIZE, (uintmax_t)MAX_BLK_CNT);
+		cluster_cnt = block_cnt_to_cls_cnt(blk_cnt
+			- On_disk_addrs::AUDIO_SECTION / BLK_SIZE);
 
-		//header
-		for(u8 i = 0; i < 4; i++) dst_ofs.put(0); //first 4 bytes must be 0
-		dst_ofs.write(MACHINE_NAME, sizeof(MACHINE_NAME)); //magic
-		dst_ofs.put((u8)Media_type_t::HDD);
-		dst_ofs.write(SB_TXT, sizeof(SB_TXT));
+		//Empty lists only need the first char of every name to be 0
+		std::memset(meta, 0, On_disk_addrs::AUDIO_SECTION);
 
-		for(u8 i = sizeof(SB_TXT); i < On_disk_sizes::HEADER - 16; i++)
-			dst_ofs.put(0);
+		//header, first 4 bytes must be 0
+		std::memcpy(meta + 4, MACHINE_NAME, sizeof(MACHINE_NAME)); //magic
+		meta[4 + sizeof(MACHINE_NAME)] = (u8)Media_type_t::HDD;
+		std::memcpy(meta + 5 + sizeof(MACHINE_NAME), SB_TXT, sizeof(SB_TXT));
 
-		//TOC
-		dst_ofs.seekp(On_disk_addrs::TOC);
+		//TOC, the name's padded with spaces
+		std::memset(TOC.name, ' ', 16);
+		std::memcpy(TOC.name, label.c_str(), std::min((size_t)16, label.size()));
+		TOC.block_cnt = blk_cnt;
+		TOC.volume_cnt = 0;
+		TOC.perf_cnt = 0;
+		TOC.patch_cnt = 0;
+		TOC.partial_cnt = 0;
+		TOC.sample_cnt = 0;
 
-		temp_u8 = std::min((size_t)16, label.size());
+		write_TOC(TOC, meta + On_disk_addrs::TOC);
+		meta[On_disk_addrs::TOC + On_disk_sizes::TOC] = 0xFF;
+		meta[On_disk_addrs::TOC + On_disk_sizes::TOC + 1] = 0xFF;
 
-		dst_ofs.write(label.c_str(), temp_u8);
+		//FAT. Free clusters are 0 already, everything past them is reserved
+		u8 *const FAT = meta + On_disk_addrs::FAT;
 
-		for(u8 i = 0; i < 16 - temp_u8; i++)
-			dst_ofs.put(' ');
+		FAT[0] = 0xFA;
+		FAT[1] = 0xFF;
 
-		blk_cnt = std::min(disk_size / BLK_SIZE, (uintmax_t)MAX_BLK_CNT);
-		temp_u32 = blk_cnt;
+		cur = cluster_cnt;
 
 		if constexpr(ENDIANNESS != std::endian::native)
-			temp_u32 = std::byteswap(temp_u32);
+			cur = std::byteswap(cur);
 
-		dst_ofs.write((char *)&temp_u32, 4);
+		std::memcpy(FAT + 2, &cur, 2);
 
-		for(u8 i = 0; i < 10; i++) dst_ofs.put(0);
-		for(u8 i = 0; i < 2; i++) dst_ofs.put(0xFF);
+		std::memset(FAT + (cluster_cnt + FAT_ATTRS.DATA_MIN) * 2, 0xFF,
+			On_disk_sizes::FAT - (cluster_cnt + FAT_ATTRS.DATA_MIN) * 2);
 
-		//FAT
-		dst_ofs.seekp(On_disk_addrs::FAT);
-		dst_ofs.put(0xFA);
-		dst_ofs.put(0xFF);
+		//in | out so it doesn't truncate
+		stream.open(fs_path, std::ios_base::binary | std::ios_base::in
+			| std::ios_base::out);
 
-		cluster_cnt = (blk_cnt - On_disk_addrs::AUDIO_SECTION / BLK_SIZE) / (AUDIO_SEGMENT_SIZE / BLK_SIZE);
-		temp_u16 = cluster_cnt;
+		if(!stream.is_open() || !stream.good())
+			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
-		if constexpr(ENDIANNESS != std::endian::native)
-			temp_u16 = std::byteswap(temp_u16);
+		stream.write((char*)meta, On_disk_addrs::AUDIO_SECTION);
+		stream.close();
 
-		dst_ofs.write((char *)&temp_u16, 2);
+		if(stream.fail())
+			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
 
-		for(u16 i = 0; i < cluster_cnt; i++)
-			dst_ofs.write((char *)&FAT_ATTRS.FREE_CLUSTER, 2);
+		//Free clusters' contents don't matter, give the space back if we can
+		sparse_util::punch_hole(fs_path, On_disk_addrs::AUDIO_SECTION,
+			(uintmax_t)cluster_cnt * AUDIO_SEGMENT_SIZE);
 
-		for(u32 i = cluster_cnt + FAT_ATTRS.DATA_MIN; i < 0x10000; i++)
-		{
-			dst_ofs.put(0xFF);
-			dst_ofs.put(0xFF);
-		}
+		return 0;
+	}
 
-		//Lists
-		for(u8 i = 1; i < sizeof(TYPE_ATTRS) / sizeof(TYPE_ATTRS[0]); i++)
+	/*The metadata gets built in memory and written in one go. The audio
+	 *section never gets written; whatever's there gets punched out where the
+	 *host allows it, otherwise it's left as is.*/
+	uint16_t mkfs(const std::filesystem::path &fs_path, const std::string &label)
+	{
+		std::unique_ptr<u8[]> meta =
+			std::make_unique<u8[]>(On_disk_addrs::AUDIO_SECTION);
+
+		return mkfs(fs_path, label, meta.get());
+	}
+
+	uint16_t mkfs(const std::vector<mkfs_job_t> &jobs, std::vector<u16> &errs,
+				  u32 thread_cnt)
+	{
+		thread_cnt = job_util::worker_cnt(thread_cnt, jobs.size());
+
+		//One metadata buffer per thread, reused for every image it makes
+		std::vector<std::unique_ptr<u8[]>> metas(thread_cnt);
+
+		errs.assign(jobs.size(), 0);
+
+		job_util::run_jobs(jobs.size(), thread_cnt,
+			[&](const size_t i, const u32 worker) -> u16
 		{
-			for(u16 j = 0; j < TYPE_ATTRS[i].MAX_CNT; j++)
-			{
-				dst_ofs.seekp(TYPE_ATTRS[i].LIST_ADDR + j * On_disk_sizes::LIST_ENTRY);
-				dst_ofs.put(0); //first char of name
-				//e_type, doesn't seem to actually do anything
-			}
-		}
-
-		if(!dst_ofs.good())
-			return ret_val_setup(min_vfs::LIBRARY_ID, (u8)min_vfs::ERR::IO_ERROR);
+			if(!metas[worker])
+				metas[worker] =
+					std::make_unique<u8[]>(On_disk_addrs::AUDIO_SECTION);
+
+			return errs[i] = mkfs(jobs[i].fs_path, jobs[i].label,
+								  metas[worker].get());
+		});
 
-		dst_ofs.close();
+		//In job order, not whichever failed first
+		for(const u16 err: errs)
+			if(err) return err;
 
 		return 0;
 	}
-}
\ No newline at end of file
+}
@@ -2,12 +2,18 @@
 #define FAT_UTILS_HEADER_GUARD
 
 #include <bit>
+#include <memory>
 #include <concepts>
 #include <cstdint>
 #include <vector>
 #include <fstream>
+#include <algorithm>
+#include <type_traits>
+#include <thread>
+#include <limits>
 
 #include "utils.hpp"
+#include "bit_util.hpp"
 #include "library_IDs.hpp"
 
 namespace FAT_utils
@@ -24,7 +30,9 @@ namespace FAT_utils
 		IO_ERROR,
 		END_OF_CHAIN,
 		ALLOC, //not actually an error
-		BAD_NEXT_CLS
+		BAD_NEXT_CLS,
+		CROSS_LINKED,
+		BAD_CHAIN_END
 	};
 	
 	//maybe add more stuff to FAT_attrs_t
@@ -71,6 +79,183 @@ namespace FAT_utils
 		}
 	};
 
+	/*In-memory FAT that remembers which sectors it has touched since the last
+	 *commit. Reads are plain array accesses; every write has to go through set
+	 *(or the FAT_cache_t overloads further down) so the sector gets marked.
+	 *commit then writes each run of consecutive dirty sectors with a single
+	 *write instead of seeking around for every 2-byte entry. Since the whole
+	 *table is mirrored in memory, writing back entries we didn't touch within
+	 *a dirty sector is harmless.
+	 *It also keeps a reverse FAT (which cluster points at which), so finding
+	 *a cluster's predecessor doesn't need a scan of the whole table. A sane
+	 *FAT has at most one predecessor per cluster; for cross-linked chains
+	 *only the last link seen is remembered.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	struct FAT_cache_t
+	{
+		static constexpr uintmax_t SECTOR_SIZE = 512;
+
+		FAT_cache_t() = default;
+
+		FAT_cache_t(const FAT_attrs_t<index_type> FAT_attrs,
+			const FAT_dyna_attrs_t<index_type> &FAT_dyna_attrs):
+			table(std::make_unique<index_type[]>(FAT_dyna_attrs.LENGTH)),
+			prev(std::make_unique<index_type[]>(FAT_dyna_attrs.LENGTH)),
+			dyna_attrs(FAT_dyna_attrs),
+			first_sector(FAT_dyna_attrs.BASE_ADDR / SECTOR_SIZE),
+			DATA_MIN(FAT_attrs.DATA_MIN), DATA_MAX(FAT_attrs.DATA_MAX),
+			NO_PREDECESSOR(FAT_attrs.END_OF_CHAIN)
+		{
+			const uintmax_t FAT_END = FAT_dyna_attrs.BASE_ADDR
+				+ FAT_dyna_attrs.LENGTH * sizeof(index_type);
+
+			dirty.resize(div_int_round_to_pos_inf(FAT_END, SECTOR_SIZE)
+				- first_sector);
+			std::fill(prev.get(), prev.get() + dyna_attrs.LENGTH,
+					  NO_PREDECESSOR);
+		}
+
+		const index_type *get() const
+		{
+			return table.get();
+		}
+
+		index_type operator[](const uintmax_t idx) const
+		{
+			return table[idx];
+		}
+
+		index_type length() const
+		{
+			return dyna_attrs.LENGTH;
+		}
+
+		//Returns END_OF_CHAIN if nothing points at cls (start of chain/free)
+		index_type predecessor(const index_type cls) const
+		{
+			return prev[cls];
+		}
+
+		void set(const uintmax_t idx, const index_type val)
+		{
+			//entries below DATA_MIN aren't links (S7XX keeps a count in 1)
+			if(idx >= DATA_MIN)
+			{
+				const index_type old = table[idx];
+
+				if(is_link(old) && prev[old] == idx) prev[old] = NO_PREDECESSOR;
+				if(is_link(val)) prev[val] = idx;
+			}
+
+			table[idx] = val;
+			dirty[(dyna_attrs.BASE_ADDR + idx * sizeof(index_type))
+				/ SECTOR_SIZE - first_sector] = true;
+		}
+
+		bool is_dirty() const
+		{
+			return std::find(dirty.begin(), dirty.end(), true) != dirty.end();
+		}
+
+		uint16_t load(std::fstream &fstream,
+			const FAT_attrs_t<index_type> FAT_attrs)
+		{
+			fstream.seekg(dyna_attrs.BASE_ADDR);
+			fstream.read((char*)table.get(),
+				dyna_attrs.LENGTH * sizeof(index_type));
+
+			if(FAT_attrs.ENDIANNESS != std::endian::native)
+			{
+				for(index_type i = 0; i < dyna_attrs.LENGTH; i++)
+					table[i] = std::byteswap(table[i]);
+			}
+
+			std::fill(dirty.begin(), dirty.end(), false);
+			std::fill(prev.get(), prev.get() + dyna_attrs.LENGTH,
+					  NO_PREDECESSOR);
+
+			for(index_type i = DATA_MIN; i < dyna_attrs.LENGTH; i++)
+				if(is_link(table[i])) prev[table[i]] = i;
+
+			return fstream.fail() ?
+				ret_val_setup(LIBRARY_ID, (uint8_t)ERR::IO_ERROR) : 0;
+		}
+
+		uint16_t commit(std::fstream &fstream,
+			const FAT_attrs_t<index_type> FAT_attrs)
+		{
+			const uintmax_t FAT_END = dyna_attrs.BASE_ADDR + dyna_attrs.LENGTH
+				* sizeof(index_type);
+
+			std::unique_ptr<index_type[]> swapped;
+			uintmax_t run_start, run_end;
+
+			run_start = 0;
+
+			while(run_start < dirty.size())
+			{
+				if(!dirty[run_start])
+				{
+					run_start++;
+					continue;
+				}
+
+				run_end = run_start + 1;
+				while(run_end < dirty.size() && dirty[run_end]) run_end++;
+
+				//clamp the run to the FAT itself, we don't own what's around it
+				const uintmax_t start_addr = std::max(dyna_attrs.BASE_ADDR,
+					(first_sector + run_start) * SECTOR_SIZE);
+				const uintmax_t end_addr = std::min(FAT_END,
+					(first_sector + run_end) * SECTOR_SIZE);
+				const uintmax_t first_idx = (start_addr - dyna_attrs.BASE_ADDR)
+					/ sizeof(index_type);
+				const uintmax_t cnt = (end_addr - start_addr)
+					/ sizeof(index_type);
+
+				const index_type *src = table.get() + first_idx;
+
+				if(FAT_attrs.ENDIANNESS != std::endian::native)
+				{
+					if(!swapped)
+						swapped = std::make_unique<index_type[]>(
+							dyna_attrs.LENGTH);
+
+					for(uintmax_t i = 0; i < cnt; i++)
+						swapped[i] = std::byteswap(src[i]);
+
+					src = swapped.get();
+				}
+
+				fstream.seekp(start_addr);
+				fstream.write((char*)src, cnt * sizeof(index_type));
+
+				if(fstream.fail())
+					return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::IO_ERROR);
+
+				std::fill(dirty.begin() + run_start, dirty.begin() + run_end,
+						  false);
+				run_start = run_end;
+			}
+
+			return 0;
+		}
+
+	private:
+		std::unique_ptr<index_type[]> table, prev;
+		std::vector<bool> dirty;
+		FAT_dyna_attrs_t<index_type> dyna_attrs;
+		uintmax_t first_sector;
+		index_type DATA_MIN, DATA_MAX, NO_PREDECESSOR;
+
+		bool is_link(const index_type val) const
+		{
+			return val >= DATA_MIN && val <= DATA_MAX
+				&& val < dyna_attrs.LENGTH;
+		}
+	};
+
 	//Might wanna create something like FAT_dyna_attrs_t to hold address and
 	//size (and maybe more?). This would be particularly useful to explicitly
 	//pass the FAT's address for the disk versions instead of implicitly getting
@@ -702,6 +887,330 @@ namespace FAT_utils
 		return err;
 	}
 
+	/*FAT_cache_t versions of the functions that modify the FAT. These only
+	 *touch memory; nothing hits the disk until the cache is committed. Same
+	 *checks and error codes as the plain in-memory versions.*/
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t free_chain(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type> FAT_attrs,
+		const std::vector<index_type> &chain)
+	{
+		if(!chain.size())
+			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::EMPTY_CHAIN);
+		if(chain.size() > (uintmax_t)(FAT.length() - FAT_attrs.DATA_MIN))
+			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_TOO_LARGE);
+
+		//back to front, see the other free_chains
+		for(uintmax_t i = chain.size(); i > 0; i--)
+		{
+			if(chain[i - 1] < FAT_attrs.DATA_MIN ||
+				chain[i - 1] > FAT_attrs.DATA_MAX ||
+				chain[i - 1] >= FAT.length())
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+			FAT.set(chain[i - 1], FAT_attrs.FREE_CLUSTER);
+		}
+
+		return 0;
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t shrink_chain(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type> FAT_attrs,
+		const std::vector<index_type> &chain, const index_type tgt_size)
+	{
+		uint16_t err;
+
+		if(!chain.size() || tgt_size >= chain.size()) return 0;
+
+		const std::vector<index_type> to_free(chain.begin() + tgt_size, chain.end());
+
+		err = free_chain(FAT, FAT_attrs, to_free);
+		if(err) return err;
+
+		if(tgt_size)
+		{
+			if(chain[tgt_size - 1] < FAT_attrs.DATA_MIN || chain[tgt_size - 1] > FAT_attrs.DATA_MAX ||
+				chain[tgt_size - 1] >= FAT.length())
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+			FAT.set(chain[tgt_size - 1], FAT_attrs.END_OF_CHAIN);
+		}
+
+		return 0;
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t write_chain(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type> FAT_attrs,
+		const std::vector<index_type> &chain)
+	{
+		uintmax_t i;
+
+		if(!chain.size())
+			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::EMPTY_CHAIN);
+		if(chain.size() > (uintmax_t)(FAT.length() - FAT_attrs.DATA_MIN))
+			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_TOO_LARGE);
+
+		if(chain[0] < FAT_attrs.DATA_MIN || chain[0] > FAT_attrs.DATA_MAX ||
+			chain[0] >= FAT.length())
+			return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+		for(i = 0; i < chain.size() - 1; i++)
+		{
+			if(chain[i + 1] < FAT_attrs.DATA_MIN || chain[i + 1] > FAT_attrs.DATA_MAX ||
+				chain[i + 1] >= FAT.length())
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+			FAT.set(chain[i], chain[i + 1]);
+		}
+
+		FAT.set(chain[i], FAT_attrs.END_OF_CHAIN);
+
+		return 0;
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t write_cluster(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type>, const index_type cur_cls,
+		const index_type next_cls)
+	{
+		if(cur_cls >= FAT.length())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_START);
+
+		FAT.set(cur_cls, next_cls);
+
+		return 0;
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t extend_chain(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type> FAT_attrs, const index_type cur_cls,
+		const index_type next_cls)
+	{
+		if(cur_cls < FAT_attrs.DATA_MIN || cur_cls > FAT_attrs.DATA_MAX || cur_cls >= FAT.length())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_START);
+
+		if(next_cls < FAT_attrs.DATA_MIN || next_cls > FAT_attrs.DATA_MAX || next_cls >= FAT.length())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_NEXT_CLS);
+
+		FAT.set(cur_cls, next_cls);
+		FAT.set(next_cls, FAT_attrs.END_OF_CHAIN);
+
+		return 0;
+	}
+
+	/*Same in-memory kernels as the free functions above, but with the FAT's
+	 *attributes as a template parameter instead of a by-value argument. Both
+	 *drivers have constexpr FAT_ATTRS, so this way the range checks become
+	 *compares against immediates and the compiler is free to unroll and
+	 *vectorise the scans. Results must match the generic versions exactly;
+	 *FAT_utils_test cross-checks them.*/
+	template <auto ATTRS>
+	requires std::integral<std::remove_cv_t<decltype(ATTRS.FREE_CLUSTER)>>
+	struct FAT_t
+	{
+		using index_type = std::remove_cv_t<decltype(ATTRS.FREE_CLUSTER)>;
+
+		static constexpr bool in_data_range(const index_type cls)
+		{
+			return cls >= ATTRS.DATA_MIN && cls <= ATTRS.DATA_MAX;
+		}
+
+		static index_type count_free_clusters(const index_type FAT[],
+			const index_type FAT_len)
+		{
+			index_type count;
+
+			count = 0;
+
+			//no branch in here, lets it get vectorised
+			for(index_type i = ATTRS.DATA_MIN; i < FAT_len; i++)
+				count += FAT[i] == ATTRS.FREE_CLUSTER;
+
+			return count;
+		}
+
+		static uint16_t get_nth_cluster(const index_type FAT[],
+			const index_type FAT_len, index_type &start, index_type idx)
+		{
+			if(!in_data_range(start) || start >= FAT_len)
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::BAD_START);
+
+			while(idx && in_data_range(FAT[start]))
+			{
+				if(FAT[start] >= FAT_len)
+					return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+				start = FAT[start];
+				idx--;
+			}
+
+			if(idx)
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::END_OF_CHAIN);
+
+			return 0;
+		}
+
+		static uint16_t follow_chain(const index_type FAT[],
+			const index_type FAT_len, const index_type start,
+			std::vector<index_type> &chain)
+		{
+			index_type cur;
+
+			if(!in_data_range(start) || start >= FAT_len)
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::BAD_START);
+
+			cur = start;
+			chain.push_back(cur);
+
+			//will not include end-of-chain marker
+			while(in_data_range(FAT[cur]))
+			{
+				//chain points OOB, likely corrupt
+				if(FAT[cur] >= FAT_len)
+					return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+				cur = FAT[cur];
+				chain.push_back(cur);
+			}
+
+			return 0;
+		}
+
+		static index_type find_next_free_cluster(const index_type FAT[],
+			const index_type FAT_len, const index_type offset)
+		{
+			if(!in_data_range(offset) || offset >= FAT_len)
+				return ATTRS.END_OF_CHAIN;
+
+			const index_type *const end = FAT + FAT_len;
+			const index_type *const found = std::find(FAT + offset, end,
+				ATTRS.FREE_CLUSTER);
+
+			return found == end ? ATTRS.END_OF_CHAIN : found - FAT;
+		}
+
+		static index_type find_next_free_cluster(const index_type FAT[],
+			const index_type FAT_len)
+		{
+			return find_next_free_cluster(FAT, FAT_len, ATTRS.DATA_MIN);
+		}
+
+		static uint16_t get_next_or_free_cluster(const index_type FAT[],
+			const index_type FAT_len, const index_type cur_cls,
+			index_type &dst, const index_type offset)
+		{
+			if(!in_data_range(cur_cls) || cur_cls >= FAT_len)
+				return ret_val_setup(LIBRARY_ID, (u8)ERR::BAD_START);
+
+			if(in_data_range(FAT[cur_cls]))
+			{
+				if(FAT[cur_cls] >= FAT_len)
+					return ret_val_setup(LIBRARY_ID, (u8)ERR::CHAIN_OOB);
+
+				dst = FAT[cur_cls];
+				return 0;
+			}
+
+			dst = find_next_free_cluster(FAT, FAT_len, offset);
+
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::ALLOC);
+		}
+
+		static uint16_t get_next_or_free_cluster(const index_type FAT[],
+			const index_type FAT_len, const index_type cur_cls,
+			index_type &dst)
+		{
+			return get_next_or_free_cluster(FAT, FAT_len, cur_cls, dst,
+											ATTRS.DATA_MIN);
+		}
+
+		static uint16_t find_free_chain(const index_type FAT[],
+			const index_type FAT_len, index_type cluster_cnt,
+			std::vector<index_type> &chain)
+		{
+			index_type last_cluster;
+
+			if(cluster_cnt < chain.size()) return 0; //nothing to do
+
+			cluster_cnt -= chain.size();
+			last_cluster = ATTRS.DATA_MIN;
+
+			for(uintmax_t i = 0; i < cluster_cnt; i++)
+			{
+				last_cluster = find_next_free_cluster(FAT, FAT_len,
+													  last_cluster);
+
+				if(last_cluster == ATTRS.END_OF_CHAIN)
+					return ret_val_setup(LIBRARY_ID,
+										 (uint8_t)ERR::NO_FREE_CLUSTERS);
+
+				chain.push_back(last_cluster++);
+			}
+
+			return 0;
+		}
+
+		/*Same contract as find_free_chain, but tries to keep what it adds
+		 *contiguous. First it carries on right after the chain's last cluster;
+		 *failing that, it takes the first free run long enough for all of it.
+		 *Only falls back to first fit if there's no such run.*/
+		static uint16_t find_contig_free_chain(const index_type FAT[],
+			const index_type FAT_len, index_type cluster_cnt,
+			std::vector<index_type> &chain)
+		{
+			const uintmax_t og_size = chain.size();
+			const uintmax_t end = std::min((uintmax_t)FAT_len,
+										   (uintmax_t)ATTRS.DATA_MAX + 1);
+
+			uintmax_t run_start, run_len;
+
+			if(cluster_cnt <= og_size) return 0; //nothing to do
+
+			if(og_size)
+			{
+				for(uintmax_t i = chain.back() + 1; chain.size() < cluster_cnt
+					&& i < end && FAT[i] == ATTRS.FREE_CLUSTER; i++)
+					chain.push_back(i);
+
+				if(chain.size() == cluster_cnt) return 0;
+
+				chain.resize(og_size);
+			}
+
+			run_start = 0;
+			run_len = 0;
+
+			for(uintmax_t i = ATTRS.DATA_MIN; i < end; i++)
+			{
+				if(FAT[i] != ATTRS.FREE_CLUSTER)
+				{
+					run_len = 0;
+					continue;
+				}
+
+				if(!run_len) run_start = i;
+
+				if(++run_len == cluster_cnt - og_size)
+				{
+					for(uintmax_t j = run_start; j <= i; j++)
+						chain.push_back(j);
+
+					return 0;
+				}
+			}
+
+			return find_free_chain(FAT, FAT_len, cluster_cnt, chain);
+		}
+	};
+
 	//maybe add cluster_size and start_of_data to some sort of FAT_dyna_attrs_t
 	template <typename index_type>
 	requires std::integral<index_type>
@@ -730,5 +1239,620 @@ namespace FAT_utils
 
 		return 0;
 	}
+
+	/*------------------------------Defragmenting-----------------------------*/
+	struct frag_stats_t
+	{
+		uintmax_t chains;
+		uintmax_t fragments; //contiguous runs, a defragged chain has 1
+		uintmax_t seeks; //jumps needed to read every chain in order
+	};
+
+	/*Walks every chain in starts, in order, appending each cluster to order.
+	 *Fails with CROSS_LINKED if a cluster is reached twice, which covers both
+	 *loops and chains sharing clusters, and with BAD_CHAIN_END if a chain ends
+	 *in anything but END_OF_CHAIN (a free cluster, say); moving those around
+	 *would duplicate or lose data, so they're left for fsck.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t walk_chains(const index_type FAT[],
+		const FAT_attrs_t<index_type> FAT_attrs, const index_type FAT_len,
+		const std::vector<index_type> &starts, std::vector<index_type> &order,
+		frag_stats_t &stats)
+	{
+		index_type cur, next;
+		std::vector<bool> seen(FAT_len);
+
+		stats = {0, 0, 0};
+
+		for(const index_type start: starts)
+		{
+			if(start < FAT_attrs.DATA_MIN || start > FAT_attrs.DATA_MAX
+				|| start >= FAT_len)
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::BAD_START);
+
+			cur = start;
+			stats.chains++;
+			stats.fragments++;
+
+			while(true)
+			{
+				if(seen[cur])
+					return ret_val_setup(LIBRARY_ID,
+										 (uint8_t)ERR::CROSS_LINKED);
+
+				if(order.empty() || order.back() + 1 != cur) stats.seeks++;
+
+				seen[cur] = true;
+				order.push_back(cur);
+				next = FAT[cur];
+
+				if(next < FAT_attrs.DATA_MIN || next > FAT_attrs.DATA_MAX)
+				{
+					if(next != FAT_attrs.END_OF_CHAIN)
+						return ret_val_setup(LIBRARY_ID,
+											 (uint8_t)ERR::BAD_CHAIN_END);
+
+					break;
+				}
+
+				if(next >= FAT_len)
+					return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::CHAIN_OOB);
+
+				if(next != cur + 1) stats.fragments++;
+				cur = next;
+			}
+		}
+
+		return 0;
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t get_frag_stats(const index_type FAT[],
+		const FAT_attrs_t<index_type> FAT_attrs, const index_type FAT_len,
+		const std::vector<index_type> &starts, frag_stats_t &stats)
+	{
+		std::vector<index_type> order;
+
+		return walk_chains(FAT, FAT_attrs, FAT_len, starts, order, stats);
+	}
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	struct defrag_plan_t
+	{
+		std::vector<index_type> src_of; //new position -> old position
+		std::vector<index_type> dst_of; //old position -> new position
+		std::vector<bool> has_data; //by old position, false if free
+
+		bool is_identity() const
+		{
+			for(uintmax_t i = 0; i < src_of.size(); i++)
+				if(src_of[i] != i) return false;
+
+			return true;
+		}
+	};
+
+	/*Lays the chains out back to back from DATA_MIN, in the order they're
+	 *given, and fills whatever's left with the free clusters. Clusters that
+	 *are neither free nor part of one of the chains (reserved, S760 OS,
+	 *orphans) stay where they are and the layout flows around them.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t plan_defrag(const index_type FAT[],
+		const FAT_attrs_t<index_type> FAT_attrs, const index_type FAT_len,
+		const std::vector<index_type> &starts, defrag_plan_t<index_type> &plan,
+		frag_stats_t &stats)
+	{
+		uint16_t err;
+		index_type src;
+		uintmax_t next_used, next_free;
+		std::vector<index_type> order;
+
+		err = walk_chains(FAT, FAT_attrs, FAT_len, starts, order, stats);
+		if(err) return err;
+
+		plan.src_of.resize(FAT_len);
+		plan.dst_of.resize(FAT_len);
+		plan.has_data.assign(FAT_len, false);
+
+		for(const index_type cls: order) plan.has_data[cls] = true;
+
+		for(uintmax_t i = 0; i < FAT_attrs.DATA_MIN && i < FAT_len; i++)
+			plan.src_of[i] = plan.dst_of[i] = i;
+
+		next_used = 0;
+		next_free = FAT_attrs.DATA_MIN;
+
+		for(uintmax_t i = FAT_attrs.DATA_MIN; i < FAT_len; i++)
+		{
+			if(FAT[i] != FAT_attrs.FREE_CLUSTER && !plan.has_data[i])
+				src = i; //pinned
+			else if(next_used < order.size()) src = order[next_used++];
+			else
+			{
+				while(FAT[next_free] != FAT_attrs.FREE_CLUSTER
+					|| plan.has_data[next_free])
+					next_free++;
+				src = next_free++;
+			}
+
+			plan.src_of[i] = src;
+			plan.dst_of[src] = i;
+		}
+
+		return 0;
+	}
+
+	/*Shuffles cluster data into the planned positions. Goes through the
+	 *destinations in order; everything before the current one is already in
+	 *place, so whatever belongs there is always further ahead. It gets swapped
+	 *with whatever's currently in the way, which then waits for its own turn.
+	 *Runs that are contiguous on both ends get swapped with one read and one
+	 *write per side, up to max_io_size. Free clusters are never read or
+	 *written.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	uint16_t move_clusters(std::fstream &fstream,
+		const FAT_attrs_t<index_type> FAT_attrs,
+		const defrag_plan_t<index_type> &plan, const uintmax_t cluster_size,
+		const uintmax_t start_of_data, const uintmax_t max_io_size,
+		uintmax_t &moved)
+	{
+		const uintmax_t FAT_len = plan.src_of.size();
+		const uintmax_t MAX_RUN = std::max(max_io_size / cluster_size,
+										   (uintmax_t)1);
+
+		bool data_in, data_out;
+		uintmax_t src, run;
+
+		//loc: where a cluster's data is now, occ: whose data a position holds
+		std::vector<index_type> loc(FAT_len), occ(FAT_len);
+		std::unique_ptr<char[]> in_buf, out_buf;
+
+		for(uintmax_t i = 0; i < FAT_len; i++) loc[i] = occ[i] = i;
+
+		in_buf = std::make_unique<char[]>(MAX_RUN * cluster_size);
+		out_buf = std::make_unique<char[]>(MAX_RUN * cluster_size);
+		moved = 0;
+
+		for(uintmax_t dst = FAT_attrs.DATA_MIN; dst < FAT_len; dst += run)
+		{
+			src = loc[plan.src_of[dst]];
+			run = 1;
+
+			if(src == dst) continue;
+
+			//src is always past dst, never let the two ranges overlap
+			while(run < MAX_RUN && dst + run < src && src + run < FAT_len
+				&& loc[plan.src_of[dst + run]] == src + run)
+				run++;
+
+			data_in = false;
+			data_out = false;
+
+			for(uintmax_t i = 0; i < run; i++)
+			{
+				data_in |= plan.has_data[plan.src_of[dst + i]];
+				data_out |= plan.has_data[occ[dst + i]];
+			}
+
+			const uintmax_t src_addr = start_of_data + (src
+				- FAT_attrs.DATA_MIN) * cluster_size;
+			const uintmax_t dst_addr = start_of_data + (dst
+				- FAT_attrs.DATA_MIN) * cluster_size;
+
+			if(data_in)
+			{
+				fstream.seekg(src_addr);
+				fstream.read(in_buf.get(), run * cluster_size);
+			}
+
+			if(data_out)
+			{
+				fstream.seekg(dst_addr);
+				fstream.read(out_buf.get(), run * cluster_size);
+			}
+
+			if(data_in)
+			{
+				fstream.seekp(dst_addr);
+				fstream.write(in_buf.get(), run * cluster_size);
+			}
+
+			if(data_out)
+			{
+				fstream.seekp(src_addr);
+				fstream.write(out_buf.get(), run * cluster_size);
+			}
+
+			if(fstream.fail())
+				return ret_val_setup(LIBRARY_ID, (uint8_t)ERR::IO_ERROR);
+
+			for(uintmax_t i = 0; i < run; i++)
+			{
+				const index_type in = plan.src_of[dst + i];
+				const index_type out = occ[dst + i];
+
+				moved += plan.has_data[in] + plan.has_data[out];
+
+				occ[dst + i] = in;
+				loc[in] = dst + i;
+				occ[src + i] = out;
+				loc[out] = src + i;
+			}
+		}
+
+		return 0;
+	}
+
+	//Rewrites the FAT to match a plan. Only touches the cache.
+	template <typename index_type>
+	requires std::integral<index_type>
+	void apply_defrag_plan(FAT_cache_t<index_type> &FAT,
+		const FAT_attrs_t<index_type> FAT_attrs,
+		const defrag_plan_t<index_type> &plan)
+	{
+		index_type val;
+
+		const std::vector<index_type> old(FAT.get(), FAT.get() + FAT.length());
+
+		for(uintmax_t i = FAT_attrs.DATA_MIN; i < old.size(); i++)
+		{
+			val = old[plan.src_of[i]];
+
+			if(val >= FAT_attrs.DATA_MIN && val <= FAT_attrs.DATA_MAX
+				&& val < old.size())
+				val = plan.dst_of[val];
+
+			if(FAT[i] != val) FAT.set(i, val);
+		}
+	}
+	/*----------------------------Whole-FAT analysis--------------------------*/
+	//Slices smaller than this aren't worth a thread
+	constexpr uintmax_t MIN_SLICE_LEN = 4096;
+
+	//thread_cnt 0 means one per hardware thread
+	inline uintmax_t slice_count(const uintmax_t len, uintmax_t thread_cnt)
+	{
+		if(!thread_cnt)
+			thread_cnt = std::max(std::thread::hardware_concurrency(), 1U);
+
+		return std::clamp(len / MIN_SLICE_LEN, (uintmax_t)1, thread_cnt);
+	}
+
+	/*Runs fn(slice, begin, end) over [0, len) split into slice_cnt slices,
+	 *each on its own thread. Slices are made of whole 64 bit words, so no two
+	 *of them ever write to the same word of a bitset_t.*/
+	template <typename func_t>
+	void run_sliced(const uintmax_t len, const uintmax_t slice_cnt,
+					const func_t &fn)
+	{
+		const uintmax_t SLICE_LEN = div_int_round_to_pos_inf(
+			div_int_round_to_pos_inf(len, slice_cnt), (uintmax_t)64) * 64;
+
+		std::vector<std::thread> threads;
+
+		for(uintmax_t i = 1; i < slice_cnt; i++)
+			threads.emplace_back(fn, i, std::min(i * SLICE_LEN, len),
+								 std::min((i + 1) * SLICE_LEN, len));
+
+		fn(0, 0, std::min(SLICE_LEN, len));
+
+		for(std::thread &thread: threads) thread.join();
+	}
+
+	/*Everything fsck wants to know about every chain at once, instead of a
+	 *follow_chain per file. A cluster's in use if it links to another one,
+	 *ends a chain or has a link pointing at it; whatever a chain runs into
+	 *counts as part of it, same as with follow_chain. Chains get split into
+	 *segments at every cluster with more than one link pointing at it, so
+	 *every cluster belongs to exactly one segment and they can all be walked
+	 *in parallel. Chains and segments only ever merge, so once a segment's
+	 *successor is known, the rest falls out of the much smaller segment
+	 *graph.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	struct FAT_analysis_t
+	{
+		static constexpr index_type NO_SEGMENT =
+			std::numeric_limits<index_type>::max();
+		static constexpr uint8_t SEG_CYCLIC = 1;
+		static constexpr uint8_t SEG_BROKEN = 2;
+
+		std::vector<index_type> in_degree; //links pointing at each cluster
+		//Clusters from here to the end of the chain, 0 if unused or it loops
+		std::vector<index_type> length;
+		bit_util::bitset_t used;
+		bit_util::bitset_t heads; //used, nothing links to it
+		bit_util::bitset_t cyclic; //ends up going around in circles
+		bit_util::bitset_t broken; //links past the end of the FAT down the line
+		bit_util::bitset_t orphans; //used, not reachable, see find_orphans
+		uintmax_t cross_links; //clusters with more than one link to them
+		uintmax_t cycles;
+		uintmax_t orphan_cnt;
+
+		std::vector<index_type> seg_of, seg_pos; //by cluster
+		std::vector<index_type> seg_start, seg_len, seg_next, seg_tail;
+		std::vector<uint8_t> seg_flags;
+	};
+
+	template <typename index_type>
+	requires std::integral<index_type>
+	void analyse_FAT(const index_type FAT[],
+		const FAT_attrs_t<index_type> FAT_attrs, const index_type FAT_len,
+		FAT_analysis_t<index_type> &analysis, const uintmax_t thread_cnt = 0)
+	{
+		typedef FAT_analysis_t<index_type> analysis_t;
+
+		const uintmax_t END = std::min<uintmax_t>(FAT_len,
+			(uintmax_t)FAT_attrs.DATA_MAX + 1);
+		const uintmax_t SLICE_CNT = slice_count(END, thread_cnt);
+
+		std::vector<std::vector<index_type>> in_degrees(SLICE_CNT);
+		std::vector<std::vector<index_type>> seg_starts(SLICE_CNT);
+		std::vector<uintmax_t> cross_links(SLICE_CNT);
+		std::vector<uint8_t> state;
+		std::vector<index_type> path;
+
+		auto links = [&](const uintmax_t cls) -> bool
+		{
+			return FAT[cls] >= FAT_attrs.DATA_MIN
+				&& FAT[cls] <= FAT_attrs.DATA_MAX;
+		};
+
+		/*Only ever writes to the clusters in the segment, save the first one,
+		 *which has to know its segment beforehand.*/
+		auto walk = [&](const index_type seg)
+		{
+			index_type cur, pos;
+
+			cur = analysis.seg_start[seg];
+			pos = 0;
+
+			while(true)
+			{
+				if(pos) analysis.seg_of[cur] = seg;
+				analysis.seg_pos[cur] = pos++;
+
+				if(!links(cur)) break;
+
+				if(FAT[cur] >= END)
+				{
+					analysis.seg_flags[seg] |= analysis_t::SEG_BROKEN;
+					break;
+				}
+
+				cur = FAT[cur];
+
+				if(analysis.in_degree[cur] != 1
+					|| analysis.seg_of[cur] != analysis_t::NO_SEGMENT)
+				{
+					analysis.seg_next[seg] = analysis.seg_of[cur];
+					break;
+				}
+			}
+
+			analysis.seg_len[seg] = pos;
+		};
+
+		analysis.in_degree.assign(END, 0);
+		analysis.length.assign(END, 0);
+		analysis.used.assign(END, false);
+		analysis.heads.assign(END, false);
+		analysis.cyclic.assign(END, false);
+		analysis.broken.assign(END, false);
+		analysis.orphans.assign(END, false);
+		analysis.seg_of.assign(END, analysis_t::NO_SEGMENT);
+		analysis.seg_pos.assign(END, 0);
+		analysis.cross_links = 0;
+		analysis.cycles = 0;
+		analysis.orphan_cnt = 0;
+
+		//In-degrees, each slice counts the links going out of it
+		run_sliced(END, SLICE_CNT, [&](const uintmax_t slice,
+			const uintmax_t begin, const uintmax_t end)
+		{
+			std::vector<index_type> &cnt = in_degrees[slice];
+
+			cnt.assign(END, 0);
+
+			for(uintmax_t i = std::max<uintmax_t>(begin, FAT_attrs.DATA_MIN);
+				i < end; i++)
+				if(links(i) && FAT[i] < END) cnt[FAT[i]]++;
+		});
+
+		//Sum them up, then find chain heads and segment starts
+		run_sliced(END, SLICE_CNT, [&](const uintmax_t slice,
+			const uintmax_t begin, const uintmax_t end)
+		{
+			for(uintmax_t i = begin; i < end; i++)
+			{
+				index_type sum = 0;
+
+				for(const std::vector<index_type> &cnt: in_degrees)
+					sum += cnt[i];
+
+				analysis.in_degree[i] = sum;
+
+				if(i < FAT_attrs.DATA_MIN || (!sum && !links(i)
+					&& FAT[i] != FAT_attrs.END_OF_CHAIN))
+					continue;
+
+				analysis.used.set(i);
+
+				if(!sum) analysis.heads.set(i);
+				else if(sum > 1) cross_links[slice]++;
+
+				if(sum != 1) seg_starts[slice].push_back(i);
+			}
+		});
+
+		in_degrees.clear();
+		analysis.seg_start.clear();
+
+		for(uintmax_t i = 0; i < SLICE_CNT; i++)
+		{
+			analysis.cross_links += cross_links[i];
+
+			for(const index_type start: seg_starts[i])
+			{
+				analysis.seg_of[start] = analysis.seg_start.size();
+				analysis.seg_start.push_back(start);
+			}
+		}
+
+		const uintmax_t SEG_CNT = analysis.seg_start.size();
+
+		analysis.seg_len.assign(SEG_CNT, 0);
+		analysis.seg_next.assign(SEG_CNT, analysis_t::NO_SEGMENT);
+		analysis.seg_flags.assign(SEG_CNT, 0);
+
+		//Segment starts already know their segment, nobody writes to them
+		run_sliced(SEG_CNT, std::min(SLICE_CNT, SEG_CNT ? SEG_CNT : 1),
+			[&](const uintmax_t, const uintmax_t begin, const uintmax_t end)
+		{
+			for(uintmax_t i = begin; i < end; i++) walk(i);
+		});
+
+		/*Whatever's left is in use but was never reached, so every cluster
+		 *in it has exactly one link pointing at it: nothing but loops.*/
+		for(uintmax_t i = FAT_attrs.DATA_MIN; i < END; i++)
+		{
+			if(!analysis.used[i]
+				|| analysis.seg_of[i] != analysis_t::NO_SEGMENT)
+				continue;
+
+			analysis.seg_of[i] = analysis.seg_start.size();
+			analysis.seg_start.push_back(i);
+			analysis.seg_len.push_back(0);
+			analysis.seg_next.push_back(analysis_t::NO_SEGMENT);
+			analysis.seg_flags.push_back(0);
+			walk(analysis.seg_start.size() - 1);
+		}
+
+		//Segment graph. 0: not seen yet, 1: on the current path, 2: done.
+		analysis.seg_tail.assign(analysis.seg_start.size(), 0);
+		state.assign(analysis.seg_start.size(), 0);
+
+		for(uintmax_t i = 0; i < analysis.seg_start.size(); i++)
+		{
+			index_type cur = i;
+
+			path.clear();
+
+			while(cur != analysis_t::NO_SEGMENT && !state[cur])
+			{
+				state[cur] = 1;
+				path.push_back(cur);
+				cur = analysis.seg_next[cur];
+			}
+
+			//Ran into itself
+			if(cur != analysis_t::NO_SEGMENT && state[cur] == 1)
+			{
+				analysis.cycles++;
+
+				for(auto it = std::find(path.begin(), path.end(), cur);
+					it != path.end(); it++)
+					analysis.seg_flags[*it] |= analysis_t::SEG_CYCLIC;
+			}
+
+			for(auto it = path.rbegin(); it != path.rend(); it++)
+			{
+				const index_type next = analysis.seg_next[*it];
+
+				state[*it] = 2;
+
+				if(next == analysis_t::NO_SEGMENT
+					|| analysis.seg_flags[*it] & analysis_t::SEG_CYCLIC)
+					continue;
+
+				analysis.seg_flags[*it] |= analysis.seg_flags[next];
+				analysis.seg_tail[*it] = analysis.seg_len[next]
+					+ analysis.seg_tail[next];
+			}
+		}
+
+		//Back down to clusters
+		run_sliced(END, SLICE_CNT, [&](const uintmax_t, const uintmax_t begin,
+			const uintmax_t end)
+		{
+			for(uintmax_t i = begin; i < end; i++)
+			{
+				if(!analysis.used[i]) continue;
+
+				const index_type seg = analysis.seg_of[i];
+				const uint8_t flags = analysis.seg_flags[seg];
+
+				if(flags & analysis_t::SEG_CYCLIC) analysis.cyclic.set(i);
+				else
+				{
+					analysis.length[i] = analysis.seg_len[seg]
+						- analysis.seg_pos[i] + analysis.seg_tail[seg];
+
+					if(flags & analysis_t::SEG_BROKEN) analysis.broken.set(i);
+				}
+			}
+		});
+	}
+
+	/*Marks every used cluster that can't be reached from any of the starts.
+	 *Starts that aren't in use get ignored.*/
+	template <typename index_type>
+	requires std::integral<index_type>
+	void find_orphans(FAT_analysis_t<index_type> &analysis,
+		const std::vector<index_type> &starts)
+	{
+		typedef FAT_analysis_t<index_type> analysis_t;
+
+		//Position of the first cluster reached in each segment
+		std::vector<index_type> reached_from(analysis.seg_start.size(),
+			analysis_t::NO_SEGMENT);
+
+		for(const index_type start: starts)
+		{
+			if(start >= analysis.used.size() || !analysis.used[start])
+				continue;
+
+			const index_type seg = analysis.seg_of[start];
+			const bool was_reached = reached_from[seg]
+				!= analysis_t::NO_SEGMENT;
+
+			if(analysis.seg_pos[start] >= reached_from[seg]) continue;
+
+			reached_from[seg] = analysis.seg_pos[start];
+
+			//Successors got everything when this one was first reached
+			if(was_reached) continue;
+
+			for(index_type next = analysis.seg_next[seg];
+				next != analysis_t::NO_SEGMENT && reached_from[next];
+				next = analysis.seg_next[next])
+			{
+				const bool next_reached = reached_from[next]
+					!= analysis_t::NO_SEGMENT;
+
+				reached_from[next] = 0;
+				if(next_reached) break;
+			}
+		}
+
+		analysis.orphans.assign(analysis.used.size(), false);
+		analysis.orphan_cnt = 0;
+
+		for(uintmax_t i = 0; i < analysis.used.size(); i++)
+		{
+			if(!analysis.used[i]) continue;
+
+			if(analysis.seg_pos[i] < reached_from[analysis.seg_of[i]])
+			{
+				analysis.orphans.set(i);
+				analysis.orphan_cnt++;
+			}
+		}
+	}
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,994 @@
+﻿#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "Utils/ints.hpp"
+#include "Utils/FAT_utils.hpp"
+
+/*Benchmark and fuzzer for FAT_utils. Works on synthetic FATs instead of
+ *FAT_test_data.bin, so the size, fill ratio and fragmentation can be dialed
+ *in. Meant as a baseline for allocator work, run it before and after.
+ *
+ *	FAT_utils_bench [bench] [fill ratio] [fragmentation] [iterations]
+ *	FAT_utils_bench fuzz [rounds] [seed]
+ *
+ *Fill ratio is the fraction of data clusters in use. Fragmentation is the
+ *chance of each cluster getting swapped to a random spot in allocation
+ *order; 0 gives perfectly contiguous chains, 1 a shuffled mess.*/
+
+//Same as the drivers' FAT_ATTRS, Utils can't depend on them
+constexpr FAT_utils::FAT_attrs_t<u16> EMU_ATTRS(std::endian::little, 0, 1,
+	0x7FFE, 0x7FFF, 0x8000);
+constexpr FAT_utils::FAT_attrs_t<u16> S7XX_ATTRS(std::endian::little, 0, 2,
+	0xFFF5, 0xFFF8, 0xFFFF);
+//Not a real FS, just gets the byteswapping paths some exercise
+constexpr FAT_utils::FAT_attrs_t<u16> BE_ATTRS(std::endian::big, 0, 2,
+	0xFFF5, 0xFFF8, 0xFFFF);
+
+//Largest FATs each driver can end up with
+constexpr u16 EMU_MAX_LEN = EMU_ATTRS.DATA_MAX + EMU_ATTRS.DATA_MIN;
+constexpr u16 S7XX_MAX_LEN = S7XX_ATTRS.DATA_MAX + 1;
+
+constexpr u16 AVG_CHAIN_LEN = 32;
+constexpr u16 ALLOC_SIZE = 64;
+
+constexpr char BENCH_FILE[] = "FAT_bench.bin";
+constexpr char FUZZ_FILES[3][16] = {"FAT_fuzz_a.bin", "FAT_fuzz_b.bin",
+	"FAT_fuzz_c.bin"};
+
+//Keeps the compiler from throwing away results we never look at
+static volatile uintmax_t sink;
+
+static void keep(const uintmax_t val)
+{
+	sink = sink ^ val;
+}
+
+struct synth_FAT_t
+{
+	std::vector<u16> table;
+	std::vector<u16> starts;
+};
+
+/*Lays out fill * data clusters worth of chains, AVG_CHAIN_LEN clusters long
+ *on average, in allocation order. Allocation order starts out sequential and
+ *each position gets swapped with a random one with probability frag.*/
+template <auto ATTRS>
+static void gen_FAT(const u16 len, const double fill, const double frag,
+					std::mt19937 &rng, synth_FAT_t &dst)
+{
+	const u16 DATA_CNT = len - ATTRS.DATA_MIN;
+	const u16 USED_CNT = DATA_CNT * std::clamp(fill, 0.0, 1.0);
+
+	u16 cnt;
+	std::vector<u16> order(DATA_CNT);
+	std::uniform_real_distribution<double> chance(0, 1);
+	std::uniform_int_distribution<u32> pos(0, DATA_CNT - 1);
+	std::uniform_int_distribution<u32> chain_len(1, AVG_CHAIN_LEN * 2 - 1);
+
+	dst.table.assign(len, ATTRS.FREE_CLUSTER);
+	dst.starts.clear();
+
+	for(u16 i = 0; i < ATTRS.DATA_MIN; i++) dst.table[i] = ATTRS.RESERVED;
+	for(u16 i = 0; i < DATA_CNT; i++) order[i] = i + ATTRS.DATA_MIN;
+
+	for(u16 i = 0; i < DATA_CNT; i++)
+		if(chance(rng) < frag) std::swap(order[i], order[pos(rng)]);
+
+	for(u16 i = 0; i < USED_CNT; i += cnt)
+	{
+		cnt = std::min<u32>(chain_len(rng), USED_CNT - i);
+		dst.starts.push_back(order[i]);
+
+		for(u16 j = 0; j < cnt - 1; j++)
+			dst.table[order[i + j]] = order[i + j + 1];
+
+		dst.table[order[i + cnt - 1]] = ATTRS.END_OF_CHAIN;
+	}
+}
+
+static bool write_FAT_file(std::fstream &fstr, const std::endian endianness,
+	const std::vector<u16> &table, const uintmax_t base_addr)
+{
+	std::vector<u16> swapped(table);
+	const std::vector<char> pad(base_addr, 0);
+
+	if(endianness != std::endian::native)
+		for(u16 &val: swapped) val = std::byteswap(val);
+
+	fstr.seekp(0);
+	fstr.write(pad.data(), pad.size());
+	fstr.write((char*)swapped.data(), swapped.size() * 2);
+	fstr.flush();
+
+	return fstr.good();
+}
+
+static bool read_FAT_file(std::fstream &fstr, const std::endian endianness,
+	std::vector<u16> &table, const uintmax_t base_addr)
+{
+	fstr.seekg(base_addr);
+	fstr.read((char*)table.data(), table.size() * 2);
+
+	if(endianness != std::endian::native)
+		for(u16 &val: table) val = std::byteswap(val);
+
+	return fstr.good();
+}
+
+/*-------------------------------Benchmarking--------------------------------*/
+typedef std::chrono::duration<double, std::nano> ns_t;
+
+template <typename F>
+static double time_op(const uintmax_t iters, F &&op)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	for(uintmax_t i = 0; i < iters; i++) op(i);
+
+	return ns_t(std::chrono::steady_clock::now() - start).count() / iters;
+}
+
+//Only op gets timed, undo puts things back the way they were
+template <typename F, typename G>
+static double time_op(const uintmax_t iters, F &&op, G &&undo)
+{
+	ns_t total(0);
+
+	for(uintmax_t i = 0; i < iters; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		op(i);
+		total += std::chrono::steady_clock::now() - start;
+
+		undo(i);
+	}
+
+	return total.count() / iters;
+}
+
+static void report(const char *name, const char *variant, const double ns)
+{
+	std::cout << '\t' << std::left << std::setw(26) << name << std::setw(10)
+		<< variant << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(14) << ns << " ns/op" << std::endl;
+}
+
+template <auto ATTRS>
+static int bench(const char *label, const u16 len, const double fill,
+				 const double frag, const uintmax_t iters, std::mt19937 &rng)
+{
+	typedef FAT_utils::FAT_t<ATTRS> FAT_t;
+
+	//The fstream versions do a read call per entry, way slower
+	const uintmax_t DISK_ITERS = std::max<uintmax_t>(iters / 64, 1);
+	const FAT_utils::FAT_dyna_attrs_t<u16> DYNA_ATTRS(len, 0);
+
+	u16 cls, err;
+	synth_FAT_t synth;
+	std::vector<u16> tails, offsets, chain, free_chain, long_chain;
+	std::fstream fstr;
+	FAT_utils::FAT_cache_t<u16> cache;
+	FAT_utils::frag_stats_t frag_stats;
+	FAT_utils::defrag_plan_t<u16> plan;
+	FAT_utils::FAT_analysis_t<u16> analysis;
+
+	gen_FAT<ATTRS>(len, fill, frag, rng, synth);
+
+	if(synth.starts.empty())
+	{
+		std::cerr << "Fill ratio too low, no chains to work with!!!"
+			<< std::endl;
+		return 1;
+	}
+
+	u16 *const FAT = synth.table.data();
+	std::uniform_int_distribution<u32> data_cls(ATTRS.DATA_MIN, len - 1);
+
+	for(const u16 start: synth.starts)
+	{
+		chain.clear();
+		FAT_t::follow_chain(FAT, len, start, chain);
+		tails.push_back(chain.back());
+
+		if(chain.size() > long_chain.size()) long_chain = chain;
+	}
+
+	for(u16 i = 0; i < 1024; i++) offsets.push_back(data_cls(rng));
+
+	err = FAT_t::find_free_chain(FAT, len, ALLOC_SIZE, free_chain);
+	if(err)
+	{
+		std::cerr << "Fill ratio too high, can't find " << ALLOC_SIZE
+			<< " free clusters!!!" << std::endl;
+		return 2;
+	}
+
+	fstr.open(BENCH_FILE, std::fstream::binary | std::fstream::in
+		| std::fstream::out | std::fstream::trunc);
+
+	if(!fstr.is_open() || !write_FAT_file(fstr, ATTRS.ENDIANNESS,
+		synth.table, DYNA_ATTRS.BASE_ADDR))
+	{
+		std::cerr << "Could not write " << BENCH_FILE << "!!!" << std::endl;
+		return 3;
+	}
+
+	cache = FAT_utils::FAT_cache_t<u16>(ATTRS, DYNA_ATTRS);
+	cache.load(fstr, ATTRS);
+
+	std::cout << label << ": " << len << " entries, " << synth.starts.size()
+		<< " chains, " << FAT_t::count_free_clusters(FAT, len)
+		<< " free clusters" << std::endl;
+
+	const u16 n = synth.starts.size();
+
+	/*Read-only*/
+	report("count_free_clusters", "generic", time_op(iters, [&](uintmax_t)
+		{keep(FAT_utils::count_free_clusters(FAT, ATTRS, len));}));
+	report("count_free_clusters", "FAT_t", time_op(iters, [&](uintmax_t)
+		{keep(FAT_t::count_free_clusters(FAT, len));}));
+	report("count_free_clusters", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{keep(FAT_utils::count_free_clusters(fstr, ATTRS, DYNA_ATTRS));}));
+
+	report("get_nth_cluster", "generic", time_op(iters, [&](uintmax_t)
+		{
+			cls = long_chain[0];
+			keep(FAT_utils::get_nth_cluster(FAT, ATTRS, len, cls,
+				(u16)(long_chain.size() - 1)) + cls);
+		}));
+	report("get_nth_cluster", "FAT_t", time_op(iters, [&](uintmax_t)
+		{
+			cls = long_chain[0];
+			keep(FAT_t::get_nth_cluster(FAT, len, cls,
+				(u16)(long_chain.size() - 1)) + cls);
+		}));
+	report("get_nth_cluster", "fstream", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			cls = long_chain[0];
+			keep(FAT_utils::get_nth_cluster(fstr, ATTRS, DYNA_ATTRS, cls,
+				(u16)(long_chain.size() - 1)) + cls);
+		}));
+
+	report("follow_chain", "generic", time_op(iters, [&](uintmax_t i)
+		{
+			chain.clear();
+			keep(FAT_utils::follow_chain(FAT, ATTRS, len,
+				synth.starts[i % n], chain) + chain.size());
+		}));
+	report("follow_chain", "FAT_t", time_op(iters, [&](uintmax_t i)
+		{
+			chain.clear();
+			keep(FAT_t::follow_chain(FAT, len, synth.starts[i % n], chain)
+				+ chain.size());
+		}));
+	report("follow_chain", "fstream", time_op(DISK_ITERS, [&](uintmax_t i)
+		{
+			chain.clear();
+			keep(FAT_utils::follow_chain(fstr, ATTRS, DYNA_ATTRS,
+				synth.starts[i % n], chain) + chain.size());
+		}));
+
+	report("find_next_free_cluster", "generic", time_op(iters,
+		[&](uintmax_t i)
+		{
+			keep(FAT_utils::find_next_free_cluster(FAT, ATTRS, len,
+				offsets[i % offsets.size()]));
+		}));
+	report("find_next_free_cluster", "FAT_t", time_op(iters, [&](uintmax_t i)
+		{
+			keep(FAT_t::find_next_free_cluster(FAT, len,
+				offsets[i % offsets.size()]));
+		}));
+	report("find_next_free_cluster", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t i)
+		{
+			keep(FAT_utils::find_next_free_cluster(fstr, ATTRS,
+				DYNA_ATTRS, offsets[i % offsets.size()]));
+		}));
+
+	//at the tails, so it always has to go looking for a free cluster
+	report("get_next_or_free_cluster", "generic", time_op(iters,
+		[&](uintmax_t i)
+		{
+			keep(FAT_utils::get_next_or_free_cluster(FAT, ATTRS, len,
+				tails[i % n], cls) + cls);
+		}));
+	report("get_next_or_free_cluster", "FAT_t", time_op(iters,
+		[&](uintmax_t i)
+		{
+			keep(FAT_t::get_next_or_free_cluster(FAT, len, tails[i % n],
+				cls) + cls);
+		}));
+	report("get_next_or_free_cluster", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t i)
+		{
+			keep(FAT_utils::get_next_or_free_cluster(fstr, ATTRS,
+				DYNA_ATTRS, tails[i % n], cls) + cls);
+		}));
+
+	report("find_free_chain", "generic", time_op(iters, [&](uintmax_t)
+		{
+			chain.clear();
+			keep(FAT_utils::find_free_chain(FAT, ATTRS, len, ALLOC_SIZE,
+				chain) + chain.back());
+		}));
+	report("find_free_chain", "FAT_t", time_op(iters, [&](uintmax_t)
+		{
+			chain.clear();
+			keep(FAT_t::find_free_chain(FAT, len, ALLOC_SIZE, chain)
+				+ chain.back());
+		}));
+	report("find_free_chain", "fstream", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			chain.clear();
+			keep(FAT_utils::find_free_chain(fstr, ATTRS, DYNA_ATTRS,
+				ALLOC_SIZE, chain) + chain.back());
+		}));
+
+	/*Mutating. Everything gets undone, so each variant sees the same FAT.
+	 *The write-through versions touch both memory and disk.*/
+	report("write_chain", "generic", time_op(iters,
+		[&](uintmax_t) {FAT_utils::write_chain(FAT, ATTRS, len, free_chain);},
+		[&](uintmax_t) {FAT_utils::free_chain(FAT, ATTRS, len, free_chain);}));
+	report("write_chain", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{FAT_utils::write_chain(fstr, ATTRS, DYNA_ATTRS, free_chain);},
+		[&](uintmax_t)
+		{FAT_utils::free_chain(fstr, ATTRS, DYNA_ATTRS, free_chain);}));
+	report("write_chain", "cache", time_op(iters,
+		[&](uintmax_t) {FAT_utils::write_chain(cache, ATTRS, free_chain);},
+		[&](uintmax_t) {FAT_utils::free_chain(cache, ATTRS, free_chain);}));
+
+	report("free_chain", "generic", time_op(iters,
+		[&](uintmax_t) {FAT_utils::free_chain(FAT, ATTRS, len, long_chain);},
+		[&](uintmax_t) {FAT_utils::write_chain(FAT, ATTRS, len, long_chain);}));
+	report("free_chain", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{FAT_utils::free_chain(fstr, ATTRS, DYNA_ATTRS, long_chain);},
+		[&](uintmax_t)
+		{FAT_utils::write_chain(fstr, ATTRS, DYNA_ATTRS, long_chain);}));
+	report("free_chain", "cache", time_op(iters,
+		[&](uintmax_t) {FAT_utils::free_chain(cache, ATTRS, long_chain);},
+		[&](uintmax_t) {FAT_utils::write_chain(cache, ATTRS, long_chain);}));
+
+	const u16 half = long_chain.size() / 2;
+
+	report("shrink_chain", "generic", time_op(iters,
+		[&](uintmax_t)
+		{FAT_utils::shrink_chain(FAT, ATTRS, len, long_chain, half);},
+		[&](uintmax_t)
+		{FAT_utils::write_chain(FAT, ATTRS, len, long_chain);}));
+	report("shrink_chain", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{FAT_utils::shrink_chain(fstr, ATTRS, DYNA_ATTRS, long_chain, half);},
+		[&](uintmax_t)
+		{FAT_utils::write_chain(fstr, ATTRS, DYNA_ATTRS, long_chain);}));
+	report("shrink_chain", "cache", time_op(iters,
+		[&](uintmax_t)
+		{FAT_utils::shrink_chain(cache, ATTRS, long_chain, half);},
+		[&](uintmax_t)
+		{FAT_utils::write_chain(cache, ATTRS, long_chain);}));
+
+	const u16 tail = long_chain.back();
+	const u16 next = free_chain[0];
+
+	report("write_cluster", "wthrough", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{
+			FAT_utils::write_cluster(FAT, fstr, ATTRS, DYNA_ATTRS, next,
+				ATTRS.RESERVED);
+		},
+		[&](uintmax_t)
+		{
+			FAT_utils::write_cluster(FAT, fstr, ATTRS, DYNA_ATTRS, next,
+				ATTRS.FREE_CLUSTER);
+		}));
+	report("write_cluster", "cache", time_op(iters,
+		[&](uintmax_t)
+		{FAT_utils::write_cluster(cache, ATTRS, next, ATTRS.RESERVED);},
+		[&](uintmax_t)
+		{FAT_utils::write_cluster(cache, ATTRS, next, ATTRS.FREE_CLUSTER);}));
+
+	report("extend_chain", "wthrough", time_op(DISK_ITERS,
+		[&](uintmax_t)
+		{FAT_utils::extend_chain(FAT, fstr, ATTRS, DYNA_ATTRS, tail, next);},
+		[&](uintmax_t)
+		{
+			FAT_utils::write_cluster(FAT, fstr, ATTRS, DYNA_ATTRS, tail,
+				ATTRS.END_OF_CHAIN);
+			FAT_utils::write_cluster(FAT, fstr, ATTRS, DYNA_ATTRS, next,
+				ATTRS.FREE_CLUSTER);
+		}));
+	report("extend_chain", "cache", time_op(iters,
+		[&](uintmax_t) {FAT_utils::extend_chain(cache, ATTRS, tail, next);},
+		[&](uintmax_t)
+		{
+			FAT_utils::write_cluster(cache, ATTRS, tail, ATTRS.END_OF_CHAIN);
+			FAT_utils::write_cluster(cache, ATTRS, next, ATTRS.FREE_CLUSTER);
+		}));
+
+	/*Cache bookkeeping. Commit gets every sector dirtied first, which is
+	 *the worst case (defrag, mkfs).*/
+	const auto dirty_all = [&](uintmax_t)
+	{
+		for(u32 i = 0; i < len; i += FAT_utils::FAT_cache_t<u16>::SECTOR_SIZE
+			/ 2)
+			cache.set(i, cache[i]);
+	};
+
+	report("FAT_cache_t::load", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t) {keep(cache.load(fstr, ATTRS));}));
+	dirty_all(0);
+	report("FAT_cache_t::commit", "fstream", time_op(DISK_ITERS,
+		[&](uintmax_t) {keep(cache.commit(fstr, ATTRS));}, dirty_all));
+
+	/*Defrag planning*/
+	report("get_frag_stats", "generic", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			keep(FAT_utils::get_frag_stats(FAT, ATTRS, len, synth.starts,
+				frag_stats) + frag_stats.fragments);
+		}));
+	report("plan_defrag", "generic", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			keep(FAT_utils::plan_defrag(FAT, ATTRS, len, synth.starts,
+				plan, frag_stats) + plan.is_identity());
+		}));
+
+	/*fsck*/
+	report("analyse_FAT", "1 thread", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			FAT_utils::analyse_FAT(FAT, ATTRS, len, analysis, 1);
+			keep(analysis.cross_links);
+		}));
+	report("analyse_FAT", "threaded", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			FAT_utils::analyse_FAT(FAT, ATTRS, len, analysis);
+			keep(analysis.cross_links);
+		}));
+	report("find_orphans", "generic", time_op(DISK_ITERS, [&](uintmax_t)
+		{
+			FAT_utils::find_orphans(analysis, synth.starts);
+			keep(analysis.orphan_cnt);
+		}));
+
+	fstr.close();
+	std::filesystem::remove(BENCH_FILE);
+
+	return 0;
+}
+
+/*---------------------------------Fuzzing-----------------------------------*/
+static void print_mismatch(const char *what, const u32 seed, const u32 round)
+{
+	std::cerr << what << " mismatch! Seed: " << seed << ", round: " << round
+		<< std::endl;
+}
+
+/*One random FAT, every FAT_t kernel against the generic in-memory and
+ *fstream versions; then a random sequence of allocations and frees applied
+ *through the generic in-memory, fstream and FAT_cache_t versions, which
+ *must all end up with the same FAT.*/
+//Everything past og_size has to be a distinct free cluster
+template <auto ATTRS>
+static bool valid_growth(const u16 FAT[], const u16 len,
+						 const std::vector<u16> &chain, const uintmax_t og_size,
+						 const u16 cnt)
+{
+	std::vector<bool> seen(len);
+
+	if(chain.size() != std::max(og_size, (uintmax_t)cnt)) return false;
+
+	for(uintmax_t i = og_size; i < chain.size(); i++)
+	{
+		if(chain[i] < ATTRS.DATA_MIN || chain[i] >= len
+			|| FAT[chain[i]] != ATTRS.FREE_CLUSTER || seen[chain[i]])
+			return false;
+
+		seen[chain[i]] = true;
+	}
+
+	return true;
+}
+
+/*Checks analyse_FAT and find_orphans against walking the chain from every
+ *single cluster, the slow way.*/
+template <auto ATTRS>
+static bool check_analysis(const std::vector<u16> &table,
+						   const std::vector<u16> &starts,
+						   const uintmax_t thread_cnt)
+{
+	typedef FAT_utils::FAT_t<ATTRS> FAT_t;
+
+	const u16 len = table.size();
+
+	bool cyclic, broken;
+	u16 cur, steps;
+	uintmax_t cross_links, cycles;
+	std::vector<u16> in_degree(len), stamp(len);
+	std::vector<bool> used(len), reached(len);
+	FAT_utils::FAT_analysis_t<u16> analysis;
+
+	auto links = [&](const u16 cls) {return FAT_t::in_data_range(table[cls]);};
+
+	FAT_utils::analyse_FAT(table.data(), ATTRS, len, analysis, thread_cnt);
+	FAT_utils::find_orphans(analysis, starts);
+
+	for(u16 i = ATTRS.DATA_MIN; i < len; i++)
+		if(links(i) && table[i] < len) in_degree[table[i]]++;
+
+	for(u16 i = ATTRS.DATA_MIN; i < len; i++)
+		used[i] = links(i) || table[i] == ATTRS.END_OF_CHAIN || in_degree[i];
+
+	cross_links = cycles = 0;
+
+	for(u16 i = 0; i < len; i++)
+	{
+		if(analysis.in_degree[i] != in_degree[i] || analysis.used[i] != used[i]
+			|| analysis.heads[i] != (used[i] && !in_degree[i]))
+			return false;
+
+		if(!used[i])
+		{
+			if(analysis.length[i] || analysis.cyclic[i] || analysis.broken[i])
+				return false;
+
+			continue;
+		}
+
+		cross_links += in_degree[i] > 1;
+		cyclic = broken = false;
+		cur = i;
+		steps = 0;
+
+		while(true)
+		{
+			if(stamp[cur] == i + 1)
+			{
+				cyclic = true;
+				break;
+			}
+
+			stamp[cur] = i + 1;
+			steps++;
+
+			if(!links(cur)) break;
+
+			if(table[cur] >= len)
+			{
+				broken = true;
+				break;
+			}
+
+			cur = table[cur];
+		}
+
+		//Counted once, from its lowest cluster
+		if(cyclic && cur == i)
+		{
+			for(cur = table[i]; cur > i; cur = table[cur]);
+			cycles += cur == i;
+		}
+
+		if(analysis.cyclic[i] != cyclic || analysis.broken[i] != broken
+			|| analysis.length[i] != (cyclic ? 0 : steps))
+			return false;
+	}
+
+	for(const u16 start: starts)
+	{
+		for(cur = start; cur < len && used[cur] && !reached[cur];
+			cur = table[cur])
+		{
+			reached[cur] = true;
+			if(!links(cur)) break;
+		}
+	}
+
+	for(u16 i = 0; i < len; i++)
+		if(analysis.orphans[i] != (used[i] && !reached[i])) return false;
+
+	return analysis.cross_links == cross_links && analysis.cycles == cycles;
+}
+
+template <auto ATTRS>
+static int fuzz_round(const u16 max_len, const u32 seed, const u32 round,
+					  std::fstream (&fstr)[3])
+{
+	typedef FAT_utils::FAT_t<ATTRS> FAT_t;
+
+	std::mt19937 rng(seed + round);
+	std::uniform_real_distribution<double> ratio(0, 1);
+	std::uniform_int_distribution<u32> any_u16(0, 0xFFFF);
+
+	const u16 len = std::uniform_int_distribution<u32>(ATTRS.DATA_MIN + 1,
+		max_len)(rng);
+	const uintmax_t base_addr = std::uniform_int_distribution<u32>(0, 1023)(
+		rng) * 2;
+	const FAT_utils::FAT_dyna_attrs_t<u16> DYNA_ATTRS(len, base_addr);
+
+	std::uniform_int_distribution<u32> data_cls(ATTRS.DATA_MIN, len - 1);
+
+	u16 err_a, err_b, err_c, cls_a, cls_b, cls_c, idx;
+	synth_FAT_t synth;
+	std::vector<u16> chain_a, chain_b, chain_c, disk;
+	FAT_utils::FAT_cache_t<u16> cache;
+
+	gen_FAT<ATTRS>(len, ratio(rng), ratio(rng), rng, synth);
+
+	//Links past the end of a short FAT, for the CHAIN_OOB paths
+	if(len <= ATTRS.DATA_MAX)
+	{
+		std::uniform_int_distribution<u32> oob(len, ATTRS.DATA_MAX);
+
+		for(u8 i = 0; i < 4; i++) synth.table[data_cls(rng)] = oob(rng);
+	}
+
+	u16 *const FAT = synth.table.data();
+
+	for(u8 i = 0; i < 3; i++)
+	{
+		fstr[i].clear();
+
+		if(!write_FAT_file(fstr[i], ATTRS.ENDIANNESS, synth.table, base_addr))
+		{
+			std::cerr << "Could not write " << FUZZ_FILES[i] << "!!!"
+				<< std::endl;
+			return 1;
+		}
+	}
+
+	/*Read-only kernels*/
+	cls_a = FAT_t::count_free_clusters(FAT, len);
+	if(cls_a != FAT_utils::count_free_clusters(FAT, ATTRS, len)
+		|| cls_a != FAT_utils::count_free_clusters(fstr[0], ATTRS, DYNA_ATTRS))
+	{
+		print_mismatch("count_free_clusters", seed, round);
+		return 2;
+	}
+
+	for(u8 i = 0; i < 64; i++)
+	{
+		//mostly real starts, sometimes anything at all
+		const u16 start = i % 4 || synth.starts.empty() ? any_u16(rng)
+			: synth.starts[any_u16(rng) % synth.starts.size()];
+
+		chain_a.clear();
+		chain_b.clear();
+		chain_c.clear();
+		err_a = FAT_t::follow_chain(FAT, len, start, chain_a);
+		err_b = FAT_utils::follow_chain(FAT, ATTRS, len, start, chain_b);
+		err_c = FAT_utils::follow_chain(fstr[0], ATTRS, DYNA_ATTRS, start,
+			chain_c);
+
+		if(err_a != err_b || err_a != err_c || chain_a != chain_b
+			|| chain_a != chain_c)
+		{
+			print_mismatch("follow_chain", seed, round);
+			return 3;
+		}
+
+		idx = chain_a.empty() ? any_u16(rng) : any_u16(rng)
+			% (chain_a.size() + 1);
+		cls_a = cls_b = cls_c = start;
+		err_a = FAT_t::get_nth_cluster(FAT, len, cls_a, idx);
+		err_b = FAT_utils::get_nth_cluster(FAT, ATTRS, len, cls_b, idx);
+		err_c = FAT_utils::get_nth_cluster(fstr[0], ATTRS, DYNA_ATTRS, cls_c,
+			idx);
+
+		if(err_a != err_b || err_a != err_c || cls_a != cls_b
+			|| cls_a != cls_c)
+		{
+			print_mismatch("get_nth_cluster", seed, round);
+			return 4;
+		}
+
+		const u16 offset = i % 2 ? any_u16(rng) : data_cls(rng);
+
+		cls_a = FAT_t::find_next_free_cluster(FAT, len, offset);
+		if(cls_a != FAT_utils::find_next_free_cluster(FAT, ATTRS, len, offset)
+			|| cls_a != FAT_utils::find_next_free_cluster(fstr[0], ATTRS,
+				DYNA_ATTRS, offset))
+		{
+			print_mismatch("find_next_free_cluster", seed, round);
+			return 5;
+		}
+
+		cls_a = cls_b = cls_c = 0;
+		err_a = FAT_t::get_next_or_free_cluster(FAT, len, start, cls_a,
+			offset);
+		err_b = FAT_utils::get_next_or_free_cluster(FAT, ATTRS, len, start,
+			cls_b, offset);
+		err_c = FAT_utils::get_next_or_free_cluster(fstr[0], ATTRS,
+			DYNA_ATTRS, start, cls_c, offset);
+
+		if(err_a != err_b || err_a != err_c || cls_a != cls_b
+			|| cls_a != cls_c)
+		{
+			print_mismatch("get_next_or_free_cluster", seed, round);
+			return 6;
+		}
+
+		const u16 cnt = any_u16(rng) % (i % 8 ? ALLOC_SIZE : len + 1);
+
+		chain_a.clear();
+		chain_b.clear();
+		chain_c.clear();
+		err_a = FAT_t::find_free_chain(FAT, len, cnt, chain_a);
+		err_b = FAT_utils::find_free_chain(FAT, ATTRS, len, cnt, chain_b);
+		err_c = FAT_utils::find_free_chain(fstr[0], ATTRS, DYNA_ATTRS, cnt,
+			chain_c);
+
+		if(err_a != err_b || err_a != err_c || chain_a != chain_b
+			|| chain_a != chain_c)
+		{
+			print_mismatch("find_free_chain", seed, round);
+			return 7;
+		}
+
+		//Grows one of the existing chains, or a new one every so often
+		chain_a.clear();
+		if(i % 4 && !synth.starts.empty() && FAT_t::follow_chain(FAT, len,
+			synth.starts[any_u16(rng) % synth.starts.size()], chain_a))
+			chain_a.clear();
+
+		const uintmax_t og_size = chain_a.size();
+		const u16 grow_to = std::min(og_size + cnt, (uintmax_t)0xFFFF);
+
+		err_a = FAT_t::find_contig_free_chain(FAT, len, grow_to, chain_a);
+
+		if(!err_a && !valid_growth<ATTRS>(FAT, len, chain_a, og_size, grow_to))
+		{
+			print_mismatch("find_contig_free_chain", seed, round);
+			return 16;
+		}
+	}
+
+	//Cross-links and loops, on top of the OOB links
+	std::vector<u16> messy(synth.table), messy_starts(synth.starts);
+
+	for(u8 i = 0; i < 8; i++) messy[data_cls(rng)] = data_cls(rng);
+	for(u8 i = 0; i < 4; i++) messy_starts.push_back(any_u16(rng));
+
+	if(!check_analysis<ATTRS>(synth.table, synth.starts, 1)
+		|| !check_analysis<ATTRS>(messy, messy_starts, round % 8 + 1))
+	{
+		print_mismatch("analyse_FAT", seed, round);
+		return 17;
+	}
+
+	/*Mutators. a: generic in-memory (write-through where that's all there
+	 *is, into file a), b: FAT_cache_t committed into file b, c: fstream
+	 *(write-through into file c and a mirror).*/
+	std::vector<u16> mirror(synth.table);
+
+	cache = FAT_utils::FAT_cache_t<u16>(ATTRS, DYNA_ATTRS);
+	if(cache.load(fstr[1], ATTRS))
+	{
+		std::cerr << "Could not load cache!!!" << std::endl;
+		return 8;
+	}
+
+	//kept in step with the allocations and frees below
+	std::vector<u16> &starts = synth.starts;
+
+	for(u8 i = 0; i < 32; i++)
+	{
+		const u8 op = any_u16(rng) % 5;
+		const uintmax_t pick = starts.empty() ? 0 : any_u16(rng)
+			% starts.size();
+
+		chain_a.clear();
+		err_a = err_b = err_c = 0;
+
+		if(op == 0 || starts.empty()) //alloc
+		{
+			err_a = FAT_t::find_free_chain(FAT, len,
+				any_u16(rng) % ALLOC_SIZE + 1, chain_a);
+			if(err_a) continue;
+
+			err_a = FAT_utils::write_chain(FAT, ATTRS, len, chain_a);
+			err_b = FAT_utils::write_chain(cache, ATTRS, chain_a);
+			err_c = FAT_utils::write_chain(fstr[2], ATTRS, DYNA_ATTRS,
+				chain_a);
+			starts.push_back(chain_a[0]);
+		}
+		else if(op == 1) //shrink
+		{
+			if(FAT_t::follow_chain(FAT, len, starts[pick], chain_a)) continue;
+
+			idx = any_u16(rng) % (chain_a.size() + 1);
+
+			err_a = FAT_utils::shrink_chain(FAT, ATTRS, len, chain_a, idx);
+			err_b = FAT_utils::shrink_chain(cache, ATTRS, chain_a, idx);
+			err_c = FAT_utils::shrink_chain(fstr[2], ATTRS, DYNA_ATTRS,
+				chain_a, idx);
+
+			if(!idx) starts.erase(starts.begin() + pick);
+		}
+		else if(op == 2) //free
+		{
+			if(FAT_t::follow_chain(FAT, len, starts[pick], chain_a)) continue;
+
+			err_a = FAT_utils::free_chain(FAT, ATTRS, len, chain_a);
+			err_b = FAT_utils::free_chain(cache, ATTRS, chain_a);
+			err_c = FAT_utils::free_chain(fstr[2], ATTRS, DYNA_ATTRS,
+				chain_a);
+			starts.erase(starts.begin() + pick);
+		}
+		else if(op == 3) //extend
+		{
+			if(FAT_t::follow_chain(FAT, len, starts[pick], chain_a)) continue;
+
+			cls_a = FAT_t::find_next_free_cluster(FAT, len, data_cls(rng));
+			if(cls_a == ATTRS.END_OF_CHAIN) continue;
+
+			err_a = FAT_utils::extend_chain(FAT, fstr[0], ATTRS, DYNA_ATTRS,
+				chain_a.back(), cls_a);
+			err_b = FAT_utils::extend_chain(cache, ATTRS, chain_a.back(),
+				cls_a);
+			err_c = FAT_utils::extend_chain(mirror.data(), fstr[2], ATTRS,
+				DYNA_ATTRS, chain_a.back(), cls_a);
+		}
+		else //mark a free cluster bad
+		{
+			cls_a = FAT_t::find_next_free_cluster(FAT, len, data_cls(rng));
+			if(cls_a == ATTRS.END_OF_CHAIN) continue;
+
+			err_a = FAT_utils::write_cluster(FAT, fstr[0], ATTRS, DYNA_ATTRS,
+				cls_a, ATTRS.RESERVED);
+			err_b = FAT_utils::write_cluster(cache, ATTRS, cls_a,
+				ATTRS.RESERVED);
+			err_c = FAT_utils::write_cluster(mirror.data(), fstr[2], ATTRS,
+				DYNA_ATTRS, cls_a, ATTRS.RESERVED);
+		}
+
+		if(err_a != err_b || err_a != err_c)
+		{
+			print_mismatch("Mutator error", seed, round);
+			return 9;
+		}
+
+		if(!std::equal(synth.table.begin(), synth.table.end(), cache.get()))
+		{
+			print_mismatch("FAT_cache_t", seed, round);
+			return 10;
+		}
+	}
+
+	disk.resize(len);
+
+	if(cache.commit(fstr[1], ATTRS)
+		|| !read_FAT_file(fstr[1], ATTRS.ENDIANNESS, disk, base_addr))
+	{
+		std::cerr << "Could not commit cache!!!" << std::endl;
+		return 11;
+	}
+
+	if(disk != synth.table)
+	{
+		print_mismatch("FAT_cache_t::commit", seed, round);
+		return 12;
+	}
+
+	if(!read_FAT_file(fstr[2], ATTRS.ENDIANNESS, disk, base_addr))
+	{
+		std::cerr << "Could not read " << FUZZ_FILES[2] << "!!!" << std::endl;
+		return 13;
+	}
+
+	if(disk != synth.table)
+	{
+		print_mismatch("fstream mutator", seed, round);
+		return 14;
+	}
+
+	//Reverse FAT. Generated FATs aren't cross-linked, so it's exact.
+	std::vector<u16> prev(len, ATTRS.END_OF_CHAIN);
+
+	for(u16 i = ATTRS.DATA_MIN; i < len; i++)
+		if(FAT_t::in_data_range(FAT[i]) && FAT[i] < len) prev[FAT[i]] = i;
+
+	for(u16 i = ATTRS.DATA_MIN; i < len; i++)
+	{
+		if(cache.predecessor(i) != prev[i])
+		{
+			print_mismatch("FAT_cache_t::predecessor", seed, round);
+			return 15;
+		}
+	}
+
+	return 0;
+}
+
+static int fuzz(const u32 rounds, const u32 seed)
+{
+	int err;
+	std::fstream fstr[3];
+
+	for(u8 i = 0; i < 3; i++)
+	{
+		fstr[i].open(FUZZ_FILES[i], std::fstream::binary | std::fstream::in
+			| std::fstream::out | std::fstream::trunc);
+
+		if(!fstr[i].is_open())
+		{
+			std::cerr << "Could not create " << FUZZ_FILES[i] << "!!!"
+				<< std::endl;
+			return 16;
+		}
+	}
+
+	std::cout << "Fuzzing, seed " << seed << "..." << std::endl;
+
+	for(u32 i = 0; i < rounds; i++)
+	{
+		switch(i % 3)
+		{
+			case 0:
+				err = fuzz_round<EMU_ATTRS>(EMU_MAX_LEN, seed, i, fstr);
+				break;
+			case 1:
+				err = fuzz_round<S7XX_ATTRS>(S7XX_MAX_LEN, seed, i, fstr);
+				break;
+			default:
+				err = fuzz_round<BE_ATTRS>(S7XX_MAX_LEN, seed, i, fstr);
+				break;
+		}
+
+		if(err) return err;
+	}
+
+	for(u8 i = 0; i < 3; i++)
+	{
+		fstr[i].close();
+		std::filesystem::remove(FUZZ_FILES[i]);
+	}
+
+	std::cout << "Fuzzing OK! " << rounds << " rounds." << std::endl;
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	constexpr u32 DEFAULT_SEED = 0x5EED;
+
+	int err;
+	double fill, frag;
+	uintmax_t iters;
+
+	if(argc > 1 && !std::strcmp(argv[1], "fuzz"))
+		return fuzz(argc > 2 ? std::stoul(argv[2]) : 300,
+					argc > 3 ? std::stoul(argv[3]) : DEFAULT_SEED);
+
+	//bench is the default, and the keyword is optional
+	const int first = argc > 1 && !std::strcmp(argv[1], "bench") ? 2 : 1;
+
+	fill = argc > first ? std::stod(argv[first]) : 0.75;
+	frag = argc > first + 1 ? std::stod(argv[first + 1]) : 0.1;
+	iters = argc > first + 2 ? std::stoull(argv[first + 2]) : 4096;
+
+	std::mt19937 rng(DEFAULT_SEED);
+
+	std::cout << "Fill ratio " << fill << ", fragmentation " << frag << ", "
+		<< iters << " iterations" << std::endl;
+
+	err = bench<EMU_ATTRS>("E-MU", EMU_MAX_LEN, fill, frag, iters, rng);
+	if(err) return err;
+
+	err = bench<S7XX_ATTRS>("S7XX", S7XX_MAX_LEN, fill, frag, iters, rng);
+	if(err) return err;
+
+	return 0;
+}
@@ -1649,6 +1649,370 @@ static int extend_chain_writethrough_tests(u16 FAT[], std::fstream &fstr)
 	return 0;
 }
 
+static int FAT_cache_tests(std::fstream &fstr)
+{
+	//55 - 220 are in the first sector, 295 is in the second one
+	const std::vector<u16> chain = {55, 68, 219, 220, 295};
+
+	std::unique_ptr<u16[]> original, on_disk;
+	FAT_utils::FAT_cache_t<u16> cache(FAT_ATTRS, FAT_DYNA_ATTRS);
+	u16 err, n_endian_cls;
+
+	original = std::make_unique<u16[]>(FAT_DYNA_ATTRS.LENGTH);
+	on_disk = std::make_unique<u16[]>(FAT_DYNA_ATTRS.LENGTH);
+
+	fstr.seekg(FAT_DYNA_ATTRS.BASE_ADDR);
+	fstr.read((char*)original.get(), FAT_DYNA_ATTRS.LENGTH * 2);
+
+	err = cache.load(fstr, FAT_ATTRS);
+	if(err)
+	{
+		std::cerr << "Unexpected error on load!!!" << std::endl;
+		std::cerr << "0x" << std::hex << err << std::dec << std::endl;
+		return 111;
+	}
+
+	if(cache.is_dirty())
+	{
+		std::cerr << "Freshly loaded cache is dirty!!!" << std::endl;
+		return 112;
+	}
+
+	for(u16 i = 1; i < std::size(follow_chain_tests_expected_chain); i++)
+	{
+		if(cache.predecessor(follow_chain_tests_expected_chain[i])
+			!= follow_chain_tests_expected_chain[i - 1])
+		{
+			std::cerr << "Bad predecessor after load!!!" << std::endl;
+			std::cerr << "Cluster: " << follow_chain_tests_expected_chain[i];
+			std::cerr << std::endl;
+			return 126;
+		}
+	}
+
+	err = FAT_utils::write_chain(cache, FAT_ATTRS, chain);
+	if(err)
+	{
+		std::cerr << "Unexpected error on write chain!!!" << std::endl;
+		std::cerr << "0x" << std::hex << err << std::dec << std::endl;
+		return 113;
+	}
+
+	for(u16 i = 0; i < chain.size(); i++)
+	{
+		if(cache.predecessor(chain[i])
+			!= (i ? chain[i - 1] : FAT_ATTRS.END_OF_CHAIN))
+		{
+			std::cerr << "Bad predecessor after write chain!!!" << std::endl;
+			std::cerr << "Cluster: " << chain[i] << std::endl;
+			return 127;
+		}
+	}
+
+	fstr.seekg(FAT_DYNA_ATTRS.BASE_ADDR + chain[0] * 2);
+	fstr.read((char*)&n_endian_cls, 2);
+
+	if(n_endian_cls != original[chain[0]] || !cache.is_dirty())
+	{
+		std::cerr << "Cache wrote through before commit!!!" << std::endl;
+		return 114;
+	}
+
+	err = cache.commit(fstr, FAT_ATTRS);
+	if(err)
+	{
+		std::cerr << "Unexpected error on commit!!!" << std::endl;
+		std::cerr << "0x" << std::hex << err << std::dec << std::endl;
+		return 115;
+	}
+
+	if(cache.is_dirty())
+	{
+		std::cerr << "Cache still dirty after commit!!!" << std::endl;
+		return 116;
+	}
+
+	fstr.seekg(FAT_DYNA_ATTRS.BASE_ADDR);
+	fstr.read((char*)on_disk.get(), FAT_DYNA_ATTRS.LENGTH * 2);
+
+	if constexpr(FAT_ATTRS.ENDIANNESS != std::endian::native)
+	{
+		for(u16 i = 0; i < FAT_DYNA_ATTRS.LENGTH; i++)
+			on_disk[i] = std::byteswap(on_disk[i]);
+	}
+
+	if(std::memcmp(on_disk.get(), cache.get(), FAT_DYNA_ATTRS.LENGTH * 2))
+	{
+		std::cerr << "On-disk and cached FAT mismatch after commit!!!";
+		std::cerr << std::endl;
+		return 117;
+	}
+
+	err = FAT_utils::free_chain(cache, FAT_ATTRS, chain);
+
+	if(!err) err = cache.commit(fstr, FAT_ATTRS);
+
+	if(err)
+	{
+		std::cerr << "Unexpected error on restoring FAT state!!!" << std::endl;
+		std::cerr << "0x" << std::hex << err << std::dec << std::endl;
+		return 118;
+	}
+
+	for(const u16 cls: chain)
+	{
+		if(cache.predecessor(cls) != FAT_ATTRS.END_OF_CHAIN)
+		{
+			std::cerr << "Predecessor not cleared after free chain!!!";
+			std::cerr << std::endl << "Cluster: " << cls << std::endl;
+			return 128;
+		}
+	}
+
+	fstr.seekg(FAT_DYNA_ATTRS.BASE_ADDR);
+	fstr.read((char*)on_disk.get(), FAT_DYNA_ATTRS.LENGTH * 2);
+
+	if(!fstr.good() || std::memcmp(on_disk.get(), original.get(),
+		FAT_DYNA_ATTRS.LENGTH * 2))
+	{
+		std::cerr << "Error on restoring FAT state!!!" << std::endl;
+		return 119;
+	}
+
+	return 0;
+}
+
+static int FAT_t_tests(const u16 FAT[])
+{
+	typedef FAT_utils::FAT_t<FAT_ATTRS> FAT_t;
+
+	constexpr u16 LEN = FAT_DYNA_ATTRS.LENGTH;
+
+	std::vector<u16> chain_a, chain_b;
+	u16 err_a, err_b, cls_a, cls_b;
+
+	if(FAT_t::count_free_clusters(FAT, LEN)
+		!= FAT_utils::count_free_clusters(FAT, FAT_ATTRS, LEN))
+	{
+		std::cerr << "Count free clusters mismatch!!!" << std::endl;
+		return 120;
+	}
+
+	//LEN + 1 to make sure both bail out the same way on OOB starts
+	for(u16 i = 0; i <= LEN; i++)
+	{
+		chain_a.clear();
+		chain_b.clear();
+
+		err_a = FAT_t::follow_chain(FAT, LEN, i, chain_a);
+		err_b = FAT_utils::follow_chain(FAT, FAT_ATTRS, LEN, i, chain_b);
+
+		if(err_a != err_b || chain_a != chain_b)
+		{
+			std::cerr << "Follow chain mismatch at " << i << "!!!" << std::endl;
+			return 121;
+		}
+
+		for(u16 j = 0; j < 4; j++)
+		{
+			cls_a = cls_b = i;
+
+			err_a = FAT_t::get_nth_cluster(FAT, LEN, cls_a, j);
+			err_b = FAT_utils::get_nth_cluster(FAT, FAT_ATTRS, LEN, cls_b, j);
+
+			if(err_a != err_b || cls_a != cls_b)
+			{
+				std::cerr << "Get nth cluster mismatch at " << i << ", idx ";
+				std::cerr << j << "!!!" << std::endl;
+				return 122;
+			}
+		}
+
+		if(FAT_t::find_next_free_cluster(FAT, LEN, i)
+			!= FAT_utils::find_next_free_cluster(FAT, FAT_ATTRS, LEN, i))
+		{
+			std::cerr << "Find next free cluster mismatch at " << i << "!!!";
+			std::cerr << std::endl;
+			return 123;
+		}
+
+		cls_a = cls_b = 0;
+
+		err_a = FAT_t::get_next_or_free_cluster(FAT, LEN, i, cls_a);
+		err_b = FAT_utils::get_next_or_free_cluster(FAT, FAT_ATTRS, LEN, i,
+			cls_b);
+
+		if(err_a != err_b || cls_a != cls_b)
+		{
+			std::cerr << "Get next or free cluster mismatch at " << i << "!!!";
+			std::cerr << std::endl;
+			return 124;
+		}
+	}
+
+	for(u16 i = 0; i <= EXPECTED_FREE_CLUSTER_COUNT + 1; i++)
+	{
+		chain_a.clear();
+		chain_b.clear();
+
+		err_a = FAT_t::find_free_chain(FAT, LEN, i, chain_a);
+		err_b = FAT_utils::find_free_chain(FAT, FAT_ATTRS, LEN, i, chain_b);
+
+		if(err_a != err_b || chain_a != chain_b)
+		{
+			std::cerr << "Find free chain mismatch for " << i << "!!!";
+			std::cerr << std::endl;
+			return 125;
+		}
+	}
+
+	return 0;
+}
+
+static int FAT_analysis_tests()
+{
+	constexpr u16 FREE = FAT_ATTRS.FREE_CLUSTER;
+	constexpr u16 EOC = FAT_ATTRS.END_OF_CHAIN;
+
+	/*1-3: plain chain, 4-5: joins it at 2, 6-7: loop, 8-10: runs into a
+	 *loop, 11: links past the end, 12: lone cluster, 15: links to a free
+	 *cluster*/
+	constexpr u16 FAT[] = {FAT_ATTRS.RESERVED, 2, 3, EOC, 5, 2, 7, 6, 9, 10, 9,
+		20, EOC, FREE, FREE, 14};
+	constexpr u16 LEN = sizeof(FAT) / 2;
+	constexpr u16 EXPECTED_LENGTH[LEN] = {0, 3, 2, 1, 4, 3, 0, 0, 0, 0, 0, 1,
+		1, 0, 1, 2};
+	constexpr u16 EXPECTED_HEADS[] = {1, 4, 8, 11, 12, 15};
+	constexpr u16 EXPECTED_ORPHANS[] = {4, 5, 6, 7, 12};
+
+	const std::vector<u16> starts = {1, 8, 11, 15, 13, 0xFFFF};
+
+	FAT_utils::FAT_analysis_t<u16> analysis;
+
+	for(u8 threads = 1; threads <= 4; threads += 3)
+	{
+		FAT_utils::analyse_FAT(FAT, FAT_ATTRS, LEN, analysis, threads);
+		FAT_utils::find_orphans(analysis, starts);
+
+		for(u16 i = 0; i < LEN; i++)
+		{
+			if(analysis.length[i] != EXPECTED_LENGTH[i])
+			{
+				std::cerr << "Chain length mismatch at " << i << "!!!";
+				std::cerr << std::endl << "Expected: " << EXPECTED_LENGTH[i];
+				std::cerr << std::endl << "Got: " << analysis.length[i];
+				std::cerr << std::endl;
+				return 129;
+			}
+
+			if(analysis.heads[i] != (std::ranges::count(EXPECTED_HEADS, i) != 0)
+				|| analysis.used[i] != (i && i != 13))
+			{
+				std::cerr << "Head or use mismatch at " << i << "!!!";
+				std::cerr << std::endl;
+				return 130;
+			}
+
+			if(analysis.cyclic[i] != (i >= 6 && i <= 10)
+				|| analysis.broken[i] != (i == 11))
+			{
+				std::cerr << "Cycle or broken chain mismatch at " << i << "!!!";
+				std::cerr << std::endl;
+				return 131;
+			}
+
+			if(analysis.orphans[i]
+				!= (std::ranges::count(EXPECTED_ORPHANS, i) != 0))
+			{
+				std::cerr << "Orphan mismatch at " << i << "!!!" << std::endl;
+				return 132;
+			}
+		}
+
+		if(analysis.in_degree[2] != 2 || analysis.in_degree[9] != 2
+			|| analysis.cross_links != 2 || analysis.cycles != 2
+			|| analysis.orphan_cnt != 5)
+		{
+			std::cerr << "FAT analysis totals mismatch!!!" << std::endl;
+			std::cerr << "Cross-links: " << analysis.cross_links << std::endl;
+			std::cerr << "Cycles: " << analysis.cycles << std::endl;
+			std::cerr << "Orphans: " << analysis.orphan_cnt << std::endl;
+			return 133;
+		}
+	}
+
+	return 0;
+}
+
+static int find_contig_free_chain_tests()
+{
+	typedef FAT_utils::FAT_t<FAT_ATTRS> FAT_t;
+
+	constexpr u16 FREE = FAT_ATTRS.FREE_CLUSTER;
+	constexpr u16 EOC = FAT_ATTRS.END_OF_CHAIN;
+
+	//Free: 2, 4-6, 8-9
+	constexpr u16 FAT[] = {FAT_ATTRS.RESERVED, EOC, FREE, EOC, FREE, FREE, FREE,
+		EOC, FREE, FREE};
+	constexpr u16 LEN = sizeof(FAT) / 2;
+
+	struct test_case_t
+	{
+		std::vector<u16> chain; //what's already there
+		u16 cluster_cnt;
+		std::vector<u16> expected;
+	};
+
+	const test_case_t CASES[] =
+	{
+		{{}, 1, {2}}, //first run that fits
+		{{}, 2, {4, 5}},
+		{{}, 3, {4, 5, 6}},
+		{{}, 4, {2, 4, 5, 6}}, //no run fits, first fit
+		{{1}, 2, {1, 2}}, //carries on right after the chain
+		{{3}, 4, {3, 4, 5, 6}},
+		{{1}, 3, {1, 4, 5}}, //can't carry on, first run that fits
+		{{7}, 3, {7, 8, 9}},
+		{{1, 2}, 2, {1, 2}} //nothing to do
+	};
+
+	u16 err, expected_err;
+	std::vector<u16> chain;
+
+	for(u8 i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++)
+	{
+		chain = CASES[i].chain;
+
+		err = FAT_t::find_contig_free_chain(FAT, LEN, CASES[i].cluster_cnt,
+											chain);
+
+		if(err || chain != CASES[i].expected)
+		{
+			std::cerr << "Find contig free chain mismatch for case " << (u16)i;
+			std::cerr << "!!!" << std::endl;
+			std::cerr << "Error: " << err << std::endl;
+			return 134;
+		}
+	}
+
+	//Only 6 free clusters
+	expected_err = ret_val_setup(FAT_utils::LIBRARY_ID,
+								 (u8)FAT_utils::ERR::NO_FREE_CLUSTERS);
+	chain.clear();
+
+	err = FAT_t::find_contig_free_chain(FAT, LEN, 7, chain);
+	if(err != expected_err)
+	{
+		std::cerr << "Find contig free chain didn't run out of clusters!!!";
+		std::cerr << std::endl;
+		std::cerr << "Expected: " << expected_err << std::endl;
+		std::cerr << "Got: " << err << std::endl;
+		return 135;
+	}
+
+	return 0;
+}
+
 /*IMPORTANT: All tests clean up after themselves and all tests expect a clean
 FAT state (THIS DOES NOT MEAN EMPTY). Anyone adding new tests should ensure
 these also clean up after themselves*/
@@ -1725,6 +2089,21 @@ int main()
 	if(err) return err;
 	std::cout << "Shrink chain (memory) OK!" << std::endl;
 
+	std::cout << "FAT_t tests..." << std::endl;
+	err = FAT_t_tests(FAT.get());
+	if(err) return err;
+	std::cout << "FAT_t OK!" << std::endl;
+
+	std::cout << "FAT analysis tests..." << std::endl;
+	err = FAT_analysis_tests();
+	if(err) return err;
+	std::cout << "FAT analysis OK!" << std::endl;
+
+	std::cout << "Find contig free chain tests..." << std::endl;
+	err = find_contig_free_chain_tests();
+	if(err) return err;
+	std::cout << "Find contig free chain OK!" << std::endl;
+
 	/*---------------------------End of memory tests--------------------------*/
 	std::cout << std::endl;
 
@@ -1783,6 +2162,14 @@ int main()
 
 	/*------------------------End of writethrough tests-----------------------*/
 	std::cout << std::endl;
+
+	std::cout << "FAT cache tests..." << std::endl;
+	err = FAT_cache_tests(fstr);
+	if(err) return err;
+	std::cout << "FAT cache OK!" << std::endl;
+
+	/*--------------------------End of FAT cache tests------------------------*/
+	std::cout << std::endl;
 	std::cout << "ALL TESTS OK!!!" << std::endl;
 	return 0;
 }
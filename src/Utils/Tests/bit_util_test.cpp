@@ -0,0 +1,121 @@
+﻿#include <vector>
+#include <random>
+#include <iostream>
+
+#include "Utils/ints.hpp"
+#include "Utils/bit_util.hpp"
+
+/*Cross-checks bit_util::bitset_t against std::vector<bool>, over sizes around
+ *the word boundaries and random sequences of sets and resets.*/
+
+static uintmax_t ref_find(const std::vector<bool> &ref, const bool val,
+						  const uintmax_t from)
+{
+	for(uintmax_t i = from; i < ref.size(); i++)
+		if(ref[i] == val) return i;
+
+	return ref.size();
+}
+
+static int check(const bit_util::bitset_t &set, const std::vector<bool> &ref,
+				 std::mt19937 &rng)
+{
+	uintmax_t i, cnt;
+
+	if(set.size() != ref.size())
+	{
+		std::cerr << "Size mismatch!!!" << std::endl;
+		std::cerr << "Expected: " << ref.size() << std::endl;
+		std::cerr << "Got: " << set.size() << std::endl;
+		return 1;
+	}
+
+	i = 0;
+	cnt = 0;
+	for(const bool bit: set)
+	{
+		if(bit != ref[i])
+		{
+			std::cerr << "Bit mismatch at " << i << "!!!" << std::endl;
+			return 2;
+		}
+
+		cnt += bit;
+		i++;
+	}
+
+	if(i != ref.size() || set.count() != cnt)
+	{
+		std::cerr << "Count mismatch!!!" << std::endl;
+		std::cerr << "Expected: " << cnt << std::endl;
+		std::cerr << "Got: " << set.count() << std::endl;
+		return 3;
+	}
+
+	for(u8 j = 0; j < 16; j++)
+	{
+		const uintmax_t from = rng() % (ref.size() + 2);
+
+		if(set.find_first_set(from) != ref_find(ref, true, from)
+			|| set.find_first_unset(from) != ref_find(ref, false, from))
+		{
+			std::cerr << "Find mismatch from " << from << "!!!" << std::endl;
+			return 4;
+		}
+	}
+
+	return 0;
+}
+
+int main()
+{
+	constexpr uintmax_t SIZES[] = {0, 1, 63, 64, 65, 127, 128, 129, 1000};
+
+	int err;
+	std::mt19937 rng(0x5EED);
+
+	bit_util::bitset_t set;
+	std::vector<bool> ref;
+
+	std::cout << "Bitset tests..." << std::endl;
+
+	for(const uintmax_t size: SIZES)
+	{
+		for(const bool val: {false, true})
+		{
+			set.assign(size, val);
+			ref.assign(size, val);
+
+			err = check(set, ref, rng);
+			if(err) return err;
+
+			for(u16 i = 0; size && i < 512; i++)
+			{
+				const uintmax_t idx = rng() % size;
+				const bool bit = rng() % 2;
+
+				set.set(idx, bit);
+				ref[idx] = bit;
+
+				if(i % 32 == 0)
+				{
+					err = check(set, ref, rng);
+					if(err) return err;
+				}
+			}
+
+			//Shrinking then growing again has to bring back zeroes
+			set.resize(size / 2);
+			ref.resize(size / 2);
+			set.resize(size + 70);
+			ref.resize(size + 70, false);
+
+			err = check(set, ref, rng);
+			if(err) return err;
+		}
+	}
+
+	std::cout << "Bitset OK!" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+﻿#include <vector>
+#include <random>
+#include <iostream>
+
+#include "Utils/ints.hpp"
+#include "Utils/pcm_util.hpp"
+
+/*Checks the interleave kernels against plain loops, over lengths around the
+ *vector width and with unaligned buffers.*/
+
+int main()
+{
+	std::mt19937 rng(42);
+
+	std::cout << "PCM interleave tests..." << std::endl;
+
+	for(size_t frame_cnt = 0; frame_cnt < 70; frame_cnt++)
+	{
+		for(size_t off = 0; off < 3; off++)
+		{
+			std::vector<u16> left(frame_cnt + off), right(frame_cnt + off);
+			std::vector<u16> inter(frame_cnt * 2 + off, 0);
+			std::vector<u16> left_out(frame_cnt + off, 0);
+			std::vector<u16> right_out(frame_cnt + off, 0);
+
+			for(size_t i = 0; i < frame_cnt + off; i++)
+			{
+				left[i] = rng();
+				right[i] = rng();
+			}
+
+			pcm_util::interleave_16(left.data() + off, right.data() + off,
+									inter.data() + off, frame_cnt);
+
+			for(size_t i = 0; i < frame_cnt; i++)
+			{
+				if(inter[off + i * 2] != left[off + i]
+					|| inter[off + i * 2 + 1] != right[off + i])
+				{
+					std::cerr << "Interleave mismatch at " << i << " ("
+						<< frame_cnt << " frames, offset " << off << ")"
+						<< std::endl;
+					std::cerr << "Exit: 1" << std::endl;
+					return 1;
+				}
+			}
+
+			pcm_util::deinterleave_16(inter.data() + off, left_out.data()
+				+ off, right_out.data() + off, frame_cnt);
+
+			for(size_t i = 0; i < frame_cnt; i++)
+			{
+				if(left_out[off + i] != left[off + i]
+					|| right_out[off + i] != right[off + i])
+				{
+					std::cerr << "Deinterleave mismatch at " << i << " ("
+						<< frame_cnt << " frames, offset " << off << ")"
+						<< std::endl;
+					std::cerr << "Exit: 2" << std::endl;
+					return 2;
+				}
+			}
+		}
+	}
+
+	std::cout << "PCM interleave OK!" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+#ifndef BIT_UTIL_HEADER_INCLUDE_GUARD
+#define BIT_UTIL_HEADER_INCLUDE_GUARD
+
+#include <cstdint>
+#include <vector>
+#include <bit>
+#include <algorithm>
+
+namespace bit_util
+{
+	/*Dynamically sized bitset, packed into 64-bit words. Unlike
+	 *std::vector<bool>, searches go a whole word at a time through
+	 *countr_zero. Bits past size() are always kept at 0.*/
+	class bitset_t
+	{
+	public:
+		typedef uint64_t word_t;
+		static constexpr uintmax_t WORD_BITS = sizeof(word_t) * 8;
+
+		class const_iterator
+		{
+		private:
+			const bitset_t *set;
+			uintmax_t idx;
+
+		public:
+			const_iterator(const bitset_t *set, const uintmax_t idx):
+				set(set), idx(idx)
+			{
+				//NOP
+			}
+
+			bool operator*() const
+			{
+				return set->test(idx);
+			}
+
+			const_iterator &operator++()
+			{
+				idx++;
+				return *this;
+			}
+
+			bool operator!=(const const_iterator &other) const
+			{
+				return idx != other.idx;
+			}
+		};
+
+	private:
+		std::vector<word_t> words;
+		uintmax_t len = 0;
+
+		//Zeroes whatever's past len in the last word
+		void clear_tail()
+		{
+			if(len % WORD_BITS)
+				words.back() &= ((word_t)1 << len % WORD_BITS) - 1;
+		}
+
+		template <const bool val>
+		uintmax_t find_first(const uintmax_t from) const
+		{
+			uintmax_t w;
+			word_t cur;
+
+			if(from >= len) return len;
+
+			w = from / WORD_BITS;
+			cur = val ? words[w] : ~words[w];
+			cur &= ~(word_t)0 << from % WORD_BITS;
+
+			while(true)
+			{
+				if(cur)
+				{
+					const uintmax_t idx = w * WORD_BITS + std::countr_zero(cur);
+					return idx < len ? idx : len;
+				}
+
+				if(++w >= words.size()) return len;
+
+				cur = val ? words[w] : ~words[w];
+			}
+		}
+
+	public:
+		bitset_t() = default;
+
+		explicit bitset_t(const uintmax_t len, const bool val = false)
+		{
+			assign(len, val);
+		}
+
+		void assign(const uintmax_t len, const bool val)
+		{
+			this->len = len;
+			words.assign((len + WORD_BITS - 1) / WORD_BITS,
+						 val ? ~(word_t)0 : 0);
+			clear_tail();
+		}
+
+		//New bits start out as 0
+		void resize(const uintmax_t len)
+		{
+			this->len = std::min(this->len, len);
+			clear_tail();
+
+			this->len = len;
+			words.resize((len + WORD_BITS - 1) / WORD_BITS, 0);
+			clear_tail();
+		}
+
+		uintmax_t size() const
+		{
+			return len;
+		}
+
+		bool test(const uintmax_t idx) const
+		{
+			return words[idx / WORD_BITS] >> idx % WORD_BITS & 1;
+		}
+
+		bool operator[](const uintmax_t idx) const
+		{
+			return test(idx);
+		}
+
+		void set(const uintmax_t idx)
+		{
+			words[idx / WORD_BITS] |= (word_t)1 << idx % WORD_BITS;
+		}
+
+		void reset(const uintmax_t idx)
+		{
+			words[idx / WORD_BITS] &= ~((word_t)1 << idx % WORD_BITS);
+		}
+
+		void set(const uintmax_t idx, const bool val)
+		{
+			if(val) set(idx);
+			else reset(idx);
+		}
+
+		uintmax_t count() const
+		{
+			uintmax_t cnt = 0;
+
+			for(const word_t word: words) cnt += std::popcount(word);
+
+			return cnt;
+		}
+
+		//Both return size() if there's no such bit at or after from
+		uintmax_t find_first_set(const uintmax_t from = 0) const
+		{
+			return find_first<true>(from);
+		}
+
+		uintmax_t find_first_unset(const uintmax_t from = 0) const
+		{
+			return find_first<false>(from);
+		}
+
+		const word_t *data() const
+		{
+			return words.data();
+		}
+
+		const_iterator begin() const
+		{
+			return const_iterator(this, 0);
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator(this, len);
+		}
+
+		bool operator==(const bitset_t &other) const
+		{
+			return len == other.len && words == other.words;
+		}
+	};
+}
+
+#endif
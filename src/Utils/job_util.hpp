@@ -0,0 +1,69 @@
+#ifndef JOB_UTIL_HEADER_INCLUDE_GUARD
+#define JOB_UTIL_HEADER_INCLUDE_GUARD
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "ints.hpp"
+
+namespace job_util
+{
+	//How many threads run_jobs ends up using
+	inline u32 worker_cnt(const u32 thread_cnt, const size_t job_cnt)
+	{
+		return std::min<uintmax_t>(thread_cnt ? thread_cnt
+			: std::max(std::thread::hardware_concurrency(), 1U), job_cnt);
+	}
+
+	/*Runs job(i) for every i below job_cnt, on thread_cnt threads (0: one
+	 *per hardware thread). Jobs get handed out one at a time, so uneven ones
+	 *don't leave threads idle.
+	 *job can also take the worker's index as a second argument, for jobs
+	 *that want state of their own (buffers and such) per thread; it's always
+	 *below worker_cnt. A failed job doesn't stop the rest; returns the first
+	 *error, by worker.*/
+	template <typename job_f>
+	uint16_t run_jobs(const size_t job_cnt, u32 thread_cnt, const job_f &job)
+	{
+		u16 first_err = 0;
+		std::atomic<size_t> next_job = 0;
+
+		thread_cnt = worker_cnt(thread_cnt, job_cnt);
+
+		std::vector<std::thread> workers;
+		std::vector<u16> worker_err(thread_cnt, 0);
+
+		for(u32 i = 0; i < thread_cnt; i++)
+		{
+			workers.emplace_back([&, i]()
+			{
+				size_t j;
+				u16 job_err;
+
+				while((j = next_job++) < job_cnt)
+				{
+					if constexpr(std::is_invocable_v<const job_f&, size_t, u32>)
+						job_err = job(j, i);
+					else
+						job_err = job(j);
+
+					if(job_err && !worker_err[i]) worker_err[i] = job_err;
+				}
+			});
+		}
+
+		for(std::thread &worker: workers)
+			worker.join();
+
+		for(const u16 cur: worker_err)
+			if(!first_err) first_err = cur;
+
+		return first_err;
+	}
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef PCM_UTIL_HEADER_INCLUDE_GUARD
+#define PCM_UTIL_HEADER_INCLUDE_GUARD
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_UTIL_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PCM_UTIL_NEON 1
+#endif
+
+#include "ints.hpp"
+
+/*16 bit PCM shuffling. Samples are moved as they are, so these work on any
+ *byte order as long as the source and destination share it.*/
+namespace pcm_util
+{
+	//L0 L1 L2..., R0 R1 R2... -> L0 R0 L1 R1...
+	inline void interleave_16(const u16 *left, const u16 *right, u16 *dst,
+							  const size_t frame_cnt)
+	{
+		size_t i = 0;
+
+#if PCM_UTIL_SSE2
+		for(; i + 8 <= frame_cnt; i += 8)
+		{
+			const __m128i l = _mm_loadu_si128((const __m128i*)(left + i));
+			const __m128i r = _mm_loadu_si128((const __m128i*)(right + i));
+
+			_mm_storeu_si128((__m128i*)(dst + i * 2), _mm_unpacklo_epi16(l, r));
+			_mm_storeu_si128((__m128i*)(dst + i * 2 + 8),
+							 _mm_unpackhi_epi16(l, r));
+		}
+#elif PCM_UTIL_NEON
+		for(; i + 8 <= frame_cnt; i += 8)
+		{
+			uint16x8x2_t lr;
+
+			lr.val[0] = vld1q_u16(left + i);
+			lr.val[1] = vld1q_u16(right + i);
+			vst2q_u16(dst + i * 2, lr);
+		}
+#endif
+
+		for(; i < frame_cnt; i++)
+		{
+			dst[i * 2] = left[i];
+			dst[i * 2 + 1] = right[i];
+		}
+	}
+
+	//L0 R0 L1 R1... -> L0 L1 L2..., R0 R1 R2...
+	inline void deinterleave_16(const u16 *src, u16 *left, u16 *right,
+								const size_t frame_cnt)
+	{
+		size_t i = 0;
+
+#if PCM_UTIL_SSE2
+		for(; i + 8 <= frame_cnt; i += 8)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 2));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 2 + 8));
+
+			//Even words to the low half, odd ones to the high half
+			a = _mm_shufflelo_epi16(a, _MM_SHUFFLE(3, 1, 2, 0));
+			a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 1, 2, 0));
+			a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm_shufflelo_epi16(b, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm_shufflehi_epi16(b, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+
+			_mm_storeu_si128((__m128i*)(left + i), _mm_unpacklo_epi64(a, b));
+			_mm_storeu_si128((__m128i*)(right + i), _mm_unpackhi_epi64(a, b));
+		}
+#elif PCM_UTIL_NEON
+		for(; i + 8 <= frame_cnt; i += 8)
+		{
+			const uint16x8x2_t lr = vld2q_u16(src + i * 2);
+
+			vst1q_u16(left + i, lr.val[0]);
+			vst1q_u16(right + i, lr.val[1]);
+		}
+#endif
+
+		for(; i < frame_cnt; i++)
+		{
+			left[i] = src[i * 2];
+			right[i] = src[i * 2 + 1];
+		}
+	}
+}
+#endif
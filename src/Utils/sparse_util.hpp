@@ -0,0 +1,40 @@
+#ifndef SPARSE_UTIL_HEADER_INCLUDE_GUARD
+#define SPARSE_UTIL_HEADER_INCLUDE_GUARD
+
+#include <cstdint>
+#include <filesystem>
+
+#if __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sparse_util
+{
+	/*Gives the host disk space behind [offset, offset + len) of a regular
+	 *file back, the range reads as zeroes afterwards and the file keeps its
+	 *size. Only done on Linux, and only if the host FS supports it. Returns
+	 *false whenever nothing got punched, in which case the old data is
+	 *still there; callers that only want the space back can ignore that.*/
+	inline bool punch_hole(const std::filesystem::path &path,
+						   const uintmax_t offset, const uintmax_t len)
+	{
+#if __linux__
+		if(!len) return true;
+
+		const int fd = open(path.c_str(), O_WRONLY);
+
+		if(fd < 0) return false;
+
+		const bool ok = !fallocate(fd, FALLOC_FL_PUNCH_HOLE
+			| FALLOC_FL_KEEP_SIZE, offset, len);
+
+		close(fd);
+
+		return ok;
+#else
+		return false;
+#endif
+	}
+}
+#endif
@@ -10,7 +10,8 @@ enum class Library_IDs: u8
 	S7XX_FS,
 	FAT_utils,
 	MIN_VFS,
-	S7XX_HOST_FS
+	S7XX_HOST_FS,
+	EMU_BANK
 };
 
 #endif // !LIBRARY_IDS_HEADER
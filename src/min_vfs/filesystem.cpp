@@ -48,4 +48,9 @@ namespace min_vfs
 
 		return 0;
 	}
+
+	uint16_t filesystem_t::fallocate(void*, const uintmax_t)
+	{
+		return ret_val_setup(LIBRARY_ID, (u8)ERR::UNSUPPORTED_OPERATION);
+	}
 }
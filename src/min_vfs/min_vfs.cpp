@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -166,6 +167,48 @@ namespace min_vfs
 		return WRONG_FS_CODE;
 	}
 
+	typedef uint16_t (*defrag_f)(const std::filesystem::path &fs_path,
+								 defrag_stats_t &stats);
+
+	//S5XX doesn't have a FAT, so there's nothing to defrag there
+	constexpr defrag_f defrag_funcs[] =
+	{
+		EMU::FS::defrag,
+		S7XX::FS::defrag
+	};
+
+	uint16_t defrag(std::filesystem::path path, defrag_stats_t &stats)
+	{
+		constexpr u16 WRONG_FS_CODE = ret_val_setup(LIBRARY_ID,
+													(u16)ERR::WRONG_FS);
+
+		std::filesystem::path remainder;
+
+		if(!std::filesystem::exists(path))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NONEXISTANT_DISK);
+
+		if(std::filesystem::is_symlink(path))
+			path = std::filesystem::read_symlink(path);
+
+		if(!std::filesystem::exists(path))
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::NONEXISTANT_DISK);
+
+		path = std::filesystem::absolute(path);
+
+		//Offline only, the driver would be working off a stale FAT
+		if(find_fs(path, remainder) != fs_map.end())
+			return ret_val_setup(LIBRARY_ID, (u8)ERR::FS_BUSY);
+
+		for(const defrag_f defrag_func: defrag_funcs)
+		{
+			const u16 err = defrag_func(path, stats);
+
+			if(err != WRONG_FS_CODE) return err;
+		}
+
+		return WRONG_FS_CODE;
+	}
+
 	template<typename T>
 	requires(std::is_base_of_v<filesystem_t, T>)
 	filesystem_t* mount_fs(const char *path)
@@ -462,10 +505,11 @@ namespace min_vfs
 		constexpr size_t BUFFER_SIZE = 512;
 
 		u16 err, dst_err;
+		uintmax_t og_dst_size, written = 0;
 		std::unique_ptr<u8[]> buffer;
 
 		stream_t src_str, dst_str;
-		std::vector<dentry_t> dentries;
+		std::vector<dentry_t> dentries, dst_dentries;
 
 		src_fs->mtx.lock();
 		err = src_fs->fopen(src_path, src_str);
@@ -477,11 +521,45 @@ namespace min_vfs
 		dst_fs->mtx.unlock();
 		if(err) return err;
 
+		//The files themselves, not whatever a driver shows inside them
 		src_fs->mtx.lock();
-		err = src_fs->list(src_path, dentries, false);
+		err = src_fs->list(src_path, dentries, true);
 		src_fs->mtx.unlock();
 		if(err) return err;
 
+		dst_fs->mtx.lock();
+		err = dst_fs->list(dst_path, dst_dentries, true);
+		dst_fs->mtx.unlock();
+		if(err) return err;
+
+		og_dst_size = dst_dentries[0].fsize;
+
+		//Just a hint, drivers that can't use it grow the file as it's written
+		err = dst_str.fallocate(dentries[0].fsize);
+		if(err && err != ret_val_setup(LIBRARY_ID,
+			(u8)ERR::UNSUPPORTED_OPERATION))
+			return err;
+
+		/*fallocate sets the size up front, so if we fail halfway through, the
+		 *destination would claim data we never wrote. Cut it back to what it
+		 *really holds, which is never less than what it started with. If that
+		 *fails too, that's the error that matters, the size is still wrong.*/
+		const bool preallocated = !err;
+		auto undo_fallocate = [&](const u16 ret) -> u16
+		{
+			u16 trunc_err = 0;
+
+			if(preallocated)
+			{
+				dst_fs->mtx.lock();
+				trunc_err = dst_fs->ftruncate(dst_path,
+											  std::max(og_dst_size, written));
+				dst_fs->mtx.unlock();
+			}
+
+			return trunc_err ? trunc_err : ret;
+		};
+
 		const uintmax_t full_buffers = dentries[0].fsize / BUFFER_SIZE;
 
 		/*I kinda wanna benchmark whether mod or multiply and subtract is
@@ -514,19 +592,23 @@ namespace min_vfs
 		for(uintmax_t i = 0; i < full_buffers; i++)
 		{
 			err = src_str.read(buffer.get(), BUFFER_SIZE);
-			if(err) return err;
+			if(err) return undo_fallocate(err);
 
 			dst_err = dst_str.write(buffer.get(), BUFFER_SIZE);
-			if(dst_err) return dst_err;
+			if(dst_err) return undo_fallocate(dst_err);
+
+			written += BUFFER_SIZE;
 		}
 
 		if(remainder)
 		{
 			err = src_str.read(buffer.get(), remainder);
-			if(err) return err;
+			if(err) return undo_fallocate(err);
 
 			dst_err = dst_str.write(buffer.get(), remainder);
-			if(dst_err) return dst_err;
+			if(dst_err) return undo_fallocate(dst_err);
+
+			written += remainder;
 		}
 
 		return 0;
@@ -25,6 +25,7 @@ namespace min_vfs
 	void lsmount(std::vector<mount_stats_t> &mounts);
 	void lsmap(std::vector<map_stats_t> &map_stats);
 	uint16_t fsck(std::filesystem::path path);
+	uint16_t defrag(std::filesystem::path path, defrag_stats_t &stats);
 	uint16_t mount(std::filesystem::path path);
 	uint16_t umount(std::filesystem::path path);
 
@@ -8,6 +8,7 @@
 #include <string>
 #include <ctime>
 #include <mutex>
+#include <chrono>
 
 #include "library_IDs.hpp"
 
@@ -90,6 +91,24 @@ namespace min_vfs
 		std::string to_string(const u8 indent) const;
 	};
 
+	//Filled in by the drivers' offline defrag
+	struct defrag_stats_t
+	{
+		uintmax_t files;
+		uintmax_t fragments_before, fragments_after;
+		uintmax_t seeks_before, seeks_after; //to read every file in order
+		uintmax_t clusters_moved;
+	};
+
+	//Filled in by the drivers' fsck, wall time spent in each of its phases
+	struct fsck_phase_t
+	{
+		const char *name;
+		std::chrono::nanoseconds time;
+	};
+
+	typedef std::vector<fsck_phase_t> fsck_timings_t;
+
 	/*TODO:
 		1. Should maybe consider mount flags (like read-only).
 
@@ -147,6 +166,13 @@ namespace min_vfs
 		virtual uint16_t write(void *internal_file, uintmax_t &pos, uintmax_t len, void *src) = 0;
 		virtual uint16_t flush(void *internal_file) = 0;
 
+		/*Size hint for a file that's about to be written. Grows it to at least
+		 *len bytes in one go, so the driver can allocate everything at once
+		 *(contiguously, if it can) instead of on every write. Never shrinks.
+		 *Drivers that can't do any better than growing on write return
+		 *UNSUPPORTED_OPERATION, which is what the default does.*/
+		virtual uint16_t fallocate(void *internal_file, const uintmax_t len);
+
 	private:
 		virtual uint16_t fopen_internal(const char *path, void **internal_file) = 0;
 	};
@@ -173,6 +199,7 @@ namespace min_vfs
 		uintmax_t get_pos();
 		
 		uint16_t flush();
+		uint16_t fallocate(const uintmax_t len);
 		uint16_t close();
 
 		stream_t& operator=(stream_t &other) = delete;
@@ -92,6 +92,17 @@ namespace min_vfs
 		return fs->flush(internal_file);
 	}
 
+	uint16_t stream_t::fallocate(const uintmax_t len)
+	{
+		if(!fs) return ret_val_setup(LIBRARY_ID, (u8)ERR::INVALID_STATE);
+
+		fs->mtx.lock();
+		const u16 err = fs->fallocate(internal_file, len);
+		fs->mtx.unlock();
+
+		return err;
+	}
+
 	uint16_t stream_t::close()
 	{
 		if(!fs) return ret_val_setup(LIBRARY_ID, (u8)ERR::INVALID_STATE);